@@ -0,0 +1,75 @@
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% MCXLAB - Monte Carlo eXtreme for MATLAB/Octave by Qianqian Fang
+%
+% In this example, we launch the photons of an isotropic source toward a
+% small, distant detector (cfg.biasprob/cfg.biasangle/cfg.biasdet) and
+% compare the detected reading and the fluence with those of an unbiased
+% simulation. A CPU reference first samples the same mixture of launch
+% directions and checks that the corrected weights are unbiased.
+%
+% This file is part of Monte Carlo eXtreme (MCX) URL:http://mcx.sf.net
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+%% CPU reference: mixture sampling of the launch direction and its weight
+
+prob = 0.5;          % probability of a biased launch
+halfangle = 0.2;     % half-angle of the biased launch cone, in radian
+detdir = [0.6 0 -0.8];   % direction from the source toward the detector
+nsample = 1e6;
+
+% isotropic directions
+ct = 2 * rand(nsample, 1) - 1;
+phi = 2 * pi * rand(nsample, 1);
+vec = [sqrt(1 - ct.^2) .* cos(phi), sqrt(1 - ct.^2) .* sin(phi), ct];
+
+% uniform directions within the cone around detdir replace a fraction prob
+isbiased = rand(nsample, 1) < prob;
+ct = 1 - rand(nsample, 1) * (1 - cos(halfangle));
+u = null(detdir)';
+cone = ct * detdir + (sqrt(1 - ct.^2) .* cos(phi)) * u(1, :) + (sqrt(1 - ct.^2) .* sin(phi)) * u(2, :);
+vec(isbiased, :) = cone(isbiased, :);
+
+% weight = source density / mixture density, both per unit solid angle
+psrc = 1 / (4 * pi);
+pbias = (vec * detdir(:) >= cos(halfangle)) / (2 * pi * (1 - cos(halfangle)));
+w = psrc ./ ((1 - prob) * psrc + prob * pbias);
+
+fprintf('CPU reference: mean weight %.4f (expected 1)\n', mean(w));
+fprintf('CPU reference: weighted fraction toward x>0 %.4f (expected 0.5)\n', mean(w .* (vec(:, 1) > 0)));
+
+%% GPU simulations with and without the biased launch
+
+% only clear cfg to avoid accidentally clearing other useful data
+clear cfg;
+cfg.nphoton = 1e7;
+cfg.vol = uint8(ones(60, 60, 60));
+cfg.srctype = 'isotropic';
+cfg.srcpos = [30 30 30];
+cfg.srcdir = [0 0 1];
+cfg.detpos = [55 30 1 2];
+cfg.gpuid = 1;
+cfg.autopilot = 1;
+cfg.prop = [0 0 1 1; 0.005 1 0 1.37];
+cfg.tstart = 0;
+cfg.tend = 5e-9;
+cfg.tstep = 5e-9;
+
+[flux, detp] = mcxlab(cfg);
+
+biascfg = cfg;
+biascfg.biasprob = prob;
+biascfg.biasangle = halfangle;
+biascfg.biasdet = 1;
+[biasflux, biasdetp] = mcxlab(biascfg);
+
+% the initial weights detp.w0 are included by mcxdetweight
+reading = sum(mcxdetweight(detp, cfg.prop)) / cfg.nphoton;
+biasreading = sum(mcxdetweight(biasdetp, biascfg.prop)) / biascfg.nphoton;
+
+fprintf('detected photons: %d unbiased, %d biased\n', size(detp.ppath, 1), size(biasdetp.ppath, 1));
+fprintf('detector reading: %e unbiased, %e biased\n', reading, biasreading);
+
+depth = 1:60;
+semilogy(depth, squeeze(flux.data(30, 30, :)), 'r-', depth, squeeze(biasflux.data(30, 30, :)), 'b--');
+legend('unbiased', 'biased launch');
+title('fluence along the line through the source');
@@ -0,0 +1,70 @@
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% MCXLAB - Monte Carlo eXtreme for MATLAB/Octave by Qianqian Fang
+%
+% In this example, we compute the forward frequency-domain (FD) fluence
+% at several modulation frequencies in a single simulation without time
+% gates (cfg.outputtype='rf' without replay), and compare it with the
+% Fourier transform of a finely gated time-resolved simulation computed
+% on the CPU.
+%
+% This file is part of Monte Carlo eXtreme (MCX) URL:http://mcx.sf.net
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+% only clear cfg to avoid accidentally clearing other useful data
+clear cfg;
+cfg.nphoton = 1e8;
+cfg.vol = uint8(ones(60, 60, 60));
+cfg.srcpos = [30 30 1];
+cfg.srcdir = [0 0 1];
+cfg.gpuid = 1;
+cfg.autopilot = 1;
+cfg.prop = [0 0 1 1; 0.005 1 0 1.37];
+cfg.tstart = 0;
+cfg.tend = 5e-9;
+cfg.seed = 1648335518;
+
+freq = [0, 100e6, 300e6]; % modulation frequencies in Hz
+
+%% forward FD output, one frame per frequency, without time gates
+
+fdcfg = cfg;
+fdcfg.outputtype = 'rf';
+fdcfg.rffreq = freq;
+fd = mcxlab(fdcfg);
+
+% the 6th dimension separates sum(w*cos(w*t)) and sum(w*sin(w*t))
+fdfluence = squeeze(fd.data(:, :, :, :, 1, 1) + 1i * fd.data(:, :, :, :, 1, 2));
+
+%% reference: Fourier transform of the time-resolved fluence of fine time gates
+
+tdcfg = cfg;
+tdcfg.outputtype = 'fluence';
+tdcfg.tstep = 1e-11;
+td = mcxlab(tdcfg);
+
+tgate = tdcfg.tstart + ((1:size(td.data, 4)) - 0.5) * tdcfg.tstep;
+tdfluence = reshape(td.data, [], numel(tgate)) * exp(-1i * 2 * pi * tgate(:) * freq);
+tdfluence = reshape(tdfluence, [size(td.data, 1), size(td.data, 2), size(td.data, 3), numel(freq)]);
+
+% MCX accumulates w*exp(+i*w*t), the complex conjugate of the Fourier transform
+tdfluence = conj(tdfluence);
+
+%% compare amplitude and phase along the depth below the source
+
+depth = 1:40;
+for i = 1:numel(freq)
+    fdline = squeeze(fdfluence(30, 30, depth, i));
+    tdline = squeeze(tdfluence(30, 30, depth, i));
+    fprintf('%6.0f MHz: max relative amplitude difference %.3f, max phase difference %.4f rad\n', ...
+            freq(i) * 1e-6, max(abs(abs(fdline) - abs(tdline)) ./ abs(tdline)), ...
+            max(abs(angle(fdline) - angle(tdline))));
+
+    subplot(2, numel(freq), i);
+    semilogy(depth, abs(fdline), 'r-', depth, abs(tdline), 'b--');
+    title(sprintf('|\\Phi| at %.0f MHz', freq(i) * 1e-6));
+    legend('forward FD', 'FFT of TD');
+
+    subplot(2, numel(freq), numel(freq) + i);
+    plot(depth, angle(fdline), 'r-', depth, angle(tdline), 'b--');
+    title(sprintf('phase at %.0f MHz (rad)', freq(i) * 1e-6));
+end
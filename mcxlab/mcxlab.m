@@ -19,6 +19,10 @@ function varargout = mcxlab(varargin)
 %         if cfg='gpuinfo': return the supported GPUs and their parameters,
 %         if cfg='version': return the version of MCXLAB as a string,
 %         see sample script at the bottom
+%         the pinned host buffers receiving the GPU outputs are reused by all
+%         respins and time-gate groups of a simulation, but are released when
+%         the GPU is reset at the end of each simulation; they are not kept
+%         between the elements of a struct array or between mcxlab calls
 %    option: (optional), options is a string, specifying additional options
 %         option='preview': this plots the domain configuration using mcxpreview(cfg)
 %         option='opencl':  force using mcxcl.mex* instead of mcx.mex* on NVIDIA/AMD/Intel hardware
@@ -113,6 +117,19 @@ function varargout = mcxlab(varargin)
 %                      setting isnormalized to 2 in the replay mode builds the Jacobian
 %                      with Born approximation instead of the default Rytov approximation
 %      cfg.isspecular: 1-calculate specular reflection if source is outside, [0] no specular reflection
+%      cfg.isbrick:    1-store the media on the GPU as 8x8x8 bricks, uniform bricks use a single
+%                      value and mixed ones are palette-encoded; [0] dense media array
+%      cfg.issvmc:     1-convert the label volume (cfg.vol of integer type, up to 255 labels)
+%                      to the split-voxel (SVMC) format before the simulation, as done
+%                      by mcxsvmc.m; [0] use the labels as they are
+%      cfg.mixfactor:  an integer above 1 downsamples the label volume (up to 255 labels)
+%                      by this factor to the mixed-label format, storing the two most
+%                      frequent labels of each block and their volume fractions; the
+%                      voxel size and the positions are rescaled and the outputs are
+%                      on the coarse grid; [0] use the labels as they are
+%      cfg.mediabits:  4 or 8-pack the labels of a label volume (cfg.vol of integer type)
+%                      at 4 or 8 bits per voxel on the GPU, requires up to 16 or 256
+%                      media; [0] store each voxel as a 32-bit integer
 %      cfg.maxgate:    the num of time-gates per simulation
 %      cfg.minenergy:  terminate photon when weight less than this level (float) [0.0]
 %      cfg.unitinmm:   defines the length unit for a grid edge length [1.0]
@@ -167,6 +184,11 @@ function varargout = mcxlab(varargin)
 %
 % == GPU settings ==
 %      cfg.autopilot:  1-automatically set threads and blocks, [0]-use nthread/nblocksize
+%      cfg.autotune:   if autopilot is 1, 1-time short calibration runs to find the fastest
+%                      block/thread sizes of the device, kernel variant and media format,
+%                      reused from cfg.tunefile afterwards; 2-always retune; [0]-disable
+%      cfg.tunefile:   cache file of the tuned configurations, ['']-.mcxtune.json in the
+%                      home folder
 %      cfg.nblocksize: how many CUDA thread blocks to be used [64]
 %      cfg.nthread:    the total CUDA thread number [2048]
 %      cfg.gpuid:      which GPU to use (run 'mcx -L' to list all GPUs) [1]
@@ -185,6 +207,11 @@ function varargout = mcxlab(varargin)
 % == Source-detector parameters ==
 %      cfg.detpos:     an N by 4 array, each row specifying a detector: [x,y,z,radius]
 %      cfg.maxdetphoton:   maximum number of photons saved by the detectors [1000000]
+%      cfg.biasprob:   probability of launching a photon within a cone toward one of the
+%                      detectors listed in cfg.biasdet, only for 'isotropic' and 'arcsine'
+%                      sources; the initial weight (detp.w0) corrects the bias [0] disable
+%      cfg.biasangle:  half-angle (in radian) of the biased launch cone [pi/6]
+%      cfg.biasdet:    1-based indices of the target detectors of the biased launch [all]
 %      cfg.srctype:    source type, the parameters of the src are specified by cfg.srcparam{1,2}
 %                              Example: <demo_mcxlab_srctype.m>
 %                      'pencil' - default, pencil beam, no param needed
@@ -250,10 +277,17 @@ function varargout = mcxlab(varargin)
 %                      simultaneously simulated; only works for 'pattern'
 %                      source, see cfg.srctype='pattern' for details
 %                      Example <demo_photon_sharing.m>
+%      cfg.patterntol: if cfg.srcnum>1, simulate the fewest orthogonal basis patterns that
+%                      reconstruct all srcpattern patterns within this relative error
+%                      (such as 1e-3), and rebuild each pattern's output from the basis
+%                      outputs; [0] simulate all patterns directly
 %      cfg.srcid:      when multiple sources are defined, if srcid is -1, each source is separately
 %                      simulated; if set to 0, all source solution are summed; if set to a positive
 %                      number starting from 1, only the specified source is simulated; default to 0
 %      cfg.omega: source modulation frequency (rad/s) for RF replay, 2*pi*f
+%      cfg.rffreq: a vector of modulation frequencies (Hz) for the forward
+%                   frequency-domain output (cfg.outputtype='rf' without replay),
+%                   one output frame per frequency; if not given, cfg.omega is used
 %      cfg.srciquv: 1x4 vector [I,Q,U,V], Stokes vector of the incident light
 %                   I: total light intensity (I >= 0)
 %                   Q: balance between horizontal and vertical linearly
@@ -262,7 +296,15 @@ function varargout = mcxlab(varargin)
 %                   light (-1 <= Q <= 1)
 %                   V: balance between right and left circularly polaized
 %                   light (-1 <= Q <= 1)
-%      cfg.lambda: source light wavelength (nm) for polarized MC
+%      cfg.lambda: source light wavelength (nm) for polarized MC and DCS g1
+%      cfg.dcsmodel: 1 or 2-compute the DCS field autocorrelation g1(tau) of each
+%                      detector from the detected partial paths and momentum transfers,
+%                      1: Brownian motion (cfg.dcsdisp is Db in mm^2/s), 2: random flow
+%                      (cfg.dcsdisp is the speed in mm/s); [0] disable DCS output
+%      cfg.dcsdisp: the Brownian diffusion coefficient or flow speed of the DCS model
+%                      [1e-7 mm^2/s or mm/s]
+%      cfg.dcstau: a vector of correlation times (s) for g1; [200 log-spaced values
+%                      between 1e-7 and 1e-1]
 %      cfg.issrcfrom0: 1-first voxel is [0 0 0], [0]- first voxel is [1 1 1]
 %      cfg.replaydet:  only works when cfg.outputtype is 'jacobian', 'wl', 'nscat', 'wp' or 'rf' and cfg.seed is an array
 %                      -1 replay all detectors and save in separate volumes (output has 5 dimensions)
@@ -306,10 +348,23 @@ function varargout = mcxlab(varargin)
 %                      'nscat' or 'wp' - weighted scattering counts for computing Jacobian for mus (replay mode)
 %                      'wm' - weighted momentum transfer for a source/detector pair (replay mode)
 %                      'rf' frequency-domain (FD/RF) mua Jacobian (replay mode),
+%                           or the forward FD fluence otherwise: frame k of the 4th
+%                           dimension holds sum(w*cos(2*pi*cfg.rffreq(k)*t)), the 6th
+%                           dimension separates these real parts from sum(w*sin(...)),
+%                           no time gate is used and cfg.tend only limits photon life
 %                      'length' total pathlengths accumulated per voxel,
 %                      for type jacobian/wl/wp, example: <demo_mcxlab_replay.m>
 %                      and  <demo_replay_timedomain.m>
 %      cfg.session:    a string for output file names (only used when no return variables)
+%      cfg.cachedir:   a folder to cache the outputs; a simulation identical to a cached
+%                      one (same domain, source, detectors, seed and output settings)
+%                      returns the cached outputs without running on the GPU
+%      cfg.cachesize: [1024] maximum size (in MB) of cfg.cachedir, the least recently
+%                      used outputs are removed first; a negative value means no limit
+%      cfg.snapshot:   path to a .mcxs snapshot saved by "mcx -f input.json --dumpjson input.mcxs";
+%                      the pre-processed domain, media, source and detector settings are
+%                      loaded from the file and replace all other simulation fields; only
+%                      gpuid/workload/nthread/session/output settings are applied on top
 %
 % == Debug ==
 %      cfg.debuglevel:  debug flag string (case insensitive), one or a combination of ['R','M','P','T'], no space
@@ -327,6 +382,11 @@ function varargout = mcxlab(varargin)
 %      cfg.maxjumpdebug: [10000000|int] when trajectory is requested in the output,
 %                     use this parameter to set the maximum position stored. By default,
 %                     only the first 1e6 positions are stored.
+%      cfg.trajphoton: [1|int] when trajectory is requested, only record every trajphoton-th photon
+%      cfg.trajstep:   [1|int] keep every trajstep-th position of each trajectory and its last
+%                     position; if above 1, the trajectories are also grouped as in cfg.istrajsort
+%      cfg.istrajsort: [0|1] if set to 1, the positions of each photon in traj are stored
+%                     contiguously, sorted by photon ID (unique across devices and repetitions)
 %
 %      fields with * are required; options in [] are the default values
 %
@@ -346,6 +406,9 @@ function varargout = mcxlab(varargin)
 %                 storing the normalized total diffuse reflectance (summation of the weights
 %                 of all escaped photon to the background regardless of their direction);
 %                 it is an empty array [] when if cfg.issaveref is 0.
+%            fluence(i).g1 is a 2D array of size [length(cfg.dcstau) cfg.detnum],
+%                 the normalized DCS field autocorrelation of each detector, returned
+%                 only when cfg.dcsmodel is set
 %            fluence(i).stat is a structure storing additional information, including
 %                 runtime: total simulation run-time in millisecond
 %                 nphoton: total simulated photon number
@@ -353,6 +416,7 @@ function varargout = mcxlab(varargin)
 %                 energyabs: total absorbed weight/energy of all photons
 %                 normalizer: normalization factor
 %                 unitinmm: same as cfg.unitinmm, voxel edge-length in mm
+%                 cached: true if the outputs were loaded from cfg.cachedir
 %
 %      detphoton: (optional) a struct array, with a length equals to that of cfg.
 %            Starting from v2018, the detphoton contains the below subfields:
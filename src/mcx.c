@@ -36,6 +36,8 @@
 #include "mcx_tictoc.h"
 #include "mcx_utils.h"
 #include "mcx_core.h"
+#include "mcx_serve.h"
+#include "mcx_merge.h"
 #ifdef _OPENMP
     #include <omp.h>
 #endif
@@ -58,17 +60,36 @@ int main (int argc, char* argv[]) {
       */
     mcx_parsecmd(argc, argv, &mcxconfig);
 
+    /**
+      * To merge the outputs of sharded runs, no GPU is needed
+      */
+    if (mcxconfig.ismerge) {
+        mcx_merge(argc, argv, &mcxconfig);
+        mcx_clearcfg(&mcxconfig);
+        return 0;
+    }
+
     /** The next step, we identify gpu number and query all GPU info */
     if (!(activedev = mcx_list_gpu(&mcxconfig, &gpuinfo))) {
         mcx_error(-1, "No GPU device found\n", __FILE__, __LINE__);
     }
 
+    /**
+      * In the server mode, the devices stay active and run all incoming jobs until the input ends
+      */
+    if (mcxconfig.isserve) {
+        int failed = mcx_serve(argc, argv, &mcxconfig, gpuinfo, activedev);
+
+        mcx_cleargpuinfo(&gpuinfo);
+        mcx_clearcfg(&mcxconfig);
+        return (failed > 0);
+    }
+
 #ifdef _OPENMP
     /**
       * Now we are ready to launch one thread for each involked GPU to run the simulation
       */
-    omp_set_num_threads(activedev);
-    #pragma omp parallel
+    #pragma omp parallel num_threads(activedev)
     {
 #endif
 
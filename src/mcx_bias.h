@@ -0,0 +1,160 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    mcx_bias.h
+
+@brief   Direction sampling and weight correction of the biased launch, shared by the host and the GPU kernel
+
+With Optode.Bias, an isotropic or arcsine source launches a fraction biasprob
+of its photons uniformly within a cone of half-angle acos(biascos) around the
+direction toward a randomly picked target detector, and the others from the
+source angular distribution. Each photon starts with the ratio of the source
+density to this mixture density, both per unit solid angle, so that the
+expected weight of any set of launch directions is unchanged.
+*******************************************************************************/
+
+#ifndef _MCEXTREME_BIAS_H
+#define _MCEXTREME_BIAS_H
+
+#include <math.h>
+#include "mcx_utils.h"
+#include "mcx_const.h"
+
+#ifdef __CUDACC__
+    #define MCX_BIAS_FUNC        __host__ __device__ static inline
+#else
+    #define MCX_BIAS_FUNC        static inline
+#endif
+
+/**
+ * @brief Pick the target detector of a biased launch
+ *
+ * @param[in] rnd: a uniform random number in [0,1)
+ * @param[in] detnum: the number of target detectors
+ * @return the index of the target in the list of target detectors
+ */
+
+MCX_BIAS_FUNC unsigned int mcx_bias_pickdet(float rnd, unsigned int detnum) {
+    unsigned int id = (unsigned int)(rnd * detnum);
+    return (id < detnum) ? id : detnum - 1;
+}
+
+/**
+ * @brief Unit vector pointing from the launch position toward the center of a detector
+ *
+ * @param[in] pos: the launch position of the photon
+ * @param[in] det: the detector, x/y/z is its center
+ * @param[in] srcdir: the direction returned if the launch position is at the detector center
+ * @return the unit vector in x/y/z
+ */
+
+MCX_BIAS_FUNC float4 mcx_bias_axis(float4 pos, float4 det, float4 srcdir) {
+    float4 axis;
+    float len;
+
+    axis.x = det.x - pos.x;
+    axis.y = det.y - pos.y;
+    axis.z = det.z - pos.z;
+    axis.w = 0.f;
+    len = axis.x * axis.x + axis.y * axis.y + axis.z * axis.z;
+
+    if (len < EPS) {
+        return srcdir;
+    }
+
+    len = 1.f / sqrtf(len);
+    axis.x *= len;
+    axis.y *= len;
+    axis.z *= len;
+    return axis;
+}
+
+/**
+ * @brief Cosine of the angle between a biased launch direction and the cone axis, uniform in solid angle
+ *
+ * @param[in] rnd: a uniform random number in [0,1)
+ * @param[in] biascos: cosine of the half-angle of the cone
+ */
+
+MCX_BIAS_FUNC float mcx_bias_conecos(float rnd, float biascos) {
+    return 1.f - rnd * (1.f - biascos);
+}
+
+/**
+ * @brief Test if a launch direction is inside the cone toward a detector
+ *
+ * @param[in] dir: the launch direction of the photon
+ * @param[in] pos: the launch position of the photon
+ * @param[in] det: the detector, x/y/z is its center
+ * @param[in] srcdir: the axis of the source angular distribution
+ * @param[in] biascos: cosine of the half-angle of the cone
+ * @return 1 if the direction is in the cone, 0 otherwise
+ */
+
+MCX_BIAS_FUNC int mcx_bias_incone(float4 dir, float4 pos, float4 det, float4 srcdir, float biascos) {
+    float4 axis = mcx_bias_axis(pos, det, srcdir);
+    return (dir.x * axis.x + dir.y * axis.y + dir.z * axis.z >= biascos);
+}
+
+/**
+ * @brief Angular density of the source per unit solid angle
+ *
+ * @param[in] srctype: MCX_SRC_ISOTROPIC or MCX_SRC_ARCSINE
+ * @param[in] dir: the launch direction of the photon
+ * @param[in] srcdir: the axis of the source angular distribution
+ */
+
+MCX_BIAS_FUNC float mcx_bias_srcdensity(int srctype, float4 dir, float4 srcdir) {
+    float ctheta = dir.x * srcdir.x + dir.y * srcdir.y + dir.z * srcdir.z;
+
+    if (srctype == MCX_SRC_ISOTROPIC) {
+        return 0.25f * R_PI;                 // uniform sphere: 1/(4*pi)
+    }
+
+    // uniform zenith angle: 1/(2*pi^2*sin(theta))
+    return 0.5f * R_PI * R_PI / fmaxf(sqrtf(fmaxf(1.f - ctheta * ctheta, 0.f)), EPS);
+}
+
+/**
+ * @brief Weight of a photon launched by the biased launch
+ *
+ * @param[in] psrc: the source density of the launch direction, from mcx_bias_srcdensity
+ * @param[in] hits: the number of target cones containing the launch direction, from mcx_bias_incone
+ * @param[in] detnum: the number of target detectors
+ * @param[in] biascos: cosine of the half-angle of the cones
+ * @param[in] biasprob: the probability of a biased launch
+ * @return the ratio of the source density to the mixture density
+ */
+
+MCX_BIAS_FUNC float mcx_bias_weight(float psrc, float hits, unsigned int detnum, float biascos, float biasprob) {
+    float pbias = hits * (0.5f * R_PI) / (detnum * (1.f - biascos)); // each cone is uniform over a solid angle of 2*pi*(1-cos)
+    return psrc / ((1.f - biasprob) * psrc + biasprob * pbias);
+}
+
+#endif
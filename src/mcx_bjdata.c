@@ -0,0 +1,781 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+
+/***************************************************************************//**
+\file    mcx_bjdata.c
+
+@brief   Convert a BJData (Draft 2) document to a cJSON tree
+
+BJData stores all numbers in little-endian byte order. Scalars and the
+elements of small typed arrays are decoded into cJSON numbers; the payloads
+of JData annotations and large N-D arrays are copied as-is into binary buffer
+nodes (see mcx_bjdata.h) and only converted when mcx_bjd_copy writes them
+into the destination array.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mcx_bjdata.h"
+#include "mcx_detfilter.h"
+
+#define BJD_MAXDIM   8                             /**< max dimensions of an N-D array */
+#define BJD_UNSIZED  ((size_t)-1)                  /**< count of a container without the '#' marker */
+
+/**
+ * Read position in a BJData document held in memory
+ */
+
+typedef struct MCXBJDReader {
+    const unsigned char* buf;      /**< the BJData document */
+    size_t len;                    /**< length of the document in bytes */
+    size_t pos;                    /**< offset of the next byte to read */
+    int depth;                     /**< nesting level of the container being read */
+} BJDReader;
+
+static cJSON* mcx_bjd_value(BJDReader* r, int marker, const char* key);
+static const char* mcx_bjd_typename(int marker);
+
+/**
+ * @brief Return the payload length of a fixed-size BJData type
+ *
+ * @param[in] marker: the BJData type marker
+ * @return the number of bytes of one element, 0 if the type is not a fixed-size number
+ */
+
+static size_t mcx_bjd_typesize(int marker) {
+    switch (marker) {
+        case 'i':
+        case 'U':
+        case 'C':
+        case 'B':
+            return 1;
+
+        case 'I':
+        case 'u':
+        case 'h':
+            return 2;
+
+        case 'l':
+        case 'm':
+        case 'd':
+            return 4;
+
+        case 'L':
+        case 'M':
+        case 'D':
+            return 8;
+
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Return the JData _ArrayType_ name of a fixed-size BJData type
+ *
+ * @param[in] marker: the BJData type marker
+ */
+
+static const char* mcx_bjd_typename(int marker) {
+    switch (marker) {
+        case 'i':
+            return "int8";
+
+        case 'I':
+            return "int16";
+
+        case 'u':
+            return "uint16";
+
+        case 'l':
+            return "int32";
+
+        case 'm':
+            return "uint32";
+
+        case 'L':
+            return "int64";
+
+        case 'M':
+            return "uint64";
+
+        case 'h':
+            return "half";
+
+        case 'd':
+            return "single";
+
+        case 'D':
+            return "double";
+
+        default:
+            return "uint8";
+    }
+}
+
+/**
+ * @brief Decode one little-endian number
+ *
+ * @param[in] p: pointer to the payload of the number
+ * @param[in] marker: the BJData type marker of the number
+ * @param[out] ival: the value as an integer, exact for all integer types
+ * @return the value as a double precision number
+ */
+
+static double mcx_bjd_decode(const unsigned char* p, int marker, long long* ival) {
+    unsigned long long u = 0;
+    size_t k = mcx_bjd_typesize(marker);
+    double val;
+
+    while (k > 0) {
+        u = (u << 8) | p[--k];
+    }
+
+    switch (marker) {
+        case 'i':
+            *ival = (signed char)u;
+            return (double)(*ival);
+
+        case 'I':
+            *ival = (short)u;
+            return (double)(*ival);
+
+        case 'l':
+            *ival = (int)u;
+            return (double)(*ival);
+
+        case 'L':
+            *ival = (long long)u;
+            return (double)(*ival);
+
+        case 'h':
+            val = mcx_half2float((unsigned short)u);
+            break;
+
+        case 'd': {
+            unsigned int u32 = (unsigned int)u;
+            float f;
+
+            memcpy(&f, &u32, sizeof(f));
+            val = f;
+            break;
+        }
+
+        case 'D':
+            memcpy(&val, &u, sizeof(val));
+            break;
+
+        default: /* U, C, B, u, m, M */
+            *ival = (long long)u;
+            return (double)u;
+    }
+
+    *ival = (long long)val;
+    return val;
+}
+
+/**
+ * @brief Read the next byte of the document
+ *
+ * @return the byte, or -1 at the end of the document
+ */
+
+static int mcx_bjd_getc(BJDReader* r) {
+    return (r->pos < r->len) ? r->buf[r->pos++] : -1;
+}
+
+/**
+ * @brief Return the next byte of the document without consuming it
+ *
+ * @return the byte, or -1 at the end of the document
+ */
+
+static int mcx_bjd_peek(BJDReader* r) {
+    return (r->pos < r->len) ? r->buf[r->pos] : -1;
+}
+
+/**
+ * @brief Read a non-negative integer, such as a length, a count or a dimension
+ *
+ * @param[in] r: the reader
+ * @param[in] marker: the integer type marker preceding the payload
+ * @param[out] val: the integer
+ * @return 1 on success, 0 if the marker is not an integer type or the value is negative
+ */
+
+static int mcx_bjd_int(BJDReader* r, int marker, size_t* val) {
+    size_t bytes = mcx_bjd_typesize(marker);
+    long long ival;
+
+    if (bytes == 0 || marker == 'h' || marker == 'd' || marker == 'D' || marker == 'C' || bytes > r->len - r->pos) {
+        return 0;
+    }
+
+    mcx_bjd_decode(r->buf + r->pos, marker, &ival);
+    r->pos += bytes;
+
+    if (ival < 0 && marker != 'M') {
+        return 0;
+    }
+
+    *val = (size_t)ival;
+    return 1;
+}
+
+/**
+ * @brief Read the optional type ('$') and count ('#') markers following '[' or '{'
+ *
+ * @param[in] r: the reader
+ * @param[in] isarray: 1 for arrays, which can also have N-D dimensions after '#'
+ * @param[out] type: the element type marker, 0 if the container is not strongly-typed
+ * @param[out] count: the element count, BJD_UNSIZED if absent
+ * @param[out] dims: the N-D dimensions (arrays only)
+ * @param[out] ndim: the number of dimensions, 1 unless an N-D count is given (arrays only)
+ * @return 1 on success, 0 on a malformed header
+ */
+
+static int mcx_bjd_header(BJDReader* r, int isarray, int* type, size_t* count, size_t* dims, int* ndim) {
+    *type = 0;
+    *count = BJD_UNSIZED;
+
+    if (isarray) {
+        *ndim = 1;
+    }
+
+    if (mcx_bjd_peek(r) == '$') {
+        r->pos++;
+
+        if ((*type = mcx_bjd_getc(r)) < 0 || mcx_bjd_peek(r) != '#') {
+            return 0;
+        }
+    }
+
+    if (mcx_bjd_peek(r) != '#') {
+        return 1;
+    }
+
+    r->pos++;
+
+    if (isarray && mcx_bjd_peek(r) == '[') {
+        int dtype;
+        size_t dcount, i, d;
+
+        r->pos++;
+
+        if (!mcx_bjd_header(r, 0, &dtype, &dcount, NULL, NULL)) {
+            return 0;
+        }
+
+        *count = 1;
+        *ndim = 0;
+
+        for (i = 0; dcount == BJD_UNSIZED || i < dcount; i++) {
+            if (dcount == BJD_UNSIZED && mcx_bjd_peek(r) == ']') {
+                r->pos++;
+                break;
+            }
+
+            if (*ndim >= BJD_MAXDIM || !mcx_bjd_int(r, dtype ? dtype : mcx_bjd_getc(r), &d)) {
+                return 0;
+            }
+
+            if (d > 0 && *count > BJD_UNSIZED / 2 / d) {
+                return 0;
+            }
+
+            dims[(*ndim)++] = d;
+            *count *= d;
+        }
+
+        return (*ndim > 0);
+    }
+
+    if (!mcx_bjd_int(r, mcx_bjd_getc(r), count)) {
+        return 0;
+    }
+
+    if (isarray) {
+        dims[0] = *count;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Store a typed array payload in a binary buffer node
+ *
+ * @param[in] data: the little-endian payload
+ * @param[in] type: the BJData type marker of the elements
+ * @param[in] count: the number of elements
+ */
+
+static cJSON* mcx_bjd_buffer(const unsigned char* data, int type, size_t count) {
+    cJSON* node = cJSON_CreateArray();
+    size_t bytes = mcx_bjd_typesize(type) * count;
+
+    node->valuestring = (char*)malloc(bytes + 1);
+    memcpy(node->valuestring, data, bytes);
+    node->valueint = (type == 'C' || type == 'B') ? 'U' : type;
+    node->valuedouble = (double)count;
+    return node;
+}
+
+/**
+ * @brief Build nested cJSON arrays from a row-major N-D typed array payload
+ *
+ * @param[in,out] data: the payload, advanced past the decoded elements
+ * @param[in] type: the BJData type marker of the elements
+ * @param[in] dims: the dimensions, slowest first
+ * @param[in] ndim: the number of dimensions
+ */
+
+static cJSON* mcx_bjd_nested(const unsigned char** data, int type, const size_t* dims, int ndim) {
+    cJSON* arr = cJSON_CreateArray();
+    size_t i, bytes = mcx_bjd_typesize(type);
+    long long ival;
+
+    for (i = 0; i < dims[0]; i++) {
+        if (ndim > 1) {
+            cJSON_AddItemToArray(arr, mcx_bjd_nested(data, type, dims + 1, ndim - 1));
+        } else {
+            cJSON_AddItemToArray(arr, cJSON_CreateNumber(mcx_bjd_decode(*data, type, &ival)));
+            *data += bytes;
+        }
+    }
+
+    return arr;
+}
+
+/**
+ * @brief Read the elements of an array after the '[' marker
+ *
+ * @param[in] r: the reader
+ * @param[in] key: the name of the array in its parent object, NULL if not in an object
+ */
+
+static cJSON* mcx_bjd_array(BJDReader* r, const char* key) {
+    int type, ndim, marker;
+    size_t count, dims[BJD_MAXDIM], i;
+    cJSON* arr, *item;
+
+    if (!mcx_bjd_header(r, 1, &type, &count, dims, &ndim)) {
+        return NULL;
+    }
+
+    if (type && mcx_bjd_typesize(type)) {
+        size_t bytes = mcx_bjd_typesize(type);
+        const unsigned char* data = r->buf + r->pos;
+
+        if (count > (r->len - r->pos) / bytes) {
+            return NULL;
+        }
+
+        r->pos += count * bytes;
+
+        if (key && (strcmp(key, "_ArrayData_") == 0 || strcmp(key, "_ArrayZipData_") == 0
+                    || (ndim == 1 && count > MCX_BJD_INLINE_MAX && strcmp(key, "Data") == 0))) {
+            return mcx_bjd_buffer(data, type, count);
+        }
+
+        if (ndim > 1 && count > MCX_BJD_INLINE_MAX) {
+            arr = cJSON_CreateObject();
+            mcx_bjd_annotate(arr, mcx_bjd_buffer(data, type, count), dims, ndim);
+            return arr;
+        }
+
+        return mcx_bjd_nested(&data, type, dims, ndim);
+    }
+
+    if (count != BJD_UNSIZED && count > r->len) {
+        return NULL;
+    }
+
+    arr = cJSON_CreateArray();
+
+    for (i = 0; count == BJD_UNSIZED || i < count; i++) {
+        if (type) {
+            marker = type;
+        } else {
+            while ((marker = mcx_bjd_getc(r)) == 'N');
+
+            if (marker == ']' && count == BJD_UNSIZED) {
+                break;
+            }
+        }
+
+        if ((item = mcx_bjd_value(r, marker, NULL)) == NULL) {
+            cJSON_Delete(arr);
+            return NULL;
+        }
+
+        cJSON_AddItemToArray(arr, item);
+    }
+
+    return arr;
+}
+
+/**
+ * @brief Read the key-value pairs of an object after the '{' marker
+ *
+ * @param[in] r: the reader
+ */
+
+static cJSON* mcx_bjd_object(BJDReader* r) {
+    int type, marker;
+    size_t count, i, len;
+    cJSON* obj, *item;
+    char* key;
+
+    if (!mcx_bjd_header(r, 0, &type, &count, NULL, NULL)) {
+        return NULL;
+    }
+
+    if (count != BJD_UNSIZED && count > r->len) {
+        return NULL;
+    }
+
+    obj = cJSON_CreateObject();
+
+    for (i = 0; count == BJD_UNSIZED || i < count; i++) {
+        if (count == BJD_UNSIZED) {
+            while (mcx_bjd_peek(r) == 'N') {
+                r->pos++;
+            }
+
+            if (mcx_bjd_peek(r) == '}') {
+                r->pos++;
+                break;
+            }
+        }
+
+        /** keys are strings without the 'S' marker */
+        if (!mcx_bjd_int(r, mcx_bjd_getc(r), &len) || len > r->len - r->pos) {
+            cJSON_Delete(obj);
+            return NULL;
+        }
+
+        key = (char*)malloc(len + 1);
+        memcpy(key, r->buf + r->pos, len);
+        key[len] = '\0';
+        r->pos += len;
+
+        marker = type ? type : mcx_bjd_getc(r);
+        item = mcx_bjd_value(r, marker, key);
+
+        if (item == NULL) {
+            free(key);
+            cJSON_Delete(obj);
+            return NULL;
+        }
+
+        cJSON_AddItemToObject(obj, key, item);
+        free(key);
+    }
+
+    return obj;
+}
+
+/**
+ * @brief Read one value whose type marker has been consumed
+ *
+ * @param[in] r: the reader
+ * @param[in] marker: the BJData type marker of the value
+ * @param[in] key: the name of the value in its parent object, NULL if not in an object
+ * @return the cJSON node, or NULL if the document is malformed
+ */
+
+static cJSON* mcx_bjd_value(BJDReader* r, int marker, const char* key) {
+    cJSON* node = NULL;
+    size_t len;
+    long long ival;
+
+    switch (marker) {
+        case 'Z':
+            return cJSON_CreateNull();
+
+        case 'T':
+            if ((node = cJSON_CreateTrue()) != NULL) {
+                node->valueint = 1;    /** as cJSON_Parse, mcx_loadjson reads the flags from valueint */
+            }
+
+            return node;
+
+        case 'F':
+            return cJSON_CreateFalse();
+
+        case 'S':
+        case 'H': {
+            char* str;
+
+            if (!mcx_bjd_int(r, mcx_bjd_getc(r), &len) || len > r->len - r->pos) {
+                return NULL;
+            }
+
+            str = (char*)malloc(len + 1);
+            memcpy(str, r->buf + r->pos, len);
+            str[len] = '\0';
+            r->pos += len;
+            node = (marker == 'H') ? cJSON_CreateNumber(atof(str)) : cJSON_CreateString(str);
+            free(str);
+            return node;
+        }
+
+        case 'C': {
+            char str[2] = {'\0', '\0'};
+            int c = mcx_bjd_getc(r);
+
+            if (c < 0) {
+                return NULL;
+            }
+
+            str[0] = (char)c;
+            return cJSON_CreateString(str);
+        }
+
+        case '[':
+        case '{':
+            if (++r->depth > MCX_BJD_MAXDEPTH) {
+                return NULL;
+            }
+
+            node = (marker == '[') ? mcx_bjd_array(r, key) : mcx_bjd_object(r);
+            r->depth--;
+            return node;
+
+        default:
+            len = mcx_bjd_typesize(marker);
+
+            if (len == 0 || len > r->len - r->pos) {
+                return NULL;
+            }
+
+            node = cJSON_CreateNumber(mcx_bjd_decode(r->buf + r->pos, marker, &ival));
+            r->pos += len;
+            return node;
+    }
+}
+
+/**
+ * @brief Convert a BJData document to a cJSON tree
+ *
+ * @param[in] buf: the BJData document
+ * @param[in] len: length of the document in bytes
+ * @param[out] errpos: if not NULL, the offset where parsing stopped on a malformed document
+ * @return the cJSON tree (free with cJSON_Delete), or NULL if the document is malformed
+ */
+
+cJSON* mcx_bjd_parse(const unsigned char* buf, size_t len, size_t* errpos) {
+    BJDReader r = {buf, len, 0, 0};
+    cJSON* root = NULL;
+    int marker;
+
+    while ((marker = mcx_bjd_getc(&r)) == 'N');
+
+    if (marker >= 0) {
+        root = mcx_bjd_value(&r, marker, NULL);
+    }
+
+    if (root == NULL && errpos) {
+        *errpos = r.pos;
+    }
+
+    return root;
+}
+
+/**
+ * @brief Test if a file name has a BJData suffix (.bjd or .jdb)
+ *
+ * @param[in] fname: the file name
+ */
+
+int mcx_bjd_issuffix(const char* fname) {
+    const char* ext = strrchr(fname, '.');
+
+    return (ext && (strcmp(ext, ".bjd") == 0 || strcmp(ext, ".jdb") == 0));
+}
+
+/**
+ * @brief Test if a cJSON node is a binary buffer created by mcx_bjd_parse
+ *
+ * @param[in] node: the cJSON node, can be NULL
+ */
+
+int mcx_bjd_isbuffer(const cJSON* node) {
+    return (node && cJSON_IsArray(node) && node->child == NULL && node->valuestring != NULL);
+}
+
+/**
+ * @brief Create a binary buffer node from a host array
+ *
+ * @param[in] data: a malloc-ed host-endian array, owned by the returned node
+ * @param[in] type: the BJData type marker of the elements, such as 'l', 'd' or 'D'
+ * @param[in] count: the number of elements
+ */
+
+cJSON* mcx_bjd_newbuffer(void* data, int type, size_t count) {
+    cJSON* node = cJSON_CreateArray();
+    size_t bytes = mcx_bjd_typesize(type), i, k;
+    const unsigned int one = 1;
+
+    if (*(const unsigned char*)&one == 0 && bytes > 1) {
+        unsigned char* p = (unsigned char*)data, tmp;
+
+        for (i = 0; i < count; i++, p += bytes) {
+            for (k = 0; k < (bytes >> 1); k++) {
+                tmp = p[k];
+                p[k] = p[bytes - 1 - k];
+                p[bytes - 1 - k] = tmp;
+            }
+        }
+    }
+
+    node->valuestring = (char*)data;
+    node->valueint = type;
+    node->valuedouble = (double)count;
+    return node;
+}
+
+/**
+ * @brief Fill an object with the JData annotations of an N-D binary buffer
+ *
+ * @param[in,out] obj: the cJSON object receiving _ArrayType_, _ArraySize_ and _ArrayData_
+ * @param[in] buffer: the binary buffer node, owned by obj afterwards
+ * @param[in] dims: the dimensions, slowest first
+ * @param[in] ndim: the number of dimensions
+ */
+
+void mcx_bjd_annotate(cJSON* obj, cJSON* buffer, const size_t* dims, int ndim) {
+    cJSON* size;
+    int i;
+
+    cJSON_AddStringToObject(obj, "_ArrayType_", mcx_bjd_typename(buffer->valueint));
+    size = cJSON_AddArrayToObject(obj, "_ArraySize_");
+
+    for (i = 0; i < ndim; i++) {
+        cJSON_AddItemToArray(size, cJSON_CreateNumber((double)dims[i]));
+    }
+
+    cJSON_AddItemToObject(obj, "_ArrayData_", buffer);
+}
+
+/**
+ * @brief Copy and convert the elements of a binary buffer to a host array
+ *
+ * @param[in] node: the binary buffer node
+ * @param[out] dst: the destination array, at least count elements long
+ * @param[in] count: the max number of elements to copy
+ * @param[in] dsttype: the BJData type marker of the destination elements, such as 'U', 'l' or 'd', not 'h'
+ * @return the number of copied elements, 0 if node is not a binary buffer
+ */
+
+size_t mcx_bjd_copy(const cJSON* node, void* dst, size_t count, char dsttype) {
+    const unsigned char* src;
+    size_t i, n, srcbytes, dstbytes;
+    int srctype, isbigendian;
+    const unsigned int one = 1;
+
+    if (!mcx_bjd_isbuffer(node) || dsttype == 'h' || (dstbytes = mcx_bjd_typesize(dsttype)) == 0) {
+        return 0;
+    }
+
+    src = (const unsigned char*)node->valuestring;
+    srctype = node->valueint;
+    srcbytes = mcx_bjd_typesize(srctype);
+    n = ((size_t)node->valuedouble < count) ? (size_t)node->valuedouble : count;
+    isbigendian = (*(const unsigned char*)&one == 0);
+
+    /** identical layout, or integers of the same width, are copied as-is */
+    if (srctype == dsttype || (srcbytes == dstbytes && !strchr("hdD", srctype) && !strchr("hdD", dsttype))) {
+        memcpy(dst, src, n * dstbytes);
+
+        if (isbigendian && dstbytes > 1) {
+            unsigned char* p = (unsigned char*)dst, tmp;
+            size_t k;
+
+            for (i = 0; i < n; i++, p += dstbytes) {
+                for (k = 0; k < (dstbytes >> 1); k++) {
+                    tmp = p[k];
+                    p[k] = p[dstbytes - 1 - k];
+                    p[dstbytes - 1 - k] = tmp;
+                }
+            }
+        }
+
+        return n;
+    }
+
+    for (i = 0; i < n; i++, src += srcbytes) {
+        long long ival;
+        double val = mcx_bjd_decode(src, srctype, &ival);
+
+        switch (dsttype) {
+            case 'i':
+                ((signed char*)dst)[i] = (signed char)ival;
+                break;
+
+            case 'U':
+            case 'C':
+            case 'B':
+                ((unsigned char*)dst)[i] = (unsigned char)ival;
+                break;
+
+            case 'I':
+                ((short*)dst)[i] = (short)ival;
+                break;
+
+            case 'u':
+                ((unsigned short*)dst)[i] = (unsigned short)ival;
+                break;
+
+            case 'l':
+                ((int*)dst)[i] = (int)ival;
+                break;
+
+            case 'm':
+                ((unsigned int*)dst)[i] = (unsigned int)ival;
+                break;
+
+            case 'L':
+            case 'M':
+                ((long long*)dst)[i] = ival;
+                break;
+
+            case 'd':
+                ((float*)dst)[i] = (float)val;
+                break;
+
+            default:
+                ((double*)dst)[i] = val;
+                break;
+        }
+    }
+
+    return n;
+}
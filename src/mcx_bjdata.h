@@ -0,0 +1,71 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+
+/***************************************************************************//**
+\file    mcx_bjdata.h
+
+@brief   Reader of Binary JData (BJData Draft 2) input files
+
+A BJData document is converted to the same cJSON tree that cJSON_Parse
+returns for the equivalent text JSON, so that mcx_loadjson can consume both.
+Strongly-typed arrays are decoded from their binary form without text
+conversion. The payloads of JData annotations (\c _ArrayData_ and
+\c _ArrayZipData_), and source pattern \c Data vectors or N-D arrays with more
+than MCX_BJD_INLINE_MAX elements, are kept as binary buffers instead;
+mcx_fastjson_parse creates the same nodes for large text arrays. A buffer node
+is an empty cJSON array whose \c valuestring holds the little-endian payload,
+\c valueint the BJData type marker and \c valuedouble the element count. An N-D buffer is wrapped in a
+JData annotated object with \c _ArrayType_ and \c _ArraySize_.
+*******************************************************************************/
+
+#ifndef _MCEXTREME_BJDATA_H
+#define _MCEXTREME_BJDATA_H
+
+#include <stddef.h>
+#include "cjson/cJSON.h"
+
+#define MCX_BJD_INLINE_MAX  1024                    /**< N-D arrays up to this length become nested cJSON arrays */
+#define MCX_BJD_MAXDEPTH    256                     /**< max nesting level of containers */
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+cJSON* mcx_bjd_parse(const unsigned char* buf, size_t len, size_t* errpos);
+int    mcx_bjd_issuffix(const char* fname);
+int    mcx_bjd_isbuffer(const cJSON* node);
+size_t mcx_bjd_copy(const cJSON* node, void* dst, size_t count, char dsttype);
+cJSON* mcx_bjd_newbuffer(void* data, int type, size_t count);
+void   mcx_bjd_annotate(cJSON* obj, cJSON* buffer, const size_t* dims, int ndim);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
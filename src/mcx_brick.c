@@ -0,0 +1,236 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    mcx_brick.c
+
+@brief   Host encoder of the brick-compressed media volume
+
+See mcx_brick.h for the layout of the encoded buffer. The encoder visits
+each 8x8x8 brick once, finds its distinct values with a small hash table
+and stores the brick as a single value, a palette-indexed block or a dense
+block, whichever applies. Voxels of partial bricks at the +x/+y/+z faces
+that fall outside the domain are never looked up and are treated as copies
+of the first voxel of the brick.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mcx_brick.h"
+
+#define BRICK_HASHBITS   (3 * MCX_BRICK_BITS + 1)  /**< log2 of the number of slots of the per-brick hash table */
+#define BRICK_HASHLEN    (1 << BRICK_HASHBITS)     /**< slots of the per-brick hash table, twice the voxels of a brick */
+#define BRICK_MAXPAL     256                       /**< max palette length, 8 bits per voxel */
+#define BRICK_MAXSHARED  64                        /**< number of uniform values whose data word is shared */
+#define BRICK_MAXOFFSET  (1u << 30)                /**< max data offset that fits in a brick entry */
+
+/**
+ * A growable buffer of 32-bit words storing the encoded volume
+ */
+
+typedef struct MCXBrickBuffer {
+    unsigned int* data;            /**< the encoded volume */
+    size_t len;                    /**< number of used words */
+    size_t maxlen;                 /**< number of allocated words */
+} BrickBuffer;
+
+/**
+ * @brief Reserve space at the end of the encoded buffer
+ *
+ * @param[in,out] buf: the encoded buffer
+ * @param[in] len: number of words to append
+ * @return the offset of the reserved words, or 0 if the buffer can not grow
+ */
+
+static size_t mcx_brick_append(BrickBuffer* buf, size_t len) {
+    size_t offset = buf->len;
+
+    if (buf->len + len > buf->maxlen) {
+        size_t maxlen = buf->maxlen + (buf->maxlen >> 1) + len;
+        unsigned int* data = (unsigned int*)realloc(buf->data, maxlen * sizeof(unsigned int));
+
+        if (data == NULL) {
+            return 0;
+        }
+
+        buf->data = data;
+        buf->maxlen = maxlen;
+    }
+
+    if (buf->len + len > BRICK_MAXOFFSET) {
+        return 0;
+    }
+
+    buf->len += len;
+    return offset;
+}
+
+/**
+ * @brief Encode a dense volume into 8x8x8 bricks
+ *
+ * @param[in] vol: the dense volume, x-fastest, one 32-bit value per voxel
+ * @param[in] dimx: the domain size along x
+ * @param[in] dimy: the domain size along y
+ * @param[in] dimz: the domain size along z
+ * @param[out] len: the length of the encoded buffer in 32-bit words
+ * @param[out] count: the numbers of uniform, palette and dense bricks
+ * @return the encoded buffer (must be freed by the caller), or NULL if the volume is too large to encode
+ */
+
+unsigned int* mcx_brick_encode(const unsigned int* vol, unsigned int dimx, unsigned int dimy, unsigned int dimz,
+                               size_t* len, unsigned int count[3]) {
+    unsigned int bx = (dimx + MCX_BRICK_MASK) >> MCX_BRICK_BITS;
+    unsigned int by = (dimy + MCX_BRICK_MASK) >> MCX_BRICK_BITS;
+    unsigned int bz = (dimz + MCX_BRICK_MASK) >> MCX_BRICK_BITS;
+    size_t nbrick = (size_t)bx * by * bz, b;
+    unsigned int val[MCX_BRICK_VOXELS], pal[BRICK_MAXPAL];
+    unsigned int hashkey[BRICK_HASHLEN], shared[BRICK_MAXSHARED];
+    short hashid[BRICK_HASHLEN];
+    size_t sharedoffset[BRICK_MAXSHARED];
+    int sharednum = 0;
+    BrickBuffer buf = {NULL, 0, 0};
+
+    memset(count, 0, 3 * sizeof(unsigned int));
+
+    mcx_brick_append(&buf, nbrick); /* the brick table, the data of all bricks follow it */
+
+    if (buf.len != nbrick || nbrick == 0) {
+        free(buf.data);
+        return NULL;
+    }
+
+    for (b = 0; b < nbrick; b++) {
+        unsigned int ix = (unsigned int)(b % bx) << MCX_BRICK_BITS;
+        unsigned int iy = (unsigned int)((b / bx) % by) << MCX_BRICK_BITS;
+        unsigned int iz = (unsigned int)(b / ((size_t)bx * by)) << MCX_BRICK_BITS;
+        unsigned int x, y, z, i, palnum = 0, bits;
+        size_t offset;
+
+        /** gather the brick, voxels outside of the domain repeat the first voxel */
+        for (z = 0; z < MCX_BRICK_SIZE; z++) {
+            for (y = 0; y < MCX_BRICK_SIZE; y++) {
+                for (x = 0; x < MCX_BRICK_SIZE; x++) {
+                    i = (((z << MCX_BRICK_BITS) | y) << MCX_BRICK_BITS) | x;
+
+                    if (ix + x < dimx && iy + y < dimy && iz + z < dimz) {
+                        val[i] = vol[((size_t)(iz + z) * dimy + (iy + y)) * dimx + (ix + x)];
+                    } else {
+                        val[i] = val[0];
+                    }
+                }
+            }
+        }
+
+        /** collect the distinct values, hashid[] stores the palette index of each hashed value */
+        memset(hashid, -1, sizeof(hashid));
+
+        for (i = 0; i < MCX_BRICK_VOXELS && palnum <= BRICK_MAXPAL; i++) {
+            unsigned int h = (val[i] * 2654435761u) >> (32 - BRICK_HASHBITS);
+
+            while (hashid[h] >= 0 && hashkey[h] != val[i]) {
+                h = (h + 1) & (BRICK_HASHLEN - 1);
+            }
+
+            if (hashid[h] < 0) {
+                if (palnum < BRICK_MAXPAL) {
+                    pal[palnum] = val[i];
+                }
+
+                hashkey[h] = val[i];
+                hashid[h] = (short)palnum++;
+            }
+        }
+
+        if (palnum == 1) {
+            /** uniform brick, share the data word with earlier bricks of the same value */
+            for (i = 0; i < (unsigned int)sharednum; i++) {
+                if (shared[i] == val[0]) {
+                    break;
+                }
+            }
+
+            if (i < (unsigned int)sharednum) {
+                offset = sharedoffset[i];
+            } else {
+                if ((offset = mcx_brick_append(&buf, 1)) == 0) {
+                    free(buf.data);
+                    return NULL;
+                }
+
+                buf.data[offset] = val[0];
+
+                if (sharednum < BRICK_MAXSHARED) {
+                    shared[sharednum] = val[0];
+                    sharedoffset[sharednum++] = offset;
+                }
+            }
+
+            buf.data[b] = (unsigned int)(offset << 2) | MCX_BRICK_UNIFORM;
+            count[MCX_BRICK_UNIFORM]++;
+        } else if (palnum <= BRICK_MAXPAL) {
+            /** palette brick, 1, 2, 4 or 8 bits per voxel so that no index straddles two words */
+            for (bits = 1; (1u << bits) < palnum; bits <<= 1);
+
+            if ((offset = mcx_brick_append(&buf, 1 + (1u << bits) + ((MCX_BRICK_VOXELS * bits) >> 5))) == 0) {
+                free(buf.data);
+                return NULL;
+            }
+
+            buf.data[offset] = bits;
+            memset(buf.data + offset + 1, 0, ((1u << bits) + ((MCX_BRICK_VOXELS * bits) >> 5)) * sizeof(unsigned int));
+            memcpy(buf.data + offset + 1, pal, palnum * sizeof(unsigned int));
+
+            for (i = 0; i < MCX_BRICK_VOXELS; i++) {
+                unsigned int h = (val[i] * 2654435761u) >> (32 - BRICK_HASHBITS);
+                unsigned int pos = i * bits;
+
+                while (hashkey[h] != val[i]) {
+                    h = (h + 1) & (BRICK_HASHLEN - 1);
+                }
+
+                buf.data[offset + 1 + (1u << bits) + (pos >> 5)] |= ((unsigned int)hashid[h] << (pos & 31));
+            }
+
+            buf.data[b] = (unsigned int)(offset << 2) | MCX_BRICK_PALETTE;
+            count[MCX_BRICK_PALETTE]++;
+        } else {
+            if ((offset = mcx_brick_append(&buf, MCX_BRICK_VOXELS)) == 0) {
+                free(buf.data);
+                return NULL;
+            }
+
+            memcpy(buf.data + offset, val, sizeof(val));
+            buf.data[b] = (unsigned int)(offset << 2) | MCX_BRICK_DENSE;
+            count[MCX_BRICK_DENSE]++;
+        }
+    }
+
+    *len = buf.len;
+    return (unsigned int*)realloc(buf.data, buf.len * sizeof(unsigned int));
+}
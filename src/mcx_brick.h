@@ -0,0 +1,108 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    mcx_brick.h
+
+@brief   Brick-compressed media volume, shared by the host encoder and the GPU kernel
+
+The volume is split into 8x8x8 bricks. The encoded buffer starts with one
+32-bit entry per brick (x-fastest brick order), storing (offset<<2)|kind,
+where offset is the position (in 32-bit words, from the start of the buffer)
+of the brick data and kind is one of
+
+- MCX_BRICK_UNIFORM: all 512 voxels share one value, stored in data[0]
+- MCX_BRICK_PALETTE: data[0]=b (1, 2, 4 or 8 bits per voxel), data[1..2^b] is
+                     the palette, followed by 512 b-bit palette indices
+- MCX_BRICK_DENSE:   data[0..511] stores all voxels (more than 256 values)
+
+Identical uniform bricks share the same data word.
+*******************************************************************************/
+
+#ifndef _MCEXTREME_BRICK_H
+#define _MCEXTREME_BRICK_H
+
+#include <stddef.h>
+
+#define MCX_BRICK_BITS       3                      /**< log2 of the brick edge length */
+#define MCX_BRICK_SIZE       (1 << MCX_BRICK_BITS)  /**< brick edge length in voxels */
+#define MCX_BRICK_MASK       (MCX_BRICK_SIZE - 1)   /**< mask to get the voxel index inside a brick */
+#define MCX_BRICK_VOXELS     (MCX_BRICK_SIZE * MCX_BRICK_SIZE * MCX_BRICK_SIZE) /**< voxels per brick */
+
+#define MCX_BRICK_UNIFORM    0                      /**< all voxels of the brick have the same value */
+#define MCX_BRICK_PALETTE    1                      /**< voxels are indices to a per-brick palette */
+#define MCX_BRICK_DENSE      2                      /**< voxels are stored uncompressed */
+
+#ifdef __CUDACC__
+    #define MCX_BRICK_FUNC   __host__ __device__ static inline
+#else
+    #define MCX_BRICK_FUNC   static inline
+#endif
+
+/**
+ * @brief Return the value of a voxel in a brick-compressed volume
+ *
+ * @param[in] brick: the encoded volume produced by mcx_brick_encode
+ * @param[in] bx: number of bricks along x
+ * @param[in] by: number of bricks along y
+ * @param[in] x: voxel index along x, starting from 0
+ * @param[in] y: voxel index along y, starting from 0
+ * @param[in] z: voxel index along z, starting from 0
+ * @return the voxel value, identical to the dense volume
+ */
+
+MCX_BRICK_FUNC unsigned int mcx_brick_lookup(const unsigned int* brick, unsigned int bx, unsigned int by,
+        unsigned int x, unsigned int y, unsigned int z) {
+    unsigned int entry = brick[((z >> MCX_BRICK_BITS) * by + (y >> MCX_BRICK_BITS)) * bx + (x >> MCX_BRICK_BITS)];
+    const unsigned int* data = brick + (entry >> 2);
+    unsigned int local = ((((z & MCX_BRICK_MASK) << MCX_BRICK_BITS) | (y & MCX_BRICK_MASK)) << MCX_BRICK_BITS) | (x & MCX_BRICK_MASK);
+
+    if ((entry & 3) == MCX_BRICK_UNIFORM) {
+        return data[0];
+    } else if ((entry & 3) == MCX_BRICK_DENSE) {
+        return data[local];
+    } else {
+        unsigned int bits = data[0];
+        unsigned int pos = local * bits;
+
+        return data[1 + ((data[1 + (1u << bits) + (pos >> 5)] >> (pos & 31)) & ((1u << bits) - 1))];
+    }
+}
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+unsigned int* mcx_brick_encode(const unsigned int* vol, unsigned int dimx, unsigned int dimy, unsigned int dimz,
+                               size_t* len, unsigned int count[3]);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,552 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    mcx_cache.c
+
+@brief   Content-addressed on-disk cache of simulation outputs
+
+Each simulation is identified by a 128-bit hash of the preprocessed simulation
+settings - the domain, optical properties, source, detectors, RNG seed and the
+output flags. The outputs of a completed simulation are stored as a single
+<hash>.mcxc record in the cache folder; a later simulation with the same hash
+loads the record and skips the GPU simulation. The least recently used records
+are removed when the total size of the folder exceeds cfg.cachesize (in MB).
+*******************************************************************************/
+
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+    #define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+    #include <io.h>
+    #include <sys/utime.h>
+#else
+    #include <dirent.h>
+    #include <utime.h>
+#endif
+
+#include "mcx_cache.h"
+#include "mcx_const.h"
+
+#define FNV_PRIME      0x100000001b3ULL        /**< 64-bit FNV-1a prime */
+#define FNV_OFFSET_1   0xcbf29ce484222325ULL   /**< 64-bit FNV-1a offset basis for the 1st hash lane */
+#define FNV_OFFSET_2   0x84222325cbf29ce4ULL   /**< offset basis of the 2nd hash lane, makes the combined key 128-bit */
+#define MCX_CACHE_NAMELEN  (MCX_CACHE_KEYLEN + 8)                        /**< buffer length of a record name, <key>.mcxc */
+#define MCX_CACHE_PATHLEN  (MAX_PATH_LENGTH + MCX_CACHE_NAMELEN)         /**< buffer length of a record path, <cachedir>/<record name> */
+
+/**
+ * Macro to add a scalar or a fixed-size member of cfg to the hash
+ */
+#define HASH_FIELD(h,x)       mcx_cache_hash((h), &(x), sizeof(x))
+
+/**
+ * Macro to add a buffer of n elements to the hash, an empty buffer still adds its length
+ */
+#define HASH_ARRAY(h,x,n)     {size_t len_ = ((x) ? (size_t)(n) : 0) * sizeof(*(x)); HASH_FIELD(h, len_); if (len_) mcx_cache_hash((h), (x), len_);}
+
+/**
+ * A record found in the cache folder, used for the LRU eviction
+ */
+
+typedef struct MCXCacheRecord {
+    char name[MCX_CACHE_NAMELEN]; /**< file name of the record, without the folder */
+    size_t size;                   /**< size of the record in bytes */
+    time_t atime;                  /**< last time the record was written or used */
+} CacheRecord;
+
+extern char pathsep;
+int mkpath(char* dir_path, int mode);
+
+/**
+ * @brief Update the two FNV-1a hash lanes with a buffer
+ *
+ * @param[in,out] h: the two 64-bit hash lanes
+ * @param[in] buf: the buffer to be hashed
+ * @param[in] len: the length of the buffer in bytes
+ */
+
+static void mcx_cache_hash(unsigned long long h[2], const void* buf, size_t len) {
+    const unsigned char* p = (const unsigned char*)buf;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        h[0] = (h[0] ^ p[i]) * FNV_PRIME;
+        h[1] = (h[1] ^ p[len - 1 - i]) * FNV_PRIME;
+    }
+}
+
+/**
+ * @brief Compute the cache key of a preprocessed simulation configuration
+ *
+ * Only the settings that affect the simulation outputs are hashed; the session
+ * name, output folder and format, log settings and the device selection are
+ * ignored so that a cached result can be reused under a different session name
+ * or on a different GPU. This function must be called after mcx_validatecfg.
+ *
+ * @param[in] cfg: simulation configuration
+ * @param[in] seedbyte: number of bytes per RNG seed, used to hash the replayed seeds
+ * @param[out] key: the 32-digit hexadecimal cache key
+ */
+
+void mcx_cache_key(Config* cfg, unsigned int seedbyte, char key[MCX_CACHE_KEYLEN]) {
+    unsigned long long h[2] = {FNV_OFFSET_1, FNV_OFFSET_2};
+    size_t dimxyz = (size_t)cfg->dim.x * cfg->dim.y * cfg->dim.z;
+    size_t patlen = 0;
+    unsigned int debuglevel = cfg->debuglevel & ~MCX_DEBUG_PROGRESS;
+
+    HASH_FIELD(h, cfg->nphoton);
+    HASH_FIELD(h, cfg->seed);
+    HASH_FIELD(h, cfg->srcpos);
+    HASH_FIELD(h, cfg->srcdir);
+    HASH_FIELD(h, cfg->srciquv);
+    HASH_FIELD(h, cfg->tstart);
+    HASH_FIELD(h, cfg->tstep);
+    HASH_FIELD(h, cfg->tend);
+    HASH_FIELD(h, cfg->steps);
+    HASH_FIELD(h, cfg->dim);
+    HASH_FIELD(h, cfg->crop0);
+    HASH_FIELD(h, cfg->crop1);
+    HASH_FIELD(h, cfg->medianum);
+    HASH_FIELD(h, cfg->polmedianum);
+    HASH_FIELD(h, cfg->detnum);
+    HASH_FIELD(h, cfg->maxdetphoton);
+    HASH_FIELD(h, cfg->sradius);
+    HASH_FIELD(h, cfg->respin);
+    HASH_FIELD(h, cfg->isreflect);
+    HASH_FIELD(h, cfg->isrefint);
+    HASH_FIELD(h, cfg->isnormalized);
+    HASH_FIELD(h, cfg->issavedet);
+    HASH_FIELD(h, cfg->issave2pt);
+    HASH_FIELD(h, cfg->isspecular);
+    HASH_FIELD(h, cfg->issrcfrom0);
+    HASH_FIELD(h, cfg->issaveseed);
+    HASH_FIELD(h, cfg->issaveexit);
+    HASH_FIELD(h, cfg->issaveref);
+    HASH_FIELD(h, cfg->ismomentum);
+    HASH_FIELD(h, cfg->istrajstokes);
+    HASH_FIELD(h, cfg->internalsrc);
+    HASH_FIELD(h, cfg->srctype);
+    HASH_FIELD(h, cfg->outputtype);
+    HASH_FIELD(h, cfg->faststep);
+    HASH_FIELD(h, cfg->minenergy);
+    HASH_FIELD(h, cfg->unitinmm);
+    HASH_FIELD(h, cfg->omega);
+    HASH_FIELD(h, cfg->lambda);
+    HASH_FIELD(h, cfg->maxvoidstep);
+    HASH_FIELD(h, cfg->voidtime);
+    HASH_FIELD(h, cfg->srcparam1);
+    HASH_FIELD(h, cfg->srcparam2);
+    HASH_FIELD(h, cfg->srcnum);
+    HASH_FIELD(h, cfg->replaydet);
+    HASH_FIELD(h, debuglevel);
+    HASH_FIELD(h, cfg->savedetflag);
+    HASH_FIELD(h, cfg->mediabyte);
+    HASH_FIELD(h, cfg->maxjumpdebug);
+    HASH_FIELD(h, cfg->gscatter);
+    HASH_FIELD(h, cfg->bc);
+    HASH_FIELD(h, cfg->nphase);
+    HASH_FIELD(h, cfg->nangle);
+    HASH_FIELD(h, cfg->srcid);
+    HASH_FIELD(h, cfg->extrasrclen);
+    HASH_FIELD(h, cfg->trajphoton);
+    HASH_FIELD(h, cfg->trajstep);
+    HASH_FIELD(h, cfg->istrajsort);
+    HASH_FIELD(h, cfg->detfilter);
+    HASH_FIELD(h, cfg->ishalfdet);
+    HASH_FIELD(h, cfg->pyramid);
+    HASH_FIELD(h, cfg->pyramidtol);
+    HASH_FIELD(h, cfg->mixfactor);
+    HASH_FIELD(h, cfg->fulldim);
+    HASH_FIELD(h, cfg->compactoffset);
+    HASH_FIELD(h, cfg->biasprob);
+    HASH_FIELD(h, cfg->biasangle);
+
+    if (cfg->mediabyte == MEDIA_2LABEL_SPLIT || cfg->mediabyte == MEDIA_ASGN_F2H) {
+        HASH_ARRAY(h, cfg->vol, dimxyz << 1);
+    } else {
+        HASH_ARRAY(h, cfg->vol, dimxyz);
+    }
+
+    if (cfg->srctype == MCX_SRC_PATTERN) {
+        patlen = (size_t)(cfg->srcparam1.w * cfg->srcparam2.w * cfg->srcnum);
+    } else if (cfg->srctype == MCX_SRC_PATTERN3D) {
+        patlen = (size_t)(cfg->srcparam1.x * cfg->srcparam1.y * cfg->srcparam1.z * cfg->srcnum);
+    }
+
+    HASH_ARRAY(h, cfg->prop, cfg->medianum);
+    HASH_ARRAY(h, cfg->polprop, cfg->polmedianum);
+    HASH_ARRAY(h, cfg->smatrix, cfg->polmedianum * NANGLES);
+    HASH_ARRAY(h, cfg->detpos, cfg->detnum);
+    HASH_ARRAY(h, cfg->srcpattern, patlen);
+    HASH_ARRAY(h, cfg->invcdf, cfg->nphase);
+    HASH_ARRAY(h, cfg->angleinvcdf, cfg->nangle);
+    HASH_ARRAY(h, cfg->rffreq, cfg->rffreqnum);
+    HASH_ARRAY(h, cfg->biasdet, cfg->biasdetnum);
+    HASH_ARRAY(h, cfg->srcdata, cfg->extrasrclen);
+    HASH_ARRAY(h, cfg->dx, (cfg->steps.x == -2.f) ? cfg->dim.x : 1);
+    HASH_ARRAY(h, cfg->dy, (cfg->steps.y == -2.f) ? cfg->dim.y : 1);
+    HASH_ARRAY(h, cfg->dz, (cfg->steps.z == -2.f) ? cfg->dim.z : 1);
+
+    if (cfg->seed == SEED_FROM_FILE) {
+        HASH_ARRAY(h, (unsigned char*)cfg->replay.seed, cfg->nphoton * seedbyte);
+        HASH_ARRAY(h, cfg->replay.weight, cfg->nphoton);
+        HASH_ARRAY(h, cfg->replay.tof, cfg->nphoton);
+        HASH_ARRAY(h, cfg->replay.detid, cfg->nphoton);
+    }
+
+    snprintf(key, MCX_CACHE_KEYLEN, "%016llx%016llx", h[0], h[1]);
+}
+
+/**
+ * @brief Compose the full path of a cache record
+ *
+ * The path buffer holds the longest cache folder and record name, so the path is never truncated.
+ *
+ * @param[in] cfg: simulation configuration
+ * @param[in] name: the file name of the record, shorter than MCX_CACHE_NAMELEN
+ * @param[out] path: the full path of the record
+ */
+
+static void mcx_cache_path(Config* cfg, const char* name, char path[MCX_CACHE_PATHLEN]) {
+    size_t len = strnlen(cfg->cachedir, MAX_PATH_LENGTH - 1);
+
+    if (len && (cfg->cachedir[len - 1] == '/' || cfg->cachedir[len - 1] == pathsep)) {
+        snprintf(path, MCX_CACHE_PATHLEN, "%.*s%.*s", (int)len, cfg->cachedir, MCX_CACHE_NAMELEN - 1, name);
+    } else {
+        snprintf(path, MCX_CACHE_PATHLEN, "%.*s%c%.*s", (int)len, cfg->cachedir, pathsep, MCX_CACHE_NAMELEN - 1, name);
+    }
+}
+
+/**
+ * @brief Load the outputs of a previous simulation from the cache folder
+ *
+ * If a record matching the key and output buffer sizes is found, the volumetric
+ * output, detected photon data, seeds and trajectories are copied to the
+ * corresponding cfg buffers, reallocated if needed, and the energy totals and
+ * the normalization factor are restored.
+ *
+ * @param[in,out] cfg: simulation configuration
+ * @param[in] key: the cache key computed by mcx_cache_key
+ * @param[in] fieldlen: number of floats in cfg.exportfield
+ * @param[in] hostdetreclen: number of floats per detected photon
+ * @param[in] seedbyte: number of bytes per detected photon seed
+ * @param[in] debuglen: number of floats per trajectory record
+ * @return 1 if the outputs are loaded from the cache, 0 otherwise
+ */
+
+int mcx_cache_load(Config* cfg, const char* key, size_t fieldlen, unsigned int hostdetreclen, unsigned int seedbyte, unsigned int debuglen) {
+    char path[MCX_CACHE_PATHLEN], name[MCX_CACHE_NAMELEN];
+    CacheHeader head;
+    FILE* fp;
+    int isok = 0;
+
+    if (cfg->cachedir[0] == '\0' || cfg->exportfield == NULL) {
+        return 0;
+    }
+
+    snprintf(name, sizeof(name), "%s%s", key, MCX_CACHE_SUFFIX);
+    mcx_cache_path(cfg, name, path);
+
+    if ((fp = fopen(path, "rb")) == NULL) {
+        return 0;
+    }
+
+    if (fread(&head, sizeof(CacheHeader), 1, fp) != 1 || memcmp(head.magic, "MCXC", 4) || head.version != MCX_CACHE_VERSION
+            || strcmp(head.key, key) || head.fieldlen != fieldlen || head.hostdetreclen != hostdetreclen
+            || head.seedbyte != (cfg->issaveseed ? seedbyte : 0) || head.debuglen != debuglen) {
+        fclose(fp);
+        return 0;
+    }
+
+    do {
+        if (fread(cfg->exportfield, sizeof(float), fieldlen, fp) != fieldlen) {
+            break;
+        }
+
+        if (head.detected) {
+            if (cfg->exportdetected == NULL || head.detected > cfg->maxdetphoton) {
+                cfg->exportdetected = (float*)realloc(cfg->exportdetected, (size_t)head.detected * hostdetreclen * sizeof(float));
+            }
+
+            if (fread(cfg->exportdetected, sizeof(float), (size_t)head.detected * hostdetreclen, fp) != (size_t)head.detected * hostdetreclen) {
+                break;
+            }
+
+            if (head.seedbyte) {
+                if (cfg->seeddata == NULL || head.detected > cfg->maxdetphoton) {
+                    cfg->seeddata = realloc(cfg->seeddata, (size_t)head.detected * head.seedbyte);
+                }
+
+                if (fread(cfg->seeddata, head.seedbyte, head.detected, fp) != head.detected) {
+                    break;
+                }
+            }
+        }
+
+        if (head.debugdatalen) {
+            cfg->exportdebugdata = (float*)realloc(cfg->exportdebugdata, (size_t)head.debugdatalen * debuglen * sizeof(float));
+
+            if (fread(cfg->exportdebugdata, sizeof(float) * debuglen, head.debugdatalen, fp) != head.debugdatalen) {
+                break;
+            }
+        }
+
+        isok = 1;
+    } while (0);
+
+    fclose(fp);
+
+    if (!isok) {
+        return 0;
+    }
+
+    cfg->detectedcount = head.detected;
+    cfg->debugdatalen = head.debugdatalen;
+    cfg->energytot = head.energytot;
+    cfg->energyesc = head.energyesc;
+    cfg->energyabs = head.energytot - head.energyesc;
+    cfg->normalizer = head.normalizer;
+    cfg->his = head.his;
+    cfg->runtime = 0;
+
+    /** refresh the time stamp of the record so that it is the last to be evicted */
+    utime(path, NULL);
+
+    return 1;
+}
+
+/**
+ * @brief Store the outputs of a completed simulation to the cache folder
+ *
+ * The record is first written to a temporary file and then renamed, so that
+ * concurrent readers never see a partially written record. The cache folder
+ * is created if it does not exist, and old records are evicted afterwards.
+ *
+ * @param[in] cfg: simulation configuration, holding the normalized outputs
+ * @param[in] key: the cache key computed by mcx_cache_key
+ * @param[in] fieldlen: number of floats in cfg.exportfield
+ * @param[in] hostdetreclen: number of floats per detected photon
+ * @param[in] seedbyte: number of bytes per detected photon seed
+ * @param[in] debuglen: number of floats per trajectory record
+ */
+
+void mcx_cache_save(Config* cfg, const char* key, size_t fieldlen, unsigned int hostdetreclen, unsigned int seedbyte, unsigned int debuglen) {
+    char path[MCX_CACHE_PATHLEN], tmppath[MCX_CACHE_PATHLEN + 4], name[MCX_CACHE_NAMELEN];
+    CacheHeader head;
+    struct stat st;
+    FILE* fp;
+    int isok;
+
+    if (cfg->cachedir[0] == '\0' || cfg->exportfield == NULL) {
+        return;
+    }
+
+    if (stat(cfg->cachedir, &st) == -1) {
+        char dir[MAX_PATH_LENGTH + 2];
+
+        strncpy(dir, cfg->cachedir, MAX_PATH_LENGTH);
+        dir[MAX_PATH_LENGTH] = '\0';
+
+        if (mkpath(dir, 0755)) {
+            MCX_FPRINTF(cfg->flog, S_RED "WARNING: can not create cache folder %s\n" S_RESET, cfg->cachedir);
+            return;
+        }
+    }
+
+    memset(&head, 0, sizeof(CacheHeader));
+    memcpy(head.magic, "MCXC", 4);
+    head.version = MCX_CACHE_VERSION;
+    strncpy(head.key, key, MCX_CACHE_KEYLEN);
+    head.fieldlen = fieldlen;
+    head.detected = (cfg->issavedet && cfg->exportdetected) ? cfg->detectedcount : 0;
+    head.hostdetreclen = hostdetreclen;
+    head.seedbyte = (cfg->issaveseed && cfg->seeddata) ? seedbyte : 0;
+    head.debuglen = debuglen;
+    head.debugdatalen = cfg->exportdebugdata ? cfg->debugdatalen : 0;
+    head.normalizer = cfg->normalizer;
+    head.runtime = cfg->runtime;
+    head.energytot = cfg->energytot;
+    head.energyesc = cfg->energyesc;
+    head.his = cfg->his;
+
+    snprintf(name, sizeof(name), "%s%s", key, MCX_CACHE_SUFFIX);
+    mcx_cache_path(cfg, name, path);
+    snprintf(tmppath, sizeof(tmppath), "%s.tmp", path);
+
+    if ((fp = fopen(tmppath, "wb")) == NULL) {
+        MCX_FPRINTF(cfg->flog, S_RED "WARNING: can not write to cache folder %s\n" S_RESET, cfg->cachedir);
+        return;
+    }
+
+    isok = (fwrite(&head, sizeof(CacheHeader), 1, fp) == 1);
+    isok = isok && (fwrite(cfg->exportfield, sizeof(float), fieldlen, fp) == fieldlen);
+
+    if (head.detected) {
+        isok = isok && (fwrite(cfg->exportdetected, sizeof(float), (size_t)head.detected * hostdetreclen, fp) == (size_t)head.detected * hostdetreclen);
+
+        if (head.seedbyte) {
+            isok = isok && (fwrite(cfg->seeddata, head.seedbyte, head.detected, fp) == head.detected);
+        }
+    }
+
+    if (head.debugdatalen) {
+        isok = isok && (fwrite(cfg->exportdebugdata, sizeof(float) * debuglen, head.debugdatalen, fp) == head.debugdatalen);
+    }
+
+    isok = (fclose(fp) == 0) && isok;
+
+    if (isok) {
+        remove(path);
+        isok = (rename(tmppath, path) == 0);
+    }
+
+    if (!isok) {
+        remove(tmppath);
+        MCX_FPRINTF(cfg->flog, S_RED "WARNING: failed to save the simulation outputs to the cache\n" S_RESET);
+        return;
+    }
+
+    mcx_cache_evict(cfg);
+}
+
+/**
+ * @brief Sort cache records from the most recently used to the least
+ */
+
+static int mcx_cache_cmprecord(const void* a, const void* b) {
+    time_t ta = ((const CacheRecord*)a)->atime, tb = ((const CacheRecord*)b)->atime;
+
+    return (ta < tb) - (ta > tb);
+}
+
+/**
+ * @brief Remove the least recently used records until the cache fits in cfg.cachesize
+ *
+ * Only files with the .mcxc suffix and a 32-digit key are considered, so that
+ * other files stored in the same folder are never removed. A zero cfg.cachesize
+ * uses the default limit, MCX_CACHE_DEFSIZE, and a negative value disables it.
+ *
+ * @param[in] cfg: simulation configuration
+ */
+
+void mcx_cache_evict(Config* cfg) {
+    CacheRecord* rec = NULL;
+    int count = 0, maxcount = 0, i;
+    size_t total = 0, limit;
+    char path[MCX_CACHE_PATHLEN];
+    struct stat st;
+
+    if (cfg->cachedir[0] == '\0' || cfg->cachesize < 0.f) {
+        return;
+    }
+
+    limit = (size_t)((double)((cfg->cachesize > 0.f) ? cfg->cachesize : MCX_CACHE_DEFSIZE) * 1024.0 * 1024.0);
+
+#ifdef _WIN32
+    {
+        struct _finddata_t fileinfo;
+        intptr_t handle;
+
+        mcx_cache_path(cfg, "*" MCX_CACHE_SUFFIX, path);
+
+        if ((handle = _findfirst(path, &fileinfo)) == -1) {
+            return;
+        }
+
+        do {
+            const char* fname = fileinfo.name;
+#else
+    {
+        DIR* dir;
+        struct dirent* entry;
+
+        if ((dir = opendir(cfg->cachedir)) == NULL) {
+            return;
+        }
+
+        while ((entry = readdir(dir)) != NULL) {
+            const char* fname = entry->d_name;
+#endif
+
+            if (strlen(fname) != MCX_CACHE_KEYLEN - 1 + strlen(MCX_CACHE_SUFFIX)
+                    || strcmp(fname + MCX_CACHE_KEYLEN - 1, MCX_CACHE_SUFFIX)) {
+                continue;
+            }
+
+            mcx_cache_path(cfg, fname, path);
+
+            if (stat(path, &st) == -1) {
+                continue;
+            }
+
+            if (count >= maxcount) {
+                maxcount += 256;
+                rec = (CacheRecord*)realloc(rec, maxcount * sizeof(CacheRecord));
+            }
+
+            strncpy(rec[count].name, fname, sizeof(rec[count].name) - 1);
+            rec[count].name[sizeof(rec[count].name) - 1] = '\0';
+            rec[count].size = st.st_size;
+            rec[count].atime = st.st_mtime;
+            total += st.st_size;
+            count++;
+#ifdef _WIN32
+        } while (_findnext(handle, &fileinfo) == 0);
+
+        _findclose(handle);
+    }
+#else
+        }
+
+        closedir(dir);
+    }
+#endif
+
+    if (total > limit && count > 0) {
+        qsort(rec, count, sizeof(CacheRecord), mcx_cache_cmprecord);
+
+        /** always keep the most recent record, even if it alone exceeds the limit */
+        for (i = count - 1; i > 0 && total > limit; i--) {
+            mcx_cache_path(cfg, rec[i].name, path);
+
+            if (remove(path) == 0) {
+                total -= rec[i].size;
+            }
+        }
+    }
+
+    free(rec);
+}
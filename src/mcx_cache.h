@@ -0,0 +1,80 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    mcx_cache.h
+
+@brief   Content-addressed on-disk cache of simulation outputs header
+*******************************************************************************/
+
+#ifndef _MCEXTREME_CACHE_H
+#define _MCEXTREME_CACHE_H
+
+#include "mcx_utils.h"
+
+#define MCX_CACHE_KEYLEN     33                    /**< length of the hexadecimal cache key, including the ending NULL */
+#define MCX_CACHE_VERSION    1                     /**< version of the .mcxc cache record format */
+#define MCX_CACHE_SUFFIX     ".mcxc"               /**< file suffix of the cache records */
+#define MCX_CACHE_DEFSIZE    1024.f                /**< default size limit of the cache folder in MB */
+
+/**
+ * Header of a .mcxc cache record, followed by the volumetric output,
+ * detected photon data, detected photon seeds and trajectory data
+ */
+
+typedef struct MCXCacheHeader {
+    char magic[4];                 /**< magic bits= 'M','C','X','C' */
+    unsigned int version;          /**< version of the cache record format */
+    char key[MCX_CACHE_KEYLEN + 3]; /**< the hash of the configuration, padded to 4-byte boundary */
+    unsigned int fieldlen;         /**< number of floats in the volumetric output, including the imaginary part of RF outputs */
+    unsigned int detected;         /**< number of saved detected photons */
+    unsigned int hostdetreclen;    /**< number of floats per detected photon */
+    unsigned int seedbyte;         /**< number of bytes per detected photon seed, 0 if not stored */
+    unsigned int debuglen;         /**< number of floats per trajectory record */
+    unsigned int debugdatalen;     /**< number of saved trajectory records */
+    float normalizer;              /**< normalization factor */
+    unsigned int runtime;          /**< kernel time of the original simulation in ms */
+    double energytot;              /**< total launched photon packet weights */
+    double energyesc;              /**< total escaped photon packet weights */
+    History his;                   /**< header of the detected photon data */
+} CacheHeader;
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+void mcx_cache_key(Config* cfg, unsigned int seedbyte, char key[MCX_CACHE_KEYLEN]);
+int  mcx_cache_load(Config* cfg, const char* key, size_t fieldlen, unsigned int hostdetreclen, unsigned int seedbyte, unsigned int debuglen);
+void mcx_cache_save(Config* cfg, const char* key, size_t fieldlen, unsigned int hostdetreclen, unsigned int seedbyte, unsigned int debuglen);
+void mcx_cache_evict(Config* cfg);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,231 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    mcx_compact.c
+
+@brief   Cropping of the zero-padded media volume and compaction of its labels
+
+Voxels with a zero medium index are background: a photon moving into such a
+voxel escapes. The zero padding around the tissue therefore only costs memory
+and bandwidth, and is removed before the simulation by cropping the volume to
+the bounding box of the non-background voxels, grown to include the sources
+and detectors. Unused label IDs are removed by renumbering the labels densely.
+The volumetric outputs are embedded back into the original grid when saved.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mcx_compact.h"
+#include "mcx_utils.h"
+#include "mcx_const.h"
+#include "mcx_norm.h"
+
+/**
+ * @brief Find the bounding box of the non-background voxels of a volume
+ *
+ * @param[in] vol: the media volume, one 32-bit word per voxel
+ * @param[in] dim: the dimensions of the volume
+ * @param[out] bbox0: the lower corner (0-based voxel index, inclusive) of the box
+ * @param[out] bbox1: the upper corner (inclusive) of the box
+ * @return 1 if the volume contains non-background voxels, 0 otherwise
+ */
+
+int mcx_compact_bbox(const unsigned int* vol, const unsigned int dim[3], unsigned int bbox0[3], unsigned int bbox1[3]) {
+    size_t slicelen = (size_t)dim[0] * dim[1];
+    int lo[3] = {(int)dim[0], (int)dim[1], (int)dim[2]}, hi[3] = {-1, -1, -1};
+    int* box = (int*)malloc(dim[2] * 4 * sizeof(int)); /* x/y range of the non-background voxels of each z-slice */
+    unsigned int i;
+    long long z;
+
+    /** the per-slice ranges are combined serially, avoiding min/max reductions */
+    #pragma omp parallel for schedule(static) num_threads(mcx_norm_threadnum(slicelen * dim[2]))
+
+    for (z = 0; z < (long long)dim[2]; z++) {
+        const unsigned int* slice = vol + z * slicelen;
+        int* zbox = box + z * 4;
+        unsigned int x, y;
+
+        zbox[0] = dim[0];
+        zbox[1] = -1;
+        zbox[2] = dim[1];
+        zbox[3] = -1;
+
+        for (y = 0; y < dim[1]; y++) {
+            for (x = 0; x < dim[0]; x++) {
+                if (slice[(size_t)y * dim[0] + x] & MED_MASK) {
+                    zbox[0] = MIN(zbox[0], (int)x);
+                    zbox[1] = MAX(zbox[1], (int)x);
+                    zbox[2] = MIN(zbox[2], (int)y);
+                    zbox[3] = MAX(zbox[3], (int)y);
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < dim[2]; i++) {
+        if (box[i * 4 + 1] >= 0) {
+            lo[0] = MIN(lo[0], box[i * 4]);
+            hi[0] = MAX(hi[0], box[i * 4 + 1]);
+            lo[1] = MIN(lo[1], box[i * 4 + 2]);
+            hi[1] = MAX(hi[1], box[i * 4 + 3]);
+            lo[2] = MIN(lo[2], (int)i);
+            hi[2] = MAX(hi[2], (int)i);
+        }
+    }
+
+    free(box);
+
+    if (hi[0] < 0) {
+        return 0;
+    }
+
+    for (i = 0; i < 3; i++) {
+        bbox0[i] = lo[i];
+        bbox1[i] = hi[i];
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Copy a box-shaped sub-region of a volume
+ *
+ * @param[in] vol: the media volume, one 32-bit word per voxel
+ * @param[in] dim: the dimensions of the volume
+ * @param[in] offset: the lower corner of the sub-region
+ * @param[in] cropdim: the dimensions of the sub-region, which must lie inside the volume
+ * @return the cropped volume, to be freed by the caller, or NULL if the allocation fails
+ */
+
+unsigned int* mcx_compact_crop(const unsigned int* vol, const unsigned int dim[3], const unsigned int offset[3],
+                               const unsigned int cropdim[3]) {
+    size_t slicelen = (size_t)cropdim[0] * cropdim[1];
+    unsigned int* newvol = (unsigned int*)malloc(slicelen * cropdim[2] * sizeof(unsigned int));
+    long long z;
+
+    if (newvol == NULL) {
+        return NULL;
+    }
+
+    #pragma omp parallel for schedule(static) num_threads(mcx_norm_threadnum(slicelen * cropdim[2]))
+
+    for (z = 0; z < (long long)cropdim[2]; z++) {
+        unsigned int y;
+
+        for (y = 0; y < cropdim[1]; y++) {
+            memcpy(newvol + z * slicelen + (size_t)y * cropdim[0],
+                   vol + ((size_t)(z + offset[2]) * dim[1] + y + offset[1]) * dim[0] + offset[0], cropdim[0] * sizeof(unsigned int));
+        }
+    }
+
+    return newvol;
+}
+
+/**
+ * @brief Renumber the labels of a volume densely, in increasing order
+ *
+ * Label 0 (background) is always kept. The bits above the label (MED_MASK),
+ * such as the detector flag, are preserved.
+ *
+ * @param[in,out] vol: the label volume, one 32-bit word per voxel
+ * @param[in] len: the number of voxels
+ * @param[in] medianum: the number of labels, all labels in vol must be smaller
+ * @param[out] labelmap: a buffer of medianum entries, labelmap[i] receives the original label of the new label i
+ * @return the number of labels in use, including the background
+ */
+
+unsigned int mcx_compact_labels(unsigned int* vol, size_t len, unsigned int medianum, unsigned int* labelmap) {
+    unsigned int* newlabel = (unsigned int*)calloc(medianum, sizeof(unsigned int));
+    unsigned int i, count = 0;
+    size_t j;
+
+    newlabel[0] = 1;
+
+    for (j = 0; j < len; j++) {
+        newlabel[vol[j] & MED_MASK] = 1;
+    }
+
+    for (i = 0; i < medianum; i++) {
+        if (newlabel[i]) {
+            labelmap[count] = i;
+            newlabel[i] = count++;
+        }
+    }
+
+    if (count < medianum) {
+        long long k;
+
+        #pragma omp parallel for schedule(static) num_threads(mcx_norm_threadnum(len))
+
+        for (k = 0; k < (long long)len; k++) {
+            vol[k] = (vol[k] & ~MED_MASK) | newlabel[vol[k] & MED_MASK];
+        }
+    }
+
+    free(newlabel);
+    return count;
+}
+
+/**
+ * @brief Embed the volumetric outputs of a cropped grid back into the original grid
+ *
+ * @param[in] field: the outputs on the cropped grid, made of nvol volumes of srcnum interleaved values per voxel
+ * @param[in] cropdim: the dimensions of the cropped grid
+ * @param[in] offset: the position of the cropped grid in the original grid
+ * @param[in] fulldim: the dimensions of the original grid
+ * @param[in] nvol: the number of volumes, such as time gates
+ * @param[in] srcnum: the number of interleaved values per voxel
+ * @return the outputs on the original grid, zero outside of the cropped grid, or NULL if the allocation fails
+ */
+
+float* mcx_compact_expand(const float* field, const unsigned int cropdim[3], const unsigned int offset[3],
+                          const unsigned int fulldim[3], size_t nvol, unsigned int srcnum) {
+    size_t cropxyz = (size_t)cropdim[0] * cropdim[1] * cropdim[2], fullxyz = (size_t)fulldim[0] * fulldim[1] * fulldim[2];
+    size_t rowlen = (size_t)cropdim[0] * srcnum;
+    float* full = (float*)calloc(fullxyz * nvol * srcnum, sizeof(float));
+    long long k;
+
+    if (full == NULL) {
+        return NULL;
+    }
+
+    /** each iteration copies a row along x of one volume */
+    #pragma omp parallel for schedule(static) num_threads(mcx_norm_threadnum(cropxyz * nvol))
+
+    for (k = 0; k < (long long)(nvol * cropdim[2] * cropdim[1]); k++) {
+        size_t v = k / ((size_t)cropdim[2] * cropdim[1]);
+        unsigned int z = (unsigned int)((k / cropdim[1]) % cropdim[2]), y = (unsigned int)(k % cropdim[1]);
+
+        memcpy(full + (v * fullxyz + ((size_t)(z + offset[2]) * fulldim[1] + y + offset[1]) * fulldim[0] + offset[0]) * srcnum,
+               field + (v * cropxyz + ((size_t)z * cropdim[1] + y) * cropdim[0]) * srcnum, rowlen * sizeof(float));
+    }
+
+    return full;
+}
@@ -0,0 +1,58 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    mcx_compact.h
+
+@brief   Cropping of the zero-padded media volume and compaction of its labels
+*******************************************************************************/
+
+#ifndef _MCEXTREME_COMPACT_H
+#define _MCEXTREME_COMPACT_H
+
+#include <stddef.h>
+
+#define MCX_COMPACT_MARGIN     2                    /**< number of background voxels kept around the cropped region */
+#define MCX_COMPACT_MINSAVING  0.1f                 /**< the volume is only cropped if this fraction of the voxels is removed */
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+int mcx_compact_bbox(const unsigned int* vol, const unsigned int dim[3], unsigned int bbox0[3], unsigned int bbox1[3]);
+unsigned int* mcx_compact_crop(const unsigned int* vol, const unsigned int dim[3], const unsigned int offset[3],
+                               const unsigned int cropdim[3]);
+unsigned int mcx_compact_labels(unsigned int* vol, size_t len, unsigned int medianum, unsigned int* labelmap);
+float* mcx_compact_expand(const float* field, const unsigned int cropdim[3], const unsigned int offset[3],
+                          const unsigned int fulldim[3], size_t nvol, unsigned int srcnum);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
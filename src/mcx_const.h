@@ -69,6 +69,8 @@
 #define MCX_DEBUG_PROGRESS     4   /**< debug flags: 4 - print progress bar */
 #define MCX_DEBUG_MOVE_ONLY    8   /**< debug flags: 8 - only save photon trajectory data, disable volume and detphoton output */
 
+#define MEDIA_LABEL8          94   /**<  media format: input: [byte: label] -> labels are packed as 4x 8bit per 32bit word on the GPU */
+#define MEDIA_LABEL4          95   /**<  media format: input: {[4bit: label0][4bit: label1]} per byte -> labels are packed as 8x 4bit per 32bit word on the GPU */
 #define MEDIA_ASGN_F2H        96   /**<  media format: input: float4 {mua,mus,g,n} -> {[half: mua],[half: mus],[half: g],[half: n]} */
 #define MEDIA_2LABEL_SPLIT    97   /**<  media format: 64bit:{[byte: lower label][byte: upper label][byte*3: reference point][byte*3: normal vector]} */
 #define MEDIA_2LABEL_MIX      98   /**<  media format: {[int: label1][int: label2][float32: label1 %]} -> 32bit:{[short 0-32767 scaled label1 %],[byte: label2],[byte: label1]} */
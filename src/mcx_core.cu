@@ -48,6 +48,18 @@ This unit is written with CUDA-C and shall be compiled using nvcc in cuda-toolki
 #include "mcx_core.h"
 #include "mcx_tictoc.h"
 #include "mcx_const.h"
+#include "mcx_cache.h"
+#include "mcx_brick.h"
+#include "mcx_lowrank.h"
+#include "mcx_tune.h"
+#include "mcx_traj.h"
+#include "mcx_detfilter.h"
+#include "mcx_bias.h"
+#include "mcx_dcs.h"
+#include "mcx_norm.h"
+#include "mcx_pyramid.h"
+#include "mcx_compact.h"
+#include "mcx_serve.h"
 
 #include <cuda.h>
 #include "cuda_fp16.h"
@@ -173,7 +185,9 @@ __device__ float dot(const float3& a, const float3& b) {
  * Format: {x,y,z}: the x/y/z coord. of the detector, and {w}: radius; all in grid unit.
  * The total length (both media properties and detector) is defined by
  * MAX_PROP_AND_DETECTORS, which is 4000 to fully utilize the constant memory space
- * (64kb=4096 float4)
+ * (64kb=4096 float4). When the media do not fit (cfg.isglobalprop), only the first
+ * gcfg->constmedia labels are stored here and all labels are read from a global-memory
+ * copy, see getproperty()
  */
 
 __constant__ float4 gproperty[MAX_PROP_AND_DETECTORS];
@@ -187,6 +201,30 @@ __constant__ float4 gproperty[MAX_PROP_AND_DETECTORS];
 
 __constant__ MCXParam gcfg[1];
 
+/**
+ * @brief Read the optical properties {mua,mus,g,n} of a medium label
+ *
+ * The properties of labels below gcfg->constmedia are read from the constant
+ * memory (gproperty); when the property table is too large for the constant
+ * memory (gcfg->globalprop is not NULL), the remaining labels are read from
+ * the global-memory table through the read-only data cache.
+ *
+ * @param[in] label: the medium label
+ * @return the optical properties of the medium
+ */
+
+__device__ inline float4 getproperty(uint label) {
+    if (gcfg->globalprop == NULL || label < gcfg->constmedia) {
+        return gproperty[label];
+    }
+
+#if defined(__CUDA_ARCH__) && __CUDA_ARCH__ >= 350
+    return __ldg(gcfg->globalprop + label);
+#else
+    return gcfg->globalprop[label];
+#endif
+}
+
 /**
  * @brief Global variable to store the number of photon movements for debugging purposes
  */
@@ -257,11 +295,11 @@ __device__ inline void clearpath(float* p, int maxmediatype) {
 __device__ inline uint finddetector(MCXpos* p0) {
     uint i;
 
-    for (i = gcfg->maxmedia + 1; i < gcfg->maxmedia + gcfg->detnum + 1; i++) {
+    for (i = gcfg->constmedia; i < gcfg->constmedia + gcfg->detnum; i++) {
         if ((gproperty[i].x - p0->x) * (gproperty[i].x - p0->x) +
                 (gproperty[i].y - p0->y) * (gproperty[i].y - p0->y) +
                 (gproperty[i].z - p0->z) * (gproperty[i].z - p0->z) < gproperty[i].w * gproperty[i].w) {
-            return i - gcfg->maxmedia;
+            return i - gcfg->constmedia + 1;
         }
     }
 
@@ -350,6 +388,26 @@ __device__ inline void updatestokes(Stokes* s, float theta, float phi, float3* u
     s->i = 1.f;
 }
 
+/**
+ * @brief Pack two floating-point values into the bits of a float as a pair of half-precision values
+ * @param[in] lo: the value stored in the lower 16 bits
+ * @param[in] hi: the value stored in the higher 16 bits
+ */
+
+__device__ inline float packhalf2(float lo, float hi) {
+    union {
+        float f;
+#if ! defined(__CUDACC_VER_MAJOR__) || __CUDACC_VER_MAJOR__ >= 9
+        __half_raw h[2];
+#else
+        half h[2];
+#endif
+    } val;
+    val.h[0] = __float2half_rn(lo);
+    val.h[1] = __float2half_rn(hi);
+    return val.f;
+}
+
 /**
  * @brief Recording detected photon information at photon termination
  * @param[in] n_det: pointer to the detector position array
@@ -359,12 +417,28 @@ __device__ inline void updatestokes(Stokes* s, float theta, float phi, float3* u
  * @param[in] v: the direction vector of the current photon packet
  * @param[in] t: random number generator (RNG) states
  * @param[in] seeddata: the RNG seed of the photon at launch, need to save for replay
+ * @param[in] tof: the time-of-flight of the photon in s, used by the detected photon filter
  */
 
-__device__ inline void savedetphoton(float n_det[], uint* detectedphoton, float* ppath, MCXpos* p0, MCXdir* v, Stokes* s, RandType t[RAND_BUF_LEN], RandType* seeddata, uint isdet) {
+__device__ inline void savedetphoton(float n_det[], uint* detectedphoton, float* ppath, MCXpos* p0, MCXdir* v, Stokes* s, RandType t[RAND_BUF_LEN], RandType* seeddata, uint isdet, float tof) {
     int detid;
     detid = (isdet == OUTSIDE_VOLUME_MIN) ? -1 : (int)finddetector(p0);
 
+    /** photons rejected by the filter are discarded before they claim a slot in the buffer */
+    if (detid && gcfg->detfilter.enabled) {
+        float nscat = 0.f;
+
+        if (gcfg->detfilter.maxscat) {
+            for (uint i = 0; i < gcfg->maxmedia; i++) {
+                nscat += ppath[i];
+            }
+        }
+
+        if (!mcx_detfilter_pass(&(gcfg->detfilter), detid, tof, p0->w, nscat)) {
+            return;
+        }
+    }
+
     if (detid) {
         uint baseaddr = atomicAdd(detectedphoton, 1);
 
@@ -385,8 +459,22 @@ __device__ inline void savedetphoton(float n_det[], uint* detectedphoton, float*
                 n_det[baseaddr++] = detid;
             }
 
-            for (i = 0; i < gcfg->partialdata; i++) {
-                n_det[baseaddr++] = ppath[i];    //< save partial pathlength to the memory
+            if (gcfg->ishalfdet) {
+                uint j;
+
+                for (i = 0; i < gcfg->maxmedia * SAVE_NSCAT(gcfg->savedetflag); i++) {
+                    n_det[baseaddr++] = ppath[i];
+                }
+
+                for (; i < gcfg->partialdata; i += gcfg->maxmedia) { //< ppath and mom, 2 media per word
+                    for (j = 0; j < gcfg->maxmedia; j += 2) {
+                        n_det[baseaddr++] = packhalf2(ppath[i + j], (j + 1 < gcfg->maxmedia) ? ppath[i + j + 1] : 0.f);
+                    }
+                }
+            } else {
+                for (i = 0; i < gcfg->partialdata; i++) {
+                    n_det[baseaddr++] = ppath[i];    //< save partial pathlength to the memory
+                }
             }
 
             if (SAVE_PEXIT(gcfg->savedetflag)) {
@@ -421,10 +509,17 @@ __device__ inline void savedetphoton(float n_det[], uint* detectedphoton, float*
  * @param[in] p: the position/weight of the current photon packet
  * @param[in] id: the global index of the photon
  * @param[in] gdebugdata: pointer to the global-memory buffer to store the trajectory info
+ * @return the position after the saved record, 0 if the photon is not sampled or the buffer is full
  */
 
 __device__ inline uint savedebugdata(MCXpos* p, uint id, float* gdebugdata, int srcid) {
-    uint pos = atomicAdd(gjumpdebug, 1);
+    uint pos;
+
+    if (gcfg->trajphoton > 1 && id % gcfg->trajphoton) {
+        return 0;
+    }
+
+    pos = atomicAdd(gjumpdebug, 1);
 
     if (pos < gcfg->maxjumpdebug) {
         pos *= MCX_DEBUG_REC_LEN + (gcfg->istrajstokes << 2);
@@ -476,11 +571,52 @@ __device__ inline float mcx_nextafterf(float a, int dir) {
     return num.f - gcfg->maxvoidstep;  /** Last, undo the offset, and return */
 }
 
+/**
+ * @brief Return the edge lengths of a voxel in grid unit
+ *
+ * For a uniform grid, all voxels are unit cubes. For a non-uniform rectilinear grid,
+ * the edge length of each voxel column/row/slice is read from gcfg->gridscale; indices
+ * outside of the domain use the nearest boundary voxel.
+ *
+ * @param[in] id: the x/y/z indices of the voxel
+ * @return the x/y/z edge lengths of the voxel in grid unit
+ */
+
+__device__ inline float3 voxelscale(short id[4]) {
+    if (gcfg->gridscale == NULL) {
+        return float3(1.f, 1.f, 1.f);
+    }
+
+    int nx = (int)gcfg->maxidx.x, ny = (int)gcfg->maxidx.y, nz = (int)gcfg->maxidx.z;
+
+    return float3(gcfg->gridscale[min(max((int)id[0], 0), nx - 1)],
+                  gcfg->gridscale[nx + min(max((int)id[1], 0), ny - 1)],
+                  gcfg->gridscale[nx + ny + min(max((int)id[2], 0), nz - 1)]);
+}
+
+/**
+ * @brief Test if a voxel is within the tallied region of a coarse-to-fine simulation
+ *
+ * @param[in] idx1d: the linear index of the voxel
+ * @return 1 if the voxel accumulates the volumetric output, 0 otherwise
+ */
+
+__device__ inline int intallyregion(uint idx1d) {
+    uint z = idx1d / gcfg->dimlen.y;
+    uint y = (idx1d - z * gcfg->dimlen.y) / gcfg->dimlen.x;
+    uint x = idx1d - z * gcfg->dimlen.y - y * gcfg->dimlen.x;
+
+    return (x >= gcfg->roi0.x && x <= gcfg->roi1.x && y >= gcfg->roi0.y && y <= gcfg->roi1.y && z >= gcfg->roi0.z && z <= gcfg->roi1.z);
+}
+
 /**
  * @brief Core function for photon-voxel ray-tracing
  *
  * This is the heart of the MCX simulation algorithm. It calculates the nearest intersection
- * of the ray inside the current cubic voxel.
+ * of the ray inside the current cubic voxel. The photon position is stored as the
+ * continuous voxel index while the direction vector and the returned distance are
+ * in the physical space (grid unit); on a non-uniform grid, the time-of-flight to
+ * each wall is scaled by the edge length of the current voxel.
  *
  * @param[in] p0: the x/y/z position of the current photon
  * @param[in] v: the direction vector of the photon
@@ -498,6 +634,14 @@ __device__ inline float hitgrid(float3* p0, float3* v, float* rv, short id[4]) {
     htime[1] = fabsf((id[1] + (v->y > 0.f) - p0->y) * rv[1]);
     htime[2] = fabsf((id[2] + (v->z > 0.f) - p0->z) * rv[2]);
 
+    if (gcfg->gridscale) {
+        float3 scale = voxelscale(id);
+
+        htime[0] *= scale.x;
+        htime[1] *= scale.y;
+        htime[2] *= scale.z;
+    }
+
     //< get the direction with the smallest time-of-flight
     dist = fminf(fminf(htime[0], htime[1]), htime[2]);
     id[3] = (dist == htime[0] ? 0 : (dist == htime[1] ? 1 : 2));
@@ -568,6 +712,43 @@ __device__ inline float reflectcoeff(MCXdir* v, float n1, float n2, int flipdir)
     }
 }
 
+/**
+ * @brief Read the media value of a voxel
+ *
+ * When the media buffer is brick-compressed (--brick 1), the voxel x/y/z
+ * indices are recovered from the 1D index and looked up in the brick table;
+ * for the label4/label8 formats, the label is extracted from the packed word
+ * and the detector flag is restored from the separate detector mask;
+ * otherwise, the dense volume is read directly.
+ *
+ * @param[in] media: the media buffer, dense or brick-compressed
+ * @param[in] idx1d: the 1D index of the voxel in the dense volume
+ * @return the 32-bit media value of the voxel
+ */
+
+__device__ inline uint getmediaid(uint media[], uint idx1d) {
+    if (gcfg->isbrick) {
+        uint iz = idx1d / gcfg->dimlen.y;
+        uint iy = idx1d - iz * gcfg->dimlen.y;
+        uint ix = iy;
+
+        iy /= gcfg->dimlen.x;
+        ix -= iy * gcfg->dimlen.x;
+        return mcx_brick_lookup(media, gcfg->brickdim.x, gcfg->brickdim.y, ix, iy, iz);
+    } else if (gcfg->mediabits) {
+        uint shift = (gcfg->mediabits == 4) ? 3 : 2; // log2 of the labels per word
+        uint label = (media[idx1d >> shift] >> ((idx1d & ((1u << shift) - 1)) * gcfg->mediabits)) & ((1u << gcfg->mediabits) - 1);
+
+        if (gcfg->maskoffset) {
+            label |= ((media[gcfg->maskoffset + (idx1d >> 5)] >> (idx1d & 31)) & 1u) << 31;
+        }
+
+        return label;
+    }
+
+    return media[idx1d];
+}
+
 /**
  * @brief Loading optical properties from constant memory
  *
@@ -593,7 +774,7 @@ __device__ void updateproperty(Medium* prop, unsigned int& mediaid, RandType t[R
      * index 0 starts from the lowest (least significant bit) end
      */
     if (islabel) { //< [i0]: traditional MCX input type - voxels store integer labels, islabel is a template const for speed
-        *((float4*)(prop)) = gproperty[mediaid & MED_MASK];
+        *((float4*)(prop)) = getproperty(mediaid & MED_MASK);
     } else if (gcfg->mediaformat == MEDIA_LABEL_HALF) { //< [h1][s0]: h1: half-prec property value; highest 2bit in s0: index 0-3, low 14bit: tissue label
         union {
             unsigned int i;
@@ -605,7 +786,7 @@ __device__ void updateproperty(Medium* prop, unsigned int& mediaid, RandType t[R
             unsigned short s[2]; /**s[1]: half-prec property; s[0]: high 2bits: idx 0-3, low 14bits: tissue label*/
         } val;
         val.i = mediaid & MED_MASK;
-        *((float4*)(prop)) = gproperty[val.s[0] & 0x3FFF];
+        *((float4*)(prop)) = getproperty(val.s[0] & 0x3FFF);
         float* p = (float*)(prop);
         p[(val.s[0] & 0xC000) >> 14] = fabsf(__half2float(val.h[1]));
     } else if (gcfg->mediaformat == MEDIA_MUA_FLOAT) { //< [f0]: single-prec mua every voxel; mus/g/n uses 2nd row in gcfg.prop
@@ -655,15 +836,15 @@ __device__ void updateproperty(Medium* prop, unsigned int& mediaid, RandType t[R
 
         if (val.h[1] > 0) {
             if ((rand_uniform01(t) * 32767.f) < val.h[1]) {
-                *((float4*)(prop)) = gproperty[val.c[1]];
+                *((float4*)(prop)) = getproperty(val.c[1]);
                 mediaid >>= 8;
             } else {
-                *((float4*)(prop)) = gproperty[val.c[0]];
+                *((float4*)(prop)) = getproperty(val.c[0]);
             }
 
             mediaid &= 0xFFFF;
         } else {
-            *((float4*)(prop)) = gproperty[val.c[0]];
+            *((float4*)(prop)) = getproperty(val.c[0]);
         }
     } else if (gcfg->mediaformat == MEDIA_ASGN_BYTE) { //< [c3][c2][c1][c0]: c0/c1/c2/c3: interpolation ratios (scaled to 0-255) of mua/mus/g/n between cfg.prop(1,:) and cfg.prop(2,:)
         union {
@@ -711,17 +892,17 @@ __device__ void updateproperty(Medium* prop, unsigned int& mediaid, RandType t[R
 
             /** Determine tissue label corresponding to the current photon position*/
             if (dot(nuvox->rp - *p, nuvox->nv) < 0) {
-                *((float4*)(prop)) = gproperty[nuvox->sv.upper]; // upper label
+                *((float4*)(prop)) = getproperty(nuvox->sv.upper); // upper label
                 nuvox->sv.isupper = 1;
                 nuvox->nv = -nuvox->nv; // normal vector always points to the other side (outward-pointing)
             } else {
-                *((float4*)(prop)) = gproperty[nuvox->sv.lower]; // lower label
+                *((float4*)(prop)) = getproperty(nuvox->sv.lower); // lower label
                 nuvox->sv.isupper = 0;
             }
 
             nuvox->sv.issplit = 1;
         } else { // if upper label is zero, the photon is inside a regular voxel
-            *((float4*)(prop)) = gproperty[val.c[7]]; // voxel uniquely labeled
+            *((float4*)(prop)) = getproperty(val.c[7]); // voxel uniquely labeled
             nuvox->sv.issplit = 0;
             nuvox->sv.isupper = 0;
         }
@@ -785,7 +966,7 @@ __device__ int reflectray(float n1, float3* c0, float3* rv, MCXsp* nuvox, Medium
 
     Icos = fabsf(dot(*c0, nuvox->nv));
 
-    n2 = (nuvox->sv.isupper) ? gproperty[nuvox->sv.upper].w : gproperty[nuvox->sv.lower].w;
+    n2 = (nuvox->sv.isupper) ? getproperty(nuvox->sv.upper).w : getproperty(nuvox->sv.lower).w;
 
     tmp0 = n1 * n1;
     tmp1 = n2 * n2;
@@ -811,7 +992,7 @@ __device__ int reflectray(float n1, float3* c0, float3* rv, MCXsp* nuvox, Medium
                 return 1;
             }
 
-            *((float4*)prop) = gproperty[nuvox->sv.isupper ? nuvox->sv.upper : nuvox->sv.lower];
+            *((float4*)prop) = getproperty(nuvox->sv.isupper ? nuvox->sv.upper : nuvox->sv.lower);
         }
     } else { /*total internal reflection*/
         *c0 += (FL3(-2.f * Icos)) * nuvox->nv;
@@ -839,7 +1020,7 @@ __device__ float getrefractiveidx(unsigned int mediaid) {
     }
 
     if (gcfg->mediaformat <= 4) {
-        return gproperty[mediaid & MED_MASK].w;
+        return getproperty(mediaid & MED_MASK).w;
     } else if (gcfg->mediaformat == MEDIA_ASGN_BYTE) {
         return 0.9f;
     } else {
@@ -875,7 +1056,7 @@ __device__ inline int skipvoid(MCXpos* p, MCXdir* v, MCXtime* f, float3* rv, uin
         if ((ushort)flipdir[0] < gcfg->maxidx.x && (ushort)flipdir[1] < gcfg->maxidx.y && (ushort)flipdir[2] < gcfg->maxidx.z) {
             idx1d = (flipdir[2] * gcfg->dimlen.y + flipdir[1] * gcfg->dimlen.x + flipdir[0]);
 
-            if (media[idx1d] & MED_MASK) { //< if enters a non-zero voxel
+            if (getmediaid(media, idx1d) & MED_MASK) { //< if enters a non-zero voxel
                 GPUDEBUG(("inside volume [%f %f %f] v=<%f %f %f>\n", p->x, p->y, p->z, v->x, v->y, v->z));
                 p->x -= v->x;
                 p->y -= v->y;
@@ -890,10 +1071,11 @@ __device__ inline int skipvoid(MCXpos* p, MCXdir* v, MCXtime* f, float3* rv, uin
                 count = 0;
 
                 while (!((ushort)flipdir[0] < gcfg->maxidx.x && (ushort)flipdir[1] < gcfg->maxidx.y
-                         && (ushort)flipdir[2] < gcfg->maxidx.z) || !(media[idx1d] & MED_MASK)) { // at most 3 times
+                         && (ushort)flipdir[2] < gcfg->maxidx.z) || !(getmediaid(media, idx1d) & MED_MASK)) { // at most 3 times
                     float dist = hitgrid((float3*)p, (float3*)v, &rv->x, flipdir);
+                    float3 scale = voxelscale(flipdir);
                     f->t += gcfg->minaccumtime * dist;
-                    *((float3*)(p)) = float3(p->x + dist * v->x, p->y + dist * v->y, p->z + dist * v->z);
+                    *((float3*)(p)) = float3(p->x + __fdividef(dist * v->x, scale.x), p->y + __fdividef(dist * v->y, scale.y), p->z + __fdividef(dist * v->z, scale.z));
 
                     if (flipdir[3] == 0) {
                         flipdir[0] += (v->x > 0.f ? 1 : -1);
@@ -918,7 +1100,8 @@ __device__ inline int skipvoid(MCXpos* p, MCXdir* v, MCXtime* f, float3* rv, uin
 
                 f->t = (gcfg->voidtime) ? f->t : 0.f;
                 float4 htime;
-                updateproperty<islabel, issvmc>((Medium*)&htime, media[idx1d], t, idx1d, media, (float3*)p, nuvox, flipdir);
+                uint mediaid = getmediaid(media, idx1d);
+                updateproperty<islabel, issvmc>((Medium*)&htime, mediaid, t, idx1d, media, (float3*)p, nuvox, flipdir);
 
                 if (gcfg->isspecular && htime.w != gproperty[0].w) {
                     p->w *= 1.f - reflectcoeff(v, gproperty[0].w, htime.w, flipdir[3]);
@@ -1029,6 +1212,30 @@ __device__ inline void rotatevector(MCXdir* v, float stheta, float ctheta, float
     GPUDEBUG(("new dir: %10.5e %10.5e %10.5e\n", v->x, v->y, v->z));
 }
 
+/**
+ * @brief Weight correction of a photon launched by the biased launch
+ *
+ * With a probability of gcfg->biasprob, the launch direction is drawn uniformly within
+ * a cone toward a randomly picked target detector, otherwise from the source angular
+ * distribution. The returned ratio of the source density to this mixture density, both
+ * per unit solid angle, keeps the expected photon weight unbiased, see mcx_bias.h.
+ *
+ * @param[in] v: the launch direction of the photon
+ * @param[in] p: the launch position of the photon
+ * @param[in] dir: the axis of the source angular distribution
+ */
+
+__device__ inline float launchbiasweight(MCXdir* v, MCXpos* p, float4 dir) {
+    float4 vdir = *((float4*)v), pos = *((float4*)p);
+    float hits = 0.f;
+
+    for (uint i = 0; i < gcfg->biasdetnum; i++) {
+        hits += mcx_bias_incone(vdir, pos, gproperty[gcfg->constmedia + gcfg->biasdet[i]], dir, gcfg->biascos);
+    }
+
+    return mcx_bias_weight(mcx_bias_srcdensity(gcfg->srctype, vdir, dir), hits, gcfg->biasdetnum, gcfg->biascos, gcfg->biasprob);
+}
+
 /**
  * @brief Terminate a photon and launch a new photon according to specified source form
  *
@@ -1152,7 +1359,7 @@ __device__ inline int launchnewphoton(MCXpos* p, MCXdir* v, Stokes* s, MCXtime*
         if (gcfg->savedet) {
             if ((isdet & DET_MASK) == DET_MASK && (*mediaid == 0 || (issvmc &&
                                                    (nuvox->sv.isupper ? nuvox->sv.upper : nuvox->sv.lower) == 0)) && gcfg->issaveref < 2) {
-                savedetphoton(n_det, dpnum, ppath, p, v, s, photonseed, seeddata, isdet);
+                savedetphoton(n_det, dpnum, ppath, p, v, s, photonseed, seeddata, isdet, f->t);
             }
         }
 
@@ -1191,12 +1398,12 @@ __device__ inline int launchnewphoton(MCXpos* p, MCXdir* v, Stokes* s, MCXtime*
 
     if (gcfg->extrasrclen && gcfg->srcid != 1) {
         if (gcfg->srcid > 1) {
-            launchsrc = (MCXSrc*)(gproperty + gcfg->maxmedia + 1 + gcfg->detnum + ((gcfg->srcid - 2) * 4));
+            launchsrc = (MCXSrc*)(gproperty + gcfg->constmedia + gcfg->detnum + ((gcfg->srcid - 2) * 4));
         } else { // gcfg->srcid = 0 or -1: simulate all sources; = 0 merge all solutions; = -1 separately store each source
             ppath[gcfg->w0offset - 1] = (int)(rand_uniform01(t) * JUST_BELOW_ONE * (gcfg->extrasrclen + 1)) + 1; // borrow initial weight section of photon-sharing for storing launch src id
 
             if ((int)ppath[gcfg->w0offset - 1] > 1) {
-                launchsrc = (MCXSrc*)(gproperty + gcfg->maxmedia + 1 + gcfg->detnum + ((int)(ppath[gcfg->w0offset - 1] - 2) * 4));
+                launchsrc = (MCXSrc*)(gproperty + gcfg->constmedia + gcfg->detnum + ((int)(ppath[gcfg->w0offset - 1] - 2) * 4));
             }
         }
     }
@@ -1295,7 +1502,7 @@ __device__ inline int launchnewphoton(MCXpos* p, MCXdir* v, Stokes* s, MCXtime*
                     if (p->x < 0.f || p->y < 0.f || p->z < 0.f || p->x >= gcfg->maxidx.x || p->y >= gcfg->maxidx.y || p->z >= gcfg->maxidx.z) {
                         *mediaid = 0;
                     } else {
-                        *mediaid = media[*idx1d];
+                        *mediaid = getmediaid(media, *idx1d);
                     }
 
                     *rv = float3(rv->x + (launchsrc->param1.x + launchsrc->param2.x) * 0.5f,
@@ -1330,7 +1537,7 @@ __device__ inline int launchnewphoton(MCXpos* p, MCXdir* v, Stokes* s, MCXtime*
                     if (p->x < 0.f || p->y < 0.f || p->z < 0.f || p->x >= gcfg->maxidx.x || p->y >= gcfg->maxidx.y || p->z >= gcfg->maxidx.z) {
                         *mediaid = 0;
                     } else {
-                        *mediaid = media[*idx1d];
+                        *mediaid = getmediaid(media, *idx1d);
                     }
 
                     *rv = float3(rv->x + (launchsrc->param1.x + v2.x) * 0.5f,
@@ -1384,7 +1591,7 @@ __device__ inline int launchnewphoton(MCXpos* p, MCXdir* v, Stokes* s, MCXtime*
                     if (p->x < 0.f || p->y < 0.f || p->z < 0.f || p->x >= gcfg->maxidx.x || p->y >= gcfg->maxidx.y || p->z >= gcfg->maxidx.z) {
                         *mediaid = 0;
                     } else {
-                        *mediaid = media[*idx1d];
+                        *mediaid = getmediaid(media, *idx1d);
                     }
 
                     break;
@@ -1396,22 +1603,37 @@ __device__ inline int launchnewphoton(MCXpos* p, MCXdir* v, Stokes* s, MCXtime*
                     // Uniform point picking on a sphere
                     // http://mathworld.wolfram.com/SpherePointPicking.html
                     float ang, stheta, ctheta, sphi, cphi;
+                    int isbiased = (gcfg->biasprob > 0.f && rand_uniform01(t) < gcfg->biasprob);
                     ang = TWO_PI * rand_uniform01(t); //next arimuth angle
                     sincosf(ang, &sphi, &cphi);
 
-                    if (gcfg->srctype == MCX_SRC_CONE) { // a solid-angle section of a uniform sphere
-                        ang = cosf(launchsrc->param1.x);
-                        ang = (launchsrc->param1.y > 0.f) ? rand_uniform01(t) * launchsrc->param1.x : acos(rand_uniform01(t) * (1.0 - ang) + ang); //sine distribution
+                    if (isbiased) { // biased launch: uniform within the cone toward a randomly picked target detector
+                        float4 axis = mcx_bias_axis(*((float4*)p), gproperty[gcfg->constmedia + gcfg->biasdet[mcx_bias_pickdet(rand_uniform01(t), gcfg->biasdetnum)]],
+                                                    launchsrc->dir);
+                        *((float4*)v) = float4(axis.x, axis.y, axis.z, v->nscat);
+                        ctheta = mcx_bias_conecos(rand_uniform01(t), gcfg->biascos);
+                        stheta = sqrtf(fmaxf(1.f - ctheta * ctheta, 0.f));
                     } else {
-                        if (gcfg->srctype == MCX_SRC_ISOTROPIC) { // uniform sphere
-                            ang = acosf(2.f * rand_uniform01(t) - 1.f);    //sine distribution
+                        if (gcfg->srctype == MCX_SRC_CONE) { // a solid-angle section of a uniform sphere
+                            ang = cosf(launchsrc->param1.x);
+                            ang = (launchsrc->param1.y > 0.f) ? rand_uniform01(t) * launchsrc->param1.x : acos(rand_uniform01(t) * (1.0 - ang) + ang); //sine distribution
                         } else {
-                            ang = ONE_PI * rand_uniform01(t);    //uniform distribution in zenith angle, arcsine
+                            if (gcfg->srctype == MCX_SRC_ISOTROPIC) { // uniform sphere
+                                ang = acosf(2.f * rand_uniform01(t) - 1.f);    //sine distribution
+                            } else {
+                                ang = ONE_PI * rand_uniform01(t);    //uniform distribution in zenith angle, arcsine
+                            }
                         }
+
+                        sincosf(ang, &stheta, &ctheta);
                     }
 
-                    sincosf(ang, &stheta, &ctheta);
                     rotatevector(v, stheta, ctheta, sphi, cphi);
+
+                    if (gcfg->biasprob > 0.f) {
+                        p->w *= launchbiasweight(v, p, launchsrc->dir);
+                    }
+
                     canfocus = 0;
                     break;
                 }
@@ -1471,7 +1693,7 @@ __device__ inline int launchnewphoton(MCXpos* p, MCXdir* v, Stokes* s, MCXtime*
                     if (p->x < 0.f || p->y < 0.f || p->z < 0.f || p->x >= gcfg->maxidx.x || p->y >= gcfg->maxidx.y || p->z >= gcfg->maxidx.z) {
                         *mediaid = 0;
                     } else {
-                        *mediaid = media[*idx1d];
+                        *mediaid = getmediaid(media, *idx1d);
                     }
 
                     canfocus = 0;
@@ -1603,7 +1825,7 @@ __device__ inline int launchnewphoton(MCXpos* p, MCXdir* v, Stokes* s, MCXtime*
 
             if (idx >= 0) {
                 *idx1d = idx;
-                *mediaid = media[*idx1d];
+                *mediaid = getmediaid(media, *idx1d);
             }
         }
 
@@ -1647,7 +1869,7 @@ __device__ inline int launchnewphoton(MCXpos* p, MCXdir* v, Stokes* s, MCXtime*
     ppath[2] = ((gcfg->srcnum > 1) ? ppath[2] : p->w); // store initial weight
     v->nscat = EPS;
 
-    if (gcfg->outputtype == otRF) { // if run RF replay
+    if (gcfg->outputtype == otRF && gcfg->seed == SEED_FROM_FILE) { // if run RF replay
         f->pathlen = photontof[(threadid * gcfg->threadphoton + min(threadid, gcfg->oddphotons - 1) + (int)f->ndone)];
         sincosf(gcfg->omega * f->pathlen, ppath + 5 + gcfg->srcnum, ppath + 4 + gcfg->srcnum);
     }
@@ -2023,7 +2245,7 @@ __global__ void mcx_main_loop(uint media[], OutputType field[], float genergy[],
         n1 = prop.n;
 
         if (islabel) {
-            *((float4*)(&prop)) = gproperty[mediaid & MED_MASK];
+            *((float4*)(&prop)) = getproperty(mediaid & MED_MASK);
         } else if (issvmc) {
             if (!nuvox.sv.issplit) {
                 updateproperty<islabel, issvmc>(&prop, mediaid, t, idx1d, media, (float3*)&p, &nuvox, flipdir);
@@ -2056,7 +2278,13 @@ __global__ void mcx_main_loop(uint media[], OutputType field[], float genergy[],
         }
 
         /** if photon moves to the next voxel, use the precomputed intersection coord */
-        *((float3*)(&p)) = float3(p.x + len * v.x, p.y + len * v.y, p.z + len * v.z);
+        if (gcfg->gridscale) {
+            /** on a non-uniform grid, the physical displacement is converted to voxel indices by the edge lengths of the current voxel */
+            float3 scale = voxelscale(flipdir);
+            *((float3*)(&p)) = float3(p.x + __fdividef(len * v.x, scale.x), p.y + __fdividef(len * v.y, scale.y), p.z + __fdividef(len * v.z, scale.z));
+        } else {
+            *((float3*)(&p)) = float3(p.x + len * v.x, p.y + len * v.y, p.z + len * v.z);
+        }
 
         /** although the below 3 lines look dumb, if you change it to flipdir[flipdir[3]] += ..., the speed drops by half, likely due to step locking */
         if (flipdir[3] == 0) {
@@ -2118,7 +2346,7 @@ __global__ void mcx_main_loop(uint media[], OutputType field[], float genergy[],
             GPUDEBUG(("moving outside: [%f %f %f], idx1d [%d]->[out], bcflag %d\n", p.x, p.y, p.z, idx1d, isdet));
         } else {
             /** otherwise, read the optical property index */
-            mediaid = media[idx1d];
+            mediaid = getmediaid(media, idx1d);
             isdet = mediaid & DET_MASK; /** upper 16bit is the mask of the covered detector */
             mediaid &= MED_MASK;       /** lower 16bit is the medium index */
         }
@@ -2128,19 +2356,19 @@ __global__ void mcx_main_loop(uint media[], OutputType field[], float genergy[],
         /**  save fluence to the voxel when photon moves out */
         if ((idx1d != idx1dold || (issvmc && hitintf)) && mediaidold) {
 
-            /**  if t is within the time window, which spans cfg->maxgate*cfg->tstep.wide */
-            if (gcfg->save2pt && f.t >= gcfg->twin0 && f.t < gcfg->twin1) {
+            /**  if t is within the time window, which spans cfg->maxgate*cfg->tstep.wide, and the voxel is within the tallied region */
+            if (gcfg->save2pt && f.t >= gcfg->twin0 && f.t < gcfg->twin1 && (!gcfg->isroi || intallyregion(idx1dold))) {
 #ifdef USE_MORE_DOUBLE
                 OutputType weight = ZERO;
 #else
                 float weight = 0.f;
 #endif
-                int tshift = (int)(floorf((f.t - gcfg->twin0) * gcfg->Rtstep));
+                int tshift = (gcfg->rfomega) ? 0 : (int)(floorf((f.t - gcfg->twin0) * gcfg->Rtstep));
 
                 /** calculate the quality to be accummulated */
                 if (gcfg->outputtype == otEnergy) {
                     weight = w0 - p.w;
-                } else if (gcfg->outputtype == otFluence || gcfg->outputtype == otFlux) {
+                } else if (gcfg->outputtype == otFluence || gcfg->outputtype == otFlux || gcfg->rfomega) {
                     weight = (prop.mua < 0.001f) ? (w0 * len) : __fdividef(w0 - p.w, prop.mua);   /** when mua->0, take limit_{mua->0} w0*(1-exp(-mua*len))/mua yields w0*len */
                 } else if (gcfg->seed == SEED_FROM_FILE) {
                     if (gcfg->outputtype == otJacobian || gcfg->outputtype == otRF) {
@@ -2164,7 +2392,30 @@ __global__ void mcx_main_loop(uint media[], OutputType field[], float genergy[],
 
                 GPUDEBUG(("deposit to [%d] %e, w=%f\n", idx1dold, weight, p.w));
 
-                if (fabsf(weight) > 0.f || gcfg->outputtype == otRF) {
+                if (gcfg->rfomega) {
+                    /** forward FD output: frame k accumulates w*cos(omega_k*t), the shadow buffer holds w*sin(omega_k*t) */
+                    for (uint k = 0; k < gcfg->rffreqnum; k++) {
+                        float cosphase, sinphase;
+                        uint fieldid = idx1dold + (tshift + k) * gcfg->dimlen.z;
+
+                        sincosf(gcfg->rfomega[k] * f.t, &sinphase, &cosphase);
+#ifdef USE_ATOMIC
+
+                        if (gcfg->isatomic) {
+                            atomicadd(& field[fieldid], weight * cosphase);
+#if SHADOWCOUNT == 2
+                            atomicadd(& field[fieldid + gcfg->dimlen.w], weight * sinphase);
+#endif
+                        } else
+#endif
+                        {
+                            field[fieldid] += weight * cosphase;
+#if SHADOWCOUNT == 2
+                            field[fieldid + gcfg->dimlen.w] += weight * sinphase;
+#endif
+                        }
+                    }
+                } else if (fabsf(weight) > 0.f || gcfg->outputtype == otRF) {
 #ifdef USE_ATOMIC
 
                     if (!gcfg->isatomic) {
@@ -2262,7 +2513,7 @@ __global__ void mcx_main_loop(uint media[], OutputType field[], float genergy[],
 
                 if ((ushort)flipdir[0] < gcfg->maxidx.x && (ushort)flipdir[1] < gcfg->maxidx.y && (ushort)flipdir[2] < gcfg->maxidx.z) {
                     idx1d = (flipdir[2] * gcfg->dimlen.y + flipdir[1] * gcfg->dimlen.x + flipdir[0]);
-                    mediaid = media[idx1d];
+                    mediaid = getmediaid(media, idx1d);
                     isdet = mediaid & DET_MASK; /** upper 16bit is the mask of the covered detector */
                     mediaid &= MED_MASK;       /** lower 16bit is the medium index */
                     GPUDEBUG(("Cyclic boundary condition, moving photon in dir %d at %d flag, new pos=[%f %f %f] [%d %d %d]\n", flipdir[3], isdet, p.x, p.y, p.z, flipdir[0], flipdir[1], flipdir[2]));
@@ -2320,7 +2571,7 @@ __global__ void mcx_main_loop(uint media[], OutputType field[], float genergy[],
             }
 
             if (issvmc && hitintf) {
-                if (gproperty[nuvox.sv.lower].w != gproperty[nuvox.sv.upper].w) {
+                if (getproperty(nuvox.sv.lower).w != getproperty(nuvox.sv.upper).w) {
                     nuvox.nv = -nuvox.nv; // flip normal vector back for reflection/refraction computation
 
                     if (reflectray(n1, (float3*) & (v), &rv, &nuvox, &prop, t)) { // true if photon transmits to background media
@@ -2336,14 +2587,14 @@ __global__ void mcx_main_loop(uint media[], OutputType field[], float genergy[],
                         continue;
                     }
                 } else {
-                    *((float4*)(&prop)) = gproperty[nuvox.sv.isupper ? nuvox.sv.upper : nuvox.sv.lower];
+                    *((float4*)(&prop)) = getproperty(nuvox.sv.isupper ? nuvox.sv.upper : nuvox.sv.lower);
                 }
             } else {
                 if (((mediaid && gcfg->doreflect) // if at an internal boundary, check cfg.isreflect flag
                         || (mediaid == 0 &&  // or if out of bbx or enters 0-voxel
                             (((isdet & 0xF) == bcUnknown && gcfg->doreflect) // if cfg.bc is "_", check cfg.isreflect
                              || (((isdet & 0xF) == bcReflect || (isdet & 0xF) == bcMirror)))))  // or if cfg.bc is 'r' or 'm'
-                        && (((isdet & 0xF) == bcMirror) || n1 != ((gcfg->mediaformat < 100) ? (prop.n) : (gproperty[(mediaid > 0 && gcfg->mediaformat >= 100) ? 1 : mediaid].w)))) {
+                        && (((isdet & 0xF) == bcMirror) || n1 != ((gcfg->mediaformat < 100) ? (prop.n) : (getproperty((mediaid > 0 && gcfg->mediaformat >= 100) ? 1 : mediaid).w)))) {
                     float Rtotal = 1.f;
                     float cphi, sphi, stheta, ctheta, tmp0, tmp1;
 
@@ -2415,7 +2666,7 @@ __global__ void mcx_main_loop(uint media[], OutputType field[], float genergy[],
                         (flipdir[3] == 0) ? (flipdir[0] = floorf(p.x)) : ((flipdir[3] == 1) ? (flipdir[1] = floorf(p.y)) : (flipdir[2] = floorf(p.z))) ;
                         GPUDEBUG(("ref p_new=[%f %f %f] v_new=[%f %f %f]\n", p.x, p.y, p.z, v.x, v.y, v.z));
                         idx1d = idx1dold;
-                        mediaid = (media[idx1d] & MED_MASK);
+                        mediaid = (getmediaid(media, idx1d) & MED_MASK);
                         updateproperty<islabel, issvmc>(&prop, mediaid, t, idx1d, media, (float3*)&p, &nuvox, flipdir); //< optical property across the interface
 
                         if (issvmc && (nuvox.sv.isupper ? nuvox.sv.upper : nuvox.sv.lower) == 0) { // terminate photon if photon is reflected to background medium
@@ -2439,7 +2690,7 @@ __global__ void mcx_main_loop(uint media[], OutputType field[], float genergy[],
             }
         } else {
             if (issvmc) {
-                *((float4*)(&prop)) = gproperty[nuvox.sv.isupper ? nuvox.sv.upper : nuvox.sv.lower];
+                *((float4*)(&prop)) = getproperty(nuvox.sv.isupper ? nuvox.sv.upper : nuvox.sv.lower);
             }
         }
 
@@ -2651,181 +2902,999 @@ int mcx_list_gpu(Config* cfg, GPUInfo** info) {
 #endif
 }
 
+/**
+ * Pinned host buffers of each device, owned by the host thread driving that device
+ */
+
+static HostPool hostpool[MAX_DEVICE];
 
 /**
- * @brief Master host code for the MCX simulation kernel (!!!Important!!!)
+ * @brief Return a pinned host buffer of at least the requested size from the pool of a device
  *
- * This function is the master host code for the MCX kernel. It is responsible
- * for initializing all GPU variables, copy data from host to GPU, launch the
- * kernel for simulation, wait for competion, and retrieve the results.
+ * A slot is only reallocated when a larger buffer is requested, so the same buffer
+ * serves all respins and time-gate groups of a run, and later runs in the same process
+ * if the device is not reset in between (server mode, pmcx).
  *
- * @param[in,out] cfg: the simulation configuration structure
- * @param[in] gpu: the GPU information structure
+ * @param[in] gpuid: the index of the device
+ * @param[in] slot: the buffer slot, one of TPoolSlot
+ * @param[in] bytes: the requested buffer length in bytes
+ * @return the pinned buffer, valid until the pool is released
  */
 
-void mcx_run_simulation(Config* cfg, GPUInfo* gpu) {
+static void* mcx_hostpool_get(int gpuid, int slot, size_t bytes) {
+    HostPool* pool = hostpool + gpuid;
 
-    int i, iter;
-    float  minstep = 1.f; //MIN(MIN(cfg->steps.x,cfg->steps.y),cfg->steps.z);
+    if (pool->len[slot] < bytes) {
+        size_t total = 0;
 
-    /** \c p0 - initial photon positions for pencil/isotropic/cone beams, used to initialize \c{p={x,y,z,w}} state in the GPU kernel */
-    float4 p0 = cfg->srcpos;
+        if (pool->buf[slot]) {
+            CUDA_ASSERT(cudaFreeHost(pool->buf[slot]));
+        }
 
-    /** \c c0 - initial photon direction state, used to initialize \c{MCXdir v={vx,vy,vz,}} state in the GPU kernel */
-    float4 c0 = cfg->srcdir;
+        CUDA_ASSERT(cudaHostAlloc(&pool->buf[slot], bytes, cudaHostAllocPortable));
+        pool->len[slot] = bytes;
 
-    /** \c stokesvec - initial photon polarization state, described by Stokes Vector */
-    float4 s0 = (float4)cfg->srciquv;
+        for (int i = 0; i < psSlotNum; i++) {
+            total += pool->len[i];
+        }
 
-    float3 maxidx = float3(cfg->dim.x, cfg->dim.y, cfg->dim.z);
-    int timegate = 0, totalgates, gpuid, threadid = 0;
+        pool->peak = MAX(pool->peak, total);
+    }
 
-    /** \c gpuphoton - number of photons to be simulated per thread, determined by total workload and thread number */
-    size_t gpuphoton = 0;
+    return pool->buf[slot];
+}
 
-    /** \c photoncount - number of completed photons returned by all thread, output */
-    size_t photoncount = 0;
+/**
+ * @brief Free all pinned host buffers of a device, must be called before the device is reset
+ *
+ * @param[in] gpuid: the index of the device
+ */
 
-    unsigned int printnum;
-    unsigned int tic, tic0, tic1, toc = 0, debuglen = MCX_DEBUG_REC_LEN + (cfg->istrajstokes << 2);
-    size_t fieldlen;
-    uint3 cp0 = cfg->crop0, cp1 = cfg->crop1;
-    uint2 cachebox;
-    uint4 dimlen;
-    float Vvox, fullload = 0.f;
+static void mcx_hostpool_release(int gpuid) {
+    HostPool* pool = hostpool + gpuid;
 
-    /** \c mcgrid - GPU grid size, only use 1D grid, used when launching the kernel in cuda <<<>>> operator */
-    dim3 mcgrid;
+    for (int i = 0; i < psSlotNum; i++) {
+        if (pool->buf[i]) {
+            CUDA_ASSERT(cudaFreeHost(pool->buf[i]));
+        }
 
-    /** \c mcblock - GPU block size, only use 1D block, used when launching the kernel in cuda <<<>>> operator */
-    dim3 mcblock;
+        pool->buf[i] = NULL;
+        pool->len[i] = 0;
+    }
+}
 
-    /** \c sharedbuf - shared memory buffer length to be requested, used when launching the kernel in cuda <<<>>> operator */
-    uint sharedbuf = 0;
+/**
+ * @brief Return a device to a clean state after a simulation is interrupted by an error
+ *
+ * In the server mode, a run interrupted by an error frees its host buffers and returns
+ * the error code without reaching the cleanup of its device buffers; the pinned host
+ * buffers are dropped and the device is reset to free all its allocations before the next job. CUDA
+ * errors are ignored here as the device may already be reset by mcx_cu_assess.
+ *
+ * @param[in] gpuid: the index of the device, starting from 0
+ */
 
-    /** \c dimxyz - output volume variable \c field voxel count, Nx*Ny*Nz*Ns where Ns=cfg.srcnum is the pattern number for photon sharing */
-    int dimxyz = cfg->dim.x * cfg->dim.y * cfg->dim.z * ((cfg->srctype == MCX_SRC_PATTERN || cfg->srctype == MCX_SRC_PATTERN3D) ? cfg->srcnum : (cfg->srcid == -1) ? (cfg->extrasrclen + 1) : 1);
+void mcx_reset_device(int gpuid) {
+    HostPool* pool = hostpool + gpuid;
 
-    /** \c media - input volume representing the simulation domain, format specified in cfg.mediaformat, read-only */
-    uint*  media = (uint*)(cfg->vol);
+    for (int i = 0; i < psSlotNum; i++) {
+        if (pool->buf[i]) {
+            cudaFreeHost(pool->buf[i]);
+        }
 
-    /** \c field - output volume to store GPU computed fluence, length is \c dimxyz */
-    float*  field;
+        pool->buf[i] = NULL;
+        pool->len[i] = 0;
+    }
 
-    /** \c rfimag - imaginary part of the RF Jacobian, length is \c dimxyz */
-    OutputType*  rfimag = NULL;
+    if (cudaSetDevice(gpuid) == cudaSuccess) {
+        cudaDeviceReset();
+    }
 
-    /** \c Ppos - per-thread photon state initialization host buffers */
-    float4* Ppos, *Pdir, *Plen, *Plen0;
+    cudaGetLastError();
+}
 
-    /** \c Pseed - per-thread RNG seed initialization host buffers */
-    uint*   Pseed;
+/**
+ * @brief Number of records a host output buffer holds after storing \c count records
+ *
+ * The detected photon and seed buffers start with \c base records, as allocated by
+ * mcx, mcxlab and pmcx, and double when full, so appending the records of each respin
+ * and device rarely calls realloc.
+ *
+ * @param[in] count: the number of stored records
+ * @param[in] base: the initial capacity in records
+ * @return the capacity of the buffer in records
+ */
 
-    /** \c Pdet - output host buffer to store detected photon partial-path and other per-photon data */
-    float*  Pdet;
+static size_t mcx_bufcapacity(size_t count, size_t base) {
+    size_t capacity = MAX(base, 1);
 
-    /** \c energy - output host buffers to accummulate total launched/absorbed energy per thread, needed for normalization */
-    float*  energy;
+    while (capacity < count) {
+        capacity <<= 1;
+    }
 
-    /** \c srcpw, \c energytot, \c energyabs - output host buffers to accummulate total launched/absorbed energy per pattern in photon sharing, needed for normalization of multi-pattern simulations */
-    float*  srcpw = NULL, *energytot = NULL, *energyabs = NULL; // for multi-srcpattern
+    return capacity;
+}
 
-    /** \c seeddata - output buffer to store RNG initial seeds for each detected photon for replay */
-    RandType* seeddata = NULL;
+/**
+ * @brief Convert the half-precision detected photon records to single precision for mcxlab and pmcx
+ *
+ * The compact records are written to files as they are; the bindings, which read the
+ * records with the single-precision layout, receive the expanded records.
+ *
+ * @param[in,out] cfg: simulation configuration, cfg->exportdetected is replaced by the expanded records
+ * @param[in] fulllen: the number of floats per record in the single-precision layout
+ */
 
-    /** \c detected - total number of detected photons, output */
-    uint    detected = 0;
+static void mcx_export_halfdet(Config* cfg, unsigned int fulllen) {
+    if (!cfg->his.ishalf || cfg->parentid == mpStandalone || cfg->exportdetected == NULL || cfg->detectedcount == 0) {
+        return;
+    }
 
-    /** \c progress - pinned-memory variable as the progress bar during simulation, updated in GPU and visible from host */
-    volatile int* progress;
+    cfg->exportdetected = mcx_detfilter_expand(cfg->exportdetected, cfg->detectedcount, cfg->savedetflag, cfg->medianum - 1, fulllen);
+    cfg->his.colcount = fulllen;
+    cfg->his.ishalf = 0;
 
-#ifdef _WIN32
-    /** \c updateprogress - CUDA event needed to avoid hanging on Windows, see https://forums.developer.nvidia.com/t/solved-how-to-update-host-memory-variable-from-device-during-opencl-kernel-execution/59409/5 */
-    cudaEvent_t updateprogress = NULL;
-#endif
+    if (cfg->exportdetected == NULL) {
+        mcx_error(-1, "can not allocate memory for the detected photon data", __FILE__, __LINE__);
+    }
+}
 
-    /** all pointers start with g___ are the corresponding GPU buffers to read/write host variables defined above */
-    uint* gmedia;
-    float4* gPpos, *gPdir, *gPlen, *gsmatrix = NULL;
-    uint*   gPseed, *gdetected;
-    int*    greplaydetid = NULL;
-    float*  gPdet, *gsrcpattern = NULL, *genergy, *greplayw = NULL, *greplaytof = NULL, *gdebugdata = NULL, *ginvcdf = NULL, *gangleinvcdf = NULL;
-    OutputType* gfield;
-    RandType* gseeddata = NULL;
-    volatile int* gprogress;
+/**
+ * @brief Compute the DCS g1 curves of all detectors from the detected photon records
+ *
+ * @param[in,out] cfg: simulation configuration, cfg->exportg1 receives cfg->detnum x cfg->dcsntau values
+ */
 
-    /**
-     *                            |----------------------------------------------->  hostdetreclen  <--------------------------------------|
-     *                                      |------------------------>    partialdata   <-------------------|
-     *host detected photon buffer: detid (1), partial_scat (#media), partial_path (#media), momontum (#media), p_exit (3), v_exit(3), w0 (1)
-     *                                      |--------------------------------------------->    w0offset   <-----------------------------------------------||<----- w0 (#srcnum) ----->||<- RF replay (2)->|
-     *gpu detected photon buffer:            partial_scat (#media), partial_path (#media), momontum (#media), E_escape (1), E_launch (1), w0 (1), srcid(1), w0_photonsharing (#srcnum)   cos(w*T),sin(w*T)
-     */
+static void mcx_export_dcs(Config* cfg) {
+    if (cfg->dcsmodel == MCX_DCS_NONE || cfg->exportdetected == NULL) {
+        return;
+    }
 
-    //< \c partialdata: per-photon buffer length for media-specific data, copy from GPU to host
-    unsigned int partialdata = (cfg->medianum - 1) * (SAVE_NSCAT(cfg->savedetflag) + SAVE_PPATH(cfg->savedetflag) + SAVE_MOM(cfg->savedetflag));
+    if (cfg->exportg1) {
+        free(cfg->exportg1);
+    }
 
-    //< \c w0offset - offset in the per-photon buffer to the start of the photon sharing related data
-    unsigned int w0offset = partialdata + 4;  //< the extra 4 numbers are total-escaped-energy, total-launched-energy, initial-weight, source_id
+    cfg->exportg1 = (float*)calloc((size_t)cfg->detnum * cfg->dcsntau, sizeof(float));
 
-    //< \c hostdetreclen - host-side det photon data buffer per-photon length
-    unsigned int hostdetreclen = partialdata + SAVE_DETID(cfg->savedetflag) + 3 * (SAVE_PEXIT(cfg->savedetflag) + SAVE_VEXIT(cfg->savedetflag)) + SAVE_W0(cfg->savedetflag) + 4 * SAVE_IQUV(cfg->savedetflag);
+    if (cfg->exportg1 == NULL || mcx_dcs_g1(cfg->exportdetected, cfg->detectedcount, cfg, cfg->exportg1)) {
+        mcx_error(-1, "can not compute the DCS g1 from the detected photon data", __FILE__, __LINE__);
+    }
 
-    //< \c is2d - flag to tell mcx if the simulation domain is 2D, set to 1 if any of the x/y/z dimensions has a length of 1
-    unsigned int is2d = (cfg->dim.x == 1 ? 1 : (cfg->dim.y == 1 ? 2 : (cfg->dim.z == 1 ? 3 : 0)));
+    MCX_FPRINTF(cfg->flog, "DCS g1 computed from " S_BOLD "" S_BLUE "%lu detected photons" S_RESET " at %u correlation times\n", cfg->detectedcount, cfg->dcsntau);
+}
 
-    /** \c param - constants to be used in the GPU, copied to GPU as \c gcfg, stored in the constant memory */
-    MCXParam param = {cfg->steps, minstep, 0, 0, cfg->tend, R_C0* cfg->unitinmm,
-                      (uint)cfg->issave2pt, (uint)cfg->isreflect, (uint)cfg->isrefint, (uint)cfg->issavedet, 1.f / cfg->tstep,
-                      p0, c0, cfg->srcparam1, cfg->srcparam2, cfg->extrasrclen, cfg->srcid, s0, maxidx, uint4(0, 0, 0, 0),
-                      cp0, cp1, uint2(0, 0), cfg->minenergy, cfg->sradius* cfg->sradius, minstep* R_C0* cfg->unitinmm, cfg->srctype,
-                      cfg->voidtime, cfg->maxdetphoton,
-                      cfg->medianum - 1, cfg->detnum, cfg->polmedianum, cfg->maxgate, ABS(cfg->sradius + 2.f) < EPS /*isatomic*/,
-                      (uint)cfg->maxvoidstep, cfg->issaveseed > 0, (uint)cfg->issaveref, cfg->isspecular > 0, (uint)cfg->istrajstokes,
-                      cfg->maxdetphoton * hostdetreclen, cfg->seed, (uint)cfg->outputtype, 0, 0, cfg->faststep,
-                      cfg->debuglevel, cfg->savedetflag, hostdetreclen, partialdata, w0offset, cfg->mediabyte,
-                      (uint)cfg->maxjumpdebug, cfg->gscatter, is2d, cfg->replaydet, cfg->srcnum,
-                      cfg->nphase, cfg->nphase + (cfg->nphase & 0x1), cfg->nangle, cfg->nangle + (cfg->nangle & 0x1), cfg->omega
-                     };
 
-    if (param.isatomic) {
-        param.skipradius2 = 0.f;
-    }
+#ifndef MCX_CONTAINER
 
-    /** Start multiple CPU threads using OpenMP, one thread for each GPU device to run simultaneously, \c threadid returns the current thread ID */
-#ifdef _OPENMP
-    threadid = omp_get_thread_num();
-#endif
+/**
+ * @brief Save the volumetric, detected photon and trajectory outputs to files
+ *
+ * Volumetric data are saved with suffix specifed by cfg.outputformat (mc2,nii,
+ * or .jdat or .jbat); detected photon and trajectory data are saved as .mch/.mct
+ * files, or .jdat/.jbat files. Outputs are only saved when mcx runs standalone,
+ * in MATLAB and Python, they are returned from the cfg->export* buffers. If the
+ * volume was cropped by mcx_preprocess (cfg->fulldim), the volumetric outputs are
+ * saved on the input grid.
+ *
+ * @param[in,out] cfg: the simulation configuration structure, holding the outputs
+ * @param[in] fieldlen: the length of the volumetric output buffer cfg->exportfield
+ * @param[in] debuglen: the number of floats per trajectory record
+ * @param[in] tic: the starting time stamp of the simulation in ms
+ */
 
-    if (threadid < MAX_DEVICE && cfg->deviceid[threadid] == '\0') {
+static void mcx_save_outputs(Config* cfg, size_t fieldlen, unsigned int debuglen, unsigned int tic) {
+    if (cfg->isnested) {
         return;
     }
 
-    /** Use \c threadid and cfg.deviceid, the compressed list of active GPU devices, to get the desired GPU ID for this thread */
-    gpuid = cfg->deviceid[threadid] - 1;
+    if (cfg->issave2pt && cfg->parentid == mpStandalone) {
+        float* field = cfg->exportfield;
+        uint3 dim = cfg->dim;
 
-    if (gpuid < 0) {
-        mcx_error(-1, "GPU ID must be non-zero", __FILE__, __LINE__);
-    }
+        if (cfg->fulldim.x) {
+            unsigned int cropdim[3] = {dim.x, dim.y, dim.z}, offset[3] = {cfg->compactoffset.x, cfg->compactoffset.y, cfg->compactoffset.z};
+            unsigned int fulldim[3] = {cfg->fulldim.x, cfg->fulldim.y, cfg->fulldim.z};
+            size_t cropxyz = (size_t)dim.x * dim.y * dim.z;
 
-    /** Activate the corresponding GPU device */
-    CUDA_ASSERT(cudaSetDevice(gpuid));
+            field = mcx_compact_expand(cfg->exportfield, cropdim, offset, fulldim, fieldlen * (1 + (cfg->outputtype == otRF)) / (cropxyz * cfg->srcnum), cfg->srcnum);
 
-    /** Use the specified GPU's parameters, stored in gpu[gpuid] to determine the maximum time gates that it can hold */
-    if (gpu[gpuid].maxgate == 0 && dimxyz > 0) {
-        int needmem = dimxyz + cfg->nthread * sizeof(float4) * 4 + sizeof(float) * cfg->maxdetphoton * hostdetreclen + 10 * 1024 * 1024; /*keep 10M for other things*/
+            if (field == NULL) {
+                mcx_error(-1, "can not allocate memory for the volumetric output on the input grid", __FILE__, __LINE__);
+            }
+
+            fieldlen = fieldlen / cropxyz * ((size_t)fulldim[0] * fulldim[1] * fulldim[2]);
+            cfg->dim = cfg->fulldim;
+        }
+
+        MCX_FPRINTF(cfg->flog, "saving data to file ...\t");
+        mcx_savedata(field, fieldlen, cfg);
+
+        if (field != cfg->exportfield) {
+            free(field);
+            cfg->dim = dim;
+        }
+
+        MCX_FPRINTF(cfg->flog, "saving data complete : %d ms\n\n", GetTimeMillis() - tic);
+        fflush(cfg->flog);
+    }
+
+    if (cfg->issavedet && cfg->parentid == mpStandalone && cfg->exportdetected) {
+        cfg->his.unitinmm = cfg->unitinmm;
+        cfg->his.savedphoton = cfg->detectedcount;
+        cfg->his.totalphoton = cfg->nphoton;
+
+        if (cfg->issaveseed) {
+            cfg->his.seedbyte = sizeof(RandType) * RAND_BUF_LEN;
+        }
+
+        cfg->his.detected = cfg->detectedcount;
+        mcx_savedetphoton(cfg->exportdetected, cfg->seeddata, cfg->detectedcount, 0, cfg);
+    }
+
+    if (cfg->exportg1 && cfg->parentid == mpStandalone) {
+        mcx_savedcs(cfg);
+    }
+
+    if ((cfg->debuglevel & (MCX_DEBUG_MOVE | MCX_DEBUG_MOVE_ONLY)) && cfg->parentid == mpStandalone && cfg->exportdebugdata) {
+        cfg->his.colcount = debuglen;
+        cfg->his.ishalf = 0;
+        cfg->his.savedphoton = cfg->debugdatalen;
+        cfg->his.totalphoton = cfg->nphoton;
+        cfg->his.detected = 0;
+        mcx_savedetphoton(cfg->exportdebugdata, NULL, cfg->debugdatalen, 0, cfg);
+    }
+}
+
+#endif
+
+/**
+ * @brief Pack a label volume at 4 or 8 bits per voxel for the GPU
+ *
+ * Each 32-bit word stores 8 (4-bit) or 4 (8-bit) consecutive labels, starting
+ * from the lowest bits. If any voxel carries the detector flag (DET_MASK), a
+ * 1-bit-per-voxel detector mask is appended after the packed labels.
+ *
+ * @param[in] cfg: the simulation configuration structure, cfg->mediabits is 4 or 8
+ * @param[out] len: the length of the packed buffer in 32-bit words
+ * @param[out] maskoffset: the word offset of the detector mask, 0 if no voxel is flagged
+ * @return the packed buffer, must be freed by the caller
+ */
+
+static uint* mcx_packmedia(Config* cfg, size_t* len, uint* maskoffset) {
+    size_t i, dimxyz = (size_t)cfg->dim.x * cfg->dim.y * cfg->dim.z;
+    uint perword = 32 / cfg->mediabits;
+    size_t labellen = (dimxyz + perword - 1) / perword, masklen = (dimxyz + 31) >> 5;
+    uint* packed = (uint*)calloc(labellen + masklen, sizeof(uint));
+    int isdet = 0;
+
+    for (i = 0; i < dimxyz; i++) {
+        packed[i / perword] |= (cfg->vol[i] & MED_MASK) << ((i % perword) * cfg->mediabits);
+
+        if (cfg->vol[i] & DET_MASK) {
+            packed[labellen + (i >> 5)] |= 1u << (i & 31);
+            isdet = 1;
+        }
+    }
+
+    *maskoffset = isdet ? labellen : 0;
+    *len = labellen + (isdet ? masklen : 0);
+    return packed;
+}
+
+/**
+ * @brief Return the kernel variant of a simulation
+ *
+ * Determine template constants for compilers to build specialized binary instances to reduce branching
+ * and thread-divergence. If not using template, the performance can take a 20% drop. The variant is
+ * the decimal code ispencil*10000+isref*1000+islabel*100+issvmc*10+ispolarized of the template constants.
+ *
+ * @param[in] cfg: the simulation configuration structure
+ */
+
+static int mcx_kernel_variant(Config* cfg) {
+    int i;
+
+    /** \c ispencil: template constant, if 1, launch photon code is dramatically simplified */
+    int ispencil = (cfg->srctype == MCX_SRC_PENCIL && cfg->nangle == 0);
+
+    /** \c isref: template constant, if 1, perform boundary reflection, if 0, total-absorbion boundary, can simplify kernel */
+    int isref = cfg->isreflect;
+
+    /** \c issvmc: template constant, if 1, consider the input volume containing split-voxel data, see Yan2020 for details */
+    int issvmc = (cfg->mediabyte == MEDIA_2LABEL_SPLIT);
+
+    /** \c ispolarized: template constant, if 1, perform polarized light simulations, currently only supports label-based media */
+    int ispolarized = (cfg->mediabyte <= 4) && (cfg->polmedianum > 0);
+
+    /** Enable reflection flag when c or m flags are used in the cfg.bc boundary condition flags */
+    for (i = 0; i < 6; i++)
+        if (cfg->bc[i] == bcReflect || cfg->bc[i] == bcMirror) {
+            isref = 1;
+        }
+
+    return ispencil * 10000 + (isref > 0) * 1000 + (cfg->mediabyte <= 4) * 100 + issvmc * 10 + ispolarized;
+}
+
+/**
+ * @brief Query the register, shared memory and block size limits of a kernel variant
+ *
+ * @param[in] variant: the kernel variant returned by mcx_kernel_variant
+ * @param[out] attr: the attributes of the compiled kernel
+ */
+
+static cudaError_t mcx_kernel_attributes(int variant, cudaFuncAttributes* attr) {
+    switch (variant) {
+        case 0:
+            return cudaFuncGetAttributes(attr, mcx_main_loop<0, 0, 0, 0, 0>);
+
+        case 10:
+            return cudaFuncGetAttributes(attr, mcx_main_loop<0, 0, 0, 1, 0>);
+
+        case 100:
+            return cudaFuncGetAttributes(attr, mcx_main_loop<0, 0, 1, 0, 0>);
+
+        case 101:
+            return cudaFuncGetAttributes(attr, mcx_main_loop<0, 0, 1, 0, 1>);
+
+        case 1000:
+            return cudaFuncGetAttributes(attr, mcx_main_loop<0, 1, 0, 0, 0>);
+
+        case 1010:
+            return cudaFuncGetAttributes(attr, mcx_main_loop<0, 1, 0, 1, 0>);
+
+        case 1100:
+            return cudaFuncGetAttributes(attr, mcx_main_loop<0, 1, 1, 0, 0>);
+
+        case 1101:
+            return cudaFuncGetAttributes(attr, mcx_main_loop<0, 1, 1, 0, 1>);
+
+        case 10000:
+            return cudaFuncGetAttributes(attr, mcx_main_loop<1, 0, 0, 0, 0>);
+
+        case 10010:
+            return cudaFuncGetAttributes(attr, mcx_main_loop<1, 0, 0, 1, 0>);
+
+        case 10100:
+            return cudaFuncGetAttributes(attr, mcx_main_loop<1, 0, 1, 0, 0>);
+
+        case 10101:
+            return cudaFuncGetAttributes(attr, mcx_main_loop<1, 0, 1, 0, 1>);
+
+        case 11000:
+            return cudaFuncGetAttributes(attr, mcx_main_loop<1, 1, 0, 0, 0>);
+
+        case 11010:
+            return cudaFuncGetAttributes(attr, mcx_main_loop<1, 1, 0, 1, 0>);
+
+        case 11100:
+            return cudaFuncGetAttributes(attr, mcx_main_loop<1, 1, 1, 0, 0>);
+
+        case 11101:
+            return cudaFuncGetAttributes(attr, mcx_main_loop<1, 1, 1, 0, 1>);
+
+    }
+
+    return cudaErrorInvalidValue;
+}
+
+/**
+ * Context of the calibration runs of the launch-configuration autotuner
+ */
+
+typedef struct MCXTuneJob {
+    Config* cfg;                   /**< the simulation to be tuned */
+    GPUInfo* gpu;                  /**< the info of all devices */
+    int gpuid;                     /**< index (starting from 0) of the tuned device */
+    int maxblock;                  /**< the largest block size the kernel variant can be launched with */
+    FILE* fnull;                   /**< the null device, receiving the log of the calibration runs */
+} TuneJob;
+
+/**
+ * @brief Time a short single-device run of the simulation with the given launch configuration
+ *
+ * The run uses a shallow copy of the configuration: it shares the preprocessed domain
+ * and source, but allocates (and here frees) its own outputs, saves nothing and keeps
+ * the device context alive.
+ *
+ * @param[in] ctx: the TuneJob structure
+ * @param[in] blocksize: thread number per block
+ * @param[in] threadnum: total thread number
+ * @return the kernel run time in ms, or -1 if the kernel can not be launched with this block size
+ */
+
+static double mcx_tune_timer(void* ctx, int blocksize, int threadnum) {
+    TuneJob* job = (TuneJob*)ctx;
+    Config tunecfg;
+    GPUInfo* tunegpu;
+    int status = 0;
+
+    if (blocksize > job->maxblock) {
+        return -1.0;
+    }
+
+    memcpy(&tunecfg, job->cfg, sizeof(Config));
+    tunecfg.nphoton = MIN(job->cfg->nphoton, MCX_TUNE_PHOTONS);
+    tunecfg.respin = 1;
+    tunecfg.autopilot = 0;
+    tunecfg.nthread = threadnum;
+    tunecfg.nblocksize = blocksize;
+    tunecfg.maxgate = job->gpu[job->gpuid].maxgate;
+    memset(tunecfg.deviceid, 0, MAX_DEVICE);
+    memset(tunecfg.workload, 0, MAX_DEVICE * sizeof(float));
+    tunecfg.deviceid[0] = (char)(job->gpuid + 1);
+    tunecfg.workload[0] = 1.f;
+    tunecfg.isnested = 1;
+    tunecfg.shardnum = 0;
+    tunecfg.cachedir[0] = '\0';
+    tunecfg.pyramid = 0;
+    tunecfg.debuglevel &= ~MCX_DEBUG_PROGRESS;
+    tunecfg.flog = job->fnull;
+    tunecfg.exportfield = NULL;
+    tunecfg.exportdetected = NULL;
+    tunecfg.exportg1 = NULL;
+    tunecfg.dcsmodel = MCX_DCS_NONE;
+    tunecfg.seeddata = NULL;
+    tunecfg.exportdebugdata = NULL;
+    tunecfg.debugdatalen = 0;
+
+    tunegpu = (GPUInfo*)malloc(job->gpu[0].devcount * sizeof(GPUInfo));
+    memcpy(tunegpu, job->gpu, job->gpu[0].devcount * sizeof(GPUInfo));
+
+#ifdef _OPENMP
+    #pragma omp parallel num_threads(1)
+#endif
+    {
+        status = mcx_run_simulation(&tunecfg, tunegpu);
+    }
+
+    free(tunecfg.exportfield);
+    free(tunecfg.exportdetected);
+    free(tunecfg.seeddata);
+    free(tunecfg.exportdebugdata);
+    free(tunegpu);
+
+    /** in the server mode, an error of the calibration run is raised again outside of the nested region to fail the job */
+    if (status) {
+        fclose(job->fnull);
+        mcx_error(status, mcx_serve_message(), __FILE__, __LINE__);
+    }
+
+    return MAX(tunecfg.runtime, 1);
+}
+
+/**
+ * @brief Set the thread and block sizes of a device from the autotune cache, or tune and cache them
+ *
+ * The cache is keyed by the device name, the kernel variant and the media format
+ * (including the packed-label, brick and global-property storage), as these set
+ * the register and memory use of the kernel. Calibration runs are limited to the
+ * block sizes the kernel variant can be launched with.
+ *
+ * @param[in] cfg: the simulation configuration structure
+ * @param[in,out] gpu: the GPU information structure, autoblock and autothread of the device are updated
+ * @param[in] gpuid: index (starting from 0) of the device
+ * @param[in] sharedfixed: dynamic shared memory of each block independent of the block size, in bytes
+ * @param[in] sharedperthread: dynamic shared memory of each thread, in bytes
+ */
+
+static void mcx_autotune(Config* cfg, GPUInfo* gpu, int gpuid, size_t sharedfixed, size_t sharedperthread) {
+    TuneJob job = {cfg, gpu, gpuid, gpu[gpuid].maxmpthread, NULL};
+    TuneResult best;
+    cudaFuncAttributes attr;
+    char tunefile[MAX_PATH_LENGTH] = {'\0'}, key[MAX_PATH_LENGTH] = {'\0'};
+    int found = 0, variant = mcx_kernel_variant(cfg);
+
+    if (cfg->tunefile[0]) {
+        strncpy(tunefile, cfg->tunefile, MAX_PATH_LENGTH - 1);
+    } else {
+        mcx_tune_filename(tunefile, MAX_PATH_LENGTH);
+    }
+
+    snprintf(key, MAX_PATH_LENGTH, "%s|k%05d|m%d%s%s%s", gpu[gpuid].name, variant, cfg->mediabyte,
+             (cfg->mediabits == 4) ? "b4" : ((cfg->mediabits == 8) ? "b8" : ""), cfg->isbrick ? "z" : "", cfg->isglobalprop ? "g" : "");
+
+    if (cfg->autotune == 1) {
+        #pragma omp critical(mcx_tune_cache)
+        {
+            found = mcx_tune_load(tunefile, key, &best);
+        }
+
+        found = found && (best.blocksize <= gpu[gpuid].maxmpthread);
+    }
+
+    if (!found) {
+        if (mcx_kernel_attributes(variant, &attr) == cudaSuccess) {
+            job.maxblock = MIN(job.maxblock, attr.maxThreadsPerBlock);
+
+            if (sharedperthread > 0 && gpu[gpuid].sharedmem > sharedfixed + attr.sharedSizeBytes) {
+                job.maxblock = MIN(job.maxblock, (int)((gpu[gpuid].sharedmem - sharedfixed - attr.sharedSizeBytes) / sharedperthread));
+            }
+        }
+
+        if ((job.fnull = fopen(MCX_TUNE_NULLDEV, "w")) == NULL) {
+            MCX_FPRINTF(cfg->flog, S_RED "WARNING: can not open %s, autotune is skipped\n" S_RESET, MCX_TUNE_NULLDEV);
+            return;
+        }
+
+        MCX_FPRINTF(cfg->flog, "autotuning device %d for %s ...\n", gpuid + 1, key);
+        found = (mcx_tune_search(gpu[gpuid].sm, gpu[gpuid].maxmpthread, (double)MIN(cfg->nphoton, MCX_TUNE_PHOTONS),
+                                 mcx_tune_timer, &job, &best, cfg->flog) > 0);
+        fclose(job.fnull);
+
+        if (found) {
+            #pragma omp critical(mcx_tune_cache)
+            {
+                if (!mcx_tune_save(tunefile, key, &best)) {
+                    MCX_FPRINTF(cfg->flog, S_RED "WARNING: can not write the autotune cache %s\n" S_RESET, tunefile);
+                }
+            }
+        }
+    }
+
+    if (found) {
+        gpu[gpuid].autoblock = best.blocksize;
+        gpu[gpuid].autothread = best.threadnum;
+        MCX_FPRINTF(cfg->flog, "autotune of device %d: block %d, thread %d (%.2f photon/ms)\n", gpuid + 1, best.blocksize, best.threadnum, best.speed);
+    }
+}
+
+/**
+ * @brief Convert the lengths (in grid unit) of the source parameters to a coarser grid
+ *
+ * @param[in,out] cfg: the configuration of the coarse simulation
+ * @param[in] factor: the ratio between the coarse and the fine voxel sizes
+ */
+
+static void mcx_pyramid_source(Config* cfg, float factor) {
+    float scale = 1.f / factor;
+    int isarea = (cfg->srctype == MCX_SRC_PLANAR || cfg->srctype == MCX_SRC_PATTERN || cfg->srctype == MCX_SRC_FOURIER || cfg->srctype == MCX_SRC_PENCILARRAY);
+    int isfourierx = (cfg->srctype == MCX_SRC_FOURIERX || cfg->srctype == MCX_SRC_FOURIERX2D);
+    int isdisk = (cfg->srctype == MCX_SRC_DISK || cfg->srctype == MCX_SRC_RING);
+
+    cfg->srcpos.x *= scale;
+    cfg->srcpos.y *= scale;
+    cfg->srcpos.z *= scale;
+
+    if (cfg->srcdir.w > 0.f || cfg->srcdir.w < 0.f) { /* focal length */
+        cfg->srcdir.w *= scale;
+    }
+
+    /** area sources are spanned by srcparam1/srcparam2.{x,y,z}, line, slit and fourierx sources by srcparam1.{x,y,z} */
+    if (isarea) {
+        cfg->srcparam2.x *= scale;
+        cfg->srcparam2.y *= scale;
+        cfg->srcparam2.z *= scale;
+    }
+
+    if (isarea || isfourierx || cfg->srctype == MCX_SRC_LINE || cfg->srctype == MCX_SRC_SLIT || cfg->srctype == MCX_SRC_HYPERBOLOID_GAUSSIAN) {
+        cfg->srcparam1.x *= scale;
+        cfg->srcparam1.y *= scale;
+        cfg->srcparam1.z *= scale;
+    }
+
+    /** the length of the 2nd vector of fourierx, the radii of disk/ring and the waist of Gaussian beams */
+    if (isfourierx) {
+        cfg->srcparam1.w *= scale;
+    } else if (isdisk || cfg->srctype == MCX_SRC_GAUSSIAN) {
+        cfg->srcparam1.x *= scale;
+        cfg->srcparam1.y *= (isdisk ? scale : 1.f);
+    }
+}
+
+/**
+ * @brief Run a fast simulation on the coarsest pyramid level and set the region tallied at full resolution
+ *
+ * The coarse run uses a shallow copy of the configuration: the media volume is replaced by
+ * cfg->pyramidvol, the lengths are converted to the coarse voxels, all time gates are merged
+ * into one and only the normalized fluence rate is computed; no detector data or file is saved.
+ * The photon number is reduced by 8 times for each level. The tallied region, cfg->roi0/roi1,
+ * is the bounding box of the voxels whose coarse fluence is at least cfg->pyramidtol of the maximum.
+ *
+ * @param[in,out] cfg: the simulation configuration, cfg->isroi, roi0 and roi1 are set
+ * @param[in] gpu: the info of all devices
+ * @param[in] gpuid: index (starting from 0) of the device running the coarse simulation
+ * @return the normalized fluence rate of the coarse run (cfg->srcnum values per voxel), to be released by free()
+ */
+
+static float* mcx_pyramid_run(Config* cfg, GPUInfo* gpu, int gpuid) {
+    Config coarse;
+    GPUInfo* coarsegpu;
+    unsigned int dim[3] = {cfg->dim.x, cfg->dim.y, cfg->dim.z}, coarsedim[3], roi0[3], roi1[3], i;
+    float factor = (float)(1u << cfg->pyramid);
+    double coverage, ratio;
+    FILE* fnull;
+    int status = 0;
+
+    cfg->isroi = 0;
+
+    if (cfg->pyramidvol == NULL || (fnull = fopen(MCX_TUNE_NULLDEV, "w")) == NULL) {
+        MCX_FPRINTF(cfg->flog, S_RED "WARNING: the coarse simulation can not be started, the full domain is tallied\n" S_RESET);
+        return NULL;
+    }
+
+    memcpy(&coarse, cfg, sizeof(Config));
+    coarse.vol = cfg->pyramidvol;
+    coarse.dim = cfg->pyramiddim;
+    coarse.brickvol = NULL;
+    coarse.isbrick = 0;
+    coarse.muavol = NULL;
+    coarse.pyramid = 0;
+    coarse.pyramidvol = NULL;
+    coarse.unitinmm = cfg->unitinmm * factor;
+    coarse.steps.x = coarse.steps.y = coarse.steps.z = coarse.unitinmm;
+    coarse.prop = (Medium*)malloc(cfg->medianum * sizeof(Medium));
+    memcpy(coarse.prop, cfg->prop, cfg->medianum * sizeof(Medium));
+
+    /** mua and mus are in 1/grid unit */
+    for (i = 0; i < cfg->medianum; i++) {
+        coarse.prop[i].mua *= factor;
+        coarse.prop[i].mus *= factor;
+    }
+
+    mcx_pyramid_source(&coarse, factor);
+
+    coarse.nphoton = MAX(cfg->nphoton >> (3 * cfg->pyramid), MIN(cfg->nphoton, (size_t)MCX_PYRAMID_MINPHOTON));
+    coarse.respin = 1;
+    coarse.tstep = cfg->tend - cfg->tstart;
+    coarse.maxgate = 1;
+    coarse.outputtype = otFlux;
+    coarse.issave2pt = 1;
+    coarse.isnormalized = 1;
+    coarse.issavedet = 0;
+    coarse.issaveseed = 0;
+    coarse.issaveexit = 0;
+    coarse.issaveref = 0;
+    coarse.debuglevel = 0;
+    coarse.autotune = 0;
+    memset(coarse.deviceid, 0, MAX_DEVICE);
+    memset(coarse.workload, 0, MAX_DEVICE * sizeof(float));
+    coarse.deviceid[0] = (char)(gpuid + 1);
+    coarse.workload[0] = 1.f;
+    coarse.isnested = 1;
+    coarse.shardnum = 0;
+    coarse.cachedir[0] = '\0';
+    coarse.flog = fnull;
+    coarse.exportfield = NULL;
+    coarse.exportdetected = NULL;
+    coarse.exportg1 = NULL;
+    coarse.dcsmodel = MCX_DCS_NONE;
+    coarse.seeddata = NULL;
+    coarse.exportdebugdata = NULL;
+    coarse.debugdatalen = 0;
+
+    coarsegpu = (GPUInfo*)malloc(gpu[0].devcount * sizeof(GPUInfo));
+    memcpy(coarsegpu, gpu, gpu[0].devcount * sizeof(GPUInfo));
+    coarsegpu[gpuid].maxgate = 1;
+
+#ifdef _OPENMP
+    #pragma omp parallel num_threads(1)
+#endif
+    {
+        status = mcx_run_simulation(&coarse, coarsegpu);
+    }
+
+    fclose(fnull);
+    free(coarse.prop);
+    free(coarse.muavol);
+    free(coarse.exportdetected);
+    free(coarse.seeddata);
+    free(coarse.exportdebugdata);
+    free(coarsegpu);
+
+    /** in the server mode, an error of the coarse run is raised again outside of the nested region to fail the job */
+    if (status) {
+        free(coarse.exportfield);
+        mcx_error(status, mcx_serve_message(), __FILE__, __LINE__);
+    }
+
+    coarsedim[0] = coarse.dim.x;
+    coarsedim[1] = coarse.dim.y;
+    coarsedim[2] = coarse.dim.z;
+    coverage = mcx_pyramid_roi(coarse.exportfield, coarsedim, cfg->srcnum, cfg->pyramidtol, cfg->pyramid, dim, roi0, roi1);
+
+    if (coverage < 0.0) {
+        MCX_FPRINTF(cfg->flog, S_RED "WARNING: the coarse simulation did not deposit any energy, the full domain is tallied\n" S_RESET);
+        free(coarse.exportfield);
+        return NULL;
+    }
+
+    ratio = (double)(roi1[0] - roi0[0] + 1) * (roi1[1] - roi0[1] + 1) * (roi1[2] - roi0[2] + 1) / ((double)dim[0] * dim[1] * dim[2]);
+    cfg->roi0 = uint3(roi0[0], roi0[1], roi0[2]);
+    cfg->roi1 = uint3(roi1[0], roi1[1], roi1[2]);
+    cfg->isroi = (ratio < 1.0);
+
+    MCX_FPRINTF(cfg->flog, "pyramid level %u: coarse run of %.0f photons on %ux%ux%u voxels in %d ms\n",
+                cfg->pyramid, (double)coarse.nphoton, coarsedim[0], coarsedim[1], coarsedim[2], coarse.runtime);
+    MCX_FPRINTF(cfg->flog, "tallying voxels [%u-%u]x[%u-%u]x[%u-%u] (%.2f%% of the domain), holding %.4f%% of the coarse fluence\n",
+                roi0[0], roi1[0], roi0[1], roi1[1], roi0[2], roi1[2], ratio * 100.0, coverage * 100.0);
+    fflush(cfg->flog);
+
+    return coarse.exportfield;
+}
+
+/**
+ * Host buffers owned by a run of mcx_run_simulation, released on the error path
+ * if the run is interrupted by an error in the server mode
+ */
+
+typedef struct MCXRunBuffers {
+    float*  field;                     /**< accumulated volumetric output */
+    float4* ppos;                      /**< photon position of each thread */
+    float4* pdir;                      /**< photon direction of each thread */
+    float4* plen;                      /**< photon states of each thread */
+    float4* plen0;                     /**< photon states of each thread at the end of a respin */
+    uint*   pseed;                     /**< RNG seeds */
+    float*  energy;                    /**< launched and escaped energy of each thread */
+    OutputType* rfimagsum;             /**< imaginary part of the RF output summed over respins */
+    float*  srcpw;                     /**< per-pattern source power */
+    float*  energytot;                 /**< per-pattern launched energy */
+    float*  energyabs;                 /**< per-pattern absorbed energy */
+    float*  scale;                     /**< normalization factor of each pattern */
+    float*  pyramidfield;              /**< fluence rate of the coarse pyramid run */
+    uint*   packmedia;                 /**< packed media labels */
+} RunBuffers;
+
+/**
+ * @brief Free the host buffers of a run interrupted by an error
+ *
+ * @param[in] own: the host buffers allocated by the run so far, NULL if not yet allocated
+ */
+
+static void mcx_run_release(volatile RunBuffers* own) {
+    free(own->field);
+    free(own->ppos);
+    free(own->pdir);
+    free(own->plen);
+    free(own->plen0);
+    free(own->pseed);
+    free(own->energy);
+    free(own->rfimagsum);
+    free(own->srcpw);
+    free(own->energytot);
+    free(own->energyabs);
+    free(own->scale);
+    free(own->pyramidfield);
+    free(own->packmedia);
+}
+
+/**
+ * @brief Master host code for the MCX simulation kernel (!!!Important!!!)
+ *
+ * This function is the master host code for the MCX kernel. It is responsible
+ * for initializing all GPU variables, copy data from host to GPU, launch the
+ * kernel for simulation, wait for competion, and retrieve the results.
+ *
+ * In the server mode, an error raised during the run returns to this function
+ * through the trap of mcx_serve_trap: the host buffers of the run are freed and
+ * the error code is returned, the caller resets the device. The steps shared by
+ * all devices run in the thread with \c threadid 0 rather than in \c omp master
+ * blocks, and no error is raised inside a critical section, so that the trap
+ * never jumps out of an OpenMP construct.
+ *
+ * @param[in,out] cfg: the simulation configuration structure
+ * @param[in] gpu: the GPU information structure
+ * @return 0 if the run completes, or the error code if it is interrupted by an error in the server mode
+ */
+
+int mcx_run_simulation(Config* cfg, GPUInfo* gpu) {
+
+    int i, iter;
+    float  minstep = 1.f; //MIN(MIN(cfg->steps.x,cfg->steps.y),cfg->steps.z);
+
+    /** \c p0 - initial photon positions for pencil/isotropic/cone beams, used to initialize \c{p={x,y,z,w}} state in the GPU kernel */
+    float4 p0 = cfg->srcpos;
+
+    /** \c c0 - initial photon direction state, used to initialize \c{MCXdir v={vx,vy,vz,}} state in the GPU kernel */
+    float4 c0 = cfg->srcdir;
+
+    /** \c stokesvec - initial photon polarization state, described by Stokes Vector */
+    float4 s0 = (float4)cfg->srciquv;
+
+    float3 maxidx = float3(cfg->dim.x, cfg->dim.y, cfg->dim.z);
+    int timegate = 0, totalgates, gpuid, threadid = 0;
+
+    /** \c gpuphoton - number of photons to be simulated per thread, determined by total workload and thread number */
+    size_t gpuphoton = 0;
+
+    /** \c photoncount - number of completed photons returned by all thread, output */
+    size_t photoncount = 0;
+
+    unsigned int printnum;
+    unsigned int tic, tic0, tic1, toc = 0, debuglen = MCX_DEBUG_REC_LEN + (cfg->istrajstokes << 2);
+    size_t fieldlen;
+    int iscachable = 0;
+    char cachekey[MCX_CACHE_KEYLEN] = {'\0'};
+    uint3 cp0 = cfg->crop0, cp1 = cfg->crop1;
+    uint2 cachebox;
+    uint4 dimlen;
+    float Vvox, fullload = 0.f;
+
+    /** \c pyramidfield - fluence rate of the coarse pre-run in the coarse-to-fine mode, only set in the master thread */
+    float* pyramidfield = NULL;
+
+    /** \c mcgrid - GPU grid size, only use 1D grid, used when launching the kernel in cuda <<<>>> operator */
+    dim3 mcgrid;
+
+    /** \c mcblock - GPU block size, only use 1D block, used when launching the kernel in cuda <<<>>> operator */
+    dim3 mcblock;
+
+    /** \c sharedbuf - shared memory buffer length to be requested, used when launching the kernel in cuda <<<>>> operator */
+    uint sharedbuf = 0;
+
+    /** \c gpusrcnum - number of patterns simulated on the GPU for photon sharing, the basis patterns if cfg.patternrank is set */
+    uint gpusrcnum = (cfg->patternrank > 0) ? cfg->patternrank : cfg->srcnum;
+
+    /** \c dimxyz - output volume variable \c field voxel count, Nx*Ny*Nz*Ns where Ns=gpusrcnum is the pattern number for photon sharing */
+    int dimxyz = cfg->dim.x * cfg->dim.y * cfg->dim.z * ((cfg->srctype == MCX_SRC_PATTERN || cfg->srctype == MCX_SRC_PATTERN3D) ? gpusrcnum : (cfg->srcid == -1) ? (cfg->extrasrclen + 1) : 1);
+
+    /** \c exportdimxyz - voxel count of the host output, the outputs of the basis patterns are expanded to all cfg.srcnum patterns */
+    int exportdimxyz = (cfg->patternrank > 0) ? cfg->dim.x * cfg->dim.y * cfg->dim.z * cfg->srcnum : dimxyz;
+
+    /** \c media - input volume representing the simulation domain, format specified in cfg.mediaformat, read-only */
+    uint*  media = (uint*)(cfg->vol);
+
+    /** \c packmedia - labels packed at 4 or 8 bits per voxel (label4/label8 formats), replaces \c media on the GPU */
+    uint*  packmedia = NULL;
+    size_t packlen = 0;
+
+    /** \c field - output volume to store GPU computed fluence, length is \c dimxyz */
+    float*  field = NULL;
+
+    /** \c rfimag - imaginary part of the RF Jacobian, length is \c dimxyz */
+    OutputType*  rfimag = NULL;
+
+    /** \c rfimagsum - imaginary part of the RF Jacobian summed over all respins, allocated only if respin > 1 */
+    OutputType*  rfimagsum = NULL;
+
+    /** \c Ppos - per-thread photon state initialization host buffers */
+    float4* Ppos = NULL, *Pdir = NULL, *Plen = NULL, *Plen0 = NULL;
+
+    /** \c Pseed - per-thread RNG seed initialization host buffers */
+    uint*   Pseed = NULL;
+
+    /** \c Pdet - output host buffer to store detected photon partial-path and other per-photon data */
+    float*  Pdet;
+
+    /** \c energy - output host buffers to accummulate total launched/absorbed energy per thread, needed for normalization */
+    float*  energy = NULL;
+
+    /** \c srcpw, \c energytot, \c energyabs - output host buffers to accummulate total launched/absorbed energy per pattern in photon sharing, needed for normalization of multi-pattern simulations */
+    float*  srcpw = NULL, *energytot = NULL, *energyabs = NULL; // for multi-srcpattern
+
+    /** \c seeddata - output buffer to store RNG initial seeds for each detected photon for replay */
+    RandType* seeddata = NULL;
+
+    /** \c own - host buffers released if an error interrupts the run in the server mode, updated as they are allocated */
+    volatile RunBuffers own = {NULL};
+
+    /** \c trap - where an error raised in the server mode returns to, \c outertrap - the trap of the enclosing run or job */
+    jmp_buf trap, *outertrap = NULL;
+
+    /** \c detected - total number of detected photons, output */
+    uint    detected = 0;
+
+    /** \c progress - pinned-memory variable as the progress bar during simulation, updated in GPU and visible from host */
+    volatile int* progress;
+
+#ifdef _WIN32
+    /** \c updateprogress - CUDA event needed to avoid hanging on Windows, see https://forums.developer.nvidia.com/t/solved-how-to-update-host-memory-variable-from-device-during-opencl-kernel-execution/59409/5 */
+    cudaEvent_t updateprogress = NULL;
+#endif
+
+    /** all pointers start with g___ are the corresponding GPU buffers to read/write host variables defined above */
+    uint* gmedia;
+    float4* gPpos, *gPdir, *gPlen, *gsmatrix = NULL, *gglobalprop = NULL;
+    float*  ggridscale = NULL, *grfomega = NULL;
+    uint*   gbiasdet = NULL;
+    uint*   gPseed, *gdetected;
+    int*    greplaydetid = NULL;
+    float*  gPdet, *gsrcpattern = NULL, *genergy, *greplayw = NULL, *greplaytof = NULL, *gdebugdata = NULL, *ginvcdf = NULL, *gangleinvcdf = NULL;
+    OutputType* gfield;
+    RandType* gseeddata = NULL;
+    volatile int* gprogress;
+
+    /**
+     *                            |----------------------------------------------->  hostdetreclen  <--------------------------------------|
+     *                                      |------------------------>    partialdata   <-------------------|
+     *host detected photon buffer: detid (1), partial_scat (#media), partial_path (#media), momontum (#media), p_exit (3), v_exit(3), w0 (1)
+     *                                      |--------------------------------------------->    w0offset   <-----------------------------------------------||<----- w0 (#srcnum) ----->||<- RF replay (2)->|
+     *gpu detected photon buffer:            partial_scat (#media), partial_path (#media), momontum (#media), E_escape (1), E_launch (1), w0 (1), srcid(1), w0_photonsharing (#srcnum)   cos(w*T),sin(w*T)
+     */
+
+    //< \c partialdata: per-photon buffer length for media-specific data, copy from GPU to host
+    unsigned int partialdata = (cfg->medianum - 1) * (SAVE_NSCAT(cfg->savedetflag) + SAVE_PPATH(cfg->savedetflag) + SAVE_MOM(cfg->savedetflag));
+
+    //< \c w0offset - offset in the per-photon buffer to the start of the photon sharing related data
+    unsigned int w0offset = partialdata + 4;  //< the extra 4 numbers are total-escaped-energy, total-launched-energy, initial-weight, source_id
+
+    //< \c hostdetreclen - host-side det photon data buffer per-photon length
+    unsigned int hostdetreclen = partialdata + SAVE_DETID(cfg->savedetflag) + 3 * (SAVE_PEXIT(cfg->savedetflag) + SAVE_VEXIT(cfg->savedetflag)) + SAVE_W0(cfg->savedetflag) + 4 * SAVE_IQUV(cfg->savedetflag);
+
+    //< \c halfsaving - words saved per detected photon if the partial path and momentum transfer are stored as half-precision pairs
+    unsigned int halfsaving = mcx_detfilter_halfsaving(cfg->savedetflag, cfg->medianum - 1, cfg->ishalfdet && cfg->issavedet);
+
+    hostdetreclen -= halfsaving;
+
+    //< \c is2d - flag to tell mcx if the simulation domain is 2D, set to 1 if any of the x/y/z dimensions has a length of 1
+    unsigned int is2d = (cfg->dim.x == 1 ? 1 : (cfg->dim.y == 1 ? 2 : (cfg->dim.z == 1 ? 3 : 0)));
+
+    /** \c param - constants to be used in the GPU, copied to GPU as \c gcfg, stored in the constant memory */
+    MCXParam param = {cfg->steps, minstep, 0, 0, cfg->tend, R_C0* cfg->unitinmm,
+                      (uint)cfg->issave2pt, (uint)cfg->isreflect, (uint)cfg->isrefint, (uint)cfg->issavedet, 1.f / cfg->tstep,
+                      p0, c0, cfg->srcparam1, cfg->srcparam2, cfg->extrasrclen, cfg->srcid, s0, maxidx, uint4(0, 0, 0, 0),
+                      cp0, cp1, uint2(0, 0), cfg->minenergy, cfg->sradius* cfg->sradius, minstep* R_C0* cfg->unitinmm, cfg->srctype,
+                      cfg->voidtime, cfg->maxdetphoton,
+                      cfg->medianum - 1, cfg->detnum, cfg->polmedianum, cfg->maxgate, ABS(cfg->sradius + 2.f) < EPS /*isatomic*/,
+                      (uint)cfg->maxvoidstep, cfg->issaveseed > 0, (uint)cfg->issaveref, cfg->isspecular > 0, (uint)cfg->istrajstokes,
+                      cfg->maxdetphoton * hostdetreclen, cfg->seed, (uint)cfg->outputtype, 0, 0, cfg->faststep,
+                      cfg->debuglevel, cfg->savedetflag, hostdetreclen, partialdata, w0offset, cfg->mediabyte,
+                      (uint)cfg->maxjumpdebug, cfg->gscatter, is2d, cfg->replaydet, gpusrcnum,
+                      cfg->nphase, cfg->nphase + (cfg->nphase & 0x1), cfg->nangle, cfg->nangle + (cfg->nangle & 0x1), cfg->omega
+                     };
+
+    if (param.isatomic) {
+        param.skipradius2 = 0.f;
+    }
+
+    param.trajphoton = MAX(cfg->trajphoton, 1);
+    param.detfilter = cfg->detfilter;
+    param.ishalfdet = (halfsaving > 0);
+
+    /** media labels below \c constmedia are read from the constant memory, others from the global-memory table */
+    param.constmedia = cfg->medianum;
+
+    if (cfg->isglobalprop) {
+        param.constmedia = (cfg->medianum + cfg->detnum + (cfg->extrasrclen << 2) > MAX_PROP_AND_DETECTORS) ?
+                           MAX_PROP_AND_DETECTORS - cfg->detnum - (cfg->extrasrclen << 2) : 1;
+    }
+
+    if (cfg->brickvol) {
+        param.isbrick = 1;
+        param.brickdim = uint2((cfg->dim.x + MCX_BRICK_MASK) >> MCX_BRICK_BITS, (cfg->dim.y + MCX_BRICK_MASK) >> MCX_BRICK_BITS);
+    }
+
+    /** Start multiple CPU threads using OpenMP, one thread for each GPU device to run simultaneously, \c threadid returns the current thread ID */
+#ifdef _OPENMP
+    threadid = omp_get_thread_num();
+#endif
+
+    if (threadid < MAX_DEVICE && cfg->deviceid[threadid] == '\0') {
+        return 0;
+    }
+
+    /** In the server mode, arm the trap: an error frees the host buffers of the run and returns its code */
+    outertrap = mcx_serve_settrap(cfg->isserve ? &trap : NULL);
+
+    if (setjmp(trap)) {
+        mcx_serve_settrap(outertrap);
+        mcx_run_release(&own);
+        return mcx_serve_status();
+    }
+
+    /** Use \c threadid and cfg.deviceid, the compressed list of active GPU devices, to get the desired GPU ID for this thread */
+    gpuid = cfg->deviceid[threadid] - 1;
+
+    if (gpuid < 0) {
+        mcx_error(-1, "GPU ID must be non-zero", __FILE__, __LINE__);
+    }
+
+    /** Activate the corresponding GPU device */
+    CUDA_ASSERT(cudaSetDevice(gpuid));
+
+    /** Use the specified GPU's parameters, stored in gpu[gpuid] to determine the maximum time gates that it can hold */
+    if (gpu[gpuid].maxgate == 0 && dimxyz > 0) {
+        int needmem = dimxyz + cfg->nthread * sizeof(float4) * 4 + sizeof(float) * cfg->maxdetphoton * hostdetreclen + 10 * 1024 * 1024; /*keep 10M for other things*/
         gpu[gpuid].maxgate = (gpu[gpuid].globalmem - needmem) / (cfg->dim.x * cfg->dim.y * cfg->dim.z);
         gpu[gpuid].maxgate = MIN(((cfg->tend - cfg->tstart) / cfg->tstep + 0.5), gpu[gpuid].maxgate);
     }
 
     /** Updating host simulation configuration \c cfg, only allow the master thread to modify cfg, others are read-only */
-    #pragma omp master
-    {
+    if (threadid == 0) {
         if (cfg->exportfield == NULL) {
             if (cfg->seed == SEED_FROM_FILE && cfg->replaydet == -1) {
-                cfg->exportfield = (float*)calloc(sizeof(float) * dimxyz, gpu[gpuid].maxgate * (1 + (cfg->outputtype == otRF)) * cfg->detnum);
+                cfg->exportfield = (float*)calloc(sizeof(float) * exportdimxyz, gpu[gpuid].maxgate * (1 + (cfg->outputtype == otRF)) * cfg->detnum);
             } else {
-                cfg->exportfield = (float*)calloc(sizeof(float) * dimxyz, gpu[gpuid].maxgate * (1 + (cfg->outputtype == otRF)));
+                cfg->exportfield = (float*)calloc(sizeof(float) * exportdimxyz, gpu[gpuid].maxgate * (1 + (cfg->outputtype == otRF)));
             }
         }
 
@@ -2838,9 +3907,11 @@ void mcx_run_simulation(Config* cfg, GPUInfo* gpu) {
         }
 
         cfg->detectedcount = 0;
+        cfg->trajidbase = 0;
         cfg->his.detected = 0;
         cfg->his.respin = cfg->respin;
         cfg->his.colcount = hostdetreclen;
+        cfg->his.ishalf = (halfsaving > 0);
         cfg->energytot = 0.f;
         cfg->energyabs = 0.f;
         cfg->energyesc = 0.f;
@@ -2872,11 +3943,6 @@ void mcx_run_simulation(Config* cfg, GPUInfo* gpu) {
         gpu[gpuid].maxgate = cfg->maxgate;
     }
 
-    /** If total thread number is not integer multiples of block size, round it to the largest block size multiple */
-    if (gpu[gpuid].autothread % gpu[gpuid].autoblock) {
-        gpu[gpuid].autothread = (gpu[gpuid].autothread / gpu[gpuid].autoblock) * gpu[gpuid].autoblock;
-    }
-
     param.maxgate = gpu[gpuid].maxgate;
 
     /** If cfg.respin is positive, the output data have to be accummulated, so we use a double-buffer to retrieve and then accummulate */
@@ -2894,8 +3960,9 @@ void mcx_run_simulation(Config* cfg, GPUInfo* gpu) {
         }
     }
 
-    #pragma omp master
-    {
+    own.field = field;
+
+    if (threadid == 0) {
         /** Master thread computes total workloads, specified by users (or equally by default) for all active devices, stored as cfg.workload[gpuid] */
         fullload = 0.f;
 
@@ -2924,26 +3991,21 @@ void mcx_run_simulation(Config* cfg, GPUInfo* gpu) {
     gpuphoton = (double)cfg->nphoton * cfg->workload[threadid] / fullload;
 
     if (gpuphoton == 0) {
-        return;
-    }
-
-    /** Once per-thread photon number \c param.threadphoton is known, we distribute the remaiders, if any, to a subset of threads, one extra photon per thread, so we can get the exact total photon number */
-    if (cfg->respin >= 1) {
-        param.threadphoton = gpuphoton / gpu[gpuid].autothread;
-        param.oddphotons = gpuphoton - param.threadphoton * gpu[gpuid].autothread;
-    } else if (cfg->respin < 0) {
-        param.threadphoton = gpuphoton / gpu[gpuid].autothread / (-cfg->respin);
-        param.oddphotons = gpuphoton / (-cfg->respin) - param.threadphoton * gpu[gpuid].autothread;
-    } else {
-        mcx_error(-1, "respin number can not be 0, check your -r/--repeat input or cfg.respin value", __FILE__, __LINE__);
+        free(field);
+        mcx_serve_settrap(outertrap);
+        return 0;
     }
 
     /** Total time gate number is computed */
     totalgates = (int)((cfg->tend - cfg->tstart) / cfg->tstep + 0.5);
-    #pragma omp master
+
+    /** The frames of all modulation frequencies of the forward FD output must be tallied in a single run */
+    if (totalgates > gpu[gpuid].maxgate && cfg->outputtype == otRF && cfg->seed != SEED_FROM_FILE) {
+        mcx_error(-1, "GPU memory can not hold the forward RF output of all modulation frequencies", __FILE__, __LINE__);
+    }
 
     /** Here we determine if the GPU memory of the current device can store all time gates, if not, disabling normalization */
-    if (totalgates > gpu[gpuid].maxgate && cfg->isnormalized) {
+    if (threadid == 0 && totalgates > gpu[gpuid].maxgate && cfg->isnormalized) {
         MCX_FPRINTF(cfg->flog, S_RED "WARNING: GPU memory can not hold all time gates, disabling normalization to allow multiple runs\n" S_RESET);
         cfg->isnormalized = 0;
     }
@@ -2957,6 +4019,61 @@ void mcx_run_simulation(Config* cfg, GPUInfo* gpu) {
         fieldlen = dimxyz * gpu[gpuid].maxgate;
     }
 
+    /**
+     * If an output cache folder is specified, and all time gates fit in one run, the master thread
+     * looks up the outputs of an identical simulation; if found, the GPU simulation is skipped
+     */
+    if (threadid == 0) {
+        cfg->iscachehit = 0;
+        iscachable = (cfg->cachedir[0] && totalgates <= gpu[gpuid].maxgate && !(cfg->debuglevel & MCX_DEBUG_RNG) && cfg->shardnum == 0 && cfg->patternrank == 0);
+
+        if (iscachable) {
+            mcx_cache_key(cfg, sizeof(RandType) * RAND_BUF_LEN, cachekey);
+            cfg->iscachehit = mcx_cache_load(cfg, cachekey, fieldlen * (1 + (cfg->outputtype == otRF)), hostdetreclen, sizeof(RandType) * RAND_BUF_LEN, debuglen);
+
+            if (cfg->iscachehit) {
+                MCX_FPRINTF(cfg->flog, "loaded " S_BOLD "" S_BLUE "%lu detected photons" S_RESET " and outputs from cache %s\n", cfg->detectedcount, cachekey);
+                mcx_export_dcs(cfg);
+#ifndef MCX_CONTAINER
+                mcx_save_outputs(cfg, fieldlen, debuglen, GetTimeMillis());
+#endif
+                mcx_export_halfdet(cfg, hostdetreclen + halfsaving);
+                MCX_FPRINTF(cfg->flog, "total simulated energy: %.2f\tabsorbed: " S_BOLD "" S_BLUE "%5.5f%%" S_RESET"\n(loss due to initial specular reflection is excluded in the total)\n",
+                            cfg->energytot, (cfg->energytot - cfg->energyesc) / cfg->energytot * 100.f);
+                fflush(cfg->flog);
+            }
+        }
+    }
+    #pragma omp barrier
+
+    if (cfg->iscachehit) {
+        free(field);
+        mcx_serve_settrap(outertrap);
+        return 0;
+    }
+
+    /** Only if the outputs are not cached, the autotune mode loads the thread and block sizes from the per-device tuning cache, or measures and saves them on a miss */
+    if (cfg->autopilot && cfg->autotune && cfg->seed != SEED_FROM_FILE && !(cfg->debuglevel & MCX_DEBUG_RNG)) {
+        mcx_autotune(cfg, gpu, gpuid, (param.nphaselen + param.nanglelen) * sizeof(float),
+                     cfg->issaveseed * (RAND_BUF_LEN * sizeof(RandType)) + sizeof(float) * (param.w0offset + gpusrcnum + 2 * (cfg->outputtype == otRF)));
+    }
+
+    /** If total thread number is not integer multiples of block size, round it to the largest block size multiple */
+    if (gpu[gpuid].autothread % gpu[gpuid].autoblock) {
+        gpu[gpuid].autothread = (gpu[gpuid].autothread / gpu[gpuid].autoblock) * gpu[gpuid].autoblock;
+    }
+
+    /** Once per-thread photon number \c param.threadphoton is known, we distribute the remaiders, if any, to a subset of threads, one extra photon per thread, so we can get the exact total photon number */
+    if (cfg->respin >= 1) {
+        param.threadphoton = gpuphoton / gpu[gpuid].autothread;
+        param.oddphotons = gpuphoton - param.threadphoton * gpu[gpuid].autothread;
+    } else if (cfg->respin < 0) {
+        param.threadphoton = gpuphoton / gpu[gpuid].autothread / (-cfg->respin);
+        param.oddphotons = gpuphoton / (-cfg->respin) - param.threadphoton * gpu[gpuid].autothread;
+    } else {
+        mcx_error(-1, "respin number can not be 0, check your -r/--repeat input or cfg.respin value", __FILE__, __LINE__);
+    }
+
     /** A 1D grid is determined by the total thread number and block size */
     mcgrid.x = gpu[gpuid].autothread / gpu[gpuid].autoblock;
 
@@ -2965,12 +4082,12 @@ void mcx_run_simulation(Config* cfg, GPUInfo* gpu) {
 
     /** If "-D R" is used, we launch a special RNG testing kernel to retrieve random numbers from RNG and test for randomness */
     if (cfg->debuglevel & MCX_DEBUG_RNG) {
-        #pragma omp master
-        {
+        if (threadid == 0) {
             float* rngfield;
             param.twin0 = cfg->tstart;
             param.twin1 = cfg->tend;
             Pseed = (uint*)malloc(sizeof(RandType) * RAND_BUF_LEN);
+            own.pseed = Pseed;
 
             for (i = 0; i < (int)(((sizeof(RandType)*RAND_BUF_LEN) >> 2)); i++) {
                 Pseed[i] = ((rand() << 16) | (rand() << 1) | (rand() >> 14));
@@ -3000,7 +4117,7 @@ void mcx_run_simulation(Config* cfg, GPUInfo* gpu) {
 
 #ifndef MCX_CONTAINER
 
-            if (cfg->issave2pt && cfg->parentid == mpStandalone) {
+            if (cfg->issave2pt && cfg->parentid == mpStandalone && !cfg->isnested) {
                 MCX_FPRINTF(cfg->flog, "saving data to file ...\t");
                 mcx_savedata(field, fieldlen, cfg);
                 MCX_FPRINTF(cfg->flog, "saving data complete : %d ms\n\n", GetTimeMillis() - tic);
@@ -3013,15 +4130,35 @@ void mcx_run_simulation(Config* cfg, GPUInfo* gpu) {
             CUDA_ASSERT(cudaFree(gPseed));
             free(field);
             free(Pseed);
+            own.field = NULL;
+            own.pseed = NULL;
 
 #ifndef MCX_DISABLE_CUDA_DEVICE_RESET
+            mcx_hostpool_release(gpuid);
             CUDA_ASSERT(cudaDeviceReset());
 #endif
 
         }
         #pragma omp barrier
 
-        return;
+        mcx_serve_settrap(outertrap);
+        return 0;
+    }
+
+    /**
+     * In the coarse-to-fine mode, the master thread first simulates the coarsest level of the media
+     * pyramid to locate the region where the fluence is significant; only this region is tallied
+     */
+    if (cfg->pyramid > 0) {
+        if (threadid == 0) {
+            pyramidfield = mcx_pyramid_run(cfg, gpu, gpuid);
+            own.pyramidfield = pyramidfield;
+        }
+        #pragma omp barrier
+
+        param.isroi = cfg->isroi;
+        param.roi0 = cfg->roi0;
+        param.roi1 = cfg->roi1;
     }
 
     /**
@@ -3033,7 +4170,12 @@ void mcx_run_simulation(Config* cfg, GPUInfo* gpu) {
     Plen = (float4*)malloc(sizeof(float4) * gpu[gpuid].autothread); /** \c Plen: host buffer for initial additional photon states */
     Plen0 = (float4*)malloc(sizeof(float4) * gpu[gpuid].autothread);
     energy = (float*)calloc(gpu[gpuid].autothread << 1, sizeof(float)); /** \c energy: host buffer for retrieving total launched and escaped energy of each thread */
-    Pdet = (float*)calloc(cfg->maxdetphoton, sizeof(float) * (hostdetreclen)); /** \c Pdet: host buffer for retrieving all detected photon information */
+    own.ppos = Ppos;
+    own.pdir = Pdir;
+    own.plen = Plen;
+    own.plen0 = Plen0;
+    own.energy = energy;
+    Pdet = (float*)mcx_hostpool_get(gpuid, psDetected, sizeof(float) * cfg->maxdetphoton * hostdetreclen); /** \c Pdet: pinned host buffer for retrieving all detected photon information */
 
     if (cfg->seed != SEED_FROM_FILE) {
         Pseed = (uint*)malloc(sizeof(RandType) * gpu[gpuid].autothread * RAND_BUF_LEN);    /** \c Pseed: RNG seed for each thread in non-replay mode, or */
@@ -3041,10 +4183,25 @@ void mcx_run_simulation(Config* cfg, GPUInfo* gpu) {
         Pseed = (uint*)malloc(sizeof(RandType) * cfg->nphoton * RAND_BUF_LEN);    /** \c Pseed: RNG seeds for photon replay in GPU threads */
     }
 
+    own.pseed = Pseed;
+
+    /**
+     * Pack the labels at 4 or 8 bits per voxel when a label4/label8 media format is used
+     */
+    if (cfg->mediabits) {
+        packmedia = mcx_packmedia(cfg, &packlen, &param.maskoffset);
+        own.packmedia = packmedia;
+        param.mediabits = cfg->mediabits;
+    }
+
     /**
      * Allocate all GPU buffers to store input or output data
      */
-    if (cfg->mediabyte != MEDIA_2LABEL_SPLIT && cfg->mediabyte != MEDIA_ASGN_F2H) {
+    if (cfg->brickvol) {
+        CUDA_ASSERT(cudaMalloc((void**) &gmedia, sizeof(uint) * cfg->bricklen));
+    } else if (packmedia) {
+        CUDA_ASSERT(cudaMalloc((void**) &gmedia, sizeof(uint) * packlen));
+    } else if (cfg->mediabyte != MEDIA_2LABEL_SPLIT && cfg->mediabyte != MEDIA_ASGN_F2H) {
         CUDA_ASSERT(cudaMalloc((void**) &gmedia, sizeof(uint) * (cfg->dim.x * cfg->dim.y * cfg->dim.z)));
     } else {
         CUDA_ASSERT(cudaMalloc((void**) &gmedia, sizeof(uint) * (2 * cfg->dim.x * cfg->dim.y * cfg->dim.z)));
@@ -3071,7 +4228,7 @@ void mcx_run_simulation(Config* cfg, GPUInfo* gpu) {
     }
 
     if (cfg->issaveseed) {
-        seeddata = (RandType*)malloc(sizeof(RandType) * cfg->maxdetphoton * RAND_BUF_LEN);
+        seeddata = (RandType*)mcx_hostpool_get(gpuid, psSeed, sizeof(RandType) * cfg->maxdetphoton * RAND_BUF_LEN);
         CUDA_ASSERT(cudaMalloc((void**) &gseeddata, sizeof(RandType)*cfg->maxdetphoton * RAND_BUF_LEN));
     }
 
@@ -3123,18 +4280,17 @@ void mcx_run_simulation(Config* cfg, GPUInfo* gpu) {
      * Allocate and copy source pattern buffer for 2D and 3D pattern sources
      */
     if (cfg->srctype == MCX_SRC_PATTERN) {
-        CUDA_ASSERT(cudaMalloc((void**) &gsrcpattern, sizeof(float) * (int)(cfg->srcparam1.w * cfg->srcparam2.w * cfg->srcnum)));
+        CUDA_ASSERT(cudaMalloc((void**) &gsrcpattern, sizeof(float) * (int)(cfg->srcparam1.w * cfg->srcparam2.w * gpusrcnum)));
     } else if (cfg->srctype == MCX_SRC_PATTERN3D) {
-        CUDA_ASSERT(cudaMalloc((void**) &gsrcpattern, sizeof(float) * (int)(cfg->srcparam1.x * cfg->srcparam1.y * cfg->srcparam1.z * cfg->srcnum)));
+        CUDA_ASSERT(cudaMalloc((void**) &gsrcpattern, sizeof(float) * (int)(cfg->srcparam1.x * cfg->srcparam1.y * cfg->srcparam1.z * gpusrcnum)));
     }
 
 #ifndef SAVE_DETECTORS
-    #pragma omp master
 
     /**
      * Saving detected photon is enabled by default, but in case if a user disabled this feature, a warning is printed
      */
-    if (cfg->issavedet) {
+    if (threadid == 0 && cfg->issavedet) {
         MCX_FPRINTF(cfg->flog, S_RED "WARNING: this MCX binary can not save partial path, please recompile mcx and make sure -D SAVE_DETECTORS is used by nvcc\n" S_RESET);
         cfg->issavedet = 0;
     }
@@ -3158,7 +4314,7 @@ void mcx_run_simulation(Config* cfg, GPUInfo* gpu) {
     param.cachebox = cachebox;
 
     memcpy(&(param.bc), cfg->bc, 12);
-    Vvox = cfg->steps.x * cfg->steps.y * cfg->steps.z; /*Vvox: voxel volume in mm^3*/
+    Vvox = (cfg->steps.x < 0.f) ? cfg->unitinmm * cfg->unitinmm * cfg->unitinmm : cfg->steps.x * cfg->steps.y * cfg->steps.z; /*Vvox: voxel volume in mm^3, non-uniform grids apply the per-voxel ratios after normalization*/
 
     if (cfg->seed > 0) {
         srand(cfg->seed + threadid);
@@ -3176,9 +4332,8 @@ void mcx_run_simulation(Config* cfg, GPUInfo* gpu) {
      * Get ready to start GPU simulation here, clock is now ticking ...
      */
     tic = StartTimer();
-    #pragma omp master
 
-    if (cfg->printnum >= 0) {
+    if (threadid == 0 && cfg->printnum >= 0) {
         mcx_printheader(cfg);
 
 #ifdef MCX_TARGET_NAME
@@ -3204,7 +4359,14 @@ void mcx_run_simulation(Config* cfg, GPUInfo* gpu) {
 
     mcx_flush(cfg);
 
-    if (cfg->mediabyte != MEDIA_2LABEL_SPLIT && cfg->mediabyte != MEDIA_ASGN_F2H) {
+    if (cfg->brickvol) {
+        CUDA_ASSERT(cudaMemcpy(gmedia, cfg->brickvol, sizeof(uint) * cfg->bricklen, cudaMemcpyHostToDevice));
+    } else if (packmedia) {
+        CUDA_ASSERT(cudaMemcpy(gmedia, packmedia, sizeof(uint) * packlen, cudaMemcpyHostToDevice));
+        free(packmedia);
+        packmedia = NULL;
+        own.packmedia = NULL;
+    } else if (cfg->mediabyte != MEDIA_2LABEL_SPLIT && cfg->mediabyte != MEDIA_ASGN_F2H) {
         CUDA_ASSERT(cudaMemcpy(gmedia, media, sizeof(uint)*cfg->dim.x * cfg->dim.y * cfg->dim.z, cudaMemcpyHostToDevice));
     } else {
         CUDA_ASSERT(cudaMemcpy(gmedia, media, sizeof(uint) * 2 * cfg->dim.x * cfg->dim.y * cfg->dim.z, cudaMemcpyHostToDevice));
@@ -3212,21 +4374,85 @@ void mcx_run_simulation(Config* cfg, GPUInfo* gpu) {
 
     CUDA_ASSERT(cudaMemcpy(genergy, energy, sizeof(float) * (gpu[gpuid].autothread << 1), cudaMemcpyHostToDevice));
 
-    if (cfg->srcpattern)
+    if (cfg->srcpattern) {
+        float* srcpattern = (cfg->patternrank > 0) ? cfg->patternbasis : cfg->srcpattern;
+
         if (cfg->srctype == MCX_SRC_PATTERN) {
-            CUDA_ASSERT(cudaMemcpy(gsrcpattern, cfg->srcpattern, sizeof(float) * (int)(cfg->srcparam1.w * cfg->srcparam2.w * cfg->srcnum), cudaMemcpyHostToDevice));
+            CUDA_ASSERT(cudaMemcpy(gsrcpattern, srcpattern, sizeof(float) * (int)(cfg->srcparam1.w * cfg->srcparam2.w * gpusrcnum), cudaMemcpyHostToDevice));
         } else if (cfg->srctype == MCX_SRC_PATTERN3D) {
-            CUDA_ASSERT(cudaMemcpy(gsrcpattern, cfg->srcpattern, sizeof(float) * (int)(cfg->srcparam1.x * cfg->srcparam1.y * cfg->srcparam1.z * cfg->srcnum), cudaMemcpyHostToDevice));
+            CUDA_ASSERT(cudaMemcpy(gsrcpattern, srcpattern, sizeof(float) * (int)(cfg->srcparam1.x * cfg->srcparam1.y * cfg->srcparam1.z * gpusrcnum), cudaMemcpyHostToDevice));
         }
+    }
 
     /**
      * Copy constants to the constant memory on the GPU
      */
-    CUDA_ASSERT(cudaMemcpyToSymbol(gproperty, cfg->prop,  cfg->medianum * sizeof(Medium), 0, cudaMemcpyHostToDevice));
-    CUDA_ASSERT(cudaMemcpyToSymbol(gproperty, cfg->detpos,  cfg->detnum * sizeof(float4), cfg->medianum * sizeof(Medium), cudaMemcpyHostToDevice));
+    CUDA_ASSERT(cudaMemcpyToSymbol(gproperty, cfg->prop,  param.constmedia * sizeof(Medium), 0, cudaMemcpyHostToDevice));
+    CUDA_ASSERT(cudaMemcpyToSymbol(gproperty, cfg->detpos,  cfg->detnum * sizeof(float4), param.constmedia * sizeof(Medium), cudaMemcpyHostToDevice));
 
     if (cfg->srcdata) {
-        CUDA_ASSERT(cudaMemcpyToSymbol(gproperty, cfg->srcdata,  cfg->extrasrclen * 4 * sizeof(float4), cfg->medianum * sizeof(Medium) + cfg->detnum * sizeof(float4), cudaMemcpyHostToDevice));
+        CUDA_ASSERT(cudaMemcpyToSymbol(gproperty, cfg->srcdata,  cfg->extrasrclen * 4 * sizeof(float4), param.constmedia * sizeof(Medium) + cfg->detnum * sizeof(float4), cudaMemcpyHostToDevice));
+    }
+
+    if (cfg->isglobalprop) {
+        CUDA_ASSERT(cudaMalloc((void**) &gglobalprop, cfg->medianum * sizeof(Medium)));
+        CUDA_ASSERT(cudaMemcpy(gglobalprop, cfg->prop, cfg->medianum * sizeof(Medium), cudaMemcpyHostToDevice));
+        param.globalprop = gglobalprop;
+    }
+
+    /** for a non-uniform grid, the edge lengths of the voxels along each axis are converted to grid unit */
+    if (cfg->steps.x < 0.f) {
+        size_t gridlen = (size_t)cfg->dim.x + cfg->dim.y + cfg->dim.z;
+        float* gridscale = (float*)malloc(gridlen * sizeof(float));
+
+        for (i = 0; i < (int)cfg->dim.x; i++) {
+            gridscale[i] = cfg->dx[i] / cfg->unitinmm;
+        }
+
+        for (i = 0; i < (int)cfg->dim.y; i++) {
+            gridscale[cfg->dim.x + i] = cfg->dy[i] / cfg->unitinmm;
+        }
+
+        for (i = 0; i < (int)cfg->dim.z; i++) {
+            gridscale[cfg->dim.x + cfg->dim.y + i] = cfg->dz[i] / cfg->unitinmm;
+        }
+
+        CUDA_ASSERT(cudaMalloc((void**) &ggridscale, gridlen * sizeof(float)));
+        CUDA_ASSERT(cudaMemcpy(ggridscale, gridscale, gridlen * sizeof(float), cudaMemcpyHostToDevice));
+        param.gridscale = ggridscale;
+        free(gridscale);
+    }
+
+    /** the forward FD output reads the angular frequency of each output frame from the global memory */
+    if (cfg->outputtype == otRF && cfg->seed != SEED_FROM_FILE && cfg->rffreqnum > 0) {
+        float* rfomega = (float*)malloc(cfg->rffreqnum * sizeof(float));
+
+        for (i = 0; i < (int)cfg->rffreqnum; i++) {
+            rfomega[i] = TWO_PI * cfg->rffreq[i];
+        }
+
+        CUDA_ASSERT(cudaMalloc((void**) &grfomega, cfg->rffreqnum * sizeof(float)));
+        CUDA_ASSERT(cudaMemcpy(grfomega, rfomega, cfg->rffreqnum * sizeof(float), cudaMemcpyHostToDevice));
+        param.rfomega = grfomega;
+        param.rffreqnum = cfg->rffreqnum;
+        free(rfomega);
+    }
+
+    /** the biased launch reads the 0-based indices of the target detectors from the global memory */
+    if (cfg->biasprob > 0.f && cfg->biasdetnum > 0) {
+        uint* biasdet = (uint*)malloc(cfg->biasdetnum * sizeof(uint));
+
+        for (i = 0; i < (int)cfg->biasdetnum; i++) {
+            biasdet[i] = cfg->biasdet[i] - 1;
+        }
+
+        CUDA_ASSERT(cudaMalloc((void**) &gbiasdet, cfg->biasdetnum * sizeof(uint)));
+        CUDA_ASSERT(cudaMemcpy(gbiasdet, biasdet, cfg->biasdetnum * sizeof(uint), cudaMemcpyHostToDevice));
+        param.biasprob = cfg->biasprob;
+        param.biascos = cosf(cfg->biasangle);
+        param.biasdetnum = cfg->biasdetnum;
+        param.biasdet = gbiasdet;
+        free(biasdet);
     }
 
     MCX_FPRINTF(cfg->flog, "init complete : %d ms\n", GetTimeMillis() - tic);
@@ -3243,7 +4469,7 @@ void mcx_run_simulation(Config* cfg, GPUInfo* gpu) {
      *
      *  The calculation of the energy conservation will only reflect the last simulation.
      */
-    sharedbuf = (param.nphaselen + param.nanglelen) * sizeof(float) + gpu[gpuid].autoblock * (cfg->issaveseed * (RAND_BUF_LEN * sizeof(RandType)) + sizeof(float) * (param.w0offset + cfg->srcnum + 2 * (cfg->outputtype == otRF)));
+    sharedbuf = (param.nphaselen + param.nanglelen) * sizeof(float) + gpu[gpuid].autoblock * (cfg->issaveseed * (RAND_BUF_LEN * sizeof(RandType)) + sizeof(float) * (param.w0offset + gpusrcnum + 2 * (cfg->outputtype == otRF)));
 
     MCX_FPRINTF(cfg->flog, "requesting %d bytes of shared memory\n", sharedbuf);
 
@@ -3300,8 +4526,7 @@ void mcx_run_simulation(Config* cfg, GPUInfo* gpu) {
              */
             tic0 = GetTimeMillis();
 #ifdef _WIN32
-            #pragma omp master
-            {
+            if (threadid == 0) {
                 /**
                  * To avoid hanging, we need to use cudaEvent to force GPU to update the pinned memory for progress bar on Windows WHQL driver
                  */
@@ -3314,35 +4539,12 @@ void mcx_run_simulation(Config* cfg, GPUInfo* gpu) {
             fflush(cfg->flog);
             mcx_flush(cfg);
 
-            /**
-             * Determine template constants for compilers to build specialized binary instances to reduce branching
-             * and thread-divergence. If not using template, the performance can take a 20% drop.
-             */
-
-            /** \c ispencil: template constant, if 1, launch photon code is dramatically simplified */
-            int ispencil = (cfg->srctype == MCX_SRC_PENCIL && cfg->nangle == 0);
-
-            /** \c isref: template constant, if 1, perform boundary reflection, if 0, total-absorbion boundary, can simplify kernel */
-            int isref = cfg->isreflect;
-
-            /** \c issvmc: template constant, if 1, consider the input volume containing split-voxel data, see Yan2020 for details */
-            int issvmc = (cfg->mediabyte == MEDIA_2LABEL_SPLIT);
-
-            /** \c ispolarized: template constant, if 1, perform polarized light simulations, currently only supports label-based media */
-            int ispolarized = (cfg->mediabyte <= 4) && (cfg->polmedianum > 0);
-
-            /** Enable reflection flag when c or m flags are used in the cfg.bc boundary condition flags */
-            for (i = 0; i < 6; i++)
-                if (cfg->bc[i] == bcReflect || cfg->bc[i] == bcMirror) {
-                    isref = 1;
-                }
-
             /**
              * Launch GPU kernel using template constants. Here, the compiler will create 2^4=16 individually compiled
              * kernel PTX binaries for each combination of template variables. This creates bigger binary and slower
              * compilation time, but brings up to 20%-30% speed improvement on certain simulations.
              */
-            switch (ispencil * 10000 + (isref > 0) * 1000 + (cfg->mediabyte <= 4) * 100 + issvmc * 10 + ispolarized) {
+            switch (mcx_kernel_variant(cfg)) {
                 case 0:
                     mcx_main_loop<0, 0, 0, 0, 0> <<< mcgrid, mcblock, sharedbuf>>>(gmedia, gfield, genergy, gPseed, gPpos, gPdir, gPlen, gPdet, gdetected, gsrcpattern, greplayw, greplaytof, greplaydetid, gseeddata, gdebugdata, ginvcdf, gangleinvcdf, gsmatrix, gprogress);
                     break;
@@ -3424,8 +4626,7 @@ void mcx_run_simulation(Config* cfg, GPUInfo* gpu) {
                     // Used 78 registers, 464 bytes cmem[0], 52 bytes cmem[2]
             }
 
-            #pragma omp master
-            {
+            if (threadid == 0) {
                 /**
                  * By now, the GPU kernel has been launched asynchronously, the master thread on the host starts
                  * reading a pinned memory variable, \c gprogress, to realtimely read the completed photon count
@@ -3504,7 +4705,15 @@ void mcx_run_simulation(Config* cfg, GPUInfo* gpu) {
              */
             if (cfg->debuglevel & (MCX_DEBUG_MOVE | MCX_DEBUG_MOVE_ONLY)) {
                 uint debugrec = 0;
+                float* debugbuf = NULL;
                 CUDA_ASSERT(cudaMemcpyFromSymbol(&debugrec, gjumpdebug, sizeof(uint), 0, cudaMemcpyDeviceToHost));
+
+                /** the records are retrieved before entering the critical section, which must not raise an error */
+                if (debugrec > 0) {
+                    debugbuf = (float*)mcx_hostpool_get(gpuid, psDebug, sizeof(float) * debuglen * min(debugrec, cfg->maxjumpdebug));
+                    CUDA_ASSERT(cudaMemcpy(debugbuf, gdebugdata, sizeof(float) * debuglen * min(debugrec, cfg->maxjumpdebug), cudaMemcpyDeviceToHost));
+                }
+
                 #pragma omp critical
                 {
                     if (debugrec > 0) {
@@ -3518,7 +4727,12 @@ are more than what your have specified (%d), please use the --maxjumpdebug optio
 
                         debugrec = min(debugrec, cfg->maxjumpdebug);
                         cfg->exportdebugdata = (float*)realloc(cfg->exportdebugdata, (cfg->debugdatalen + debugrec) * debuglen * sizeof(float));
-                        CUDA_ASSERT(cudaMemcpy(cfg->exportdebugdata + cfg->debugdatalen, gdebugdata, sizeof(float)*debuglen * debugrec, cudaMemcpyDeviceToHost));
+                        memcpy(cfg->exportdebugdata + (size_t)cfg->debugdatalen * debuglen, debugbuf, sizeof(float) * debuglen * debugrec);
+
+                        if (cfg->istrajsort) {
+                            cfg->trajidbase = mcx_traj_shiftid(cfg->exportdebugdata + (size_t)cfg->debugdatalen * debuglen, debugrec, debuglen, cfg->trajidbase);
+                        }
+
                         cfg->debugdatalen += debugrec;
                     }
                 }
@@ -3530,14 +4744,14 @@ are more than what your have specified (%d), please use the --maxjumpdebug optio
 #ifdef SAVE_DETECTORS
 
             if (cfg->issavedet) {
-                CUDA_ASSERT(cudaMemcpy(Pdet, gPdet, sizeof(float)*cfg->maxdetphoton * (hostdetreclen), cudaMemcpyDeviceToHost));
+                CUDA_ASSERT(cudaMemcpy(Pdet, gPdet, sizeof(float)*MIN(detected, cfg->maxdetphoton) * (hostdetreclen), cudaMemcpyDeviceToHost));
                 CUDA_ASSERT(cudaGetLastError());
 
                 /**
                  * If photon seeds are needed for replay, here we retrieve the seed data
                  */
                 if (cfg->issaveseed) {
-                    CUDA_ASSERT(cudaMemcpy(seeddata, gseeddata, sizeof(RandType)*cfg->maxdetphoton * RAND_BUF_LEN, cudaMemcpyDeviceToHost));
+                    CUDA_ASSERT(cudaMemcpy(seeddata, gseeddata, sizeof(RandType)*MIN(detected, cfg->maxdetphoton) * RAND_BUF_LEN, cudaMemcpyDeviceToHost));
                 }
 
                 if (detected > cfg->maxdetphoton) {
@@ -3558,10 +4772,14 @@ is more than what your have specified (%d), please use the -H option to specify
                 if (cfg->exportdetected) {
                     #pragma omp critical
                     {
-                        cfg->exportdetected = (float*)realloc(cfg->exportdetected, (cfg->detectedcount + detected) * hostdetreclen * sizeof(float));
+                        size_t capacity = mcx_bufcapacity(cfg->detectedcount + detected, cfg->maxdetphoton);
 
-                        if (cfg->issaveseed && cfg->seeddata) {
-                            cfg->seeddata = (RandType*)realloc(cfg->seeddata, (cfg->detectedcount + detected) * sizeof(RandType) * RAND_BUF_LEN);
+                        if (capacity != mcx_bufcapacity(cfg->detectedcount, cfg->maxdetphoton)) {
+                            cfg->exportdetected = (float*)realloc(cfg->exportdetected, capacity * hostdetreclen * sizeof(float));
+
+                            if (cfg->issaveseed && cfg->seeddata) {
+                                cfg->seeddata = (RandType*)realloc(cfg->seeddata, capacity * sizeof(RandType) * RAND_BUF_LEN);
+                            }
                         }
 
                         memcpy(cfg->exportdetected + cfg->detectedcount * (hostdetreclen), Pdet, detected * (hostdetreclen)*sizeof(float));
@@ -3582,7 +4800,7 @@ is more than what your have specified (%d), please use the -H option to specify
              * Accumulate volumetric fluence from all threads/devices
              */
             if (cfg->issave2pt) {
-                OutputType* rawfield = (OutputType*)malloc(sizeof(OutputType) * fieldlen * SHADOWCOUNT);
+                OutputType* rawfield = (OutputType*)mcx_hostpool_get(gpuid, psField, sizeof(OutputType) * fieldlen * SHADOWCOUNT);
                 CUDA_ASSERT(cudaMemcpy(rawfield, gfield, sizeof(OutputType)*fieldlen * SHADOWCOUNT, cudaMemcpyDeviceToHost));
                 MCX_FPRINTF(cfg->flog, "transfer complete:\t%d ms\n", GetTimeMillis() - tic);
                 fflush(cfg->flog);
@@ -3603,12 +4821,26 @@ is more than what your have specified (%d), please use the -H option to specify
 #endif
                 }
 
-                if (cfg->outputtype == otRF && cfg->omega > 0.f && SHADOWCOUNT == 2) {
-                    rfimag = (OutputType*)malloc(fieldlen * sizeof(OutputType));
-                    memcpy(rfimag, rawfield + fieldlen, fieldlen * sizeof(OutputType));
-                }
+                /**
+                 * The imaginary part of a single respin is exported directly from the pooled buffer; each
+                 * respin overwrites that buffer, so the imaginary parts of multiple respins are summed in rfimagsum
+                 */
+                if (cfg->outputtype == otRF && (cfg->omega > 0.f || cfg->rffreqnum > 0) && SHADOWCOUNT == 2) {
+                    if (ABS(cfg->respin) > 1) {
+                        if (rfimagsum == NULL) {
+                            rfimagsum = (OutputType*)calloc(fieldlen, sizeof(OutputType));
+                            own.rfimagsum = rfimagsum;
+                        }
 
-                free(rawfield);
+                        for (i = 0; i < (int)fieldlen; i++) {
+                            rfimagsum[i] += rawfield[i + fieldlen];
+                        }
+
+                        rfimag = rfimagsum;
+                    } else {
+                        rfimag = rawfield + fieldlen;
+                    }
+                }
 
                 /**
                  * If respin is used, each repeatition is accumulated to the 2nd half of the buffer
@@ -3664,10 +4896,13 @@ is more than what your have specified (%d), please use the -H option to specify
                     cfg->exportfield[i + fieldlen] += rfimag[i];
             }
 
-            free(rfimag);
             rfimag = NULL;
         }
 
+        if (rfimagsum) {
+            memset(rfimagsum, 0, fieldlen * sizeof(OutputType));
+        }
+
         if (param.twin1 < cfg->tend) {
             CUDA_ASSERT(cudaMemset(genergy, 0, sizeof(float) * (gpu[gpuid].autothread << 1)));
         }
@@ -3679,39 +4914,58 @@ is more than what your have specified (%d), please use the -H option to specify
      * Let the master thread to deal with the normalization and file IO
      * First, if multi-pattern simulation, i.e. photon sharing, is used, we normalize each pattern first
      */
-    #pragma omp master
-    {
+    if (threadid == 0) {
+        float* scale = NULL;
+
+        /**
+         * If a low-rank basis replaced the photon-sharing patterns, rebuild the output of each pattern from the basis outputs
+         */
+        if (cfg->patternrank > 0 && cfg->exportfield) {
+            mcx_lowrank_expand(cfg->exportfield, fieldlen / gpusrcnum, gpusrcnum, cfg->srcnum, cfg->patterncoef);
+            dimxyz = exportdimxyz;
+            fieldlen = exportdimxyz * gpu[gpuid].maxgate;
+        }
+
+        /**
+         * If requested, group the trajectory records of each photon and keep every cfg.trajstep-th position
+         */
+        if (cfg->istrajsort && cfg->exportdebugdata && cfg->debugdatalen > 0) {
+            size_t trajphotons = 0;
+            unsigned int trajtic = GetTimeMillis();
+
+            cfg->exportdebugdata = mcx_traj_compact(cfg->exportdebugdata, &cfg->debugdatalen, debuglen, cfg->trajstep, &trajphotons);
+            MCX_FPRINTF(cfg->flog, "grouped %u trajectory positions of %lu photons:\t%d ms\n", cfg->debugdatalen, (unsigned long)trajphotons, GetTimeMillis() - trajtic);
+        }
+
         if (cfg->issave2pt && cfg->srctype == MCX_SRC_PATTERN && cfg->srcnum > 1) { // post-processing only for multi-srcpattern
             srcpw = (float*)calloc(cfg->srcnum, sizeof(float));
             energytot = (float*)calloc(cfg->srcnum, sizeof(float));
             energyabs = (float*)calloc(cfg->srcnum, sizeof(float));
+            own.srcpw = srcpw;
+            own.energytot = energytot;
+            own.energyabs = energyabs;
             int psize = (int)cfg->srcparam1.w * (int)cfg->srcparam2.w;
+            double* patsum = (double*)calloc(cfg->srcnum, sizeof(double));
 
-            for (i = 0; i < int(cfg->srcnum); i++) {
-                float kahanc = 0.f;
-
-                for (iter = 0; iter < psize; iter++) {
-                    mcx_kahanSum(&srcpw[i], &kahanc, cfg->srcpattern[iter * cfg->srcnum + i]);
-                }
+            /** all patterns are summed in one pass over the interleaved pattern and output arrays */
+            mcx_norm_colsum(cfg->srcpattern, psize, cfg->srcnum, NULL, 0, patsum);
 
+            for (i = 0; i < int(cfg->srcnum); i++) {
+                srcpw[i] = (float)patsum[i];
                 energytot[i] = cfg->nphoton * srcpw[i] / (float)psize;
-                kahanc = 0.f;
-
-                if (cfg->outputtype == otEnergy) {
-                    int fieldlenPsrc = fieldlen / cfg->srcnum;
+            }
 
-                    for (iter = 0; iter < fieldlenPsrc; iter++) {
-                        mcx_kahanSum(&energyabs[i], &kahanc, cfg->exportfield[iter * cfg->srcnum + i]);
-                    }
-                } else {
-                    int j;
+            if (cfg->outputtype == otEnergy) {
+                mcx_norm_colsum(cfg->exportfield, fieldlen / cfg->srcnum, cfg->srcnum, NULL, 0, patsum);
+            } else {
+                mcx_norm_colsum(cfg->exportfield, (size_t)gpu[gpuid].maxgate * dimlen.z, cfg->srcnum, mcx_muavolume(cfg), dimlen.z, patsum);
+            }
 
-                    for (iter = 0; iter < gpu[gpuid].maxgate; iter++)
-                        for (j = 0; j < (int)dimlen.z; j++) {
-                            mcx_kahanSum(&energyabs[i], &kahanc, cfg->exportfield[iter * dimxyz + (j * cfg->srcnum + i)]*mcx_updatemua((uint)cfg->vol[j], cfg));
-                        }
-                }
+            for (i = 0; i < int(cfg->srcnum); i++) {
+                energyabs[i] = (float)patsum[i];
             }
+
+            free(patsum);
         }
 
         /**
@@ -3723,9 +4977,11 @@ is more than what your have specified (%d), please use the -H option to specify
          * (joule/mm) when cfg.outputtype='flux' (default).
          */
         if (cfg->issave2pt && cfg->isnormalized) {
-            float* scale = (float*)calloc(cfg->srcnum, sizeof(float));
+            scale = (float*)calloc(cfg->srcnum, sizeof(float));
+            own.scale = scale;
             scale[0] = 1.f;
             int isnormalized = 0;
+            int isrfwd = (cfg->outputtype == otRF && cfg->seed != SEED_FROM_FILE); /** forward FD output */
             MCX_FPRINTF(cfg->flog, "normalizing raw data ...\t");
             cfg->energyabs += cfg->energytot - cfg->energyesc;
 
@@ -3733,10 +4989,11 @@ is more than what your have specified (%d), please use the -H option to specify
              * If output is flux (J/(s*mm^2), default), raw data (joule*mm) is multiplied by (1/(Nphoton*Vvox*dt))
              * If output is fluence (J/mm^2), raw data (joule*mm) is multiplied by (1/(Nphoton*Vvox))
              */
-            if (cfg->outputtype == otFlux || cfg->outputtype == otFluence) {
+            if (cfg->outputtype == otFlux || cfg->outputtype == otFluence || isrfwd) {
                 scale[0] = cfg->unitinmm / (cfg->energytot * Vvox * cfg->tstep); /* Vvox (in mm^3 already) * (Tstep) * (Eabsorp/U) */
 
-                if (cfg->outputtype == otFluence) {
+                /** the forward FD output is a time-integrated quantity, normalized as the fluence */
+                if (cfg->outputtype == otFluence || isrfwd) {
                     scale[0] *= cfg->tstep;
                 }
             } else if (cfg->outputtype == otEnergy || cfg->outputtype == otL) { /** If output is energy (joule), raw data is simply multiplied by 1/Nphoton */
@@ -3744,15 +5001,16 @@ is more than what your have specified (%d), please use the -H option to specify
             } else if (cfg->outputtype == otJacobian || cfg->outputtype == otWP || cfg->outputtype == otDCS || cfg->outputtype == otRF) {
                 if (cfg->seed == SEED_FROM_FILE && cfg->replaydet == -1) {
                     int detid;
+                    double* detweight = (double*)calloc(cfg->detnum, sizeof(double));
+
+                    /** the replayed weights of all detectors are summed in a single pass */
+                    if (cfg->isnormalized != 2) {
+                        mcx_norm_labelsum(cfg->replay.weight, cfg->replay.detid, cfg->nphoton, cfg->detnum, detweight);
+                    }
 
                     for (detid = 1; detid <= (int)cfg->detnum; detid++) {
                         if (cfg->isnormalized != 2) {
-                            scale[0] = 0.f; // the cfg->normalizer and cfg.his.normalizer are inaccurate in this case, but this is ok
-
-                            for (size_t i = 0; i < cfg->nphoton; i++)
-                                if (cfg->replay.detid[i] == detid) {
-                                    scale[0] += cfg->replay.weight[i];
-                                }
+                            scale[0] = (float)detweight[detid - 1]; // the cfg->normalizer and cfg.his.normalizer are inaccurate in this case, but this is ok
 
                             if (scale[0] > 0.f) {
                                 scale[0] = cfg->unitinmm / scale[0];
@@ -3763,20 +5021,20 @@ is more than what your have specified (%d), please use the -H option to specify
 
                         MCX_FPRINTF(cfg->flog, "normalization factor for detector %d alpha=%f\n", detid, scale[0]);
                         fflush(cfg->flog);
-                        mcx_normalize(cfg->exportfield + (detid - 1)*dimxyz * gpu[gpuid].maxgate, scale[0], dimxyz * gpu[gpuid].maxgate, cfg->isnormalized, 0, 1);
+                        mcx_norm_scale(cfg->exportfield + (detid - 1)*dimxyz * gpu[gpuid].maxgate, (size_t)dimxyz * gpu[gpuid].maxgate, 1, scale, cfg->isnormalized);
 
                         if (cfg->outputtype == otRF) {
-                            mcx_normalize(cfg->exportfield + fieldlen + (detid - 1)*dimxyz * gpu[gpuid].maxgate, scale[0], dimxyz * gpu[gpuid].maxgate, cfg->isnormalized, 0, 1);
+                            mcx_norm_scale(cfg->exportfield + fieldlen + (detid - 1)*dimxyz * gpu[gpuid].maxgate, (size_t)dimxyz * gpu[gpuid].maxgate, 1, scale, cfg->isnormalized);
                         }
                     }
 
+                    free(detweight);
                     isnormalized = 1;
                 } else {
-                    scale[0] = 0.f;
+                    double weightsum = 0.0;
 
-                    for (size_t i = 0; i < cfg->nphoton; i++) {
-                        scale[0] += cfg->replay.weight[i];
-                    }
+                    mcx_norm_colsum(cfg->replay.weight, cfg->nphoton, 1, NULL, 0, &weightsum);
+                    scale[0] = (float)weightsum;
 
                     if (scale[0] > 0.f) {
                         scale[0] = cfg->unitinmm / scale[0];
@@ -3806,70 +5064,67 @@ is more than what your have specified (%d), please use the -H option to specify
             cfg->normalizer = scale[0];
             cfg->his.normalizer = scale[0];
 
-            if (!isnormalized) {
+            /**
+             * A shard saves its raw output, the merge tool applies the combined factors of all shards
+             * and, on a non-uniform grid, the voxel-volume division using the grid saved in <session>_shard.json
+             */
+            if (cfg->shardnum > 0) {
+                MCX_FPRINTF(cfg->flog, "shard %d/%d, normalization factor alpha=%f is not applied\n", cfg->shardid, cfg->shardnum, scale[0]);
+            } else if (!isnormalized) {
                 for (i = 0; i < (int)cfg->srcnum; i++) {
                     MCX_FPRINTF(cfg->flog, "source %d, normalization factor alpha=%f\n", (i + 1), scale[i]);
-                    fflush(cfg->flog);
-                    mcx_normalize(cfg->exportfield, scale[i], fieldlen / cfg->srcnum * ((cfg->outputtype == otRF) + 1), cfg->isnormalized, i, cfg->srcnum);
                 }
-            }
-
-            free(scale);
-            MCX_FPRINTF(cfg->flog, "data normalization complete : %d ms\n", GetTimeMillis() - tic);
-        }
 
-        /**
-         * If not running as a mex file, we need to save volumetric output data, if enabled, as
-         * a file, with suffix specifed by cfg.outputformat (mc2,nii, or .jdat or .jbat)
-         */
-
-#ifndef MCX_CONTAINER
+                fflush(cfg->flog);
 
-        if (cfg->issave2pt && cfg->parentid == mpStandalone) {
-            MCX_FPRINTF(cfg->flog, "saving data to file ...\t");
-            mcx_savedata(cfg->exportfield, fieldlen, cfg);
-            MCX_FPRINTF(cfg->flog, "saving data complete : %d ms\n\n", GetTimeMillis() - tic);
-            fflush(cfg->flog);
-        }
+                /** all sources are scaled in one pass, each row of the output holds the srcnum interleaved values of a voxel */
+                mcx_norm_scale(cfg->exportfield, (size_t)fieldlen / cfg->srcnum * ((cfg->outputtype == otRF) + 1), cfg->srcnum, scale, cfg->isnormalized);
 
-#endif
+                /** on a non-uniform grid, the fluence of each voxel is further divided by its volume relative to a unitinmm^3 voxel */
+                if (cfg->steps.x < 0.f && (cfg->outputtype == otFlux || cfg->outputtype == otFluence || isrfwd)) {
+                    unsigned int griddim[3] = {cfg->dim.x, cfg->dim.y, cfg->dim.z};
 
-        /**
-         * If not running as a mex file, we need to save detected photon data, if enabled, as
-         * a file, either as a .mch file, or a .jdat/.jbat file
-         */
-#ifndef MCX_CONTAINER
+                    mcx_norm_voxelvolume(cfg->exportfield, griddim, cfg->dx, cfg->dy, cfg->dz, cfg->unitinmm,
+                                         (size_t)fieldlen / ((size_t)dimlen.z * cfg->srcnum) * (isrfwd + 1), cfg->srcnum);
+                }
 
-        if (cfg->issavedet && cfg->parentid == mpStandalone && cfg->exportdetected) {
-            cfg->his.unitinmm = cfg->unitinmm;
-            cfg->his.savedphoton = cfg->detectedcount;
-            cfg->his.totalphoton = cfg->nphoton;
+                /** in the coarse-to-fine mode, the time-integrated output is compared with the coarse run inside the tallied region */
+                if (pyramidfield && (cfg->outputtype == otFlux || cfg->outputtype == otFluence)) {
+                    unsigned int griddim[3] = {cfg->dim.x, cfg->dim.y, cfg->dim.z}, coarsedim[3] = {cfg->pyramiddim.x, cfg->pyramiddim.y, cfg->pyramiddim.z};
+                    unsigned int roi0[3] = {cfg->roi0.x, cfg->roi0.y, cfg->roi0.z}, roi1[3] = {cfg->roi1.x, cfg->roi1.y, cfg->roi1.z};
+                    double err = mcx_pyramid_error(cfg->exportfield, griddim, gpu[gpuid].maxgate, (cfg->outputtype == otFlux) ? 1.f / gpu[gpuid].maxgate : 1.f,
+                                                   pyramidfield, coarsedim, cfg->srcnum, cfg->pyramid, roi0, roi1);
 
-            if (cfg->issaveseed) {
-                cfg->his.seedbyte = sizeof(RandType) * RAND_BUF_LEN;
+                    MCX_FPRINTF(cfg->flog, "pyramid: relative L2 difference between the coarse and full-resolution fluence in the tallied region: %e\n", err);
+                }
             }
 
-            cfg->his.detected = cfg->detectedcount;
-            mcx_savedetphoton(cfg->exportdetected, cfg->seeddata, cfg->detectedcount, 0, cfg);
+            MCX_FPRINTF(cfg->flog, "data normalization complete : %d ms\n", GetTimeMillis() - tic);
         }
 
-#endif
+        /**
+         * If an output cache folder is specified, store the normalized outputs under the hash of this simulation
+         */
+        if (iscachable) {
+            mcx_cache_save(cfg, cachekey, fieldlen * (1 + (cfg->outputtype == otRF)), hostdetreclen, sizeof(RandType) * RAND_BUF_LEN, debuglen);
+        }
+
+        mcx_export_halfdet(cfg, hostdetreclen + halfsaving);
+        mcx_export_dcs(cfg);
 
         /**
-         * If not running as a mex file, we need to save photon trajectory data, if enabled, as
-         * a file, either as a .mct file, or a .jdat/.jbat file
+         * If not running as a mex file, we need to save the volumetric, detected photon and trajectory data to files
          */
 #ifndef MCX_CONTAINER
+        mcx_save_outputs(cfg, fieldlen, debuglen, tic);
 
-        if ((cfg->debuglevel & (MCX_DEBUG_MOVE | MCX_DEBUG_MOVE_ONLY)) && cfg->parentid == mpStandalone && cfg->exportdebugdata) {
-            cfg->his.colcount = debuglen;
-            cfg->his.savedphoton = cfg->debugdatalen;
-            cfg->his.totalphoton = cfg->nphoton;
-            cfg->his.detected = 0;
-            mcx_savedetphoton(cfg->exportdebugdata, NULL, cfg->debugdatalen, 0, cfg);
+        if (cfg->shardnum > 0) {
+            mcx_saveshard(scale, cfg);
         }
 
 #endif
+        free(scale);
+        own.scale = NULL;
     }
     #pragma omp barrier
     /**
@@ -3887,8 +5142,7 @@ is more than what your have specified (%d), please use the -H option to specify
 
     CUDA_ASSERT(cudaMemcpy(energy, genergy, sizeof(float) * (gpu[gpuid].autothread << 1), cudaMemcpyDeviceToHost));
 
-    #pragma omp master
-    {
+    if (threadid == 0) {
         printnum = (gpu[gpuid].autothread < (int)cfg->printnum) ? gpu[gpuid].autothread : cfg->printnum;
 
         for (i = 0; i < (int)printnum; i++) {
@@ -3927,6 +5181,23 @@ is more than what your have specified (%d), please use the -H option to specify
      * Simulation is complete, now we need clear up all GPU memory buffers
      */
     CUDA_ASSERT(cudaFree(gmedia));
+
+    if (gglobalprop) {
+        CUDA_ASSERT(cudaFree(gglobalprop));
+    }
+
+    if (ggridscale) {
+        CUDA_ASSERT(cudaFree(ggridscale));
+    }
+
+    if (grfomega) {
+        CUDA_ASSERT(cudaFree(grfomega));
+    }
+
+    if (gbiasdet) {
+        CUDA_ASSERT(cudaFree(gbiasdet));
+    }
+
     CUDA_ASSERT(cudaFree(gfield));
     CUDA_ASSERT(cudaFree(gPpos));
     CUDA_ASSERT(cudaFree(gPdir));
@@ -3954,7 +5225,6 @@ is more than what your have specified (%d), please use the -H option to specify
 
     if (cfg->issaveseed) {
         CUDA_ASSERT(cudaFree(gseeddata));
-        free(seeddata);
     }
 
     if (cfg->seed == SEED_FROM_FILE) {
@@ -3972,10 +5242,18 @@ is more than what your have specified (%d), please use the -H option to specify
     }
 
     /**
-     * The below call in theory is not needed, but it ensures the device is freed for other programs, especially on Windows
+     * The below call in theory is not needed, but it ensures the device is freed for other programs, especially on Windows;
+     * in the server mode, or in a nested run, the device context is kept alive for the next job
      */
+    MCX_FPRINTF(cfg->flog, "pinned host buffers of device %d: peak %.1f MB\n", gpuid + 1, hostpool[gpuid].peak / 1048576.0);
+
 #ifndef MCX_DISABLE_CUDA_DEVICE_RESET
-    CUDA_ASSERT(cudaDeviceReset());
+
+    if (!cfg->isserve && !cfg->isnested) {
+        mcx_hostpool_release(gpuid);
+        CUDA_ASSERT(cudaDeviceReset());
+    }
+
 #endif
 
     /**
@@ -3986,10 +5264,14 @@ is more than what your have specified (%d), please use the -H option to specify
     free(Plen);
     free(Plen0);
     free(Pseed);
-    free(Pdet);
     free(energy);
     free(field);
+    free(rfimagsum);
     free(srcpw);
     free(energytot);
     free(energyabs);
+    free(pyramidfield);
+
+    mcx_serve_settrap(outertrap);
+    return 0;
 }
@@ -194,10 +194,47 @@ typedef struct  __align__(16) KernelParams {
     unsigned int nangle;               /**< number of samples for launch angle inverse-cdf, will be added by 2 to include 0 and 1 on the two ends */
     unsigned int nanglelen;            /**< even-rounded nangle so that shared memory buffer won't give an error */
     float omega;                       /**< modulation angular frequency (2*pi*f), in rad/s, for FD/RF replay */
+    float* rfomega;                    /**< angular frequencies (rad/s) of the output frames of the forward FD output, NULL otherwise */
+    unsigned int rffreqnum;            /**< number of modulation frequencies of the forward FD output */
+    float biasprob;                    /**< probability of launching a photon toward the target detectors, 0 to disable the biased launch */
+    float biascos;                     /**< cosine of the half-angle of the biased launch cone around each target detector */
+    unsigned int biasdetnum;           /**< number of target detectors of the biased launch */
+    unsigned int* biasdet;             /**< 0-based indices of the target detectors of the biased launch, NULL if disabled */
+    unsigned int isbrick;              /**< 1 if the media buffer is brick-compressed, see mcx_brick.h */
+    uint2 brickdim;                    /**< number of 8x8x8 bricks along x and y when isbrick is set */
+    unsigned int mediabits;            /**< 0: 32-bit media words; 4 or 8: labels packed at 4 or 8 bits per voxel */
+    unsigned int maskoffset;           /**< word offset of the 1-bit detector mask after the packed labels, 0 if none */
+    unsigned int constmedia;           /**< number of media properties stored in the constant memory, followed by the detectors */
+    float4* globalprop;                /**< global-memory table of all media properties, NULL if all fit in the constant memory */
+    float* gridscale;                  /**< edge lengths (in grid unit) of the voxels along x, then y, then z, NULL for uniform grids */
+    unsigned int trajphoton;           /**< save the trajectory of every trajphoton-th photon when -D M is used */
+    DetFilter detfilter;               /**< criteria of the detected photons to be saved, see mcx_detfilter.h */
+    unsigned int ishalfdet;            /**< 1 to save the ppath/mom columns of detected photons as half-precision pairs */
+    unsigned int isroi;                /**< 1 if only the voxels within [roi0, roi1] accumulate the volumetric output */
+    uint3 roi0;                        /**< lower corner (0-based voxel index, inclusive) of the tallied region */
+    uint3 roi1;                        /**< upper corner (inclusive) of the tallied region */
     unsigned char bc[12];              /**< boundary condition flags, copy the first 12 chars from cfg->bc without the terminating NULL */
 } MCXParam;
 
-void mcx_run_simulation(Config* cfg, GPUInfo* gpu);
+/**
+ * Slots of the pinned host buffer pool, one for each kind of device-to-host transfer
+ */
+
+enum TPoolSlot {psField, psDetected, psSeed, psDebug, psSlotNum};
+
+/**
+ * Page-locked host buffers of a device, reused across respins, time-gate groups and
+ * successive simulations as long as the device context is kept alive
+ */
+
+typedef struct MCXHostPool {
+    void*  buf[psSlotNum];             /**< pinned buffer of each slot, NULL if not yet allocated */
+    size_t len[psSlotNum];             /**< allocated bytes of each slot */
+    size_t peak;                       /**< peak total bytes held by the pool */
+} HostPool;
+
+int  mcx_run_simulation(Config* cfg, GPUInfo* gpu);
+void mcx_reset_device(int gpuid);
 int  mcx_list_gpu(Config* cfg, GPUInfo** info);
 
 #ifdef  __cplusplus
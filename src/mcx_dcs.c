@@ -0,0 +1,223 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    mcx_dcs.c
+
+@brief   Diffuse correlation spectroscopy (DCS) g1 from the detected photon momentum transfer
+
+This is a native implementation of utils/mcxdcsg1.m. For each detector, the
+normalized electric-field autocorrelation at a correlation time tau is
+
+  g1(tau) = sum_p exp(-sum_i k0_i^2 <dr^2(tau)>/3 Y_pi - sum_i mua_i L_pi) / sum_p exp(-sum_i mua_i L_pi)
+
+where Y_pi and L_pi are the momentum transfer and the partial path of the
+detected photon p in medium i, k0_i=2*pi*n_i/lambda, and the mean square
+displacement <dr^2> is 6*Db*tau for Brownian motion or V^2*tau^2 for random
+flow. Each record is reduced to its two exponents once, and the photons are
+split into blocks that are summed in parallel and combined in a fixed order,
+so that the result does not depend on the thread number.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mcx_dcs.h"
+#include "mcx_const.h"
+#include "mcx_detfilter.h"
+#include "mcx_norm.h"
+
+#define DCS_MINROWS      1024                       /**< minimum number of photons summed by one block */
+#define DCS_MAXBLOCK     64                         /**< max number of blocks */
+#define DCS_MAXPARTIAL   (1 << 22)                  /**< max number of partial sums held by all blocks */
+
+/**
+ * @brief Create the default list of correlation times, log-equidistant between MCX_DCS_TAUMIN and MCX_DCS_TAUMAX
+ *
+ * @param[in] ntau: the number of correlation times
+ * @return the correlation times in s, must be freed by the caller, NULL if the memory can not be allocated
+ */
+
+float* mcx_dcs_taulist(unsigned int ntau) {
+    float* tau = (float*)malloc(ntau * sizeof(float));
+    unsigned int i;
+
+    if (tau == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; i < ntau; i++) {
+        double ratio = (ntau > 1) ? (double)i / (ntau - 1) : 0.0;
+
+        tau[i] = (float)(MCX_DCS_TAUMIN * pow(MCX_DCS_TAUMAX / MCX_DCS_TAUMIN, ratio));
+    }
+
+    return tau;
+}
+
+/**
+ * @brief Read a partial path or momentum transfer value of a record
+ *
+ * @param[in] col: the first column of the group of values
+ * @param[in] j: the 0-based medium index
+ * @param[in] ishalf: 1 if the group is stored in half precision, two values per word
+ * @return the value in single precision
+ */
+
+static float mcx_dcs_column(const float* col, unsigned int j, int ishalf) {
+    if (ishalf) {
+        unsigned int pair = ((const unsigned int*)col)[j >> 1];
+
+        return mcx_half2float((unsigned short)((j & 1) ? (pair >> 16) : (pair & 0xFFFF)));
+    }
+
+    return col[j];
+}
+
+/**
+ * @brief Compute the DCS g1 curves of all detectors from the detected photon records
+ *
+ * The records use the layout of cfg->savedetflag, with cfg->his.colcount floats per
+ * record and the ppath/mom columns in half precision if cfg->his.ishalf is set; the
+ * partial paths are in grid unit, as cfg->prop. Records of a detector outside of
+ * [1, cfg->detnum] are skipped, and g1 of a detector without photons is 0.
+ *
+ * @param[in] rec: the detected photon records
+ * @param[in] count: the number of records
+ * @param[in] cfg: simulation configuration, providing the model (dcsmodel, dcsdisp), the
+ *                 correlation times (dcstau, dcsntau), the wavelength and the media
+ * @param[out] g1: cfg->detnum x cfg->dcsntau values, g1[d * dcsntau + t] for detector d+1
+ * @return 0 if successful, -1 if the records lack the columns or the memory can not be allocated
+ */
+
+int mcx_dcs_g1(const float* rec, size_t count, const Config* cfg, float* g1) {
+    unsigned int maxmedia = cfg->medianum - 1, detnum = cfg->detnum, ntau = cfg->dcsntau, rowlen = ntau + 1;
+    unsigned int group = cfg->his.ishalf ? ((maxmedia + 1) >> 1) : maxmedia;
+    unsigned int ppathoff = SAVE_DETID(cfg->savedetflag) + SAVE_NSCAT(cfg->savedetflag) * maxmedia;
+    unsigned int momoff = ppathoff + SAVE_PPATH(cfg->savedetflag) * group;
+    unsigned int w0off = momoff + SAVE_MOM(cfg->savedetflag) * group + 3 * (SAVE_PEXIT(cfg->savedetflag) + SAVE_VEXIT(cfg->savedetflag));
+    size_t blocklen, blocknum = (count + DCS_MINROWS - 1) / DCS_MINROWS, sumlen = (size_t)detnum * rowlen;
+    double lambda = ((cfg->lambda > 0.f) ? cfg->lambda : MCX_DCS_LAMBDA) * 1e-6; /* in mm */
+    double* kfactor, *mua, *disp, *partial;
+    unsigned int i, j;
+    int b;
+
+    if (!SAVE_PPATH(cfg->savedetflag) || !SAVE_MOM(cfg->savedetflag) || detnum == 0 || ntau == 0 || cfg->dcstau == NULL) {
+        return -1;
+    }
+
+    blocknum = MIN(blocknum, DCS_MAXBLOCK);
+    blocknum = MAX(MIN(blocknum, DCS_MAXPARTIAL / sumlen), 1);
+    blocklen = (count + blocknum - 1) / blocknum;
+
+    kfactor = (double*)malloc(maxmedia * sizeof(double));
+    mua = (double*)malloc(maxmedia * sizeof(double));
+    disp = (double*)malloc(ntau * sizeof(double));
+    partial = (double*)calloc(blocknum * sumlen, sizeof(double));
+
+    if (kfactor == NULL || mua == NULL || disp == NULL || partial == NULL) {
+        free(kfactor);
+        free(mua);
+        free(disp);
+        free(partial);
+        return -1;
+    }
+
+    /** k0^2/3 of each medium in 1/mm^2; mua is in 1/grid-unit like the partial paths */
+    for (j = 0; j < maxmedia; j++) {
+        double k0 = TWO_PI * cfg->prop[j + 1].n / lambda;
+
+        kfactor[j] = k0 * k0 / 3.0;
+        mua[j] = cfg->prop[j + 1].mua;
+    }
+
+    for (i = 0; i < ntau; i++) {
+        disp[i] = (cfg->dcsmodel == MCX_DCS_RANDOMFLOW) ? (double)cfg->dcsdisp * cfg->dcsdisp * cfg->dcstau[i] * cfg->dcstau[i]
+                  : 6.0 * cfg->dcsdisp * cfg->dcstau[i];
+    }
+
+    #pragma omp parallel for schedule(static) num_threads(mcx_norm_threadnum(count * rowlen))
+
+    for (b = 0; b < (int)blocknum; b++) {
+        double* acc = partial + (size_t)b * sumlen;
+        size_t p, end = MIN(((size_t)b + 1) * blocklen, count);
+
+        for (p = (size_t)b * blocklen; p < end; p++) {
+            const float* row = rec + p * cfg->his.colcount;
+            unsigned int detid = SAVE_DETID(cfg->savedetflag) ? (((unsigned int)row[0]) & 0xFFFF) : 1;
+            double atten = 0.0, mom = 0.0, weight;
+            double* sum;
+            unsigned int k;
+
+            if (detid < 1 || detid > detnum) {
+                continue;
+            }
+
+            for (k = 0; k < maxmedia; k++) {
+                atten += mua[k] * mcx_dcs_column(row + ppathoff, k, cfg->his.ishalf);
+                mom += kfactor[k] * mcx_dcs_column(row + momoff, k, cfg->his.ishalf);
+            }
+
+            weight = exp(-atten);
+
+            /** the initial weight carries the launch weight correction of the biased launch */
+            if (SAVE_W0(cfg->savedetflag)) {
+                weight *= row[w0off];
+            }
+
+            sum = acc + (size_t)(detid - 1) * rowlen;
+
+            for (k = 0; k < ntau; k++) {
+                sum[k] += weight * exp(-disp[k] * mom);
+            }
+
+            sum[ntau] += weight;
+        }
+    }
+
+    for (b = 1; b < (int)blocknum; b++) {
+        for (i = 0; i < sumlen; i++) {
+            partial[i] += partial[(size_t)b * sumlen + i];
+        }
+    }
+
+    for (j = 0; j < detnum; j++) {
+        double norm = partial[(size_t)j * rowlen + ntau];
+
+        for (i = 0; i < ntau; i++) {
+            g1[(size_t)j * ntau + i] = (norm > 0.0) ? (float)(partial[(size_t)j * rowlen + i] / norm) : 0.f;
+        }
+    }
+
+    free(kfactor);
+    free(mua);
+    free(disp);
+    free(partial);
+    return 0;
+}
@@ -0,0 +1,62 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    mcx_dcs.h
+
+@brief   Diffuse correlation spectroscopy (DCS) g1 from the detected photon momentum transfer
+*******************************************************************************/
+
+#ifndef _MCEXTREME_DCS_H
+#define _MCEXTREME_DCS_H
+
+#include <stddef.h>
+#include "mcx_utils.h"
+
+#define MCX_DCS_NONE         0                      /**< do not compute g1 */
+#define MCX_DCS_BROWNIAN     1                      /**< Brownian motion, mean square displacement 6*Db*tau */
+#define MCX_DCS_RANDOMFLOW   2                      /**< random flow, mean square displacement V^2*tau^2 */
+
+#define MCX_DCS_NTAU         200                    /**< default number of correlation times */
+#define MCX_DCS_TAUMIN       1e-7                   /**< default shortest correlation time in s */
+#define MCX_DCS_TAUMAX       1e-1                   /**< default longest correlation time in s */
+#define MCX_DCS_DISP         1e-7f                  /**< default Db (mm^2/s) or V (mm/s) */
+#define MCX_DCS_LAMBDA       785.f                  /**< default wavelength in nm */
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+float* mcx_dcs_taulist(unsigned int ntau);
+int mcx_dcs_g1(const float* rec, size_t count, const Config* cfg, float* g1);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
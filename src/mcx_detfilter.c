@@ -0,0 +1,190 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+
+/***************************************************************************//**
+\file    mcx_detfilter.c
+
+@brief   Host reference of the detected photon filter and half-precision record decoding
+
+The GPU kernel tests a photon with mcx_detfilter_pass using its exit weight,
+time-of-flight and scattering count before it claims a slot. The host
+reference re-evaluates the same test from a saved single-precision record:
+the time-of-flight and the exit weight are recomputed from the partial paths
+(as in replay, ignoring the time spent in the background and the weight
+changes of Russian roulette), and criteria whose columns are not saved are
+skipped.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mcx_detfilter.h"
+
+/**
+ * @brief Convert an IEEE 754 half-precision value to single precision
+ *
+ * @param[in] h: the bits of the half-precision value
+ * @return the single-precision value
+ */
+
+float mcx_half2float(unsigned short h) {
+    union {
+        float f;
+        unsigned int i;
+    } val;
+    unsigned int sign = ((unsigned int)(h & 0x8000)) << 16;
+    unsigned int expo = (h >> 10) & 0x1F, mant = h & 0x3FF;
+
+    if (expo == 0x1F) {        /* inf and nan */
+        val.i = sign | 0x7F800000 | (mant << 13);
+    } else if (expo) {         /* normalized */
+        val.i = sign | ((expo + 112) << 23) | (mant << 13);
+    } else if (mant) {         /* denormalized, shift the mantissa until it is normalized */
+        expo = 113;
+
+        while (!(mant & 0x400)) {
+            mant <<= 1;
+            expo--;
+        }
+
+        val.i = sign | (expo << 23) | ((mant & 0x3FF) << 13);
+    } else {
+        val.i = sign;
+    }
+
+    return val.f;
+}
+
+/**
+ * @brief Test a saved single-precision detected photon record against the filter
+ *
+ * @param[in] rec: the record of one detected photon
+ * @param[in] his: the header of the detected photon data, providing the column layout and unit
+ * @param[in] cfg: simulation configuration, providing the filter and the media properties
+ * @return 1 if the photon is kept, 0 if it is discarded
+ */
+
+int mcx_detfilter_record(const float* rec, const History* his, Config* cfg) {
+    DetFilter filter = cfg->detfilter;
+    unsigned int flag = his->savedetflag, i;
+    const float* nscat = rec + SAVE_DETID(flag);
+    const float* ppath = nscat + SAVE_NSCAT(flag) * his->maxmedia;
+    const float* w0 = rec + SAVE_DETID(flag) + his->maxmedia * (SAVE_NSCAT(flag) + SAVE_PPATH(flag) + SAVE_MOM(flag))
+                      + 3 * (SAVE_PEXIT(flag) + SAVE_VEXIT(flag));
+    int detid = 1;
+    float tof = 0.f, weight = SAVE_W0(flag) ? *w0 : 1.f, count = 0.f;
+
+    if (SAVE_DETID(flag)) {
+        detid = (int)rec[0];
+
+        if (his->totalsource > 1) {
+            detid &= 0xFFFF;
+        }
+    } else {
+        filter.isdetmask = 0;
+    }
+
+    if (SAVE_PPATH(flag)) {
+        for (i = 0; i < his->maxmedia; i++) {
+            float plen = ppath[i] * his->unitinmm;
+
+            weight *= expf(-cfg->prop[i + 1].mua * plen);
+            tof += plen * R_C0 * cfg->prop[i + 1].n;
+        }
+    } else {
+        filter.tmax = filter.tmin;
+        filter.minweight = 0.f;
+    }
+
+    if (SAVE_NSCAT(flag)) {
+        for (i = 0; i < his->maxmedia; i++) {
+            count += nscat[i];
+        }
+    } else {
+        filter.maxscat = 0;
+    }
+
+    return mcx_detfilter_pass(&filter, detid, tof, weight, count);
+}
+
+/**
+ * @brief Convert detected photon records with half-precision ppath/mom columns to single precision
+ *
+ * @param[in] rec: the records in the compact layout, the buffer is reallocated and must not be used afterwards
+ * @param[in] count: the number of records
+ * @param[in] savedetflag: the bit-mask of the saved detected photon columns
+ * @param[in] maxmedia: the number of media, excluding the background medium 0
+ * @param[in] fulllen: the number of floats per record in the single-precision layout
+ * @return the records in the single-precision layout, NULL if the memory can not be allocated
+ */
+
+float* mcx_detfilter_expand(float* rec, size_t count, unsigned int savedetflag, unsigned int maxmedia, unsigned int fulllen) {
+    unsigned int halflen = fulllen - mcx_detfilter_halfsaving(savedetflag, maxmedia, 1);
+    unsigned int head = SAVE_DETID(savedetflag) + SAVE_NSCAT(savedetflag) * maxmedia;
+    unsigned int groups = SAVE_PPATH(savedetflag) + SAVE_MOM(savedetflag);
+    unsigned int tail = fulllen - head - groups * maxmedia, g, j;
+    float* tmp, *newrec;
+    size_t i;
+
+    if (halflen == fulllen || count == 0) {
+        return rec;
+    }
+
+    newrec = (float*)realloc(rec, count * fulllen * sizeof(float));
+    tmp = (float*)malloc(halflen * sizeof(float));
+
+    if (newrec == NULL || tmp == NULL) {
+        free(newrec ? newrec : rec);
+        free(tmp);
+        return NULL;
+    }
+
+    /** expand from the last record, so that no compact record is overwritten before it is read */
+    for (i = count; i-- > 0;) {
+        const unsigned int* word = (const unsigned int*)(tmp + head);
+        float* full = newrec + i * fulllen;
+
+        memcpy(tmp, newrec + i * halflen, halflen * sizeof(float));
+        memcpy(full, tmp, head * sizeof(float));
+
+        for (g = 0; g < groups; g++) {
+            for (j = 0; j < maxmedia; j++) {
+                unsigned int pair = word[g * ((maxmedia + 1) >> 1) + (j >> 1)];
+
+                full[head + g * maxmedia + j] = mcx_half2float((unsigned short)((j & 1) ? (pair >> 16) : (pair & 0xFFFF)));
+            }
+        }
+
+        memcpy(full + head + groups * maxmedia, tmp + head + groups * ((maxmedia + 1) >> 1), tail * sizeof(float));
+    }
+
+    free(tmp);
+    return newrec;
+}
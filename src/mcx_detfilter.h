@@ -0,0 +1,113 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+
+/***************************************************************************//**
+\file    mcx_detfilter.h
+
+@brief   Detected photon filter and half-precision records, shared by the host and the GPU kernel
+
+A detected photon is only given a slot in the detected photon buffer if it
+passes the filter set in Optode.DetFilter: detector subset, time-of-flight
+window, minimum exit weight and maximum scattering count. The GPU kernel and
+the host reference (mcx_detfilter_record, filtering the photons loaded for replay)
+use the same test, mcx_detfilter_pass.
+
+With Session.HalfDetPhoton (or --halfdet 1), the partial path (ppath) and the
+momentum transfer (mom) columns of each record are stored as IEEE 754 half
+precision values, two per 32-bit word; the first of each pair occupies the
+lower 16 bits, and a group of n media takes (n+1)/2 words. All other columns
+are left in single precision.
+*******************************************************************************/
+
+#ifndef _MCEXTREME_DETFILTER_H
+#define _MCEXTREME_DETFILTER_H
+
+#include <stddef.h>
+#include "mcx_utils.h"
+#include "mcx_const.h"
+
+#ifdef __CUDACC__
+    #define MCX_DETFILTER_FUNC   __host__ __device__ static inline
+#else
+    #define MCX_DETFILTER_FUNC   static inline
+#endif
+
+/**
+ * @brief Test if a detected photon is kept by the filter
+ *
+ * @param[in] filter: the detected photon filter
+ * @param[in] detid: the index of the detector capturing the photon, starting from 1
+ * @param[in] tof: the time-of-flight of the photon in s
+ * @param[in] weight: the exit weight of the photon
+ * @param[in] nscat: the total scattering count of the photon
+ * @return 1 if the photon is kept, 0 if it is discarded
+ */
+
+MCX_DETFILTER_FUNC int mcx_detfilter_pass(const DetFilter* filter, int detid, float tof, float weight, float nscat) {
+    if (filter->isdetmask && (detid < 1 || detid > MAX_FILTER_DET || !((filter->detmask[(detid - 1) >> 5] >> ((detid - 1) & 31)) & 1))) {
+        return 0;
+    }
+
+    if (filter->tmax > filter->tmin && (tof < filter->tmin || tof > filter->tmax)) {
+        return 0;
+    }
+
+    if (weight < filter->minweight) {
+        return 0;
+    }
+
+    return (filter->maxscat == 0 || nscat <= (float)filter->maxscat);
+}
+
+/**
+ * @brief Return the number of 32-bit words that half-precision storage saves in each detected photon record
+ *
+ * @param[in] savedetflag: the bit-mask of the saved detected photon columns
+ * @param[in] maxmedia: the number of media, excluding the background medium 0
+ * @param[in] ishalf: 1 if the ppath and mom columns are stored in half precision
+ * @return the number of words saved per record, 0 if ishalf is 0
+ */
+
+MCX_DETFILTER_FUNC unsigned int mcx_detfilter_halfsaving(unsigned int savedetflag, unsigned int maxmedia, int ishalf) {
+    return ishalf ? (SAVE_PPATH(savedetflag) + SAVE_MOM(savedetflag)) * (maxmedia >> 1) : 0;
+}
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+float mcx_half2float(unsigned short h);
+int mcx_detfilter_record(const float* rec, const History* his, Config* cfg);
+float* mcx_detfilter_expand(float* rec, size_t count, unsigned int savedetflag, unsigned int maxmedia, unsigned int fulllen);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
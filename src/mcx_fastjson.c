@@ -0,0 +1,473 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+
+/***************************************************************************//**
+\file    mcx_fastjson.c
+
+@brief   JSON parser with a fast path for large numerical arrays
+
+cJSON allocates one node per array element, which dominates the loading
+time and memory of inputs with large source patterns, detector or media
+lists. Before calling cJSON, the text is scanned for numerical vectors
+(\c Data, \c _ArrayData_) and matrices of equal-length rows (\c Media,
+\c Detector) longer than MCX_BJD_INLINE_MAX elements. Their numbers are
+converted directly into a packed array and the array is blanked to \c []
+in a copy of the text; after cJSON_Parse, each blanked array is located by
+its order among all empty arrays and turned into a binary buffer node (see
+mcx_bjdata.h), wrapped in a JData annotated object for matrices.
+
+Numbers with at most 19 significant digits and a decimal exponent within
++/-22 are converted with a single exact multiplication or division; other
+numbers fall back to strtod.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "mcx_fastjson.h"
+#include "mcx_bjdata.h"
+
+#define FASTJSON_MAXEXP    22                      /**< max power of 10 that is exact in double precision */
+#define FASTJSON_MAXDIGIT  19                      /**< max decimal digits that fit in a 64-bit mantissa */
+
+static const double fastjson_pow10[FASTJSON_MAXEXP + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/**
+ * A growable list of numbers parsed from one array
+ */
+
+typedef struct MCXFastValues {
+    double* val;                   /**< the parsed numbers */
+    size_t len;                    /**< number of parsed numbers */
+    size_t maxlen;                 /**< number of allocated numbers */
+    int isint;                     /**< 1 if all numbers are written as integers */
+    int isint32;                   /**< 1 if all numbers are integers within the 32-bit range */
+} FastValues;
+
+/**
+ * A large numerical array found in the text and converted to a binary buffer
+ */
+
+typedef struct MCXFastArray {
+    size_t start;                  /**< offset of the opening '[' */
+    size_t end;                    /**< offset after the closing ']' */
+    size_t ordinal;                /**< index among all empty arrays of the blanked text */
+    int ndim;                      /**< 1 for a vector, 2 for a matrix */
+    size_t dims[2];                /**< length of a vector, or the rows and columns of a matrix */
+    cJSON* data;                   /**< the binary buffer node */
+} FastArray;
+
+/**
+ * @brief Skip JSON whitespace
+ */
+
+static const char* mcx_fastjson_skipws(const char* p) {
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+        p++;
+    }
+
+    return p;
+}
+
+/**
+ * @brief Parse one JSON number
+ *
+ * @param[in] p: pointer to the first character of the number
+ * @param[out] val: the value
+ * @param[out] isint: set to 0 if the number has a fraction or an exponent
+ * @return pointer after the number, or NULL if p does not point to a number
+ */
+
+static const char* mcx_fastjson_number(const char* p, double* val, int* isint) {
+    const char* start = p;
+    unsigned long long mant = 0;
+    int digits = 0, exp10 = 0, expval = 0, isneg = 0, isexpneg = 0;
+
+    if (*p == '-') {
+        isneg = 1;
+        p++;
+    }
+
+    if (*p < '0' || *p > '9') {
+        return NULL;
+    }
+
+    while (*p >= '0' && *p <= '9') {
+        mant = mant * 10 + (*p++ - '0');
+        digits++;
+    }
+
+    if (*p == '.') {
+        p++;
+        *isint = 0;
+
+        if (*p < '0' || *p > '9') {
+            return NULL;
+        }
+
+        while (*p >= '0' && *p <= '9') {
+            mant = mant * 10 + (*p++ - '0');
+            digits++;
+            exp10--;
+        }
+    }
+
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        *isint = 0;
+
+        if (*p == '+' || *p == '-') {
+            isexpneg = (*p++ == '-');
+        }
+
+        if (*p < '0' || *p > '9') {
+            return NULL;
+        }
+
+        while (*p >= '0' && *p <= '9') {
+            if (expval < 10000) {
+                expval = expval * 10 + (*p - '0');
+            }
+
+            p++;
+        }
+
+        exp10 += isexpneg ? -expval : expval;
+    }
+
+    if (digits > FASTJSON_MAXDIGIT || mant > (1ULL << 53) || exp10 < -FASTJSON_MAXEXP || exp10 > FASTJSON_MAXEXP) {
+        *val = strtod(start, NULL);
+    } else {
+        *val = (exp10 < 0) ? (double)mant / fastjson_pow10[-exp10] : (double)mant * fastjson_pow10[exp10];
+
+        if (isneg) {
+            *val = -*val;
+        }
+    }
+
+    return p;
+}
+
+/**
+ * @brief Parse the comma-separated numbers of an array, after its '['
+ *
+ * @param[in] p: pointer after the opening '['
+ * @param[in,out] v: the parsed numbers are appended to this list
+ * @return pointer after the closing ']', or NULL if the array holds anything but numbers
+ */
+
+static const char* mcx_fastjson_list(const char* p, FastValues* v) {
+    p = mcx_fastjson_skipws(p);
+
+    if (*p == ']') {
+        return p + 1;
+    }
+
+    while (1) {
+        double val;
+        int isint = 1;
+
+        if ((p = mcx_fastjson_number(p, &val, &isint)) == NULL) {
+            return NULL;
+        }
+
+        if (v->len >= v->maxlen) {
+            v->maxlen = (v->maxlen << 1) + 1024;
+            v->val = (double*)realloc(v->val, v->maxlen * sizeof(double));
+        }
+
+        v->val[v->len++] = val;
+        v->isint &= isint;
+        v->isint32 &= (isint && val >= INT_MIN && val <= INT_MAX);
+        p = mcx_fastjson_skipws(p);
+
+        if (*p == ',') {
+            p = mcx_fastjson_skipws(p + 1);
+        } else if (*p == ']') {
+            return p + 1;
+        } else {
+            return NULL;
+        }
+    }
+}
+
+/**
+ * @brief Parse a numerical vector, or a matrix stored as an array of equal-length vectors
+ *
+ * @param[in] p: pointer to the opening '['
+ * @param[out] v: the numbers, in row-major order for a matrix
+ * @param[out] ndim: 1 for a vector, 2 for a matrix
+ * @param[out] dims: length of the vector, or the rows and columns of the matrix
+ * @return pointer after the closing ']', or NULL if the array is not numerical
+ */
+
+static const char* mcx_fastjson_array(const char* p, FastValues* v, int* ndim, size_t dims[2]) {
+    v->len = 0;
+    v->isint = 1;
+    v->isint32 = 1;
+    p = mcx_fastjson_skipws(p + 1);
+
+    if (*p != '[') {
+        *ndim = 1;
+        p = mcx_fastjson_list(p, v);
+        dims[0] = v->len;
+        return p;
+    }
+
+    *ndim = 2;
+    dims[0] = 0;
+    dims[1] = 0;
+
+    while (1) {
+        size_t len = v->len;
+
+        if ((p = mcx_fastjson_list(p + 1, v)) == NULL) {
+            return NULL;
+        }
+
+        if (dims[0] > 0 && v->len - len != dims[1]) {
+            return NULL;
+        }
+
+        dims[1] = v->len - len;
+        dims[0]++;
+        p = mcx_fastjson_skipws(p);
+
+        if (*p == ',') {
+            p = mcx_fastjson_skipws(p + 1);
+
+            if (*p != '[') {
+                return NULL;
+            }
+        } else if (*p == ']') {
+            return p + 1;
+        } else {
+            return NULL;
+        }
+    }
+}
+
+/**
+ * @brief Test if a key holds arrays that are read by the fast path
+ *
+ * @param[in] key: the key, not NUL-terminated
+ * @param[in] len: length of the key
+ * @param[in] ndim: 1 for a vector, 2 for a matrix
+ */
+
+static int mcx_fastjson_iskey(const char* key, size_t len, int ndim) {
+    static const char* vectorkeys[] = {"Data", "_ArrayData_", NULL};
+    static const char* matrixkeys[] = {"Media", "Detector", NULL};
+    const char** keys = (ndim == 1) ? vectorkeys : matrixkeys;
+    int i;
+
+    for (i = 0; key && keys[i]; i++) {
+        if (strlen(keys[i]) == len && strncmp(key, keys[i], len) == 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Pack the parsed numbers into a binary buffer node
+ *
+ * Integers within the 32-bit range are stored as int32, larger integers (such as
+ * packed 2-label voxels) as float64 to keep them exact, other numbers as float32.
+ */
+
+static cJSON* mcx_fastjson_buffer(const FastValues* v) {
+    size_t i;
+
+    if (v->isint32) {
+        int* data = (int*)malloc(v->len * sizeof(int));
+
+        for (i = 0; i < v->len; i++) {
+            data[i] = (int)v->val[i];
+        }
+
+        return mcx_bjd_newbuffer(data, 'l', v->len);
+    } else if (v->isint) {
+        double* data = (double*)malloc(v->len * sizeof(double));
+
+        memcpy(data, v->val, v->len * sizeof(double));
+        return mcx_bjd_newbuffer(data, 'D', v->len);
+    } else {
+        float* data = (float*)malloc(v->len * sizeof(float));
+
+        for (i = 0; i < v->len; i++) {
+            data[i] = (float)v->val[i];
+        }
+
+        return mcx_bjd_newbuffer(data, 'd', v->len);
+    }
+}
+
+/**
+ * @brief Attach the binary buffers to the blanked arrays of the parsed tree
+ *
+ * The tree is visited in document order, counting the empty arrays.
+ *
+ * @param[in] node: the first node of a sibling list
+ * @param[in] list: the converted arrays, in document order
+ * @param[in] num: the number of converted arrays
+ * @param[in,out] next: index of the next converted array to attach
+ * @param[in,out] nempty: the number of empty arrays visited so far
+ */
+
+static void mcx_fastjson_attach(cJSON* node, FastArray* list, size_t num, size_t* next, size_t* nempty) {
+    for (; node && *next < num; node = node->next) {
+        if (cJSON_IsArray(node) && node->child == NULL) {
+            if (list[*next].ordinal == *nempty) {
+                FastArray* arr = list + (*next)++;
+
+                if (arr->ndim == 1) {
+                    node->valuestring = arr->data->valuestring;
+                    node->valueint = arr->data->valueint;
+                    node->valuedouble = arr->data->valuedouble;
+                    arr->data->valuestring = NULL;
+                    cJSON_Delete(arr->data);
+                } else {
+                    node->type = cJSON_Object;
+                    mcx_bjd_annotate(node, arr->data, arr->dims, arr->ndim);
+                }
+
+                arr->data = NULL;
+            }
+
+            (*nempty)++;
+        } else if (node->child) {
+            mcx_fastjson_attach(node->child, list, num, next, nempty);
+        }
+    }
+}
+
+/**
+ * @brief Parse a JSON text, converting large numerical arrays without creating a node per number
+ *
+ * @param[in] text: the JSON text, not modified
+ * @return the cJSON tree (free with cJSON_Delete), or NULL on a syntax error, in which case
+ *         cJSON_GetErrorPtr points into text
+ */
+
+cJSON* mcx_fastjson_parse(const char* text) {
+    FastValues v = {NULL, 0, 0, 1, 1};
+    FastArray* list = NULL;
+    size_t num = 0, maxnum = 0, nempty = 0, pos = 0, len = strlen(text), valuepos = (size_t)-1, keylen = 0, i;
+    const char* key = NULL;
+    char* blanked;
+    cJSON* root;
+
+    while (pos < len) {
+        if (text[pos] == '"') {
+            size_t start = ++pos;
+            const char* p;
+
+            while (pos < len && text[pos] != '"') {
+                pos += (text[pos] == '\\') ? 2 : 1;
+            }
+
+            /** remember a key and where its value starts */
+            p = mcx_fastjson_skipws(text + (++pos < len ? pos : len));
+
+            if (*p == ':') {
+                key = text + start;
+                keylen = pos - 1 - start;
+                valuepos = mcx_fastjson_skipws(p + 1) - text;
+            }
+        } else if (text[pos] == '[') {
+            int ndim;
+            size_t dims[2] = {0, 0};
+            const char* end = mcx_fastjson_array(text + pos, &v, &ndim, dims);
+
+            if (end && v.len > MCX_BJD_INLINE_MAX && pos == valuepos && mcx_fastjson_iskey(key, keylen, ndim)) {
+                if (num >= maxnum) {
+                    maxnum = (maxnum << 1) + 16;
+                    list = (FastArray*)realloc(list, maxnum * sizeof(FastArray));
+                }
+
+                list[num].start = pos;
+                list[num].end = end - text;
+                list[num].ordinal = nempty++;
+                list[num].ndim = ndim;
+                list[num].dims[0] = dims[0];
+                list[num].dims[1] = dims[1];
+                list[num++].data = mcx_fastjson_buffer(&v);
+                pos = end - text;
+            } else if (end && ndim == 1) {
+                /** a numerical vector holds no nested array or string */
+                nempty += (v.len == 0);
+                pos = end - text;
+            } else {
+                pos++;
+            }
+        } else {
+            pos++;
+        }
+    }
+
+    free(v.val);
+
+    if (num == 0) {
+        return cJSON_Parse(text);
+    }
+
+    blanked = (char*)malloc(len + 1);
+    memcpy(blanked, text, len + 1);
+
+    for (i = 0; i < num; i++) {
+        memset(blanked + list[i].start, ' ', list[i].end - list[i].start);
+        blanked[list[i].start] = '[';
+        blanked[list[i].end - 1] = ']';
+    }
+
+    root = cJSON_Parse(blanked);
+    free(blanked);
+
+    if (root) {
+        size_t next = 0;
+
+        nempty = 0;
+        mcx_fastjson_attach(root, list, num, &next, &nempty);
+    }
+
+    for (i = 0; i < num; i++) {
+        cJSON_Delete(list[i].data);
+    }
+
+    free(list);
+
+    /** on a syntax error, parse the original text again so that the error pointer is valid */
+    return root ? root : cJSON_Parse(text);
+}
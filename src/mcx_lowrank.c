@@ -0,0 +1,293 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    mcx_lowrank.c
+
+@brief   Truncated eigen-basis of photon-sharing source patterns
+
+In the photon-sharing mode, each launched photon carries one weight per
+pattern and every deposit is repeated for all srcnum patterns. Because the
+outputs are linear in the pattern values, a stack of correlated patterns P
+(pixels x srcnum) can be replaced by k orthogonal basis patterns B=P*V, where
+the columns of V are the leading eigenvectors of the Gram matrix P'*P; the
+output of pattern s is then the sum of the basis outputs weighted by V(s,:).
+The rank k is the smallest one whose relative reconstruction error
+||P-B*V'||/||P|| (Frobenius norm) does not exceed the given tolerance.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mcx_lowrank.h"
+
+#define LOWRANK_MAXSWEEP  50                        /**< max number of Jacobi sweeps */
+#define LOWRANK_MINRANK   2                         /**< the GPU kernel only runs photon sharing with 2 or more patterns */
+
+/**
+ * @brief Compute the eigenvalues and eigenvectors of a symmetric matrix with cyclic Jacobi rotations
+ *
+ * @param[in,out] a: the n x n symmetric matrix, overwritten, its diagonal holds the eigenvalues on return
+ * @param[out] v: the n x n matrix of eigenvectors, stored in the columns
+ * @param[in] n: the size of the matrix
+ */
+
+static void mcx_lowrank_jacobi(double* a, double* v, unsigned int n) {
+    unsigned int p, q, k, sweep;
+    double trace = 0.0;
+
+    memset(v, 0, sizeof(double) * n * n);
+
+    for (p = 0; p < n; p++) {
+        v[p * n + p] = 1.0;
+        trace += fabs(a[p * n + p]);
+    }
+
+    for (sweep = 0; sweep < LOWRANK_MAXSWEEP; sweep++) {
+        double off = 0.0;
+
+        for (p = 0; p < n; p++)
+            for (q = p + 1; q < n; q++) {
+                off += a[p * n + q] * a[p * n + q];
+            }
+
+        if (off <= 1e-24 * trace * trace) {
+            break;
+        }
+
+        for (p = 0; p < n; p++) {
+            for (q = p + 1; q < n; q++) {
+                double apq = a[p * n + q], theta, t, c, s;
+
+                if (fabs(apq) <= 1e-300) {
+                    continue;
+                }
+
+                theta = (a[q * n + q] - a[p * n + p]) / (2.0 * apq);
+                t = ((theta >= 0.0) ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+                c = 1.0 / sqrt(t * t + 1.0);
+                s = t * c;
+
+                for (k = 0; k < n; k++) { /** A=A*J */
+                    double akp = a[k * n + p], akq = a[k * n + q];
+                    a[k * n + p] = c * akp - s * akq;
+                    a[k * n + q] = s * akp + c * akq;
+                }
+
+                for (k = 0; k < n; k++) { /** A=J'*A */
+                    double apk = a[p * n + k], aqk = a[q * n + k];
+                    a[p * n + k] = c * apk - s * aqk;
+                    a[q * n + k] = s * apk + c * aqk;
+                }
+
+                for (k = 0; k < n; k++) { /** V=V*J */
+                    double vkp = v[k * n + p], vkq = v[k * n + q];
+                    v[k * n + p] = c * vkp - s * vkq;
+                    v[k * n + q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Compute a truncated orthogonal basis of a stack of source patterns
+ *
+ * @param[in] pattern: the patterns, pattern[i*srcnum+s] is the value of pattern s at pixel i
+ * @param[in] pixelnum: the number of pixels (or voxels for 3D patterns) of each pattern
+ * @param[in] srcnum: the number of patterns
+ * @param[in] tol: the max relative reconstruction error in Frobenius norm
+ * @param[out] basis: the basis patterns, basis[i*rank+j] is the value of basis j at pixel i, freed by the caller
+ * @param[out] coef: the mixing coefficients, pattern s is approximated by sum_j coef[s*rank+j]*basis(:,j), freed by the caller
+ * @param[out] err: the relative reconstruction error of the returned basis
+ * @return the rank of the basis, 0 if no basis with fewer than srcnum patterns meets the tolerance
+ */
+
+unsigned int mcx_lowrank_basis(const float* pattern, size_t pixelnum, unsigned int srcnum, float tol,
+                               float** basis, float** coef, float* err) {
+    double* gram, *vec, *eig, total = 0.0, residual = 0.0;
+    unsigned int* order, rank, i, j;
+    int s;
+
+    *basis = NULL;
+    *coef = NULL;
+
+    if (srcnum <= LOWRANK_MINRANK || pixelnum == 0) {
+        return 0;
+    }
+
+    gram = (double*)calloc((size_t)srcnum * srcnum, sizeof(double));
+    vec = (double*)malloc(sizeof(double) * srcnum * srcnum);
+    eig = (double*)malloc(sizeof(double) * srcnum);
+    order = (unsigned int*)malloc(sizeof(unsigned int) * srcnum);
+
+    if (gram == NULL || vec == NULL || eig == NULL || order == NULL) {
+        free(gram);
+        free(vec);
+        free(eig);
+        free(order);
+        return 0;
+    }
+
+    /** the Gram matrix P'*P, each row is accumulated by one thread */
+    #pragma omp parallel for schedule(dynamic)
+
+    for (s = 0; s < (int)srcnum; s++) {
+        size_t pix;
+        unsigned int t;
+
+        for (pix = 0; pix < pixelnum; pix++) {
+            const float* row = pattern + pix * srcnum;
+
+            for (t = (unsigned int)s; t < srcnum; t++) {
+                gram[s * srcnum + t] += (double)row[s] * row[t];
+            }
+        }
+
+        for (t = (unsigned int)s + 1; t < srcnum; t++) {
+            gram[t * srcnum + s] = gram[s * srcnum + t];
+        }
+    }
+
+    mcx_lowrank_jacobi(gram, vec, srcnum);
+
+    /** sort the eigenvalues in descending order, the Gram matrix is semi-definite */
+    for (i = 0; i < srcnum; i++) {
+        eig[i] = (gram[i * srcnum + i] > 0.0) ? gram[i * srcnum + i] : 0.0;
+        order[i] = i;
+        total += eig[i];
+    }
+
+    for (i = 1; i < srcnum; i++) {
+        unsigned int id = order[i];
+
+        for (j = i; j > 0 && eig[order[j - 1]] < eig[id]; j--) {
+            order[j] = order[j - 1];
+        }
+
+        order[j] = id;
+    }
+
+    /** the squared error of a rank-k basis is the sum of the discarded eigenvalues */
+    for (rank = srcnum; rank > LOWRANK_MINRANK; rank--) {
+        if (residual + eig[order[rank - 1]] > (double)tol * tol * total) {
+            break;
+        }
+
+        residual += eig[order[rank - 1]];
+    }
+
+    free(gram);
+    free(eig);
+
+    if (rank >= srcnum || total <= 0.0) {
+        free(vec);
+        free(order);
+        return 0;
+    }
+
+    *err = (float)sqrt(residual / total);
+    *basis = (float*)calloc(pixelnum * rank, sizeof(float));
+    *coef = (float*)malloc(sizeof(float) * srcnum * rank);
+
+    if (*basis == NULL || *coef == NULL) {
+        free(*basis);
+        free(*coef);
+        free(vec);
+        free(order);
+        *basis = NULL;
+        *coef = NULL;
+        return 0;
+    }
+
+    for (j = 0; j < rank; j++) {
+        double sum = 0.0, sign;
+        size_t pix;
+
+        for (pix = 0; pix < pixelnum; pix++) {
+            double val = 0.0;
+
+            for (i = 0; i < srcnum; i++) {
+                val += pattern[pix * srcnum + i] * vec[i * srcnum + order[j]];
+            }
+
+            (*basis)[pix * rank + j] = (float)val;
+            sum += val;
+        }
+
+        /** flip the basis so that it launches a positive total weight */
+        sign = (sum < 0.0) ? -1.0 : 1.0;
+
+        for (pix = 0; pix < pixelnum && sign < 0.0; pix++) {
+            (*basis)[pix * rank + j] = -(*basis)[pix * rank + j];
+        }
+
+        for (i = 0; i < srcnum; i++) {
+            (*coef)[i * rank + j] = (float)(sign * vec[i * srcnum + order[j]]);
+        }
+    }
+
+    free(vec);
+    free(order);
+    return rank;
+}
+
+/**
+ * @brief Reconstruct the outputs of all patterns from the outputs of the basis patterns, in place
+ *
+ * @param[in,out] field: on input, field[c*rank+j] is the output of basis j at cell c; on return,
+ *                       field[c*srcnum+s] is the output of pattern s, the buffer must hold cellnum*srcnum values
+ * @param[in] cellnum: the number of output cells (voxels times time gates)
+ * @param[in] rank: the number of basis patterns
+ * @param[in] srcnum: the number of patterns
+ * @param[in] coef: the mixing coefficients returned by mcx_lowrank_basis
+ */
+
+void mcx_lowrank_expand(float* field, size_t cellnum, unsigned int rank, unsigned int srcnum, const float* coef) {
+    float* val = (float*)malloc(sizeof(float) * rank);
+    size_t c;
+    unsigned int s, j;
+
+    /** walk backwards, the output of cell c never overlaps the inputs of the cells before it */
+    for (c = cellnum; c > 0; c--) {
+        memcpy(val, field + (c - 1) * rank, sizeof(float) * rank);
+
+        for (s = 0; s < srcnum; s++) {
+            double sum = 0.0;
+
+            for (j = 0; j < rank; j++) {
+                sum += (double)coef[s * rank + j] * val[j];
+            }
+
+            field[(c - 1) * srcnum + s] = (float)sum;
+        }
+    }
+
+    free(val);
+}
@@ -0,0 +1,957 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    mcx_merge.c
+
+@brief   Merge tool for the outputs of sharded (--shard k/N) simulations
+
+A run with --shard k/N simulates the k-th of N slices of the photons and saves
+its volumetric output without normalization, together with a <session>_shard.json
+file recording its photon number, energy tallies and normalization factors.
+
+Every normalization factor of MCX takes the form C/E, where E is the launched
+energy (or the total replay weight), and E of a combined run is the sum of the
+shards; the factor of the merged output is therefore 1/sum(1/alpha_k), which
+is applied to the sum of the raw shard outputs. Detected photon records are
+concatenated and their headers are updated with the combined totals.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mcx_merge.h"
+#include "mcx_const.h"
+#include "mcx_norm.h"
+#include "mcx_bjdata.h"
+#include "ubj/ubj.h"
+
+#define NII_HEADER_SIZE 352    /**< NIFTI header size, including the 4-byte extension flag */
+
+extern char pathsep;
+
+/**
+ * @brief Read a numerical JSON field, or return the fallback value if it does not exist
+ */
+
+static double mcx_merge_getnum(cJSON* obj, const char* key, double fallback) {
+    cJSON* item = cJSON_GetObjectItem(obj, key);
+    return (cJSON_IsNumber(item) ? item->valuedouble : fallback);
+}
+
+/**
+ * @brief Read a JSON array of len positive numbers into a newly allocated float buffer
+ */
+
+static float* mcx_merge_getpositive(cJSON* obj, const char* key, unsigned int len) {
+    cJSON* item = cJSON_GetObjectItem(obj, key);
+    float* val;
+    unsigned int i;
+
+    if (len == 0 || cJSON_GetArraySize(item) != (int)len) {
+        MCX_FPRINTF(stderr, "the length of %s does not match the grid\n", key);
+        MCX_ERROR(-1, "invalid non-uniform grid in the shard tally file");
+    }
+
+    val = (float*)calloc(len, sizeof(float));
+
+    for (i = 0, item = item->child; item; item = item->next, i++) {
+        val[i] = item->valuedouble;
+
+        if (val[i] <= 0.f) {
+            MCX_ERROR(-1, "the voxel spacings of a non-uniform grid must be positive");
+        }
+    }
+
+    return val;
+}
+
+/**
+ * @brief Read the full content of a file into a null-terminated buffer
+ *
+ * @param[in] fname: the file name
+ * @param[out] len: the length of the file in bytes
+ */
+
+static char* mcx_merge_readfile(const char* fname, size_t* len) {
+    FILE* fp = fopen(fname, "rb");
+    char* buf;
+
+    if (fp == NULL) {
+        MCX_FPRINTF(stderr, "can not read %s\n", fname);
+        MCX_ERROR(-2, "can not open the shard output file");
+    }
+
+    fseek(fp, 0, SEEK_END);
+    *len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    buf = (char*)malloc(*len + 1);
+
+    if (fread(buf, 1, *len, fp) != *len) {
+        MCX_ERROR(-2, "fail to read the shard output file");
+    }
+
+    buf[*len] = '\0';
+    fclose(fp);
+    return buf;
+}
+
+/**
+ * @brief Parse a JSON/JData file
+ *
+ * @param[in] fname: the file name
+ */
+
+static cJSON* mcx_merge_loadjson(const char* fname) {
+    size_t len;
+    char* buf = mcx_merge_readfile(fname, &len);
+    cJSON* root = cJSON_Parse(buf);
+
+    free(buf);
+
+    if (root == NULL) {
+        MCX_FPRINTF(stderr, "invalid JSON file %s\n", fname);
+        MCX_ERROR(-1, "fail to parse the shard output file");
+    }
+
+    return root;
+}
+
+/**
+ * @brief Parse a binary JData file
+ *
+ * @param[in] fname: the file name
+ */
+
+static cJSON* mcx_merge_loadbjd(const char* fname) {
+    size_t len, errpos = 0;
+    char* buf = mcx_merge_readfile(fname, &len);
+    cJSON* root = mcx_bjd_parse((const unsigned char*)buf, len, &errpos);
+
+    free(buf);
+
+    if (root == NULL) {
+        MCX_FPRINTF(stderr, "invalid BJData file %s at byte %lu\n", fname, (unsigned long)errpos);
+        MCX_ERROR(-1, "fail to parse the shard output file");
+    }
+
+    return root;
+}
+
+/**
+ * @brief Write a parsed JSON/BJData node to a BJData stream
+ *
+ * Binary buffers are written as strongly-typed arrays of the same type, except
+ * for half-precision buffers, which are widened to single precision.
+ *
+ * @param[in] ctx: the BJData writer
+ * @param[in] node: the node to be written
+ */
+
+static void mcx_merge_ubjnode(ubjw_context_t* ctx, const cJSON* node) {
+    static const char markers[] = "iUIulmLMhdD";
+    const cJSON* item;
+
+    if (mcx_bjd_isbuffer(node)) {
+        const char* pos = strchr(markers, node->valueint);
+        char type = (node->valueint == 'h') ? 'd' : (char)node->valueint;
+        size_t count = (size_t)node->valuedouble;
+        void* buf;
+
+        if (node->valueint == 0 || pos == NULL) {
+            MCX_ERROR(-1, "unsupported binary array type in the BJData file");
+        }
+
+        buf = malloc(count * 8 + 1);
+        mcx_bjd_copy(node, buf, count, type);
+        ubjw_write_buffer(ctx, (const uint8_t*)buf, (UBJ_TYPE)(UBJ_INT8 + (strchr(markers, type) - markers)), count);
+        free(buf);
+    } else if (cJSON_IsObject(node)) {
+        ubjw_begin_object(ctx, UBJ_MIXED, 0);
+
+        for (item = node->child; item; item = item->next) {
+            ubjw_write_key(ctx, item->string);
+            mcx_merge_ubjnode(ctx, item);
+        }
+
+        ubjw_end(ctx);
+    } else if (cJSON_IsArray(node)) {
+        ubjw_begin_array(ctx, UBJ_MIXED, 0);
+
+        for (item = node->child; item; item = item->next) {
+            mcx_merge_ubjnode(ctx, item);
+        }
+
+        ubjw_end(ctx);
+    } else if (cJSON_IsNumber(node)) {
+        if (node->valuedouble == (double)(int64_t)node->valuedouble) {
+            ubjw_write_integer(ctx, (int64_t)node->valuedouble);
+        } else {
+            ubjw_write_float64(ctx, node->valuedouble);
+        }
+    } else if (cJSON_IsString(node)) {
+        ubjw_write_string(ctx, node->valuestring);
+    } else if (cJSON_IsBool(node)) {
+        ubjw_write_bool(ctx, cJSON_IsTrue(node));
+    } else {
+        ubjw_write_null(ctx);
+    }
+}
+
+/**
+ * @brief Locate and load the tally file of a shard
+ *
+ * The input can be the tally file itself, any output file of the shard, such
+ * as <session>.jnii, <session>.mc2, <session>.mch or <session>_detp.jdat, or
+ * the session name; the output files listed in the tally file are resolved
+ * relative to the folder of the tally file.
+ *
+ * @param[in] input: a file name given after --merge
+ * @param[out] shard: the tallies of the shard
+ */
+
+static void mcx_merge_loadshard(const char* input, ShardInfo* shard) {
+    char fname[MAX_FULL_PATH], folder[MAX_FULL_PATH];
+    char* ext;
+    cJSON* root, *obj, *item;
+    size_t len = strlen(input), dirlen = 0, i;
+
+    if (len >= MAX_FULL_PATH - sizeof(MCX_MERGE_SUFFIX)) {
+        MCX_ERROR(-1, "shard file name is too long");
+    }
+
+    strcpy(fname, input);
+
+    for (i = 0; i < len; i++) {
+        if (fname[i] == '/' || fname[i] == '\\') {
+            dirlen = i + 1;
+        }
+    }
+
+    memcpy(folder, fname, dirlen);
+    folder[dirlen] = '\0';
+
+    if (len < strlen(MCX_MERGE_SUFFIX) || strcmp(fname + len - strlen(MCX_MERGE_SUFFIX), MCX_MERGE_SUFFIX)) {
+        if (len > 10 && strcmp(fname + len - 10, "_detp.jdat") == 0) {
+            fname[len - 10] = '\0';
+        } else if ((ext = strrchr(fname + dirlen, '.')) != NULL) {
+            *ext = '\0';
+        }
+
+        strcat(fname, MCX_MERGE_SUFFIX);
+    }
+
+    root = mcx_merge_loadjson(fname);
+    obj = cJSON_GetObjectItem(root, "MCXShard");
+
+    if (obj == NULL) {
+        MCX_FPRINTF(stderr, "%s is not a shard tally file\n", fname);
+        MCX_ERROR(-1, "missing MCXShard object");
+    }
+
+    memset(shard, 0, sizeof(ShardInfo));
+    shard->id = (int)mcx_merge_getnum(obj, "Id", 0);
+    shard->count = (int)mcx_merge_getnum(obj, "Count", 0);
+    shard->srcnum = (int)mcx_merge_getnum(obj, "SrcNum", 1);
+    shard->normalize = (int)mcx_merge_getnum(obj, "Normalize", 0);
+    shard->photons = mcx_merge_getnum(obj, "Photons", 0.0);
+    shard->energytot = mcx_merge_getnum(obj, "EnergyTotal", 0.0);
+    shard->energyesc = mcx_merge_getnum(obj, "EnergyEscape", 0.0);
+
+    if (shard->count < 1 || shard->id < 1 || shard->id > shard->count || shard->srcnum < 1) {
+        MCX_FPRINTF(stderr, "invalid shard index in %s\n", fname);
+        MCX_ERROR(-1, "invalid shard tally file");
+    }
+
+    if (shard->normalize) {
+        item = cJSON_GetObjectItem(obj, "Normalizer");
+
+        if (cJSON_GetArraySize(item) != shard->srcnum) {
+            MCX_ERROR(-1, "the normalization factors do not match the source number");
+        }
+
+        shard->normalizer = (float*)calloc(shard->srcnum, sizeof(float));
+
+        for (i = 0, item = item->child; item; item = item->next, i++) {
+            shard->normalizer[i] = item->valuedouble;
+
+            if (shard->normalizer[i] <= 0.f) {
+                MCX_ERROR(-1, "shard normalization factors must be positive");
+            }
+        }
+    }
+
+    if ((item = cJSON_GetObjectItem(obj, "Grid")) != NULL) {
+        cJSON* dim = cJSON_GetObjectItem(item, "Dim");
+
+        if (cJSON_GetArraySize(dim) != 3) {
+            MCX_ERROR(-1, "invalid non-uniform grid in the shard tally file");
+        }
+
+        for (i = 0, dim = dim->child; dim; dim = dim->next, i++) {
+            shard->dim[i] = (dim->valueint > 0) ? dim->valueint : 0;
+        }
+
+        shard->unitinmm = mcx_merge_getnum(item, "UnitInMM", 1.0);
+        shard->dx = mcx_merge_getpositive(item, "Dx", shard->dim[0]);
+        shard->dy = mcx_merge_getpositive(item, "Dy", shard->dim[1]);
+        shard->dz = mcx_merge_getpositive(item, "Dz", shard->dim[2]);
+    }
+
+    if ((item = cJSON_GetObjectItem(obj, "Field")) != NULL && cJSON_IsString(item)) {
+        snprintf(shard->field, MAX_FULL_PATH, "%s%s", folder, item->valuestring);
+    }
+
+    if ((item = cJSON_GetObjectItem(obj, "Detected")) != NULL && cJSON_IsString(item)) {
+        snprintf(shard->detected, MAX_FULL_PATH, "%s%s", folder, item->valuestring);
+    }
+
+    cJSON_Delete(root);
+}
+
+/**
+ * @brief Return the suffix of a file name, without the dot
+ */
+
+static const char* mcx_merge_ext(const char* fname) {
+    const char* ext = strrchr(fname, '.');
+    return (ext ? ext + 1 : "");
+}
+
+/**
+ * @brief Load the raw volumetric output of a shard
+ *
+ * @param[in] fname: the volumetric output file
+ * @param[out] len: the number of floating point elements
+ * @param[in,out] jroot: for .jnii/.bnii, returns the parsed document, which is kept for the first shard
+ * @param[out] header: for .nii/.tx3, returns the bytes of the file header
+ * @param[in] cfg: simulation configuration
+ */
+
+static float* mcx_merge_loadfield(const char* fname, size_t* len, cJSON** jroot, char* header, int* headerlen, Config* cfg) {
+    const char* ext = mcx_merge_ext(fname);
+    float* field = NULL;
+
+    *headerlen = 0;
+
+    if (strcmp(ext, "jnii") == 0 || strcmp(ext, "bnii") == 0) {
+        int ndim = 0;
+        uint dims[6] = {0};
+        char* type = NULL;
+        cJSON* dat;
+
+        *jroot = (ext[0] == 'j') ? mcx_merge_loadjson(fname) : mcx_merge_loadbjd(fname);
+        dat = cJSON_GetObjectItem(*jroot, "NIFTIData");
+
+        if (dat == NULL || cJSON_GetObjectItem(dat, "_ArrayZipData_") == NULL) {
+            MCX_ERROR(-1, "only compressed JNIfTI outputs saved by mcx can be merged");
+        }
+
+        if (mcx_jdatadecode((void**)&field, &ndim, dims, 6, &type, dat, cfg) || field == NULL) {
+            MCX_ERROR(-1, "fail to decode the JNIfTI data");
+        }
+
+        if (ndim > 6 || (type && strcmp(type, "single"))) {
+            MCX_ERROR(-1, "unexpected data type in the JNIfTI output");
+        }
+
+        *len = 1;
+
+        for (int i = 0; i < ndim; i++) {
+            *len *= dims[i];
+        }
+
+        return field;
+    } else if (strcmp(ext, "mc2") == 0 || strcmp(ext, "nii") == 0 || strcmp(ext, "tx3") == 0) {
+        size_t bytes;
+        char* buf = mcx_merge_readfile(fname, &bytes);
+
+        *headerlen = (ext[0] == 'n') ? NII_HEADER_SIZE : ((ext[0] == 't') ? 4 * sizeof(int) : 0);
+
+        if (bytes < (size_t)*headerlen || (bytes - *headerlen) % sizeof(float)) {
+            MCX_ERROR(-1, "the size of the volumetric output is invalid");
+        }
+
+        memcpy(header, buf, *headerlen);
+        *len = (bytes - *headerlen) / sizeof(float);
+        field = (float*)malloc(bytes - *headerlen + 1);
+        memcpy(field, buf + *headerlen, bytes - *headerlen);
+        free(buf);
+        return field;
+    }
+
+    MCX_FPRINTF(stderr, "unsupported output format: %s\n", fname);
+    MCX_ERROR(-1, "only .jnii, .bnii, .mc2, .nii and .tx3 volumetric outputs can be merged");
+    return NULL;
+}
+
+/**
+ * @brief Sum the raw volumetric outputs of all shards and apply the combined normalization
+ *
+ * The shards are loaded and accumulated one at a time in double precision.
+ *
+ * @param[in] shards: the tallies of all shards
+ * @param[in] num: the number of shards
+ * @param[in] scale: the combined normalization factors of each source
+ * @param[in] name: output file name without the suffix
+ * @param[in] cfg: simulation configuration
+ */
+
+static void mcx_merge_field(ShardInfo* shards, int num, float* scale, const char* name, Config* cfg) {
+    char header[NII_HEADER_SIZE], fname[MAX_FULL_PATH + 16];
+    cJSON* root = NULL;
+    double* sum = NULL;
+    float* field;
+    size_t len = 0, fieldlen = 0, i;
+    int k, headerlen = 0;
+    FILE* fp;
+
+    for (k = 0; k < num; k++) {
+        cJSON* jroot = NULL;
+
+        MCX_FPRINTF(cfg->flog, "merging %s\n", shards[k].field);
+        field = mcx_merge_loadfield(shards[k].field, &len, &jroot, header, &headerlen, cfg);
+
+        if (k == 0) {
+            fieldlen = len;
+            sum = (double*)calloc(fieldlen, sizeof(double));
+            root = jroot;
+        } else {
+            if (len != fieldlen || strcmp(mcx_merge_ext(shards[k].field), mcx_merge_ext(shards[0].field))) {
+                MCX_ERROR(-1, "the volumetric outputs of the shards do not match");
+            }
+
+            if (jroot) {
+                cJSON_Delete(jroot);
+            }
+        }
+
+        for (i = 0; i < fieldlen; i++) {
+            sum[i] += field[i];
+        }
+
+        free(field);
+    }
+
+    field = (float*)malloc(fieldlen * sizeof(float));
+
+    for (i = 0; i < fieldlen; i++) {
+        field[i] = (float)sum[i];
+    }
+
+    free(sum);
+
+    if (scale) {
+        for (k = 0; k < shards[0].srcnum; k++) {
+            MCX_FPRINTF(cfg->flog, "source %d, normalization factor alpha=%f\n", (k + 1), scale[k]);
+        }
+
+        mcx_norm_scale(field, fieldlen / shards[0].srcnum, shards[0].srcnum, scale, shards[0].normalize);
+
+        /** on a non-uniform grid, the fluence of each voxel is divided by its volume, as in a single run */
+        if (shards[0].dx) {
+            size_t dimxyz = (size_t)shards[0].dim[0] * shards[0].dim[1] * shards[0].dim[2];
+
+            if (fieldlen % (dimxyz * shards[0].srcnum)) {
+                MCX_ERROR(-1, "the volumetric output does not match the non-uniform grid");
+            }
+
+            mcx_norm_voxelvolume(field, shards[0].dim, shards[0].dx, shards[0].dy, shards[0].dz, shards[0].unitinmm,
+                                 fieldlen / (dimxyz * shards[0].srcnum), shards[0].srcnum);
+        }
+    }
+
+    snprintf(fname, sizeof(fname), "%s.%s", name, mcx_merge_ext(shards[0].field));
+
+    if (root) {
+        cJSON* dat = cJSON_GetObjectItem(root, "NIFTIData"), *hdr = cJSON_GetObjectItem(root, "NIFTIHeader");
+        cJSON* item = cJSON_GetObjectItem(dat, "_ArraySize_");
+        int iscol = (cJSON_GetObjectItem(dat, "_ArrayOrder_") != NULL), ndim = cJSON_GetArraySize(item);
+        uint dims[6] = {0};
+        char* jsonstr;
+
+        for (k = 0, item = item->child; item && k < 6; item = item->next, k++) {
+            dims[k] = item->valueint;
+        }
+
+        if (hdr && cJSON_GetObjectItem(hdr, "Name")) {
+            cJSON_ReplaceItemInObject(hdr, "Name", cJSON_CreateString(cfg->session));
+        }
+
+        cJSON_DeleteItemFromObject(root, "NIFTIData");
+
+        if (strcmp(mcx_merge_ext(fname), "bnii") == 0) {
+            ubjw_context_t* ctx;
+
+            fp = fopen(fname, "wb");
+
+            if (fp == NULL) {
+                MCX_ERROR(-2, "can not save data to disk");
+            }
+
+            /** the header of the first shard is copied, and the merged data are appended */
+            ctx = ubjw_open_file(fp);
+            ubjw_begin_object(ctx, UBJ_MIXED, 0);
+
+            for (item = root->child; item; item = item->next) {
+                ubjw_write_key(ctx, item->string);
+                mcx_merge_ubjnode(ctx, item);
+            }
+
+            ubjw_write_key(ctx, "NIFTIData");
+            ubjw_begin_object(ctx, UBJ_MIXED, 0);
+
+            if (mcx_jdataencode(field, ndim, dims, "single", 4, cfg->zipid, ctx, 1, iscol, cfg)) {
+                MCX_ERROR(-1, "error when converting to JSON");
+            }
+
+            ubjw_end(ctx);
+            ubjw_end(ctx);
+            ubjw_close_context(ctx);    /* also closes fp */
+            fp = NULL;
+        } else {
+            cJSON_AddItemToObject(root, "NIFTIData", dat = cJSON_CreateObject());
+
+            if (mcx_jdataencode(field, ndim, dims, "single", 4, cfg->zipid, dat, 0, iscol, cfg)) {
+                MCX_ERROR(-1, "error when converting to JSON");
+            }
+
+            jsonstr = cJSON_Print(root);
+
+            if (jsonstr == NULL) {
+                MCX_ERROR(-1, "error when converting to JSON");
+            }
+
+            fp = fopen(fname, "wt");
+
+            if (fp == NULL) {
+                MCX_ERROR(-2, "can not save data to disk");
+            }
+
+            fprintf(fp, "%s\n", jsonstr);
+            free(jsonstr);
+        }
+
+        cJSON_Delete(root);
+    } else {
+        fp = fopen(fname, "wb");
+
+        if (fp == NULL) {
+            MCX_ERROR(-2, "can not save data to disk");
+        }
+
+        fwrite(header, 1, headerlen, fp);
+        fwrite(field, sizeof(float), fieldlen, fp);
+    }
+
+    if (fp) {
+        fclose(fp);
+    }
+
+    free(field);
+    MCX_FPRINTF(cfg->flog, "merged volumetric output is saved to %s\n", fname);
+}
+
+/**
+ * @brief Copy a number of bytes between two files, or skip them if the output is NULL
+ */
+
+static void mcx_merge_copy(FILE* in, FILE* out, size_t bytes, char* buf) {
+    while (bytes > 0) {
+        size_t len = MIN(bytes, MCX_MERGE_BUFSIZE);
+
+        if (fread(buf, 1, len, in) != len) {
+            MCX_ERROR(-2, "the detected photon file is truncated");
+        }
+
+        if (out && fwrite(buf, 1, len, out) != len) {
+            MCX_ERROR(-2, "can not save data to disk");
+        }
+
+        bytes -= len;
+    }
+}
+
+/**
+ * @brief Concatenate the .mch detected photon files of all shards
+ *
+ * The merged file holds a single header followed by the partial path data
+ * of all shards, and then their RNG seeds, in the layout of a single run.
+ *
+ * @param[in] shards: the tallies of all shards
+ * @param[in] num: the number of shards
+ * @param[in] name: output file name without the suffix
+ * @param[in] cfg: simulation configuration
+ */
+
+static void mcx_merge_mch(ShardInfo* shards, int num, const char* name, Config* cfg) {
+    char fname[MAX_FULL_PATH + 16];
+    char* buf = (char*)malloc(MCX_MERGE_BUFSIZE);
+    History his, merged;
+    double invsum = 0.0;
+    int k, pass, isnormalized = 1;
+    FILE* fp, *out;
+
+    memset(&merged, 0, sizeof(History));
+    snprintf(fname, sizeof(fname), "%s.mch", name);
+    out = fopen(fname, "wb");
+
+    if (out == NULL) {
+        MCX_ERROR(-2, "can not save data to disk");
+    }
+
+    fwrite(&merged, sizeof(History), 1, out);
+
+    /** the first pass copies the partial path data, the second pass copies the seeds */
+    for (pass = 0; pass < 2; pass++) {
+        for (k = 0; k < num; k++) {
+            int block = 0;
+
+            fp = fopen(shards[k].detected, "rb");
+
+            if (fp == NULL) {
+                MCX_FPRINTF(stderr, "can not read %s\n", shards[k].detected);
+                MCX_ERROR(-2, "can not open the detected photon file");
+            }
+
+            for (block = 0; fread(&his, sizeof(History), 1, fp) == 1; block++) {
+                size_t ppathbytes = (size_t)his.savedphoton * his.colcount * sizeof(float);
+                size_t seedbytes = (size_t)his.savedphoton * his.seedbyte;
+
+                if (memcmp(his.magic, "MCXH", 4)) {
+                    MCX_ERROR(-1, "invalid mch file header");
+                }
+
+                if (pass == 0) {
+                    if (k == 0 && block == 0) {
+                        merged = his;
+                        merged.totalphoton = merged.detected = merged.savedphoton = 0;
+                    } else if (his.colcount != merged.colcount || his.seedbyte != merged.seedbyte || his.maxmedia != merged.maxmedia) {
+                        MCX_ERROR(-1, "the detected photon data of the shards do not match");
+                    }
+
+                    merged.totalphoton += his.totalphoton;
+                    merged.detected += his.detected;
+                    merged.savedphoton += his.savedphoton;
+
+                    if (block == 0) {
+                        if (his.normalizer > 0.f) {
+                            invsum += 1.0 / his.normalizer;
+                        } else {
+                            isnormalized = 0;
+                        }
+                    }
+                }
+
+                mcx_merge_copy(fp, (pass == 0 ? out : NULL), ppathbytes, buf);
+                mcx_merge_copy(fp, (pass == 1 ? out : NULL), seedbytes, buf);
+            }
+
+            fclose(fp);
+        }
+
+        if (merged.seedbyte == 0) {
+            break;
+        }
+    }
+
+    merged.normalizer = (isnormalized && invsum > 0.0) ? (float)(1.0 / invsum) : 0.f;
+    fseek(out, 0, SEEK_SET);
+    fwrite(&merged, sizeof(History), 1, out);
+    fclose(out);
+    free(buf);
+    MCX_FPRINTF(cfg->flog, "merged %u detected photons (normalizer %f) are saved to %s\n", merged.savedphoton, merged.normalizer, fname);
+}
+
+/**
+ * @brief Return the byte length of a JData element type
+ */
+
+static int mcx_merge_typebyte(const char* type) {
+    if (strstr(type, "int8")) {
+        return 1;
+    } else if (strstr(type, "int16")) {
+        return 2;
+    } else if (strstr(type, "int64") || strstr(type, "double")) {
+        return 8;
+    }
+
+    return 4;
+}
+
+/**
+ * @brief Concatenate the _detp.jdat detected photon files of all shards
+ *
+ * Each data field under MCXData.PhotonData is stored as a row-major 2D array
+ * with one row per photon, so that the rows of all shards are appended.
+ *
+ * @param[in] shards: the tallies of all shards
+ * @param[in] num: the number of shards
+ * @param[in] name: output file name without the suffix
+ * @param[in] cfg: simulation configuration
+ */
+
+static void mcx_merge_jdet(ShardInfo* shards, int num, const char* name, Config* cfg) {
+    char fname[MAX_FULL_PATH + 16];
+    char* colname[MCX_MERGE_MAXCOL] = {NULL}, *coltype[MCX_MERGE_MAXCOL] = {NULL};
+    char* coldata[MCX_MERGE_MAXCOL] = {NULL};
+    uint colrows[MCX_MERGE_MAXCOL] = {0}, colnum[MCX_MERGE_MAXCOL] = {0};
+    cJSON* root = NULL, *info = NULL, *dat, *sub;
+    double totalphoton = 0.0, detected = 0.0, saved = 0.0, invsum = 0.0;
+    int k, col, colcount = 0, isnormalized = 1;
+    char* jsonstr;
+    FILE* fp;
+
+    for (k = 0; k < num; k++) {
+        cJSON* jroot = mcx_merge_loadjson(shards[k].detected);
+        cJSON* hdr = cJSON_GetObjectItem(cJSON_GetObjectItem(jroot, "MCXData"), "Info");
+        float normalizer;
+
+        dat = cJSON_GetObjectItem(cJSON_GetObjectItem(jroot, "MCXData"), "PhotonData");
+
+        if (hdr == NULL || dat == NULL) {
+            MCX_ERROR(-1, "invalid detected photon JData file");
+        }
+
+        totalphoton += mcx_merge_getnum(hdr, "TotalPhoton", 0.0);
+        detected += mcx_merge_getnum(hdr, "DetectedPhoton", 0.0);
+        saved += mcx_merge_getnum(hdr, "SavedPhoton", 0.0);
+        normalizer = mcx_merge_getnum(hdr, "Normalizer", 0.0);
+
+        if (normalizer > 0.f) {
+            invsum += 1.0 / normalizer;
+        } else {
+            isnormalized = 0;
+        }
+
+        for (col = 0, sub = dat->child; sub; sub = sub->next, col++) {
+            cJSON* size = cJSON_GetObjectItem(sub, "_ArraySize_");
+            cJSON* type = cJSON_GetObjectItem(sub, "_ArrayType_");
+            uint dims[2] = {0, 0};
+            int ndim = 0, byte;
+            char* buf = NULL, *dtype = NULL;
+
+            if (col >= MCX_MERGE_MAXCOL || cJSON_GetArraySize(size) != 2 || !cJSON_IsString(type)) {
+                MCX_ERROR(-1, "unexpected detected photon data field");
+            }
+
+            dims[0] = size->child->valueint;
+            dims[1] = size->child->next->valueint;
+            byte = mcx_merge_typebyte(type->valuestring);
+
+            if (k == 0) {
+                colname[col] = sub->string;
+                coltype[col] = type->valuestring;
+                colnum[col] = dims[1];
+                colcount++;
+            } else if (col >= colcount || strcmp(colname[col], sub->string) || strcmp(coltype[col], type->valuestring) || colnum[col] != dims[1]) {
+                MCX_ERROR(-1, "the detected photon data of the shards do not match");
+            }
+
+            if (dims[0] == 0) {
+                continue;
+            }
+
+            if (cJSON_GetObjectItem(sub, "_ArrayZipData_") == NULL
+                    || mcx_jdatadecode((void**)&buf, &ndim, dims, 2, &dtype, sub, cfg) || buf == NULL) {
+                MCX_ERROR(-1, "fail to decode the detected photon data");
+            }
+
+            coldata[col] = (char*)realloc(coldata[col], ((size_t)colrows[col] + dims[0]) * dims[1] * byte);
+            memcpy(coldata[col] + (size_t)colrows[col] * dims[1] * byte, buf, (size_t)dims[0] * dims[1] * byte);
+            colrows[col] += dims[0];
+            free(buf);
+        }
+
+        if (col != colcount) {
+            MCX_ERROR(-1, "the detected photon data of the shards do not match");
+        }
+
+        if (k == 0) {
+            root = jroot; /* keep the first document as the template, so that the column names stay valid */
+            info = hdr;
+        } else {
+            cJSON_Delete(jroot);
+        }
+    }
+
+    cJSON_ReplaceItemInObject(info, "TotalPhoton", cJSON_CreateNumber(totalphoton));
+    cJSON_ReplaceItemInObject(info, "DetectedPhoton", cJSON_CreateNumber(detected));
+    cJSON_ReplaceItemInObject(info, "SavedPhoton", cJSON_CreateNumber(saved));
+    cJSON_ReplaceItemInObject(info, "Normalizer", cJSON_CreateNumber((isnormalized && invsum > 0.0) ? (float)(1.0 / invsum) : 0.f));
+
+    dat = cJSON_CreateObject();
+
+    for (col = 0; col < colcount; col++) {
+        uint dims[2] = {colrows[col], colnum[col]};
+
+        cJSON_AddItemToObject(dat, colname[col], sub = cJSON_CreateObject());
+
+        if (mcx_jdataencode(coldata[col], 2, dims, coltype[col], mcx_merge_typebyte(coltype[col]), cfg->zipid, sub, 0, 0, cfg)) {
+            MCX_ERROR(-1, "error when converting to JSON");
+        }
+
+        free(coldata[col]);
+    }
+
+    cJSON_ReplaceItemInObject(cJSON_GetObjectItem(root, "MCXData"), "PhotonData", dat);
+
+    jsonstr = cJSON_Print(root);
+
+    if (jsonstr == NULL) {
+        MCX_ERROR(-1, "error when converting to JSON");
+    }
+
+    snprintf(fname, sizeof(fname), "%s_detp.jdat", name);
+    fp = fopen(fname, "wt");
+
+    if (fp == NULL) {
+        MCX_ERROR(-2, "can not save data to disk");
+    }
+
+    fprintf(fp, "%s\n", jsonstr);
+    fclose(fp);
+    free(jsonstr);
+    cJSON_Delete(root);
+    MCX_FPRINTF(cfg->flog, "merged %.0f detected photons are saved to %s\n", saved, fname);
+}
+
+/**
+ * @brief Merge the outputs of sharded simulations into the outputs of a single run
+ *
+ * All file names following --merge on the command line are treated as shard
+ * outputs; the merged outputs are saved with the session name given by -s
+ * (or "merged" if not set), in the same formats as the shard outputs.
+ *
+ * @param[in] argc: the number of command line parameters
+ * @param[in] argv: the command line parameters
+ * @param[in] cfg: simulation configuration, providing the session name, root folder and zip method
+ */
+
+int mcx_merge(int argc, char* argv[], Config* cfg) {
+    ShardInfo* shards = NULL;
+    char name[MAX_FULL_PATH];
+    char* isloaded;
+    float* scale = NULL;
+    double photons = 0.0, energytot = 0.0, energyesc = 0.0;
+    int i, k, num = 0;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--merge") == 0) {
+            for (; i + 1 < argc && argv[i + 1][0] != '-'; i++) {
+                shards = (ShardInfo*)realloc(shards, sizeof(ShardInfo) * (num + 1));
+                mcx_merge_loadshard(argv[i + 1], shards + num);
+                num++;
+            }
+        }
+    }
+
+    if (num == 0) {
+        MCX_ERROR(-1, "please list the shard outputs after --merge");
+    }
+
+    isloaded = (char*)calloc(shards[0].count, 1);
+
+    for (k = 0; k < num; k++) {
+        if (shards[k].count != shards[0].count || shards[k].srcnum != shards[0].srcnum || shards[k].normalize != shards[0].normalize
+                || (shards[k].field[0] == '\0') != (shards[0].field[0] == '\0') || (shards[k].detected[0] == '\0') != (shards[0].detected[0] == '\0')
+                || (shards[k].dx == NULL) != (shards[0].dx == NULL) || memcmp(shards[k].dim, shards[0].dim, sizeof(shards[0].dim))) {
+            MCX_ERROR(-1, "the shards do not come from the same simulation");
+        }
+
+        if (isloaded[shards[k].id - 1]) {
+            MCX_FPRINTF(stderr, "shard %d/%d is listed more than once\n", shards[k].id, shards[k].count);
+            MCX_ERROR(-1, "duplicated shard");
+        }
+
+        isloaded[shards[k].id - 1] = 1;
+        photons += shards[k].photons;
+        energytot += shards[k].energytot;
+        energyesc += shards[k].energyesc;
+    }
+
+    free(isloaded);
+
+    if (num < shards[0].count) {
+        MCX_FPRINTF(cfg->flog, S_RED "WARNING: only %d of %d shards are merged\n" S_RESET, num, shards[0].count);
+    }
+
+    /** the combined factor of each source, 1/sum(1/alpha_k), equals the factor of a single run with all photons */
+    if (shards[0].normalize) {
+        scale = (float*)calloc(shards[0].srcnum, sizeof(float));
+
+        for (i = 0; i < shards[0].srcnum; i++) {
+            double invsum = 0.0;
+
+            for (k = 0; k < num; k++) {
+                invsum += 1.0 / shards[k].normalizer[i];
+            }
+
+            scale[i] = (float)(1.0 / invsum);
+        }
+    }
+
+    if (cfg->session[0] == '\0') {
+        strcpy(cfg->session, "merged");
+    }
+
+    if (cfg->rootpath[0]) {
+        snprintf(name, MAX_FULL_PATH, "%s%c%s", cfg->rootpath, pathsep, cfg->session);
+    } else {
+        snprintf(name, MAX_FULL_PATH, "%s", cfg->session);
+    }
+
+    MCX_FPRINTF(cfg->flog, "merging %d shards: %.0f photons, total simulated energy: %.2f\tabsorbed: " S_BOLD "" S_BLUE "%5.5f%%" S_RESET "\n",
+                num, photons, energytot, (energytot > 0.0 ? (energytot - energyesc) / energytot * 100.0 : 0.0));
+
+    if (shards[0].field[0]) {
+        mcx_merge_field(shards, num, scale, name, cfg);
+    }
+
+    if (shards[0].detected[0]) {
+        if (strcmp(mcx_merge_ext(shards[0].detected), "mch") == 0) {
+            mcx_merge_mch(shards, num, name, cfg);
+        } else {
+            mcx_merge_jdet(shards, num, name, cfg);
+        }
+    }
+
+    for (k = 0; k < num; k++) {
+        free(shards[k].normalizer);
+        free(shards[k].dx);
+        free(shards[k].dy);
+        free(shards[k].dz);
+    }
+
+    free(shards);
+    free(scale);
+    fflush(cfg->flog);
+    return 0;
+}
@@ -0,0 +1,76 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    mcx_merge.h
+
+@brief   Merge tool for the outputs of sharded (--shard k/N) simulations
+*******************************************************************************/
+
+#ifndef _MCEXTREME_MERGE_H
+#define _MCEXTREME_MERGE_H
+
+#include "mcx_utils.h"
+
+#define MCX_MERGE_SUFFIX     "_shard.json"         /**< suffix of the tally file saved by each shard */
+#define MCX_MERGE_MAXCOL     16                    /**< max number of data fields per detected photon record */
+#define MCX_MERGE_BUFSIZE    (1 << 20)             /**< buffer size in bytes when copying binary records */
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Energy tallies and normalization factors of a shard, loaded from <session>_shard.json
+ */
+
+typedef struct MCXShardInfo {
+    char field[MAX_FULL_PATH];    /**< full path of the un-normalized volumetric output, empty if not saved */
+    char detected[MAX_FULL_PATH]; /**< full path of the detected photon file, empty if not saved */
+    int id;                       /**< shard index, starting from 1 */
+    int count;                    /**< total number of shards */
+    int srcnum;                   /**< number of pattern sources */
+    int normalize;                /**< normalization option, 0 if the output should not be normalized */
+    double photons;               /**< number of photons simulated in this shard */
+    double energytot;             /**< total launched energy */
+    double energyesc;             /**< total escaped energy */
+    float* normalizer;            /**< normalization factors of each source */
+    unsigned int dim[3];          /**< dimensions of a non-uniform grid */
+    float unitinmm;               /**< reference voxel size in mm of a non-uniform grid */
+    float* dx;                    /**< voxel spacing along x of a non-uniform grid, NULL if the grid is uniform */
+    float* dy;                    /**< voxel spacing along y of a non-uniform grid */
+    float* dz;                    /**< voxel spacing along z of a non-uniform grid */
+} ShardInfo;
+
+int  mcx_merge(int argc, char* argv[], Config* cfg);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
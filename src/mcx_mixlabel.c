@@ -0,0 +1,141 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    mcx_mixlabel.c
+
+@brief   Downsampling of label volumes to the mixed-label (MEDIA_2LABEL_MIX) format
+
+A high-resolution segmentation is simulated on a grid that is coarser by an
+integer factor: each coarse voxel covers a factor x factor x factor block of
+the input voxels, and records the two most frequent labels of the block and
+the volume fraction of the second one among them. The kernel picks one of the
+two labels at random with this fraction each time the properties of the voxel
+are read, so a tissue boundary is resolved at a sub-voxel level, while the
+volume and the fluence outputs shrink by the cube of the factor.
+
+The packed word is {[short ratio][byte label2][byte label1]}, where ratio is
+the volume fraction of label2 scaled to 32767, as decoded by mcx_core.cu.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mcx_mixlabel.h"
+#include "mcx_utils.h"
+#include "mcx_const.h"
+#include "mcx_norm.h"
+
+/**
+ * @brief Downsample a label volume by an integer factor to the packed mixed-label format
+ *
+ * The block of the last voxel along an axis is truncated if the dimension is not a
+ * multiple of the factor. A block of background (label 0) voxels remains background;
+ * if the background is one of the two labels of a block, it is mixed as label 0.
+ *
+ * @param[in] vol: the label volume (column-major, labels up to MCX_MIXLABEL_MAXLABEL)
+ * @param[in] dim: the dimensions of the label volume
+ * @param[in] factor: the edge length of the block of input voxels merged into a voxel
+ * @param[out] newdim: the dimensions of the downsampled volume, ceil(dim/factor)
+ * @return the downsampled volume of newdim voxels, NULL if the memory can not be allocated
+ */
+
+unsigned int* mcx_mixlabel_downsample(const unsigned int* vol, const unsigned int dim[3], unsigned int factor, unsigned int newdim[3]) {
+    unsigned int* newvol;
+    size_t rownum;
+    long long row;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        newdim[i] = (dim[i] + factor - 1) / factor;
+    }
+
+    rownum = (size_t)newdim[1] * newdim[2];
+    newvol = (unsigned int*)calloc(rownum * newdim[0], sizeof(unsigned int));
+
+    if (newvol == NULL) {
+        return NULL;
+    }
+
+    /** each thread counts the labels of one block at a time, resetting only the labels it has seen */
+    #pragma omp parallel for schedule(static) num_threads(mcx_norm_threadnum((size_t)dim[0] * dim[1] * dim[2]))
+
+    for (row = 0; row < (long long)rownum; row++) {
+        unsigned int count[MCX_MIXLABEL_MAXLABEL + 1] = {0};
+        unsigned char seen[MCX_MIXLABEL_MAXLABEL + 1];
+        unsigned int y0 = (row % newdim[1]) * factor, z0 = (row / newdim[1]) * factor;
+        unsigned int y1 = MIN(y0 + factor, dim[1]), z1 = MIN(z0 + factor, dim[2]);
+        unsigned int nx, x, y, z;
+
+        for (nx = 0; nx < newdim[0]; nx++) {
+            unsigned int x0 = nx * factor, x1 = MIN(x0 + factor, dim[0]);
+            unsigned int label1 = 0, label2 = 0, n1 = 0, n2 = 0, nseen = 0, k;
+
+            for (z = z0; z < z1; z++) {
+                for (y = y0; y < y1; y++) {
+                    const unsigned int* line = vol + ((size_t)z * dim[1] + y) * dim[0];
+
+                    for (x = x0; x < x1; x++) {
+                        unsigned int label = line[x] & MCX_MIXLABEL_MAXLABEL;
+
+                        if (count[label]++ == 0) {
+                            seen[nseen++] = label;
+                        }
+                    }
+                }
+            }
+
+            /** ties are resolved by the order of first appearance in the block */
+            for (k = 0; k < nseen; k++) {
+                unsigned int label = seen[k], n = count[label];
+
+                if (n > n1) {
+                    label2 = label1;
+                    n2 = n1;
+                    label1 = label;
+                    n1 = n;
+                } else if (n > n2) {
+                    label2 = label;
+                    n2 = n;
+                }
+
+                count[label] = 0;
+            }
+
+            if (n2 > 0) {
+                unsigned int ratio = (unsigned int)(((unsigned long long)n2 * MCX_MIXLABEL_FULL + ((n1 + n2) >> 1)) / (n1 + n2));
+
+                newvol[row * newdim[0] + nx] = (ratio << 16) | (label2 << 8) | label1;
+            } else {
+                newvol[row * newdim[0] + nx] = label1;
+            }
+        }
+    }
+
+    return newvol;
+}
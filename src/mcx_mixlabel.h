@@ -0,0 +1,51 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    mcx_mixlabel.h
+
+@brief   Downsampling of label volumes to the mixed-label (MEDIA_2LABEL_MIX) format
+*******************************************************************************/
+
+#ifndef _MCEXTREME_MIXLABEL_H
+#define _MCEXTREME_MIXLABEL_H
+
+#define MCX_MIXLABEL_MAXLABEL   255                 /**< the mixed-label format stores the labels as bytes */
+#define MCX_MIXLABEL_FULL       32767               /**< the mixing ratio stored for a volume fraction of 1 */
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+unsigned int* mcx_mixlabel_downsample(const unsigned int* vol, const unsigned int dim[3], unsigned int factor, unsigned int newdim[3]);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,287 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    mcx_norm.c
+
+@brief   Parallel reductions and scaling used to normalize the simulation outputs
+
+The outputs of a multi-pattern (photon sharing) simulation are stored as
+rows of srcnum interleaved values; all functions here walk such arrays
+row by row so that every pattern is processed in the same pass. Sums are
+split into at most MCX_NORM_MAXBLOCK blocks of consecutive rows; each block
+is accumulated with Kahan summation in double precision and the block sums
+are added pairwise. The block layout only depends on the data length, so
+the results do not change with the number of threads.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+#include "mcx_norm.h"
+
+#define NORM_MINPARALLEL  65536                     /**< arrays shorter than this are processed by a single thread */
+
+/**
+ * @brief Return the number of threads used to process an array
+ *
+ * The normalization runs inside the per-GPU thread of mcx_run_simulation; the
+ * per-GPU team is sized by a num_threads clause, so the default thread number
+ * (OMP_NUM_THREADS or omp_set_num_threads) still applies here
+ *
+ * @param[in] len: the number of elements to be processed
+ * @return the number of threads, 1 for short arrays or if OpenMP is disabled
+ */
+
+int mcx_norm_threadnum(size_t len) {
+#ifdef _OPENMP
+
+    if (len >= NORM_MINPARALLEL) {
+        return omp_get_max_threads();
+    }
+
+#endif
+    return 1;
+}
+
+/**
+ * @brief Split a reduction into blocks of consecutive rows
+ *
+ * @param[in] rownum: the number of rows to be summed
+ * @param[out] blocklen: the number of rows per block
+ * @return the number of blocks
+ */
+
+static size_t mcx_norm_blocks(size_t rownum, size_t* blocklen) {
+    size_t blocknum = (rownum + MCX_NORM_MINROWS - 1) / MCX_NORM_MINROWS;
+
+    if (blocknum > MCX_NORM_MAXBLOCK) {
+        blocknum = MCX_NORM_MAXBLOCK;
+    }
+
+    if (blocknum == 0) {
+        blocknum = 1;
+    }
+
+    *blocklen = (rownum + blocknum - 1) / blocknum;
+    return blocknum;
+}
+
+/**
+ * @brief Add the per-block sums pairwise and store the total in the given array
+ *
+ * @param[in,out] partial: blocknum x len block sums, overwritten
+ * @param[in] blocknum: the number of blocks
+ * @param[in] len: the number of sums per block
+ * @param[out] sum: the len totals
+ */
+
+static void mcx_norm_pairwise(double* partial, size_t blocknum, size_t len, double* sum) {
+    size_t step, b, i;
+
+    for (step = 1; step < blocknum; step <<= 1) {
+        for (b = 0; b + step < blocknum; b += (step << 1)) {
+            for (i = 0; i < len; i++) {
+                partial[b * len + i] += partial[(b + step) * len + i];
+            }
+        }
+    }
+
+    memcpy(sum, partial, len * sizeof(double));
+}
+
+/**
+ * @brief Sum each column of a row-major array, optionally weighting each row
+ *
+ * @param[in] data: the rownum x colnum array, colnum values per row
+ * @param[in] rownum: the number of rows
+ * @param[in] colnum: the number of columns, i.e. number of patterns
+ * @param[in] rowweight: if not NULL, row r is multiplied by rowweight[r % weightlen]
+ * @param[in] weightlen: the length of rowweight
+ * @param[out] sum: the colnum column sums
+ */
+
+void mcx_norm_colsum(const float* data, size_t rownum, unsigned int colnum, const float* rowweight, size_t weightlen, double* sum) {
+    size_t blocklen, blocknum = mcx_norm_blocks(rownum, &blocklen);
+    double* partial = (double*)calloc(blocknum * colnum, sizeof(double));
+    int b;
+
+    #pragma omp parallel num_threads(mcx_norm_threadnum(rownum * colnum))
+    {
+        double* comp = (double*)malloc(colnum * sizeof(double));
+
+        #pragma omp for schedule(static)
+
+        for (b = 0; b < (int)blocknum; b++) {
+            double* acc = partial + (size_t)b * colnum;
+            size_t row, end = ((size_t)b + 1) * blocklen;
+            unsigned int i;
+
+            memset(comp, 0, colnum * sizeof(double));
+
+            for (row = (size_t)b * blocklen; row < end && row < rownum; row++) {
+                const float* val = data + row * colnum;
+                double w = (rowweight ? rowweight[row % weightlen] : 1.0);
+
+                for (i = 0; i < colnum; i++) {
+                    double y = val[i] * w - comp[i];
+                    double t = acc[i] + y;
+
+                    comp[i] = (t - acc[i]) - y;
+                    acc[i] = t;
+                }
+            }
+        }
+
+        free(comp);
+    }
+
+    mcx_norm_pairwise(partial, blocknum, colnum, sum);
+    free(partial);
+}
+
+/**
+ * @brief Sum the values sharing the same label, such as the weights of the photons detected by each detector
+ *
+ * @param[in] data: the values to be summed
+ * @param[in] label: the 1-based label of each value, values with labels outside of [1, labelnum] are skipped
+ * @param[in] len: the length of data and label
+ * @param[in] labelnum: the number of labels
+ * @param[out] sum: the labelnum sums, sum[i] is the total of label i+1
+ */
+
+void mcx_norm_labelsum(const float* data, const int* label, size_t len, unsigned int labelnum, double* sum) {
+    size_t blocklen, blocknum = mcx_norm_blocks(len, &blocklen);
+    double* partial = (double*)calloc(blocknum * labelnum, sizeof(double));
+    int b;
+
+    #pragma omp parallel num_threads(mcx_norm_threadnum(len))
+    {
+        double* comp = (double*)malloc(labelnum * sizeof(double));
+
+        #pragma omp for schedule(static)
+
+        for (b = 0; b < (int)blocknum; b++) {
+            double* acc = partial + (size_t)b * labelnum;
+            size_t i, end = ((size_t)b + 1) * blocklen;
+
+            memset(comp, 0, labelnum * sizeof(double));
+
+            for (i = (size_t)b * blocklen; i < end && i < len; i++) {
+                if (label[i] > 0 && label[i] <= (int)labelnum) {
+                    int id = label[i] - 1;
+                    double y = data[i] - comp[id];
+                    double t = acc[id] + y;
+
+                    comp[id] = (t - acc[id]) - y;
+                    acc[id] = t;
+                }
+            }
+        }
+
+        free(comp);
+    }
+
+    mcx_norm_pairwise(partial, blocknum, labelnum, sum);
+    free(partial);
+}
+
+/**
+ * @brief Multiply each column of a row-major array by its own scaling factor in a single pass
+ *
+ * @param[in,out] field: the rownum x colnum array, colnum values per row
+ * @param[in] rownum: the number of rows
+ * @param[in] colnum: the number of columns, i.e. number of patterns
+ * @param[in] scale: the colnum scaling factors
+ * @param[in] option: if set to 2, only normalize positive values (negative values for diffuse reflectance calculations)
+ */
+
+void mcx_norm_scale(float* field, size_t rownum, unsigned int colnum, const float* scale, int option) {
+    long long row;
+
+    #pragma omp parallel for schedule(static) num_threads(mcx_norm_threadnum(rownum * colnum))
+
+    for (row = 0; row < (long long)rownum; row++) {
+        float* val = field + (size_t)row * colnum;
+        unsigned int i;
+
+        for (i = 0; i < colnum; i++) {
+            if (option == 2 && val[i] < 0.f) {
+                continue;
+            }
+
+            val[i] *= scale[i];
+        }
+    }
+}
+
+/**
+ * @brief Divide the output of each voxel of a non-uniform grid by its volume relative to a reference voxel
+ *
+ * @param[in,out] field: framenum frames of dim[0] x dim[1] x dim[2] voxels (x-fastest), each voxel stores colnum values
+ * @param[in] dim: the domain size along x, y and z
+ * @param[in] dx: the dim[0] voxel edge lengths (in mm) along x
+ * @param[in] dy: the dim[1] voxel edge lengths (in mm) along y
+ * @param[in] dz: the dim[2] voxel edge lengths (in mm) along z
+ * @param[in] unitinmm: the edge length (in mm) of the reference voxel
+ * @param[in] framenum: the number of frames, such as time gates
+ * @param[in] colnum: the number of values per voxel, i.e. number of patterns
+ */
+
+void mcx_norm_voxelvolume(float* field, const unsigned int dim[3], const float* dx, const float* dy, const float* dz,
+                          float unitinmm, size_t framenum, unsigned int colnum) {
+    size_t slicelen = (size_t)dim[0] * dim[1], dimxyz = slicelen * dim[2];
+    double unitvol = (double)unitinmm * unitinmm * unitinmm;
+    long long z;
+
+    #pragma omp parallel for schedule(static) num_threads(mcx_norm_threadnum(dimxyz * framenum * colnum))
+
+    for (z = 0; z < (long long)dim[2]; z++) {
+        size_t frame, x, y;
+        unsigned int i;
+
+        for (y = 0; y < dim[1]; y++) {
+            for (x = 0; x < dim[0]; x++) {
+                float ratio = (float)(unitvol / ((double)dx[x] * dy[y] * dz[z]));
+                size_t idx = (size_t)z * slicelen + y * dim[0] + x;
+
+                for (frame = 0; frame < framenum; frame++) {
+                    float* val = field + (frame * dimxyz + idx) * colnum;
+
+                    for (i = 0; i < colnum; i++) {
+                        val[i] *= ratio;
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,58 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    mcx_norm.h
+
+@brief   Parallel reductions and scaling used to normalize the simulation outputs
+*******************************************************************************/
+
+#ifndef _MCEXTREME_NORM_H
+#define _MCEXTREME_NORM_H
+
+#include <stddef.h>
+
+#define MCX_NORM_MINROWS   1024                     /**< minimum number of rows summed by one block */
+#define MCX_NORM_MAXBLOCK  256                      /**< max number of blocks of a reduction */
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+int  mcx_norm_threadnum(size_t len);
+void mcx_norm_colsum(const float* data, size_t rownum, unsigned int colnum, const float* rowweight, size_t weightlen, double* sum);
+void mcx_norm_labelsum(const float* data, const int* label, size_t len, unsigned int labelnum, double* sum);
+void mcx_norm_scale(float* field, size_t rownum, unsigned int colnum, const float* scale, int option);
+void mcx_norm_voxelvolume(float* field, const unsigned int dim[3], const float* dx, const float* dy, const float* dz,
+                          float unitinmm, size_t framenum, unsigned int colnum);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
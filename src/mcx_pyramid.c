@@ -0,0 +1,465 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    mcx_pyramid.c
+
+@brief   Multi-resolution media pyramid and coarse-to-fine tally regions
+
+Each level of the pyramid halves the grid along all axes: a coarse voxel
+covers up to 2x2x2 voxels of the finer level. Label-based formats keep the
+most frequent label of the 8 voxels (ties favor non-zero labels), while the
+continuous formats keep the background if at least half of the voxels are
+background, and the average of the non-background voxels otherwise. As the
+kernel works in grid units, the mua/mus values stored directly in the voxels
+are scaled by the ratio of the voxel sizes.
+
+A fast simulation on the coarsest level gives the region in which the fluence
+exceeds a fraction of its maximum; the full-resolution simulation only tallies
+the volumetric output inside this region.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mcx_pyramid.h"
+#include "mcx_detfilter.h"
+#include "mcx_norm.h"
+
+/**
+ * @brief Return the most frequent value of a short list
+ *
+ * @param[in] val: the values
+ * @param[in] n: the length of the list, at most 8
+ * @return the most frequent value, ties are resolved in favor of non-zero values, then of the first one
+ */
+
+static unsigned int mcx_pyramid_majority(const unsigned int* val, int n) {
+    unsigned int best = val[0];
+    int i, j, bestcount = 0;
+
+    for (i = 0; i < n; i++) {
+        int count = 0;
+
+        for (j = 0; j < n; j++) {
+            count += (val[j] == val[i]);
+        }
+
+        if (count > bestcount || (count == bestcount && best == 0 && val[i] != 0)) {
+            best = val[i];
+            bestcount = count;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * @brief Convert a float to a half-precision value
+ *
+ * @param[in] val: the input value
+ * @return the half-precision value in the lower 16 bits
+ */
+
+static unsigned short mcx_pyramid_half(float val) {
+    float pair[2] = {val, 1.f};
+
+    return (unsigned short)(mcx_float2half2(pair) & 0xFFFF);
+}
+
+/**
+ * @brief Merge the voxels of a 2x2x2 block of a continuous media format
+ *
+ * @param[in] val: the voxels of the block
+ * @param[in] n: the number of voxels in the block
+ * @param[in] mediabyte: the media format
+ * @param[in] propscale: factor applied to the mua/mus values stored in the voxels
+ * @return the coarse voxel, 0 if at least half of the block is background
+ */
+
+static unsigned int mcx_pyramid_average(const unsigned int* val, int n, unsigned int mediabyte, float propscale) {
+    float sum[4] = {0.f, 0.f, 0.f, 0.f};
+    int i, j, len = 0;
+    union {
+        unsigned int i;
+        float f;
+        unsigned short h[2];
+        short s[2];
+        unsigned char c[4];
+    } voxel;
+
+    for (i = 0; i < n; i++) {
+        if (val[i] == 0) {
+            continue;
+        }
+
+        voxel.i = val[i];
+        len++;
+
+        if (mediabyte == MEDIA_MUA_FLOAT) {
+            sum[0] += voxel.f;
+        } else if (mediabyte == MEDIA_AS_F2H || mediabyte == MEDIA_AS_HALF) {
+            sum[0] += mcx_half2float(voxel.h[0]);
+            sum[1] += mcx_half2float(voxel.h[1]);
+        } else if (mediabyte == MEDIA_AS_SHORT) {
+            sum[0] += voxel.h[0];
+            sum[1] += voxel.h[1];
+        } else {
+            for (j = 0; j < 4; j++) {
+                sum[j] += voxel.c[j];
+            }
+        }
+    }
+
+    if ((len << 1) <= n) {
+        return 0;
+    }
+
+    if (mediabyte == MEDIA_MUA_FLOAT) {
+        voxel.f = sum[0] / len * propscale;
+    } else if (mediabyte == MEDIA_AS_F2H || mediabyte == MEDIA_AS_HALF) {
+        sum[0] *= propscale / len;
+        sum[1] *= propscale / len;
+        voxel.i = (unsigned int)mcx_float2half2(sum);
+    } else if (mediabyte == MEDIA_AS_SHORT) {
+        voxel.h[0] = (unsigned short)(sum[0] / len + 0.5f);
+        voxel.h[1] = (unsigned short)(sum[1] / len + 0.5f);
+    } else {
+        for (j = 0; j < 4; j++) {
+            voxel.c[j] = (unsigned char)(sum[j] / len + 0.5f);
+        }
+    }
+
+    return (voxel.i == 0) ? 1 : voxel.i; /* a tissue voxel must not become background */
+}
+
+/**
+ * @brief Downsample a media volume by 2 along all axes
+ *
+ * The detector mask bit of the label formats is not kept, as the coarse
+ * levels are not used to detect photons.
+ *
+ * @param[in] vol: the media volume in the host format used by the GPU (32-bit words)
+ * @param[in] dim: the x/y/z dimensions of vol
+ * @param[in] mediabyte: the media format, the 64-bit formats (svmc, asgn_float) are not supported
+ * @param[in] propscale: factor applied to the mua/mus values stored in the voxels, 2 for a physical downsampling
+ * @param[out] halfdim: the x/y/z dimensions of the output, half of dim rounded up
+ * @return the downsampled volume, to be released by free()
+ */
+
+unsigned int* mcx_pyramid_halve(const unsigned int* vol, const unsigned int dim[3], unsigned int mediabyte,
+                                float propscale, unsigned int halfdim[3]) {
+    unsigned int* out;
+    size_t len;
+    long long row;
+
+    halfdim[0] = (dim[0] + 1) >> 1;
+    halfdim[1] = (dim[1] + 1) >> 1;
+    halfdim[2] = (dim[2] + 1) >> 1;
+    len = (size_t)halfdim[0] * halfdim[1] * halfdim[2];
+    out = (unsigned int*)malloc(len * sizeof(unsigned int));
+
+    #pragma omp parallel for schedule(static) num_threads(mcx_norm_threadnum(len))
+
+    for (row = 0; row < (long long)halfdim[1] * halfdim[2]; row++) {
+        unsigned int y = (unsigned int)(row % halfdim[1]), z = (unsigned int)(row / halfdim[1]), x, i, j, k;
+        unsigned int val[8];
+
+        for (x = 0; x < halfdim[0]; x++) {
+            int n = 0;
+
+            for (k = (z << 1); k < MIN((z << 1) + 2, dim[2]); k++) {
+                for (j = (y << 1); j < MIN((y << 1) + 2, dim[1]); j++) {
+                    for (i = (x << 1); i < MIN((x << 1) + 2, dim[0]); i++) {
+                        val[n] = vol[((size_t)k * dim[1] + j) * dim[0] + i];
+
+                        if (mediabyte <= 4) {
+                            val[n] &= MED_MASK;
+                        }
+
+                        n++;
+                    }
+                }
+            }
+
+            if (mediabyte <= 4 || mediabyte == MEDIA_2LABEL_MIX || mediabyte == MEDIA_LABEL_HALF) {
+                unsigned int label = mcx_pyramid_majority(val, n);
+
+                /** the upper half of a label_half voxel stores mua (0) or mus (1) if the upper 2 bits of the lower half are 0 or 1 */
+                if (mediabyte == MEDIA_LABEL_HALF && ((label & 0xFFFF) >> 14) < 2) {
+                    label = (label & 0xFFFF) | ((unsigned int)mcx_pyramid_half(mcx_half2float(label >> 16) * propscale) << 16);
+                }
+
+                out[row * halfdim[0] + x] = label;
+            } else {
+                out[row * halfdim[0] + x] = mcx_pyramid_average(val, n, mediabyte, propscale);
+            }
+        }
+    }
+
+    return out;
+}
+
+/**
+ * @brief Build the coarsest level of a media pyramid
+ *
+ * @param[in] vol: the media volume in the host format used by the GPU (32-bit words)
+ * @param[in] dim: the x/y/z dimensions of vol
+ * @param[in] mediabyte: the media format, the 64-bit formats (svmc, asgn_float) are not supported
+ * @param[in] level: the number of 2x downsampling levels, between 1 and MCX_PYRAMID_MAXLEVEL
+ * @param[out] coarsedim: the x/y/z dimensions of the coarsest level
+ * @return the coarsest level, to be released by free()
+ */
+
+unsigned int* mcx_pyramid_build(const unsigned int* vol, const unsigned int dim[3], unsigned int mediabyte,
+                                unsigned int level, unsigned int coarsedim[3]) {
+    unsigned int* coarse = NULL, *fine;
+    unsigned int finedim[3] = {dim[0], dim[1], dim[2]}, i;
+
+    for (i = 0; i < level; i++) {
+        fine = coarse;
+        coarse = mcx_pyramid_halve((fine ? fine : vol), finedim, mediabyte, 2.f, coarsedim);
+        memcpy(finedim, coarsedim, sizeof(finedim));
+        free(fine);
+    }
+
+    return coarse;
+}
+
+/**
+ * @brief Find the region where the fluence of a coarse simulation is significant
+ *
+ * The region is the bounding box of the coarse voxels whose fluence (summed
+ * over all sources) is at least tol times the maximum, grown by one coarse
+ * voxel on each side and converted to the indices of the full-resolution grid.
+ *
+ * @param[in] coarse: the output of the coarse simulation, srcnum values per voxel, single time gate
+ * @param[in] coarsedim: the x/y/z dimensions of the coarse grid
+ * @param[in] srcnum: the number of values per voxel
+ * @param[in] tol: the relative threshold of the fluence
+ * @param[in] level: the number of 2x downsampling levels between the grids
+ * @param[in] dim: the x/y/z dimensions of the full-resolution grid
+ * @param[out] roi0: the lower corner (0-based, inclusive) of the region in the full-resolution grid
+ * @param[out] roi1: the upper corner (inclusive) of the region in the full-resolution grid
+ * @return the fraction of the coarse fluence within the region, or -1 if the coarse output is empty
+ */
+
+double mcx_pyramid_roi(const float* coarse, const unsigned int coarsedim[3], unsigned int srcnum, float tol,
+                       unsigned int level, const unsigned int dim[3], unsigned int roi0[3], unsigned int roi1[3]) {
+    size_t slicelen = (size_t)coarsedim[0] * coarsedim[1];
+    unsigned int factor = (1u << level), i;
+    int lo[3] = {(int)coarsedim[0], (int)coarsedim[1], (int)coarsedim[2]}, hi[3] = {-1, -1, -1};
+    double maxval = 0.0, total = 0.0, inside = 0.0;
+    double* slice = (double*)calloc(coarsedim[2] * 3, sizeof(double)); /* max, sum and inside-box sum of each z-slice */
+    int* box = (int*)malloc(coarsedim[2] * 4 * sizeof(int));            /* x/y range of each z-slice above the threshold */
+    long long z;
+
+    /** the per-slice partial results are combined serially, the reductions do not depend on the thread number */
+    #pragma omp parallel for schedule(static) num_threads(mcx_norm_threadnum(slicelen * coarsedim[2]))
+
+    for (z = 0; z < (long long)coarsedim[2]; z++) {
+        size_t j;
+        unsigned int s;
+
+        for (j = 0; j < slicelen; j++) {
+            double val = 0.0;
+
+            for (s = 0; s < srcnum; s++) {
+                val += coarse[(z * slicelen + j) * srcnum + s];
+            }
+
+            slice[z * 3] = MAX(slice[z * 3], val);
+            slice[z * 3 + 1] += val;
+        }
+    }
+
+    for (i = 0; i < coarsedim[2]; i++) {
+        maxval = MAX(maxval, slice[i * 3]);
+        total += slice[i * 3 + 1];
+    }
+
+    if (!(maxval > 0.0)) {
+        free(slice);
+        free(box);
+        return -1.0;
+    }
+
+    #pragma omp parallel for schedule(static) num_threads(mcx_norm_threadnum(slicelen * coarsedim[2]))
+
+    for (z = 0; z < (long long)coarsedim[2]; z++) {
+        size_t j;
+        unsigned int s;
+        int* zbox = box + z * 4;
+
+        zbox[0] = coarsedim[0];
+        zbox[1] = -1;
+        zbox[2] = coarsedim[1];
+        zbox[3] = -1;
+
+        for (j = 0; j < slicelen; j++) {
+            double val = 0.0;
+
+            for (s = 0; s < srcnum; s++) {
+                val += coarse[(z * slicelen + j) * srcnum + s];
+            }
+
+            if (val > 0.0 && val >= tol * maxval) {
+                int x = (int)(j % coarsedim[0]), y = (int)(j / coarsedim[0]);
+
+                zbox[0] = MIN(zbox[0], x);
+                zbox[1] = MAX(zbox[1], x);
+                zbox[2] = MIN(zbox[2], y);
+                zbox[3] = MAX(zbox[3], y);
+            }
+        }
+    }
+
+    for (i = 0; i < coarsedim[2]; i++) {
+        if (box[i * 4 + 1] >= 0) {
+            lo[0] = MIN(lo[0], box[i * 4]);
+            hi[0] = MAX(hi[0], box[i * 4 + 1]);
+            lo[1] = MIN(lo[1], box[i * 4 + 2]);
+            hi[1] = MAX(hi[1], box[i * 4 + 3]);
+            lo[2] = MIN(lo[2], (int)i);
+            hi[2] = MAX(hi[2], (int)i);
+        }
+    }
+
+    /** grow the box by one coarse voxel to include the voxels partially above the threshold */
+    for (i = 0; i < 3; i++) {
+        lo[i] = MAX(lo[i] - 1, 0);
+        hi[i] = MIN(hi[i] + 1, (int)coarsedim[i] - 1);
+    }
+
+    #pragma omp parallel for schedule(static) num_threads(mcx_norm_threadnum(slicelen * coarsedim[2]))
+
+    for (z = lo[2]; z <= hi[2]; z++) {
+        int x, y;
+        unsigned int s;
+
+        for (y = lo[1]; y <= hi[1]; y++) {
+            for (x = lo[0]; x <= hi[0]; x++) {
+                for (s = 0; s < srcnum; s++) {
+                    slice[z * 3 + 2] += coarse[(z * slicelen + (size_t)y * coarsedim[0] + x) * srcnum + s];
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < coarsedim[2]; i++) {
+        inside += slice[i * 3 + 2];
+    }
+
+    for (i = 0; i < 3; i++) {
+        roi0[i] = lo[i] * factor;
+        roi1[i] = MIN((unsigned int)(hi[i] + 1) * factor, dim[i]) - 1;
+    }
+
+    free(slice);
+    free(box);
+
+    return inside / total;
+}
+
+/**
+ * @brief Compare a full-resolution output with the output of the coarse simulation
+ *
+ * Inside the tallied region, the full-resolution output is summed over the
+ * time gates, scaled by framescale, and averaged over the voxels covered by
+ * each coarse voxel; the relative L2 norm of the difference to the coarse
+ * output is returned.
+ *
+ * @param[in] field: the full-resolution output, framenum x (voxels) x srcnum values
+ * @param[in] dim: the x/y/z dimensions of the full-resolution grid
+ * @param[in] framenum: the number of time gates of field
+ * @param[in] framescale: factor applied to the sum over the time gates, e.g. 1/framenum to compare average fluence rates
+ * @param[in] coarse: the output of the coarse simulation, srcnum values per voxel, single time gate
+ * @param[in] coarsedim: the x/y/z dimensions of the coarse grid
+ * @param[in] srcnum: the number of values per voxel
+ * @param[in] level: the number of 2x downsampling levels between the grids
+ * @param[in] roi0: the lower corner (0-based, inclusive) of the tallied region
+ * @param[in] roi1: the upper corner (inclusive) of the tallied region
+ * @return the relative L2 difference, or -1 if the full-resolution output is empty in the region
+ */
+
+double mcx_pyramid_error(const float* field, const unsigned int dim[3], size_t framenum, float framescale,
+                         const float* coarse, const unsigned int coarsedim[3], unsigned int srcnum, unsigned int level,
+                         const unsigned int roi0[3], const unsigned int roi1[3]) {
+    size_t len = (size_t)coarsedim[0] * coarsedim[1] * coarsedim[2], dimxyz = (size_t)dim[0] * dim[1] * dim[2];
+    unsigned int factor = (1u << level);
+    double diff = 0.0, norm = 0.0;
+    long long c;
+
+    #pragma omp parallel for schedule(static) num_threads(mcx_norm_threadnum(len)) reduction(+:diff,norm)
+
+    for (c = 0; c < (long long)len; c++) {
+        unsigned int lo[3], hi[3], i, j, k, s;
+        size_t t, n;
+        double fine = 0.0, val = 0.0;
+
+        lo[0] = (unsigned int)(c % coarsedim[0]) * factor;
+        lo[1] = (unsigned int)((c / coarsedim[0]) % coarsedim[1]) * factor;
+        lo[2] = (unsigned int)(c / ((size_t)coarsedim[0] * coarsedim[1])) * factor;
+
+        for (i = 0; i < 3; i++) {
+            hi[i] = MIN(lo[i] + factor, dim[i]) - 1;
+        }
+
+        if (lo[0] < roi0[0] || lo[1] < roi0[1] || lo[2] < roi0[2] || hi[0] > roi1[0] || hi[1] > roi1[1] || hi[2] > roi1[2]) {
+            continue;
+        }
+
+        n = (size_t)(hi[0] - lo[0] + 1) * (hi[1] - lo[1] + 1) * (hi[2] - lo[2] + 1);
+
+        for (t = 0; t < framenum; t++) {
+            for (k = lo[2]; k <= hi[2]; k++) {
+                for (j = lo[1]; j <= hi[1]; j++) {
+                    for (i = lo[0]; i <= hi[0]; i++) {
+                        size_t idx = t * dimxyz + ((size_t)k * dim[1] + j) * dim[0] + i;
+
+                        for (s = 0; s < srcnum; s++) {
+                            fine += field[idx * srcnum + s];
+                        }
+                    }
+                }
+            }
+        }
+
+        fine *= framescale / n;
+
+        for (s = 0; s < srcnum; s++) {
+            val += coarse[c * srcnum + s];
+        }
+
+        diff += (val - fine) * (val - fine);
+        norm += fine * fine;
+    }
+
+    return (norm > 0.0) ? sqrt(diff / norm) : -1.0;
+}
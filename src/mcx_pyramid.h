@@ -0,0 +1,61 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    mcx_pyramid.h
+
+@brief   Multi-resolution media pyramid and coarse-to-fine tally regions
+*******************************************************************************/
+
+#ifndef _MCEXTREME_PYRAMID_H
+#define _MCEXTREME_PYRAMID_H
+
+#include <stddef.h>
+
+#define MCX_PYRAMID_MAXLEVEL   4                    /**< max number of 2x downsampling levels */
+#define MCX_PYRAMID_MINPHOTON  100000               /**< min photon number of the coarse run, unless fewer photons are simulated in total */
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+unsigned int* mcx_pyramid_halve(const unsigned int* vol, const unsigned int dim[3], unsigned int mediabyte,
+                                float propscale, unsigned int halfdim[3]);
+unsigned int* mcx_pyramid_build(const unsigned int* vol, const unsigned int dim[3], unsigned int mediabyte,
+                                unsigned int level, unsigned int coarsedim[3]);
+double mcx_pyramid_roi(const float* coarse, const unsigned int coarsedim[3], unsigned int srcnum, float tol,
+                       unsigned int level, const unsigned int dim[3], unsigned int roi0[3], unsigned int roi1[3]);
+double mcx_pyramid_error(const float* field, const unsigned int dim[3], size_t framenum, float framescale,
+                         const float* coarse, const unsigned int coarsedim[3], unsigned int srcnum, unsigned int level,
+                         const unsigned int roi0[3], const unsigned int roi1[3]);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
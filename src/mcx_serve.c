@@ -0,0 +1,635 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    mcx_serve.c
+
+@brief   Persistent server mode, running JSON jobs on warm devices
+*******************************************************************************/
+
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+    #define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+    #include <signal.h>
+    #include <unistd.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+#endif
+
+#include "mcx_serve.h"
+#include "mcx_const.h"
+#include "mcx_core.h"
+#include "mcx_tictoc.h"
+
+/**
+ * Raw volume cache entry, keyed by the file name, file size and modification
+ * time as well as the input parameters that affect how the volume is decoded
+ */
+
+typedef struct MCXVolCache {
+    char filename[MAX_PATH_LENGTH]; /**< full path of the cached volume file */
+    off_t filesize;               /**< size of the volume file in bytes */
+    time_t mtime;                 /**< last modification time of the volume file */
+    uint3 dim;                    /**< volume dimensions */
+    uint mediabyte;               /**< media format of the cached volume */
+    float unitinmm;               /**< voxel size used to scale continuous media */
+    uint maxlabel;                /**< largest label in a label-based volume */
+    uint* vol;                    /**< decoded volume, before shapes, cropping and detector masking */
+    size_t len;                   /**< number of uint elements in vol */
+    unsigned int lastuse;         /**< LRU counter */
+} VolCache;
+
+extern char flagset[256];
+extern char pathsep;
+
+static VolCache volcache[MCX_SERVE_VOLCACHE];
+static unsigned int volcachetick = 0;
+
+/**
+ * When armed, mcx_error jumps back to the armed trap instead of terminating
+ * the server; each worker thread has its own trap and error message. The job
+ * loop arms the trap while a job is parsed, and mcx_run_simulation arms its own
+ * trap so that it can release its buffers and return the error code; a trap is
+ * never armed across an OpenMP construct.
+ */
+
+static jmp_buf* servetrap = NULL;
+static int servecode = 0;
+static char servemsg[MCX_SERVE_MAXMSG];
+
+#ifdef _OPENMP
+    #pragma omp threadprivate(servetrap, servecode, servemsg)
+#endif
+
+/**
+ * @brief Return the job to the job loop if an error is raised while the trap is armed
+ *
+ * This function is called by mcx_error; it does not return if the calling thread
+ * is parsing a server job, otherwise the error is handled as usual.
+ *
+ * @param[in] id: the error code
+ * @param[in] msg: the error message
+ */
+
+void mcx_serve_trap(const int id, const char* msg) {
+    if (servetrap) {
+        jmp_buf* trap = servetrap;
+
+        servetrap = NULL;
+        servecode = id;
+
+        if (msg != servemsg) {
+            snprintf(servemsg, MCX_SERVE_MAXMSG, "%s", msg);
+        }
+        longjmp(*trap, 1);
+    }
+}
+
+/**
+ * @brief Arm the error trap of the calling thread
+ *
+ * @param[in] trap: the jump buffer set by setjmp, or NULL to disarm the trap
+ * @return the previously armed trap, to be restored by the caller
+ */
+
+jmp_buf* mcx_serve_settrap(jmp_buf* trap) {
+    jmp_buf* oldtrap = servetrap;
+
+    servetrap = trap;
+    return oldtrap;
+}
+
+/**
+ * @brief Return the error code of the last error caught by the trap of the calling thread
+ */
+
+int mcx_serve_status(void) {
+    return (servecode) ? servecode : -1;
+}
+
+/**
+ * @brief Return the error message of the last error caught by the trap of the calling thread
+ */
+
+const char* mcx_serve_message(void) {
+    return servemsg;
+}
+
+/**
+ * @brief Read the next JSON job from a stream
+ *
+ * Jobs are framed by balanced curly brackets, so that both single-line and
+ * pretty-printed JSON objects can be sent back-to-back; any text between two
+ * jobs (white spaces, new lines) is ignored.
+ *
+ * @param[in] in: the input stream
+ * @param[in,out] buf: the buffer to store the job, grown with realloc if needed
+ * @param[in,out] buflen: the allocated length of buf
+ * @return the length of the job string, or 0 if the stream ends
+ */
+
+int mcx_serve_readjob(FILE* in, char** buf, size_t* buflen) {
+    int c, depth = 0, instr = 0, isescape = 0;
+    size_t len = 0;
+
+    while ((c = fgetc(in)) != EOF) {
+        if (depth == 0 && c != '{') {
+            continue;
+        }
+
+        if (len + 2 > *buflen) {
+            *buflen = (*buflen) ? (*buflen) << 1 : 4096;
+            *buf = (char*)realloc(*buf, *buflen);
+        }
+
+        (*buf)[len++] = (char)c;
+
+        if (instr) {
+            if (isescape) {
+                isescape = 0;
+            } else if (c == '\\') {
+                isescape = 1;
+            } else if (c == '"') {
+                instr = 0;
+            }
+        } else if (c == '"') {
+            instr = 1;
+        } else if (c == '{') {
+            depth++;
+        } else if (c == '}' && --depth == 0) {
+            (*buf)[len] = '\0';
+            return (int)len;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Load a previously decoded volume from the server cache
+ *
+ * @param[in] filename: the full path of the volume file
+ * @param[in,out] cfg: simulation configuration, cfg->vol is replaced on a cache hit
+ * @return 1 if the volume is found in the cache, 0 otherwise
+ */
+
+int mcx_serve_fetchvol(const char* filename, Config* cfg) {
+    struct stat st;
+    int i, hit = 0;
+    uint medianum = MAX(cfg->medianum, cfg->polmedianum + 1);
+
+    if (stat(filename, &st) != 0) {
+        return 0;
+    }
+
+    #pragma omp critical(mcx_serve_volcache)
+    {
+        for (i = 0; i < MCX_SERVE_VOLCACHE; i++) {
+            VolCache* entry = volcache + i;
+
+            if (entry->vol && strcmp(entry->filename, filename) == 0 && entry->filesize == st.st_size
+                    && entry->mtime == st.st_mtime && entry->mediabyte == cfg->mediabyte && entry->unitinmm == cfg->unitinmm
+                    && entry->dim.x == cfg->dim.x && entry->dim.y == cfg->dim.y && entry->dim.z == cfg->dim.z
+                    && ((cfg->mediabyte > 4 && cfg->mediabyte != MEDIA_LABEL8 && cfg->mediabyte != MEDIA_LABEL4) || entry->maxlabel < medianum)) {
+                if (cfg->vol) {
+                    free(cfg->vol);
+                }
+
+                cfg->vol = (uint*)malloc(entry->len * sizeof(uint));
+                memcpy(cfg->vol, entry->vol, entry->len * sizeof(uint));
+                entry->lastuse = ++volcachetick;
+                hit = 1;
+                break;
+            }
+        }
+    }
+
+    return hit;
+}
+
+/**
+ * @brief Store a freshly decoded volume in the server cache, evicting the least-recently used entry
+ *
+ * @param[in] filename: the full path of the volume file
+ * @param[in] cfg: simulation configuration, cfg->vol must be the decoded volume from mcx_loadvolume
+ */
+
+void mcx_serve_storevol(const char* filename, Config* cfg) {
+    struct stat st;
+    int i, slot = 0;
+    size_t j, len = (size_t)cfg->dim.x * cfg->dim.y * cfg->dim.z;
+    uint maxlabel = 0;
+
+    if (cfg->vol == NULL || strlen(filename) >= MAX_PATH_LENGTH || stat(filename, &st) != 0) {
+        return;
+    }
+
+    if (cfg->mediabyte <= 4 || cfg->mediabyte == MEDIA_LABEL8 || cfg->mediabyte == MEDIA_LABEL4) {
+        for (j = 0; j < len; j++) {
+            maxlabel = MAX(maxlabel, cfg->vol[j]);
+        }
+    }
+
+    len *= (1 + (cfg->mediabyte == MEDIA_2LABEL_SPLIT || cfg->mediabyte == MEDIA_ASGN_F2H));
+
+    #pragma omp critical(mcx_serve_volcache)
+    {
+        for (i = 0; i < MCX_SERVE_VOLCACHE; i++) {
+            if (volcache[i].vol == NULL || strcmp(volcache[i].filename, filename) == 0) {
+                slot = i;
+                break;
+            }
+
+            if (volcache[i].lastuse < volcache[slot].lastuse) {
+                slot = i;
+            }
+        }
+
+        free(volcache[slot].vol);
+        strncpy(volcache[slot].filename, filename, MAX_PATH_LENGTH - 1);
+        volcache[slot].filesize = st.st_size;
+        volcache[slot].mtime = st.st_mtime;
+        volcache[slot].dim = cfg->dim;
+        volcache[slot].mediabyte = cfg->mediabyte;
+        volcache[slot].unitinmm = cfg->unitinmm;
+        volcache[slot].maxlabel = maxlabel;
+        volcache[slot].len = len;
+        volcache[slot].vol = (uint*)malloc(len * sizeof(uint));
+        memcpy(volcache[slot].vol, cfg->vol, len * sizeof(uint));
+        volcache[slot].lastuse = ++volcachetick;
+    }
+}
+
+/**
+ * @brief Release all cached volumes
+ */
+
+void mcx_serve_clearcache(void) {
+    int i;
+
+    for (i = 0; i < MCX_SERVE_VOLCACHE; i++) {
+        free(volcache[i].vol);
+        memset(volcache + i, 0, sizeof(VolCache));
+    }
+
+    volcachetick = 0;
+}
+
+/**
+ * Suffixes of the output files a job may write next to <rootpath>/<session>
+ */
+
+static const char* servesuffix[] = {".jnii", ".bnii", ".nii", ".hdr", ".img", ".mc2", ".ubj", ".tx3",
+                                    ".mch", ".mct", "_detp.jdat", "_traj.jdat", "_g1.json", NULL
+                                   };
+
+/**
+ * @brief List the output files written by a job
+ *
+ * The files named after the session of the job that were modified since the job
+ * started are returned, so that the client can fetch the outputs.
+ *
+ * @param[in] cfg: simulation configuration of the job
+ * @param[in] start: the time the job started
+ * @return a JSON array of the full paths of the output files
+ */
+
+static cJSON* mcx_serve_outputs(Config* cfg, time_t start) {
+    cJSON* files = cJSON_CreateArray();
+    char fname[MAX_FULL_PATH];
+    struct stat st;
+    int i;
+
+    for (i = 0; servesuffix[i]; i++) {
+        if (cfg->rootpath[0]) {
+            snprintf(fname, MAX_FULL_PATH, "%s%c%s%s", cfg->rootpath, pathsep, cfg->session, servesuffix[i]);
+        } else {
+            snprintf(fname, MAX_FULL_PATH, "%s%s", cfg->session, servesuffix[i]);
+        }
+
+        if (stat(fname, &st) == 0 && st.st_mtime >= start) {
+            cJSON_AddItemToArray(files, cJSON_CreateString(fname));
+        }
+    }
+
+    return files;
+}
+
+/**
+ * @brief Send the status of a completed (or failed) job back to the client as a single-line JSON
+ *
+ * @param[in] out: the output stream
+ * @param[in] jobid: the sequential index of the job, starting from 1
+ * @param[in] status: 0 if the job is successful, otherwise the error code
+ * @param[in] cfg: simulation configuration of the job
+ * @param[in] devid: the device (starting from 1) that ran the job
+ * @param[in] elapsed: total wall-clock time of the job in ms, including parsing and saving
+ * @param[in] start: the time the job started, to find the output files it wrote
+ */
+
+static void mcx_serve_reply(FILE* out, int jobid, int status, Config* cfg, int devid, unsigned int elapsed, time_t start) {
+    cJSON* root = cJSON_CreateObject();
+    char* str;
+
+    cJSON_AddNumberToObject(root, "JobID", jobid);
+    cJSON_AddNumberToObject(root, "Status", status);
+
+    if (status == 0) {
+        cJSON_AddStringToObject(root, "Session", cfg->session);
+        cJSON_AddStringToObject(root, "RootPath", cfg->rootpath);
+        cJSON_AddNumberToObject(root, "Device", devid);
+        cJSON_AddNumberToObject(root, "Photons", (double)cfg->nphoton);
+        cJSON_AddNumberToObject(root, "Detected", (double)cfg->detectedcount);
+        cJSON_AddNumberToObject(root, "EnergyTotal", cfg->energytot);
+        cJSON_AddNumberToObject(root, "EnergyAbsorbed", cfg->energyabs);
+        cJSON_AddNumberToObject(root, "Normalizer", cfg->normalizer);
+        cJSON_AddNumberToObject(root, "KernelTime", cfg->runtime);
+        cJSON_AddBoolToObject(root, "Cached", cfg->iscachehit);
+        cJSON_AddItemToObject(root, "Outputs", mcx_serve_outputs(cfg, start));
+    } else {
+        cJSON_AddNumberToObject(root, "Device", devid);
+        cJSON_AddStringToObject(root, "Message", servemsg);
+    }
+
+    cJSON_AddNumberToObject(root, "Elapsed", elapsed);
+
+    str = cJSON_PrintUnformatted(root);
+    fprintf(out, "%s\n", str);
+    fflush(out);
+
+    free(str);
+    cJSON_Delete(root);
+}
+
+/**
+ * @brief Run all jobs from an input stream, one worker thread per active device
+ *
+ * Each worker pulls the next job from the shared stream, parses it with the
+ * same command line options as the server, and runs it on its own device, so
+ * that jobs run concurrently when multiple devices are active. An error raised
+ * by any stage of a job fails only that job: the device is reset and the error
+ * is returned in the reply, while the jobs on the other devices continue.
+ *
+ * @param[in] in: stream to read JSON jobs from
+ * @param[in] out: stream to write job status to
+ * @param[in] argc: the number of command line parameters of the server
+ * @param[in] argv: the command line parameters of the server, applied to every job
+ * @param[in] cfg: the server configuration, cfg->deviceid lists the active devices
+ * @param[in] gpuinfo: the GPU information queried once when the server starts
+ * @param[in] activedev: the number of active devices
+ * @param[in,out] jobcount: the counter used to assign job IDs
+ * @return the number of failed jobs
+ */
+
+static int mcx_serve_stream(FILE* in, FILE* out, int argc, char* argv[], Config* cfg, GPUInfo* gpuinfo, int activedev, int* jobcount) {
+    int failed = 0, devcount = gpuinfo[0].devcount;
+
+#ifdef _OPENMP
+    #pragma omp parallel num_threads(activedev) reduction(+:failed)
+#endif
+    {
+        int threadid = 0, len, jobid, status, devid, isnamed;
+        unsigned int tic;
+        time_t start;
+        size_t buflen = 0;
+        char* job = NULL;
+        GPUInfo* jobgpu = (GPUInfo*)malloc(devcount * sizeof(GPUInfo));
+        Config jobcfg;
+        jmp_buf trap;
+
+#ifdef _OPENMP
+        threadid = omp_get_thread_num();
+#endif
+        devid = (unsigned char)cfg->deviceid[threadid];
+
+        while (1) {
+            #pragma omp critical(mcx_serve_input)
+            {
+                len = mcx_serve_readjob(in, &job, &buflen);
+                jobid = (len > 0) ? ++(*jobcount) : 0;
+            }
+
+            if (len <= 0) {
+                break;
+            }
+
+            tic = GetTimeMillis();
+            start = time(NULL);
+            status = 0;
+            mcx_initcfg(&jobcfg);
+
+            /** parsing is serialized because the command line flags are shared between jobs */
+            #pragma omp critical(mcx_serve_parse)
+            {
+                if (setjmp(trap) == 0) {
+                    servetrap = &trap;
+                    memset(flagset, 0, sizeof(flagset));
+                    mcx_parsecmd(argc, argv, &jobcfg);
+
+                    if (out == stdout && jobcfg.flog == stdout) {
+                        jobcfg.flog = stderr;
+                    }
+
+                    isnamed = (jobcfg.session[0] != '\0');
+                    mcx_readconfig(job, &jobcfg);
+
+                    /** a job without a Session.ID, which mcx_readconfig names "default", is named after its job ID */
+                    if (!isnamed && strcmp(jobcfg.session, "default") == 0) {
+                        snprintf(jobcfg.session, MAX_SESSION_LENGTH, "mcxjob_%d", jobid);
+                    }
+
+                    if (jobcfg.extrajson) {
+                        cJSON* jroot = cJSON_Parse(jobcfg.extrajson);
+
+                        if (jroot == NULL) {
+                            MCX_ERROR(-1, "invalid json fragment following --json");
+                        }
+
+                        jobcfg.extrajson[0] = '_';
+                        mcx_loadjson(jroot, &jobcfg);
+                        cJSON_Delete(jroot);
+                    }
+                } else {
+                    status = mcx_serve_status();
+                }
+
+                servetrap = NULL;
+            }
+
+            if (status == 0) {
+                memset(jobcfg.deviceid, 0, MAX_DEVICE);
+                memset(jobcfg.workload, 0, MAX_DEVICE * sizeof(float));
+                jobcfg.deviceid[0] = (char)devid;
+                jobcfg.workload[0] = 1.f;
+
+                /** start from the pristine device info as mcx_run_simulation adjusts the launch settings per job */
+                memcpy(jobgpu, gpuinfo, devcount * sizeof(GPUInfo));
+                jobgpu[devid - 1].maxgate = jobcfg.maxgate;
+
+                /** an error raised by the run is caught by mcx_run_simulation, which frees its buffers and returns the error code */
+#ifdef _OPENMP
+                #pragma omp parallel num_threads(1)
+#endif
+                {
+                    status = mcx_run_simulation(&jobcfg, jobgpu);
+                }
+
+                if (status) {
+                    mcx_reset_device(devid - 1);
+                }
+            }
+
+            if (status) {
+                failed++;
+            }
+
+            #pragma omp critical(mcx_serve_output)
+            {
+                mcx_serve_reply(out, jobid, status, &jobcfg, devid, GetTimeMillis() - tic, start);
+            }
+
+            if (jobcfg.flog != stdout && jobcfg.flog != stderr) {
+                fclose(jobcfg.flog);
+            }
+
+            mcx_clearcfg(&jobcfg);
+        }
+
+        free(job);
+        free(jobgpu);
+    }
+
+    return failed;
+}
+
+#ifndef _WIN32
+
+/**
+ * @brief Listen on a Unix domain socket and serve jobs from each connection in turn
+ *
+ * @param[in] addr: the path of the socket file
+ * @return the number of failed jobs
+ */
+
+static int mcx_serve_socket(const char* addr, int argc, char* argv[], Config* cfg, GPUInfo* gpuinfo, int activedev, int* jobcount) {
+    struct sockaddr_un sa;
+    int fd, conn, failed = 0;
+
+    if (strlen(addr) >= sizeof(sa.sun_path)) {
+        MCX_ERROR(-1, "the socket path for --serve is too long");
+    }
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        MCX_ERROR(-1, "can not create the server socket");
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    memcpy(sa.sun_path, addr, strlen(addr) + 1);
+    unlink(addr);
+
+    if (bind(fd, (struct sockaddr*)&sa, sizeof(sa)) || listen(fd, 8)) {
+        close(fd);
+        MCX_ERROR(-1, "can not listen on the specified socket");
+    }
+
+    signal(SIGPIPE, SIG_IGN); /** a client leaving early must not terminate the server */
+    MCX_FPRINTF(stderr, "MCX server is listening on %s with %d device(s)\n", addr, activedev);
+
+    while ((conn = accept(fd, NULL, NULL)) >= 0) {
+        FILE* in = fdopen(conn, "r");
+        FILE* out = fdopen(dup(conn), "w");
+
+        if (in && out) {
+            failed += mcx_serve_stream(in, out, argc, argv, cfg, gpuinfo, activedev, jobcount);
+        }
+
+        if (in) {
+            fclose(in);
+        } else {
+            close(conn);
+        }
+
+        if (out) {
+            fclose(out);
+        }
+    }
+
+    close(fd);
+    unlink(addr);
+    return failed;
+}
+
+#endif
+
+/**
+ * @brief Run MCX as a persistent server (--serve)
+ *
+ * The server queries the devices once and keeps their contexts alive between jobs
+ * (no cudaDeviceReset), caches decoded volumes, and runs jobs concurrently on all
+ * active devices. Each job is a JSON input object, the same as those accepted by
+ * -f; the command line options of the server apply to every job. The status of
+ * each job is returned as one line of JSON, listing the output files saved by the
+ * job, or the error message if the job failed.
+ *
+ * @param[in] argc: the number of command line parameters
+ * @param[in] argv: the command line parameters
+ * @param[in] cfg: the server configuration parsed by mcx_parsecmd
+ * @param[in] gpuinfo: the GPU information returned by mcx_list_gpu
+ * @param[in] activedev: the number of active devices
+ * @return the number of failed jobs
+ */
+
+int mcx_serve(int argc, char* argv[], Config* cfg, GPUInfo* gpuinfo, int activedev) {
+    int jobcount = 0, failed = 0;
+
+    if (cfg->serveaddr[0] == '\0' || strcmp(cfg->serveaddr, "-") == 0) {
+        MCX_FPRINTF(stderr, "MCX server is reading jobs from stdin with %d device(s)\n", activedev);
+        failed = mcx_serve_stream(stdin, stdout, argc, argv, cfg, gpuinfo, activedev, &jobcount);
+    } else {
+#ifdef _WIN32
+        MCX_ERROR(-1, "Unix socket server is not supported on this platform, please use --serve - instead");
+#else
+        failed = mcx_serve_socket(cfg->serveaddr, argc, argv, cfg, gpuinfo, activedev, &jobcount);
+#endif
+    }
+
+    mcx_serve_clearcache();
+    MCX_FPRINTF(stderr, "MCX server completed %d job(s), %d failed\n", jobcount, failed);
+    return failed;
+}
@@ -0,0 +1,63 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    mcx_serve.h
+
+@brief   MCX persistent server mode header
+*******************************************************************************/
+
+#ifndef _MCEXTREME_SERVE_H
+#define _MCEXTREME_SERVE_H
+
+#include <setjmp.h>
+
+#include "mcx_utils.h"
+
+#define MCX_SERVE_VOLCACHE   4                     /**< max number of raw volumes cached between jobs */
+#define MCX_SERVE_MAXMSG     1024                  /**< max length of the error message returned to the client */
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+int  mcx_serve(int argc, char* argv[], Config* cfg, GPUInfo* gpuinfo, int activedev);
+int  mcx_serve_readjob(FILE* in, char** buf, size_t* buflen);
+void mcx_serve_trap(const int id, const char* msg);
+jmp_buf* mcx_serve_settrap(jmp_buf* trap);
+int  mcx_serve_status(void);
+const char* mcx_serve_message(void);
+int  mcx_serve_fetchvol(const char* filename, Config* cfg);
+void mcx_serve_storevol(const char* filename, Config* cfg);
+void mcx_serve_clearcache(void);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,392 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    mcx_snapshot.c
+
+@brief   Binary snapshot of a preprocessed simulation configuration
+
+A snapshot stores the Config structure after all preprocessing steps - volume
+loading, shape rasterization, detector masking, unit conversion, polarization
+and replay preparation - together with every array it points to. Loading a
+snapshot restores the simulation settings with a handful of block reads and
+skips the preprocessing entirely, so repeated runs of a large domain start
+simulating immediately.
+
+The file starts with a 64-byte SnapshotHeader, followed by the Config structure
+with all pointers cleared, a table of SnapshotRecord entries and the array
+data; every section is aligned to MCX_SNAPSHOT_ALIGN bytes. A snapshot is only
+valid for binaries sharing the same Config layout and byte order.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mcx_snapshot.h"
+#include "mcx_const.h"
+
+#define MCX_SNAPSHOT_MAXARRAY  32    /**< maximum number of arrays stored in a snapshot */
+
+/**
+ * Macro to round up a byte offset to the snapshot alignment
+ */
+#define SNAPSHOT_ALIGN(x)   ((((unsigned long long)(x)) + MCX_SNAPSHOT_ALIGN - 1) / MCX_SNAPSHOT_ALIGN * MCX_SNAPSHOT_ALIGN)
+
+/**
+ * Macro to append an array member of cfg and its length in bytes to the array list
+ */
+#define SNAPSHOT_ARRAY(nm,x,len)  {list[n].name = (nm); list[n].ptr = (void**)&(x); list[n].bytes = (len); n++;}
+
+/**
+ * An array member of the Config structure and its expected length
+ */
+
+typedef struct MCXSnapshotArray {
+    const char* name;              /**< name of the array in the record table */
+    void** ptr;                    /**< address of the pointer member in Config */
+    size_t bytes;                  /**< length of the array in bytes, derived from the scalar settings */
+} SnapshotArray;
+
+/**
+ * @brief List all array members of a preprocessed configuration
+ *
+ * The lengths are derived from the scalar members only, so that the same list
+ * computed from a restored Config validates the records of a snapshot.
+ *
+ * @param[in] cfg: simulation configuration
+ * @param[out] list: the array members, their names and lengths in bytes
+ * @return the number of entries in list
+ */
+
+static int mcx_snapshot_arrays(Config* cfg, SnapshotArray list[MCX_SNAPSHOT_MAXARRAY]) {
+    size_t dimxyz = (size_t)cfg->dim.x * cfg->dim.y * cfg->dim.z;
+    size_t patlen = 0;
+    size_t nreplay = (cfg->seed == SEED_FROM_FILE) ? cfg->nphoton : 0;
+    int n = 0;
+
+    if (cfg->srctype == MCX_SRC_PATTERN) {
+        patlen = (size_t)(cfg->srcparam1.w * cfg->srcparam2.w * cfg->srcnum);
+    } else if (cfg->srctype == MCX_SRC_PATTERN3D) {
+        patlen = (size_t)(cfg->srcparam1.x * cfg->srcparam1.y * cfg->srcparam1.z * cfg->srcnum);
+    }
+
+    SNAPSHOT_ARRAY("vol", cfg->vol, dimxyz * sizeof(unsigned int) * (1 + (cfg->mediabyte == MEDIA_2LABEL_SPLIT || cfg->mediabyte == MEDIA_ASGN_F2H)));
+    SNAPSHOT_ARRAY("prop", cfg->prop, cfg->medianum * sizeof(Medium));
+    SNAPSHOT_ARRAY("polprop", cfg->polprop, cfg->polmedianum * sizeof(POLMedium));
+    SNAPSHOT_ARRAY("smatrix", cfg->smatrix, (size_t)cfg->polmedianum * NANGLES * sizeof(float4));
+    SNAPSHOT_ARRAY("detpos", cfg->detpos, cfg->detnum * sizeof(float4));
+    SNAPSHOT_ARRAY("srcpattern", cfg->srcpattern, patlen * sizeof(float));
+    SNAPSHOT_ARRAY("invcdf", cfg->invcdf, cfg->nphase * sizeof(float));
+    SNAPSHOT_ARRAY("angleinvcdf", cfg->angleinvcdf, cfg->nangle * sizeof(float));
+    SNAPSHOT_ARRAY("srcdata", cfg->srcdata, cfg->extrasrclen * sizeof(ExtraSrc));
+    SNAPSHOT_ARRAY("dx", cfg->dx, ((cfg->steps.x == -2.f) ? cfg->dim.x : 1) * sizeof(float));
+    SNAPSHOT_ARRAY("dy", cfg->dy, ((cfg->steps.y == -2.f) ? cfg->dim.y : 1) * sizeof(float));
+    SNAPSHOT_ARRAY("dz", cfg->dz, ((cfg->steps.z == -2.f) ? cfg->dim.z : 1) * sizeof(float));
+    SNAPSHOT_ARRAY("replay.seed", cfg->replay.seed, nreplay * cfg->replay.seedbyte);
+    SNAPSHOT_ARRAY("replay.weight", cfg->replay.weight, nreplay * sizeof(float));
+    SNAPSHOT_ARRAY("replay.tof", cfg->replay.tof, nreplay * sizeof(float));
+    SNAPSHOT_ARRAY("replay.detid", cfg->replay.detid, nreplay * sizeof(int));
+    SNAPSHOT_ARRAY("brickvol", cfg->brickvol, cfg->bricklen * sizeof(unsigned int));
+    SNAPSHOT_ARRAY("patternbasis", cfg->patternbasis, (cfg->patternrank ? patlen / cfg->srcnum * cfg->patternrank : 0) * sizeof(float));
+    SNAPSHOT_ARRAY("patterncoef", cfg->patterncoef, (size_t)cfg->srcnum * cfg->patternrank * sizeof(float));
+    SNAPSHOT_ARRAY("pyramidvol", cfg->pyramidvol, (size_t)cfg->pyramiddim.x * cfg->pyramiddim.y * cfg->pyramiddim.z * sizeof(unsigned int));
+    SNAPSHOT_ARRAY("dcstau", cfg->dcstau, cfg->dcsntau * sizeof(float));
+    SNAPSHOT_ARRAY("rffreq", cfg->rffreq, cfg->rffreqnum * sizeof(float));
+    SNAPSHOT_ARRAY("biasdet", cfg->biasdet, cfg->biasdetnum * sizeof(unsigned int));
+
+    return n;
+}
+
+/**
+ * @brief Write zeros to pad a file to the snapshot alignment
+ *
+ * @param[in] fp: the file handle
+ * @param[in] pos: the current write position
+ * @return the aligned write position
+ */
+
+static unsigned long long mcx_snapshot_pad(FILE* fp, unsigned long long pos) {
+    static const char zeros[MCX_SNAPSHOT_ALIGN] = {0};
+    size_t len = (size_t)(SNAPSHOT_ALIGN(pos) - pos);
+
+    if (len && fwrite(zeros, 1, len, fp) != len) {
+        MCX_ERROR(-2, "fail to write the snapshot file");
+    }
+
+    return pos + len;
+}
+
+/**
+ * @brief Save a preprocessed simulation configuration to a binary snapshot
+ *
+ * The snapshot must be written after the preprocessing (mcx_prepdomain or
+ * mcx_validatecfg) so that loading it can skip all these steps.
+ *
+ * @param[in] fname: the output file name, usually with a .mcxs suffix
+ * @param[in] cfg: the preprocessed simulation configuration
+ */
+
+void mcx_snapshot_save(const char* fname, Config* cfg) {
+    SnapshotHeader header;
+    SnapshotRecord rec[MCX_SNAPSHOT_MAXARRAY];
+    SnapshotArray list[MCX_SNAPSHOT_MAXARRAY];
+    Config snap = *cfg;
+    unsigned long long pos;
+    int i, n, recnum = 0;
+    FILE* fp;
+
+    n = mcx_snapshot_arrays(cfg, list);
+
+    memset(rec, 0, sizeof(rec));
+
+    for (i = 0; i < n; i++) {
+        if (*(list[i].ptr) && list[i].bytes) {
+            strncpy(rec[recnum].name, list[i].name, MCX_SNAPSHOT_NAMELEN - 1);
+            rec[recnum].bytes = list[i].bytes;
+            recnum++;
+        }
+    }
+
+    /** pointers are meaningless in another process, the loader re-attaches the arrays by name */
+    snap.prop = NULL;
+    snap.polprop = NULL;
+    snap.detpos = NULL;
+    snap.smatrix = NULL;
+    snap.vol = NULL;
+    snap.flog = NULL;
+    snap.exportfield = NULL;
+    snap.exportdetected = NULL;
+    snap.shapedata = NULL;
+    snap.extrajson = NULL;
+    snap.srcpattern = NULL;
+    snap.replay.detid = NULL;
+    snap.replay.seed = NULL;
+    snap.replay.weight = NULL;
+    snap.replay.tof = NULL;
+    snap.seeddata = NULL;
+    snap.exportdebugdata = NULL;
+    snap.dx = snap.dy = snap.dz = NULL;
+    snap.invcdf = NULL;
+    snap.angleinvcdf = NULL;
+    snap.srcdata = NULL;
+    snap.brickvol = NULL;
+    snap.patternbasis = NULL;
+    snap.patterncoef = NULL;
+    snap.muavol = NULL;
+    snap.pyramidvol = NULL;
+    snap.dcstau = NULL;
+    snap.rffreq = NULL;
+    snap.biasdet = NULL;
+    snap.exportg1 = NULL;
+    snap.issnapshot = 0;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "MCXS", 4);
+    header.version = MCX_SNAPSHOT_VERSION;
+    header.headerbytes = sizeof(SnapshotHeader);
+    header.configbytes = sizeof(Config);
+    header.recordnum = recnum;
+    header.alignment = MCX_SNAPSHOT_ALIGN;
+    header.endian = MCX_SNAPSHOT_ENDIAN;
+
+    pos = SNAPSHOT_ALIGN(SNAPSHOT_ALIGN(sizeof(SnapshotHeader)) + sizeof(Config)) + SNAPSHOT_ALIGN(recnum * sizeof(SnapshotRecord));
+
+    for (i = 0; i < recnum; i++) {
+        rec[i].offset = pos;
+        pos = SNAPSHOT_ALIGN(pos + rec[i].bytes);
+    }
+
+    if ((fp = fopen(fname, "wb")) == NULL) {
+        MCX_ERROR(-2, "can not write to the specified snapshot file");
+    }
+
+    if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+        MCX_ERROR(-2, "fail to write the snapshot file");
+    }
+
+    pos = mcx_snapshot_pad(fp, sizeof(header));
+
+    if (fwrite(&snap, sizeof(Config), 1, fp) != 1) {
+        MCX_ERROR(-2, "fail to write the snapshot file");
+    }
+
+    pos = mcx_snapshot_pad(fp, pos + sizeof(Config));
+
+    if (recnum && fwrite(rec, sizeof(SnapshotRecord), recnum, fp) != recnum) {
+        MCX_ERROR(-2, "fail to write the snapshot file");
+    }
+
+    pos = mcx_snapshot_pad(fp, pos + recnum * sizeof(SnapshotRecord));
+
+    for (i = 0, recnum = 0; i < n; i++) {
+        if (*(list[i].ptr) && list[i].bytes) {
+            if (fwrite(*(list[i].ptr), 1, list[i].bytes, fp) != list[i].bytes) {
+                MCX_ERROR(-2, "fail to write the snapshot file");
+            }
+
+            pos = mcx_snapshot_pad(fp, pos + list[i].bytes);
+            recnum++;
+        }
+    }
+
+    fclose(fp);
+
+    MCX_FPRINTF(cfg->flog, "saved preprocessed settings with %d arrays to snapshot %s (%llu bytes)\n", recnum, fname, pos);
+}
+
+/**
+ * @brief Restore a preprocessed simulation configuration from a binary snapshot
+ *
+ * All simulation settings and arrays are replaced by those stored in the snapshot;
+ * the runtime settings that do not alter the simulation - the log handle, device
+ * selection, thread/block sizes, output folder, session name (if set), cache and
+ * dump settings and the output buffers - are kept from cfg. The restored
+ * configuration is flagged by cfg->issnapshot so that mcx_validatecfg skips the
+ * preprocessing.
+ *
+ * @param[in] fname: the snapshot file name
+ * @param[in,out] cfg: simulation configuration, the snapshot overwrites the simulation settings
+ */
+
+void mcx_snapshot_load(const char* fname, Config* cfg) {
+    SnapshotHeader header;
+    SnapshotRecord rec[MCX_SNAPSHOT_MAXARRAY];
+    SnapshotArray list[MCX_SNAPSHOT_MAXARRAY];
+    Config old = *cfg;
+    int i, j, n;
+    FILE* fp;
+
+    if ((fp = fopen(fname, "rb")) == NULL) {
+        MCX_ERROR(-2, "can not open the specified snapshot file");
+    }
+
+    if (fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, "MCXS", 4)) {
+        MCX_ERROR(-2, "the specified file is not an mcx snapshot");
+    }
+
+    if (header.version != MCX_SNAPSHOT_VERSION || header.endian != MCX_SNAPSHOT_ENDIAN) {
+        MCX_ERROR(-2, "the snapshot was created by an incompatible mcx version or on a host of a different byte order");
+    }
+
+    if (header.configbytes != sizeof(Config) || header.headerbytes != sizeof(SnapshotHeader) || header.alignment != MCX_SNAPSHOT_ALIGN) {
+        MCX_ERROR(-2, "the snapshot was created by an mcx binary of a different build, please regenerate it");
+    }
+
+    if (header.recordnum > MCX_SNAPSHOT_MAXARRAY) {
+        MCX_ERROR(-2, "the snapshot contains too many arrays");
+    }
+
+    if (fseek(fp, (long)SNAPSHOT_ALIGN(sizeof(SnapshotHeader)), SEEK_SET) || fread(cfg, sizeof(Config), 1, fp) != 1) {
+        MCX_ERROR(-2, "fail to read the settings from the snapshot");
+    }
+
+    if (fseek(fp, (long)SNAPSHOT_ALIGN(SNAPSHOT_ALIGN(sizeof(SnapshotHeader)) + sizeof(Config)), SEEK_SET)
+            || (header.recordnum && fread(rec, sizeof(SnapshotRecord), header.recordnum, fp) != header.recordnum)) {
+        MCX_ERROR(-2, "fail to read the record table from the snapshot");
+    }
+
+    /** release the arrays of the settings being replaced */
+    n = mcx_snapshot_arrays(&old, list);
+    free(old.muavol);
+
+    for (i = 0; i < n; i++) {
+        if (*(list[i].ptr)) {
+            free(*(list[i].ptr));
+        }
+    }
+
+    /** keep the runtime settings and buffers of the caller */
+    cfg->flog = old.flog;
+    cfg->parentid = old.parentid;
+    cfg->gpuid = old.gpuid;
+    cfg->nthread = old.nthread;
+    cfg->nblocksize = old.nblocksize;
+    cfg->autopilot = old.autopilot;
+    cfg->isgpuinfo = old.isgpuinfo;
+    cfg->isserve = old.isserve;
+    cfg->isnested = old.isnested;
+    cfg->isdumpjson = old.isdumpjson;
+    cfg->cachesize = old.cachesize;
+    cfg->exportfield = old.exportfield;
+    cfg->exportdetected = old.exportdetected;
+    cfg->exportg1 = old.exportg1;
+    cfg->exportdebugdata = old.exportdebugdata;
+    cfg->seeddata = old.seeddata;
+    cfg->shapedata = old.shapedata;
+    cfg->extrajson = old.extrajson;
+    memcpy(cfg->deviceid, old.deviceid, MAX_DEVICE);
+    memcpy(cfg->workload, old.workload, MAX_DEVICE * sizeof(float));
+    memcpy(cfg->rootpath, old.rootpath, MAX_PATH_LENGTH);
+    memcpy(cfg->jsonfile, old.jsonfile, MAX_PATH_LENGTH);
+    memcpy(cfg->serveaddr, old.serveaddr, MAX_PATH_LENGTH);
+    memcpy(cfg->cachedir, old.cachedir, MAX_PATH_LENGTH);
+
+    if (old.session[0]) {
+        memcpy(cfg->session, old.session, MAX_SESSION_LENGTH);
+    }
+
+    /** attach the stored arrays, the lengths must agree with the restored settings */
+    n = mcx_snapshot_arrays(cfg, list);
+
+    for (i = 0; i < n; i++) {
+        *(list[i].ptr) = NULL;
+
+        for (j = 0; j < (int)header.recordnum; j++) {
+            if (strncmp(rec[j].name, list[i].name, MCX_SNAPSHOT_NAMELEN) == 0) {
+                break;
+            }
+        }
+
+        if (j == (int)header.recordnum) {
+            continue;
+        }
+
+        if (rec[j].bytes != list[i].bytes) {
+            MCX_ERROR(-2, "the array length in the snapshot does not match its settings, the file is corrupted");
+        }
+
+        *(list[i].ptr) = malloc(list[i].bytes);
+
+        if (*(list[i].ptr) == NULL) {
+            MCX_ERROR(-2, "can not allocate memory");
+        }
+
+        if (fseek(fp, (long)rec[j].offset, SEEK_SET) || fread(*(list[i].ptr), 1, list[i].bytes, fp) != list[i].bytes) {
+            MCX_ERROR(-2, "fail to read the array data from the snapshot");
+        }
+    }
+
+    fclose(fp);
+
+    if (cfg->vol == NULL || cfg->prop == NULL) {
+        MCX_ERROR(-2, "the snapshot does not contain the domain or the optical properties");
+    }
+
+    cfg->issnapshot = 1;
+}
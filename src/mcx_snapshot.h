@@ -0,0 +1,84 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    mcx_snapshot.h
+
+@brief   Binary snapshot of a preprocessed simulation configuration header
+*******************************************************************************/
+
+#ifndef _MCEXTREME_SNAPSHOT_H
+#define _MCEXTREME_SNAPSHOT_H
+
+#include "mcx_utils.h"
+
+#define MCX_SNAPSHOT_VERSION  1                     /**< version of the .mcxs snapshot format */
+#define MCX_SNAPSHOT_SUFFIX   ".mcxs"               /**< file suffix of the snapshots */
+#define MCX_SNAPSHOT_ALIGN    64                    /**< byte alignment of every data block in a snapshot */
+#define MCX_SNAPSHOT_ENDIAN   0x01020304            /**< marker to detect snapshots written on a host of a different byte order */
+#define MCX_SNAPSHOT_NAMELEN  16                    /**< length of the array names in the record table */
+
+/**
+ * Header of a .mcxs snapshot, followed by the Config structure, the record
+ * table and the array data blocks; each section starts at a multiple of
+ * MCX_SNAPSHOT_ALIGN bytes so that the file can be memory-mapped
+ */
+
+typedef struct MCXSnapshotHeader {
+    char magic[4];                 /**< magic bits= 'M','C','X','S' */
+    unsigned int version;          /**< version of the snapshot format */
+    unsigned int headerbytes;      /**< size of this header in bytes */
+    unsigned int configbytes;      /**< size of the Config structure of the writing binary */
+    unsigned int recordnum;        /**< number of arrays stored in the snapshot */
+    unsigned int alignment;        /**< byte alignment of the sections */
+    unsigned int endian;           /**< always MCX_SNAPSHOT_ENDIAN */
+    unsigned int reserved[9];      /**< reserved fields for future extension, pads the header to 64 bytes */
+} SnapshotHeader;
+
+/**
+ * An entry of the record table, locating one array of the Config structure
+ */
+
+typedef struct MCXSnapshotRecord {
+    char name[MCX_SNAPSHOT_NAMELEN]; /**< name of the Config member, such as "vol" or "replay.seed" */
+    unsigned long long offset;     /**< offset of the data block from the start of the file */
+    unsigned long long bytes;      /**< length of the data block in bytes */
+} SnapshotRecord;
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+void mcx_snapshot_save(const char* fname, Config* cfg);
+void mcx_snapshot_load(const char* fname, Config* cfg);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,454 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    mcx_svmc.c
+
+@brief   Conversion of label volumes to the split-voxel (SVMC) media format
+
+This is a native implementation of utils/mcxsvmc.m. The binary mask of each
+label is smoothed by a 3x3x3 Gaussian kernel (replicating the edge voxels) and
+its isosurface at level 0.5 is extracted; the samples are placed at the grid
+coordinates used by mcxsvmc.m, i.e. the value of voxel i is located at i+1.
+A mixed voxel keeps the surface of the lowest label crossing it, and stores
+the area-weighted centroid and normal of the surface patches inside the voxel,
+together with the lowest and the highest labels whose surfaces cross it.
+
+Instead of marching cubes, the isosurface is extracted by splitting each cell
+into 6 tetrahedra; the area-weighted centroid and normal of the patches in a
+voxel are nearly identical. A cell is only examined if the labels of the
+4x4x4 voxels used by its smoothed corners are not uniform, and only with the
+labels present among these voxels, so that no per-label volume is needed.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mcx_svmc.h"
+#include "mcx_utils.h"
+#include "mcx_norm.h"
+
+#define SVMC_NEAR    0x1      /**< flag: the labels around the cell starting at this sample are not uniform */
+#define SVMC_SPLIT   0x2      /**< flag: the voxel is crossed by an isosurface */
+#define SVMC_FLAT    0x4      /**< flag: the interface of the voxel is aligned with the grid */
+
+/**
+ * The 6 tetrahedra sharing the main diagonal of a cell, corner c of a cell is located at (c&1, (c>>1)&1, (c>>2)&1)
+ */
+
+static const int svmctet[6][4] = {{0, 1, 3, 7}, {0, 1, 5, 7}, {0, 2, 3, 7}, {0, 2, 6, 7}, {0, 4, 5, 7}, {0, 4, 6, 7}};
+
+/**
+ * Accumulated area, area-weighted centroid and area vector of the surface patches in a voxel
+ */
+
+typedef struct SVMCSurface {
+    double area;             /**< total area of the patches */
+    double centroid[3];      /**< sum of the patch centroids weighted by their areas */
+    double normal[3];        /**< sum of the area vectors of the patches, pointing towards lower mask values */
+} SVMCSurface;
+
+/**
+ * @brief Add a triangle to the surface of a voxel
+ *
+ * @param[in] a,b,c: the vertices of the triangle
+ * @param[in] dir: a vector pointing towards the lower values, used to orient the normal
+ * @param[in,out] surf: the accumulated surface
+ */
+
+static void mcx_svmc_triangle(const double a[3], const double b[3], const double c[3], const double dir[3], SVMCSurface* surf) {
+    double u[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]}, v[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+    double n[3] = {u[1]* v[2] - u[2]* v[1], u[2]* v[0] - u[0]* v[2], u[0]* v[1] - u[1]* v[0]};
+    double sign = (n[0] * dir[0] + n[1] * dir[1] + n[2] * dir[2] < 0.0) ? -0.5 : 0.5, area;
+    int i;
+
+    area = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]) * 0.5;
+    surf->area += area;
+
+    for (i = 0; i < 3; i++) {
+        surf->centroid[i] += area * (a[i] + b[i] + c[i]) * (1.0 / 3.0);
+        surf->normal[i] += n[i] * sign;
+    }
+}
+
+/**
+ * @brief Interpolate the position of the isosurface along an edge
+ *
+ * @param[in] p0,p1: the end points of the edge
+ * @param[in] v0,v1: the values at the end points, on either side of the level
+ * @param[in] level: the isosurface level
+ * @param[out] q: the crossing point
+ */
+
+static void mcx_svmc_edge(const double p0[3], double v0, const double p1[3], double v1, double level, double q[3]) {
+    double t = (level - v0) / (v1 - v0);
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        q[i] = p0[i] + t * (p1[i] - p0[i]);
+    }
+}
+
+/**
+ * @brief Extract the isosurface of a cell using 6 tetrahedra
+ *
+ * @param[in] val: the values at the 8 corners of the cell
+ * @param[in] origin: the coordinates of corner 0
+ * @param[in] level: the isosurface level
+ * @param[in,out] surf: the accumulated surface
+ * @return 1 if the isosurface crosses the cell, 0 otherwise
+ */
+
+static int mcx_svmc_cell(const double val[8], const double origin[3], double level, SVMCSurface* surf) {
+    int t, i, iscrossed = 0;
+
+    for (t = 0; t < 6; t++) {
+        double p[4][3], v[4], dir[3] = {0.0, 0.0, 0.0}, q[4][3];
+        int in[4], count = 0, a, b, c, d;
+
+        for (i = 0; i < 4; i++) {
+            int corner = svmctet[t][i];
+
+            p[i][0] = origin[0] + (corner & 1);
+            p[i][1] = origin[1] + ((corner >> 1) & 1);
+            p[i][2] = origin[2] + ((corner >> 2) & 1);
+            v[i] = val[corner];
+            in[i] = (v[i] > level);
+            count += in[i];
+        }
+
+        if (count == 0 || count == 4) {
+            continue;
+        }
+
+        iscrossed = 1;
+
+        for (i = 0; i < 4; i++) {
+            double sign = in[i] ? -1.0 / count : 1.0 / (4 - count);
+
+            dir[0] += sign * p[i][0];
+            dir[1] += sign * p[i][1];
+            dir[2] += sign * p[i][2];
+        }
+
+        if (count == 1 || count == 3) {
+            /** one vertex is separated from the others: a single triangle */
+            for (a = 0; a < 4; a++) {
+                if (in[a] == (count == 1)) {
+                    break;
+                }
+            }
+
+            for (i = 0, b = 0; i < 4; i++) {
+                if (i != a) {
+                    mcx_svmc_edge(p[a], v[a], p[i], v[i], level, q[b++]);
+                }
+            }
+
+            mcx_svmc_triangle(q[0], q[1], q[2], dir, surf);
+        } else {
+            /** two vertices on each side: a quadrilateral made of two triangles */
+            for (a = 0; !in[a]; a++);
+
+            for (b = a + 1; !in[b]; b++);
+
+            for (c = 0; in[c]; c++);
+
+            for (d = c + 1; in[d]; d++);
+
+            mcx_svmc_edge(p[a], v[a], p[c], v[c], level, q[0]);
+            mcx_svmc_edge(p[a], v[a], p[d], v[d], level, q[1]);
+            mcx_svmc_edge(p[b], v[b], p[d], v[d], level, q[2]);
+            mcx_svmc_edge(p[b], v[b], p[c], v[c], level, q[3]);
+            mcx_svmc_triangle(q[0], q[1], q[2], dir, surf);
+            mcx_svmc_triangle(q[0], q[2], q[3], dir, surf);
+        }
+    }
+
+    return iscrossed;
+}
+
+/**
+ * @brief Grow the SVMC_NEAR flags along an axis, from [i] to [i-1, i+2]
+ *
+ * @param[in,out] flag: the per-voxel flags
+ * @param[in] dim: the dimensions of the volume
+ * @param[in] axis: 0, 1 or 2 for the x, y or z axis
+ */
+
+static void mcx_svmc_grow(unsigned char* flag, const unsigned int dim[3], int axis) {
+    size_t stride = (axis == 0) ? 1 : ((axis == 1) ? dim[0] : (size_t)dim[0] * dim[1]);
+    size_t dimxyz = (size_t)dim[0] * dim[1] * dim[2];
+    unsigned int len = dim[axis];
+    long long line;
+
+    #pragma omp parallel num_threads(mcx_norm_threadnum(dimxyz))
+    {
+        unsigned char* buf = (unsigned char*)malloc(len);
+
+        #pragma omp for schedule(static)
+
+        for (line = 0; line < (long long)(dimxyz / len); line++) {
+            size_t base = (axis == 0) ? line * len : ((axis == 1) ? (line / dim[0]) * dim[0] * len + line % dim[0] : line);
+            unsigned int i;
+
+            for (i = 0; i < len; i++) {
+                buf[i] = flag[base + i * stride] & SVMC_NEAR;
+            }
+
+            for (i = 0; i < len; i++) {
+                unsigned char near = buf[i] | (i > 0 ? buf[i - 1] : 0) | (i + 1 < len ? buf[i + 1] : 0) | (i + 2 < len ? buf[i + 2] : 0);
+
+                flag[base + i * stride] |= near;
+            }
+        }
+
+        free(buf);
+    }
+}
+
+/**
+ * @brief Convert a label volume to the split-voxel (MEDIA_2LABEL_SPLIT) format
+ *
+ * The output is identical in layout to the volume produced by utils/mcxsvmc.m:
+ * 8 bytes per voxel, storing the lower label, the upper label (0 for a voxel
+ * made of a single label), the fractional position of the reference point in
+ * the voxel (scaled by 255), and the normal pointing from the lower to the upper
+ * label (mapped from [-1,1] to [0,254]).
+ *
+ * @param[in] vol: the label volume, labels must not exceed MCX_SVMC_MAXLABEL
+ * @param[in] dim: the dimensions of the volume
+ * @param[in] issmooth: 1 to smooth the mask of each label before extracting the isosurface
+ * @param[in] iscurveonly: 1 to keep the voxels whose interface lies on a grid plane (and their neighbors) unsplit
+ * @return the split-voxel volume of 8*dim[0]*dim[1]*dim[2] bytes, to be freed by the caller, or NULL if out of memory
+ */
+
+unsigned char* mcx_svmc_encode(const unsigned int* vol, const unsigned int dim[3], int issmooth, int iscurveonly) {
+    size_t slicelen = (size_t)dim[0] * dim[1], dimxyz = slicelen * dim[2];
+    unsigned char* newvol = (unsigned char*)malloc(dimxyz << 3);
+    unsigned char* flag = (unsigned char*)calloc(dimxyz, 1);
+    double w[3];
+    long long z;
+
+    if (newvol == NULL || flag == NULL) {
+        free(newvol);
+        free(flag);
+        return NULL;
+    }
+
+    w[0] = w[2] = exp(-0.5 / (MCX_SVMC_KERNELSTD * MCX_SVMC_KERNELSTD));
+    w[1] = 1.0;
+    w[0] /= (w[1] + 2.0 * w[0]);
+    w[2] = w[0];
+    w[1] = 1.0 - 2.0 * w[0];
+
+    /** mark the voxels whose label differs from a +x/+y/+z neighbor, and initialize the unsplit voxels */
+    #pragma omp parallel for schedule(static) num_threads(mcx_norm_threadnum(dimxyz))
+
+    for (z = 0; z < (long long)dim[2]; z++) {
+        unsigned int x, y;
+
+        for (y = 0; y < dim[1]; y++) {
+            for (x = 0; x < dim[0]; x++) {
+                size_t idx = z * slicelen + (size_t)y * dim[0] + x;
+
+                memset(newvol + (idx << 3), 0, 8);
+                newvol[idx << 3] = (unsigned char)vol[idx];
+
+                if ((x + 1 < dim[0] && vol[idx + 1] != vol[idx]) || (y + 1 < dim[1] && vol[idx + dim[0]] != vol[idx])
+                        || (z + 1 < dim[2] && vol[idx + slicelen] != vol[idx])) {
+                    flag[idx] = SVMC_NEAR;
+                }
+            }
+        }
+    }
+
+    /** the cell starting at sample i depends on the voxels i-1 to i+2 along each axis */
+    mcx_svmc_grow(flag, dim, 0);
+    mcx_svmc_grow(flag, dim, 1);
+    mcx_svmc_grow(flag, dim, 2);
+
+    #pragma omp parallel for schedule(dynamic) num_threads(mcx_norm_threadnum(dimxyz))
+
+    for (z = 0; z < (long long)dim[2] - 1; z++) {
+        unsigned int x, y;
+
+        for (y = 0; y + 1 < dim[1]; y++) {
+            for (x = 0; x + 1 < dim[0]; x++) {
+                unsigned int block[4][4][4], label[64], labelnum = 0, low = 0, high = 0, i, j, k, l;
+                double origin[3] = {x + 1.0, y + 1.0, z + 1.0}; /* sample i is located at i+1 as in mcxsvmc.m */
+                SVMCSurface surf;
+                size_t idx;
+                int isfound = 0;
+
+                if (!(flag[z * slicelen + (size_t)y * dim[0] + x] & SVMC_NEAR)) {
+                    continue;
+                }
+
+                /** collect the voxels around the cell, replicating the edges, and their distinct labels in ascending order */
+                for (k = 0; k < 4; k++) {
+                    for (j = 0; j < 4; j++) {
+                        for (i = 0; i < 4; i++) {
+                            long long px = MIN(MAX((long long)x + i - 1, 0), (long long)dim[0] - 1);
+                            long long py = MIN(MAX((long long)y + j - 1, 0), (long long)dim[1] - 1);
+                            long long pz = MIN(MAX(z + k - 1, 0), (long long)dim[2] - 1);
+                            unsigned int val = vol[pz * slicelen + py * dim[0] + px], pos = labelnum;
+
+                            block[k][j][i] = val;
+
+                            for (l = 0; l < labelnum; l++) {
+                                if (label[l] >= val) {
+                                    pos = l;
+                                    break;
+                                }
+                            }
+
+                            if (pos == labelnum || label[pos] != val) {
+                                memmove(label + pos + 1, label + pos, (labelnum - pos) * sizeof(unsigned int));
+                                label[pos] = val;
+                                labelnum++;
+                            }
+                        }
+                    }
+                }
+
+                for (l = 0; l < labelnum; l++) {
+                    SVMCSurface cur;
+                    double val[8];
+                    int c;
+
+                    for (c = 0; c < 8; c++) {
+                        int cx = 1 + (c & 1), cy = 1 + ((c >> 1) & 1), cz = 1 + ((c >> 2) & 1), dx, dy, dz;
+
+                        if (!issmooth) {
+                            val[c] = (block[cz][cy][cx] == label[l]);
+                            continue;
+                        }
+
+                        val[c] = 0.0;
+
+                        for (dz = -1; dz <= 1; dz++) {
+                            for (dy = -1; dy <= 1; dy++) {
+                                for (dx = -1; dx <= 1; dx++) {
+                                    if (block[cz + dz][cy + dy][cx + dx] == label[l]) {
+                                        val[c] += w[dx + 1] * w[dy + 1] * w[dz + 1];
+                                    }
+                                }
+                            }
+                        }
+                    }
+
+                    memset(&cur, 0, sizeof(SVMCSurface));
+
+                    if (mcx_svmc_cell(val, origin, MCX_SVMC_LEVEL, &cur)) {
+                        if (!isfound) {
+                            surf = cur;
+                            low = label[l];
+                            isfound = 1;
+                        }
+
+                        high = label[l];
+                    }
+                }
+
+                if (!isfound) {
+                    continue;
+                }
+
+                /** the cell covers the voxel (x+1,y+1,z+1) */
+                idx = (z + 1) * slicelen + (size_t)(y + 1) * dim[0] + x + 1;
+                flag[idx] |= SVMC_SPLIT;
+
+                {
+                    unsigned char* rec = newvol + (idx << 3);
+                    double len = sqrt(surf.normal[0] * surf.normal[0] + surf.normal[1] * surf.normal[1] + surf.normal[2] * surf.normal[2]);
+                    int isgridplane = 0, isaxis = 0;
+
+                    rec[0] = (unsigned char)low;
+                    rec[1] = (unsigned char)((low == high) ? 0 : high);
+
+                    for (i = 0; i < 3; i++) {
+                        double nc = (surf.area > 0.0) ? surf.centroid[i] / surf.area : 0.0;
+                        double nn = (len > 0.0) ? surf.normal[i] / len : 1.0;
+
+                        nc -= floor(nc);
+                        isgridplane |= (surf.area > 0.0 && nc < 1e-6);
+                        isaxis |= (len > 0.0 && fabs(nn) == 1.0);
+                        rec[2 + i] = (unsigned char)floor(nc * 255.0);
+                        rec[5 + i] = (unsigned char)MIN(floor((nn + 1.0) * 255.0 / 2.0), 254.0);
+                    }
+
+                    if (iscurveonly && isgridplane && isaxis) {
+                        flag[idx] |= SVMC_FLAT;
+                    }
+                }
+            }
+        }
+    }
+
+    /** a voxel whose interface lies on a grid plane, and its neighbors, are not split */
+    if (iscurveonly) {
+        #pragma omp parallel for schedule(static) num_threads(mcx_norm_threadnum(dimxyz))
+
+        for (z = 0; z < (long long)dim[2]; z++) {
+            unsigned int x, y;
+
+            for (y = 0; y < dim[1]; y++) {
+                for (x = 0; x < dim[0]; x++) {
+                    size_t idx = z * slicelen + (size_t)y * dim[0] + x;
+                    long long i, j, k;
+                    int isflat = 0;
+
+                    if (!(flag[idx] & SVMC_SPLIT)) {
+                        continue;
+                    }
+
+                    for (k = MAX(z - 1, 0); k <= MIN(z + 1, (long long)dim[2] - 1) && !isflat; k++) {
+                        for (j = MAX((long long)y - 1, 0); j <= MIN((long long)y + 1, (long long)dim[1] - 1) && !isflat; j++) {
+                            for (i = MAX((long long)x - 1, 0); i <= MIN((long long)x + 1, (long long)dim[0] - 1); i++) {
+                                if (flag[k * slicelen + j * dim[0] + i] & SVMC_FLAT) {
+                                    isflat = 1;
+                                    break;
+                                }
+                            }
+                        }
+                    }
+
+                    if (isflat) {
+                        memset(newvol + (idx << 3), 0, 8);
+                        newvol[idx << 3] = (unsigned char)vol[idx];
+                    }
+                }
+            }
+        }
+    }
+
+    free(flag);
+    return newvol;
+}
@@ -0,0 +1,52 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    mcx_svmc.h
+
+@brief   Conversion of label volumes to the split-voxel (SVMC) media format
+*******************************************************************************/
+
+#ifndef _MCEXTREME_SVMC_H
+#define _MCEXTREME_SVMC_H
+
+#define MCX_SVMC_MAXLABEL    255                    /**< the split-voxel format stores the labels as bytes */
+#define MCX_SVMC_KERNELSTD   1.0                    /**< standard deviation (in voxels) of the 3x3x3 Gaussian smoothing kernel */
+#define MCX_SVMC_LEVEL       0.5                    /**< level of the isosurface of the smoothed binary mask of each label */
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+unsigned char* mcx_svmc_encode(const unsigned int* vol, const unsigned int dim[3], int issmooth, int iscurveonly);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
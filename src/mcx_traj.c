@@ -0,0 +1,307 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+
+/***************************************************************************//**
+\file    mcx_traj.c
+
+@brief   Host-side grouping, sampling and delta quantization of photon trajectories
+
+With -D M, the GPU threads append trajectory records (photon ID, x, y, z, w,
+source ID and optionally the Stokes vector) to a shared buffer through an
+atomic counter, so the positions of different photons are interleaved, while
+the positions of each photon keep their order. mcx_traj_compact sorts the
+records by photon ID with a parallel merge sort of (ID, record index) keys,
+keeps every k-th position of each photon together with its last position, and
+gathers the records into a new buffer with a parallel scatter. The grouped
+positions can then be saved as per-photon deltas of integer coordinates,
+which compress far better than the raw floating-point positions.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+#include "mcx_traj.h"
+
+#define TRAJ_ID(rec)       (((const unsigned int*)(rec))[0])   /**< photon ID stored in the bits of the 1st float of a record */
+#define TRAJ_KEYID(key)    ((unsigned int)((key) >> 32))      /**< photon ID of a sorting key */
+#define TRAJ_KEYREC(key)   ((size_t)((key) & 0xFFFFFFFFu))    /**< record index of a sorting key */
+
+/**
+ * @brief Return the number of host threads used to process the trajectories
+ *
+ * As for the other host post-processing, OMP_NUM_THREADS or omp_set_num_threads applies
+ */
+
+static int mcx_traj_threads(void) {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+/**
+ * @brief Compare two sorting keys for qsort
+ */
+
+static int mcx_traj_cmp(const void* a, const void* b) {
+    unsigned long long x = *(const unsigned long long*)a, y = *(const unsigned long long*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Sort the keys in parallel: each chunk is sorted by qsort, then pairs of runs are merged
+ *
+ * @param[in,out] keys: the keys to be sorted
+ * @param[in] n: number of keys
+ * @param[in] nchunk: number of chunks, usually the thread number
+ */
+
+static void mcx_traj_sort(unsigned long long* keys, size_t n, int nchunk) {
+    unsigned long long* src = keys, *dst, *tmp;
+    int t, width;
+
+    if (nchunk < 2 || n < (size_t)nchunk * 64) {
+        qsort(keys, n, sizeof(unsigned long long), mcx_traj_cmp);
+        return;
+    }
+
+    dst = (unsigned long long*)malloc(n * sizeof(unsigned long long));
+
+    #pragma omp parallel for num_threads(nchunk)
+
+    for (t = 0; t < nchunk; t++) {
+        size_t lo = n * t / nchunk, hi = n * (t + 1) / nchunk;
+        qsort(keys + lo, hi - lo, sizeof(unsigned long long), mcx_traj_cmp);
+    }
+
+    for (width = 1; width < nchunk; width <<= 1) {
+        #pragma omp parallel for num_threads(nchunk)
+
+        for (t = 0; t < nchunk; t += (width << 1)) {
+            size_t lo = n * t / nchunk;
+            size_t mid = n * ((t + width < nchunk) ? t + width : nchunk) / nchunk;
+            size_t hi = n * ((t + (width << 1) < nchunk) ? t + (width << 1) : nchunk) / nchunk;
+            size_t i = lo, j = mid, k = lo;
+
+            while (i < mid && j < hi) {
+                dst[k++] = (src[i] < src[j]) ? src[i++] : src[j++];
+            }
+
+            memcpy(dst + k, src + i, (mid - i) * sizeof(unsigned long long));
+            k += mid - i;
+            memcpy(dst + k, src + j, (hi - j) * sizeof(unsigned long long));
+        }
+
+        tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    if (src != keys) {
+        memcpy(keys, src, n * sizeof(unsigned long long));
+        dst = src;
+    }
+
+    free(dst);
+}
+
+/**
+ * @brief Offset the photon IDs of a batch of trajectory records
+ *
+ * The IDs written by the GPU count the photons of one kernel launch; shifting
+ * each appended batch keeps the IDs unique between respins and devices.
+ *
+ * @param[in,out] rec: the records of the batch
+ * @param[in] count: number of records
+ * @param[in] reclen: number of floats per record
+ * @param[in] base: the offset added to the IDs
+ * @return the offset of the next batch, 1 more than the largest shifted ID
+ */
+
+unsigned int mcx_traj_shiftid(float* rec, size_t count, unsigned int reclen, unsigned int base) {
+    unsigned int next = base;
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        unsigned int* id = (unsigned int*)(rec + i * reclen);
+        *id += base;
+        next = (*id + 1 > next) ? *id + 1 : next;
+    }
+
+    return next;
+}
+
+/**
+ * @brief Group the trajectory records by photon and keep every stepstride-th position
+ *
+ * @param[in] rec: the interleaved records, freed by this function
+ * @param[in,out] count: number of records, updated to the number of kept records
+ * @param[in] reclen: number of floats per record
+ * @param[in] stepstride: keep every stepstride-th position of each photon, plus its last position; 0 or 1 keeps all
+ * @param[out] photonnum: number of photons in the trajectories
+ * @return the grouped records, sorted by photon ID, the positions of a photon are in the order they were visited
+ */
+
+float* mcx_traj_compact(float* rec, unsigned int* count, unsigned int reclen, unsigned int stepstride, size_t* photonnum) {
+    size_t n = *count, photons = 0;
+    unsigned long long* keys;
+    size_t* offset;
+    float* out;
+    int nthread = mcx_traj_threads();
+
+    if (stepstride < 1) {
+        stepstride = 1;
+    }
+
+    keys = (unsigned long long*)malloc(n * sizeof(unsigned long long));
+    offset = (size_t*)calloc(nthread + 1, sizeof(size_t));
+
+    #pragma omp parallel num_threads(nthread)
+    {
+        size_t i, lo, hi;
+#ifdef _OPENMP
+        int t = omp_get_thread_num(), nt = omp_get_num_threads();
+#else
+        int t = 0, nt = 1;
+#endif
+        lo = n * t / nt;
+        hi = n * (t + 1) / nt;
+
+        for (i = lo; i < hi; i++) {
+            keys[i] = ((unsigned long long)TRAJ_ID(rec + i * reclen) << 32) | i;
+        }
+    }
+
+    mcx_traj_sort(keys, n, nthread);
+
+    /** count, then gather the kept records of each chunk of the sorted keys */
+    #pragma omp parallel num_threads(nthread) reduction(+:photons)
+    {
+        size_t i, lo, hi, start, kept = 0;
+        int pass;
+#ifdef _OPENMP
+        int t = omp_get_thread_num(), nt = omp_get_num_threads();
+#else
+        int t = 0, nt = 1;
+#endif
+        lo = n * t / nt;
+        hi = n * (t + 1) / nt;
+
+        for (pass = 0; pass < 2; pass++) {
+            for (start = lo; start > 0 && TRAJ_KEYID(keys[start - 1]) == TRAJ_KEYID(keys[lo]); start--);
+
+            for (i = lo; i < hi; i++) {
+                if (i > lo && TRAJ_KEYID(keys[i]) != TRAJ_KEYID(keys[i - 1])) {
+                    start = i;
+                }
+
+                if (pass == 0 && i == start) {
+                    photons++;
+                }
+
+                if ((i - start) % stepstride == 0 || i + 1 == n || TRAJ_KEYID(keys[i + 1]) != TRAJ_KEYID(keys[i])) {
+                    if (pass == 0) {
+                        kept++;
+                    } else {
+                        memcpy(out + offset[t] * reclen, rec + TRAJ_KEYREC(keys[i]) * reclen, reclen * sizeof(float));
+                        offset[t]++;
+                    }
+                }
+            }
+
+            if (pass == 0) {
+                offset[t + 1] = kept;
+                #pragma omp barrier
+                #pragma omp single
+                {
+                    for (i = 1; i <= (size_t)nt; i++) {
+                        offset[i] += offset[i - 1];
+                    }
+
+                    out = (float*)malloc((offset[nt] ? offset[nt] : 1) * reclen * sizeof(float));
+                    *count = (unsigned int)offset[nt];
+                }
+            }
+        }
+    }
+
+    free(keys);
+    free(offset);
+    free(rec);
+    *photonnum = photons;
+    return out;
+}
+
+/**
+ * @brief Convert the positions of grouped trajectories to per-photon deltas of integer coordinates
+ *
+ * The positions are rounded to multiples of quant; the first position of each photon
+ * is stored as is, the following ones as the difference to the previous position,
+ * so that a position is recovered by the cumulative sum over the photon times quant.
+ *
+ * @param[in] rec: the records grouped by mcx_traj_compact
+ * @param[in] count: number of records
+ * @param[in] reclen: number of floats per record
+ * @param[in] quant: the quantization step, in grid unit
+ * @return the 3 x count quantized deltas, must be freed by the caller
+ */
+
+int* mcx_traj_quantize(const float* rec, size_t count, unsigned int reclen, float quant) {
+    int* dp = (int*)malloc((count ? count : 1) * 3 * sizeof(int));
+
+    #pragma omp parallel num_threads(mcx_traj_threads())
+    {
+        size_t i, lo, hi;
+        int j;
+#ifdef _OPENMP
+        int t = omp_get_thread_num(), nt = omp_get_num_threads();
+#else
+        int t = 0, nt = 1;
+#endif
+        lo = count * t / nt;
+        hi = count * (t + 1) / nt;
+
+        for (i = lo; i < hi; i++) {
+            const float* r = rec + i * reclen;
+            int isfirst = (i == 0 || TRAJ_ID(r) != TRAJ_ID(r - reclen));
+
+            for (j = 1; j <= 3; j++) {
+                dp[i * 3 + j - 1] = (int)floorf(r[j] / quant + 0.5f) - (isfirst ? 0 : (int)floorf(r[j - (int)reclen] / quant + 0.5f));
+            }
+        }
+    }
+
+    return dp;
+}
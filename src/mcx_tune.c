@@ -0,0 +1,292 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+
+/***************************************************************************//**
+\file    mcx_tune.c
+
+@brief   Launch-configuration autotuner and its per-device cache
+
+The default thread and block sizes (see mcx_list_gpu) are derived from the
+compute capability alone, while the fastest launch configuration also depends
+on the register use of the kernel variant and on the media format. The tuner
+times short calibration runs over the block size and the thread multiplier
+(the total thread number is the thread capacity of all SMs times the
+multiplier) with a coordinate search: the block sizes are first compared at
+the default multiplier, then the multipliers at the fastest block size.
+
+The runs are timed by a callback, so that the search can be driven by a mock
+timer without a GPU. The best configurations are stored in a JSON file, one
+object per "<device name>|k<kernel variant>|m<media format>" key.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mcx_tune.h"
+#include "cjson/cJSON.h"
+
+#define TUNE_DEFAULT_MULT   2      /**< thread multiplier used when comparing the block sizes */
+
+static const int tuneblock[] = {64, 128, 256, 512, 1024}; /**< candidate block sizes */
+static const int tunemult[] = {1, 2, 4, 8};               /**< candidate thread multipliers */
+
+extern char pathsep;
+
+/**
+ * @brief Time one candidate launch configuration and keep it if it is the fastest so far
+ *
+ * @param[in] sm: number of SMs of the device
+ * @param[in] maxmpthread: max number of resident threads per SM
+ * @param[in] photons: photon number of each calibration run
+ * @param[in] blocksize: the candidate block size
+ * @param[in] mult: the candidate thread multiplier
+ * @param[in] timer: the callback timing a calibration run
+ * @param[in] ctx: user data passed to the timer
+ * @param[in,out] best: the fastest configuration found so far
+ * @param[in] flog: file handle to print the timing of each candidate, NULL to be silent
+ * @return 1 if the candidate was timed, 0 if it can not be launched
+ */
+
+static int mcx_tune_try(int sm, int maxmpthread, double photons, int blocksize, int mult,
+                        MCXTuneTimer timer, void* ctx, TuneResult* best, FILE* flog) {
+    int threadnum = (maxmpthread / blocksize) * blocksize * sm * mult;
+    double ms;
+
+    if (blocksize > maxmpthread || threadnum <= 0) {
+        return 0;
+    }
+
+    ms = timer(ctx, blocksize, threadnum);
+
+    if (flog) {
+        fprintf(flog, "autotune: block %4d, thread %8d: %.0f ms\n", blocksize, threadnum, ms);
+    }
+
+    if (ms <= 0.0) {
+        return 0;
+    }
+
+    if (photons / ms > best->speed) {
+        best->blocksize = blocksize;
+        best->threadnum = threadnum;
+        best->speed = photons / ms;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Search the fastest block size and thread number of a device
+ *
+ * The first launch pays for the module loading and the context warm-up, so
+ * the first candidate is timed twice and its first timing is discarded.
+ *
+ * @param[in] sm: number of SMs of the device
+ * @param[in] maxmpthread: max number of resident threads per SM
+ * @param[in] photons: photon number of each calibration run
+ * @param[in] timer: the callback timing a calibration run
+ * @param[in] ctx: user data passed to the timer
+ * @param[out] best: the fastest configuration
+ * @param[in] flog: file handle to print the timing of each candidate, NULL to be silent
+ * @return the number of timed candidates, 0 if none could be launched
+ */
+
+int mcx_tune_search(int sm, int maxmpthread, double photons, MCXTuneTimer timer, void* ctx, TuneResult* best, FILE* flog) {
+    int i, count = 0, blocksize;
+
+    memset(best, 0, sizeof(TuneResult));
+
+    if (sm <= 0 || maxmpthread <= 0 || timer == NULL) {
+        return 0;
+    }
+
+    timer(ctx, tuneblock[0], (maxmpthread / tuneblock[0]) * tuneblock[0] * sm * TUNE_DEFAULT_MULT);
+
+    for (i = 0; i < (int)(sizeof(tuneblock) / sizeof(int)); i++) {
+        count += mcx_tune_try(sm, maxmpthread, photons, tuneblock[i], TUNE_DEFAULT_MULT, timer, ctx, best, flog);
+    }
+
+    if (count == 0) {
+        return 0;
+    }
+
+    blocksize = best->blocksize;
+
+    for (i = 0; i < (int)(sizeof(tunemult) / sizeof(int)); i++) {
+        if (tunemult[i] != TUNE_DEFAULT_MULT) {
+            count += mcx_tune_try(sm, maxmpthread, photons, blocksize, tunemult[i], timer, ctx, best, flog);
+        }
+    }
+
+    return count;
+}
+
+/**
+ * @brief Parse the cache file, return NULL if it does not exist or can not be parsed
+ *
+ * @param[in] fname: the cache file name
+ */
+
+static cJSON* mcx_tune_read(const char* fname) {
+    FILE* fp = fopen(fname, "rb");
+    cJSON* root = NULL;
+    char* buf;
+    long len;
+
+    if (fp == NULL) {
+        return NULL;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    if (len > 0 && (buf = (char*)malloc(len + 1)) != NULL) {
+        if (fread(buf, 1, len, fp) == (size_t)len) {
+            buf[len] = '\0';
+            root = cJSON_Parse(buf);
+        }
+
+        free(buf);
+    }
+
+    fclose(fp);
+
+    if (root && !cJSON_IsObject(root)) {
+        cJSON_Delete(root);
+        root = NULL;
+    }
+
+    return root;
+}
+
+/**
+ * @brief Look up a cached launch configuration
+ *
+ * @param[in] fname: the cache file name
+ * @param[in] key: the device, kernel variant and media format key
+ * @param[out] res: the cached configuration
+ * @return 1 if found, 0 otherwise
+ */
+
+int mcx_tune_load(const char* fname, const char* key, TuneResult* res) {
+    cJSON* root = mcx_tune_read(fname);
+    cJSON* item, *val;
+    int found = 0;
+
+    if (root == NULL) {
+        return 0;
+    }
+
+    item = cJSON_GetObjectItemCaseSensitive(root, key);
+
+    if (cJSON_IsObject(item)) {
+        memset(res, 0, sizeof(TuneResult));
+
+        if (cJSON_IsNumber(val = cJSON_GetObjectItem(item, "BlockSize"))) {
+            res->blocksize = val->valueint;
+        }
+
+        if (cJSON_IsNumber(val = cJSON_GetObjectItem(item, "ThreadNum"))) {
+            res->threadnum = val->valueint;
+        }
+
+        if (cJSON_IsNumber(val = cJSON_GetObjectItem(item, "Speed"))) {
+            res->speed = val->valuedouble;
+        }
+
+        found = (res->blocksize > 0 && res->threadnum >= res->blocksize);
+    }
+
+    cJSON_Delete(root);
+    return found;
+}
+
+/**
+ * @brief Add or replace a launch configuration in the cache file, other entries are kept
+ *
+ * @param[in] fname: the cache file name
+ * @param[in] key: the device, kernel variant and media format key
+ * @param[in] res: the configuration to store
+ * @return 1 if the cache file was written, 0 otherwise
+ */
+
+int mcx_tune_save(const char* fname, const char* key, const TuneResult* res) {
+    cJSON* root = mcx_tune_read(fname);
+    cJSON* item = cJSON_CreateObject();
+    FILE* fp;
+    char* text;
+    int ok = 0;
+
+    if (root == NULL) {
+        root = cJSON_CreateObject();
+    }
+
+    cJSON_AddNumberToObject(item, "BlockSize", res->blocksize);
+    cJSON_AddNumberToObject(item, "ThreadNum", res->threadnum);
+    cJSON_AddNumberToObject(item, "Speed", res->speed);
+
+    if (cJSON_GetObjectItemCaseSensitive(root, key)) {
+        cJSON_ReplaceItemInObjectCaseSensitive(root, key, item);
+    } else {
+        cJSON_AddItemToObject(root, key, item);
+    }
+
+    text = cJSON_Print(root);
+
+    if (text && (fp = fopen(fname, "wb")) != NULL) {
+        ok = (fwrite(text, 1, strlen(text), fp) == strlen(text));
+        fclose(fp);
+    }
+
+    free(text);
+    cJSON_Delete(root);
+    return ok;
+}
+
+/**
+ * @brief Return the default cache file, .mcxtune.json in the home folder (or the current folder)
+ *
+ * @param[out] fname: buffer to store the file name
+ * @param[in] len: length of the buffer
+ */
+
+void mcx_tune_filename(char* fname, size_t len) {
+    const char* home = getenv("HOME");
+
+    if (home == NULL || home[0] == '\0') {
+        home = getenv("USERPROFILE");
+    }
+
+    if (home == NULL || home[0] == '\0') {
+        snprintf(fname, len, "%s", MCX_TUNE_FILE);
+    } else {
+        snprintf(fname, len, "%s%c%s", home, pathsep, MCX_TUNE_FILE);
+    }
+}
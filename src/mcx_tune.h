@@ -0,0 +1,81 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section sref Reference
+**  \li \c (\b Fang2009) Qianqian Fang and David A. Boas,
+**          <a href="http://www.opticsinfobase.org/abstract.cfm?uri=oe-17-22-20178">
+**          "Monte Carlo Simulation of Photon Migration in 3D Turbid Media Accelerated
+**          by Graphics Processing Units,"</a> Optics Express, 17(22) 20178-20190 (2009).
+**  \li \c (\b Yu2018) Leiming Yu, Fanny Nina-Paravecino, David Kaeli, and Qianqian Fang,
+**          "Scalable and massively parallel Monte Carlo photon transport
+**           simulations for heterogeneous computing platforms," J. Biomed. Optics,
+**           23(1), 010504, 2018. https://doi.org/10.1117/1.JBO.23.1.010504
+**  \li \c (\b Yan2020) Shijie Yan and Qianqian Fang* (2020), "Hybrid mesh and voxel
+**          based Monte Carlo algorithm for accurate and efficient photon transport
+**          modeling in complex bio-tissues," Biomed. Opt. Express, 11(11)
+**          pp. 6262-6270. https://doi.org/10.1364/BOE.409468
+**
+**  \section sformat Formatting
+**          Please always run "make pretty" inside the \c src folder before each commit.
+**          The above command requires \c astyle to perform automatic formatting.
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+
+/***************************************************************************//**
+\file    mcx_tune.h
+
+@brief   Launch-configuration autotuner and its per-device cache
+*******************************************************************************/
+
+#ifndef _MCEXTREME_TUNE_H
+#define _MCEXTREME_TUNE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define MCX_TUNE_FILE        ".mcxtune.json"        /**< default cache file name, stored in the home folder */
+#define MCX_TUNE_PHOTONS     10000000               /**< max photon number of each calibration run */
+
+#ifdef _WIN32
+    #define MCX_TUNE_NULLDEV "NUL"                  /**< null device receiving the log of the calibration runs */
+#else
+    #define MCX_TUNE_NULLDEV "/dev/null"            /**< null device receiving the log of the calibration runs */
+#endif
+
+/**
+ * The best launch configuration found for a device and a workload class
+ */
+
+typedef struct MCXTuneResult {
+    int blocksize;                 /**< thread number per block */
+    int threadnum;                 /**< total thread number */
+    double speed;                  /**< simulation speed of the calibration run, in photon/ms */
+} TuneResult;
+
+/**
+ * Callback to time one calibration run, returns the elapsed time in ms, or
+ * a non-positive value if the configuration can not be launched
+ */
+
+typedef double (*MCXTuneTimer)(void* ctx, int blocksize, int threadnum);
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+int mcx_tune_search(int sm, int maxmpthread, double photons, MCXTuneTimer timer, void* ctx, TuneResult* best, FILE* flog);
+int mcx_tune_load(const char* fname, const char* key, TuneResult* res);
+int mcx_tune_save(const char* fname, const char* key, const TuneResult* res);
+void mcx_tune_filename(char* fname, size_t len);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -51,6 +51,16 @@
 #include "mcx_core.h"
 #include "mcx_bench.h"
 #include "mcx_mie.h"
+#include "mcx_brick.h"
+#include "mcx_lowrank.h"
+#include "mcx_traj.h"
+#include "mcx_detfilter.h"
+#include "mcx_norm.h"
+#include "mcx_pyramid.h"
+#include "mcx_compact.h"
+#include "mcx_svmc.h"
+#include "mcx_mixlabel.h"
+#include "mcx_dcs.h"
 
 #if defined(_WIN32) && defined(USE_OS_TIMER) && !defined(MCX_CONTAINER)
     #include "mmc_tictoc.h"
@@ -59,6 +69,10 @@
 #ifndef MCX_CONTAINER
     #include "zmat/zmatlib.h"
     #include "ubj/ubj.h"
+    #include "mcx_serve.h"
+    #include "mcx_snapshot.h"
+    #include "mcx_bjdata.h"
+    #include "mcx_fastjson.h"
 #endif
 
 /**
@@ -108,7 +122,7 @@
 const char shortopt[] = {'h', 'i', 'f', 'n', 't', 'T', 's', 'a', 'g', 'b', '-', 'z', 'u', 'H', 'P',
                          'd', 'r', 'S', 'p', 'e', 'U', 'R', 'l', 'L', '-', 'I', '-', 'G', 'M', 'A', 'E', 'v', 'D',
                          'k', 'q', 'Y', 'O', 'F', '-', '-', 'x', 'X', '-', 'K', 'm', 'V', 'B', 'W', 'w', '-',
-                         '-', '-', 'Z', 'j', '-', '-', '-', '\0'
+                         '-', '-', 'Z', 'j', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '\0'
                         };
 
 /**
@@ -128,7 +142,11 @@ const char* fullopt[] = {"--help", "--interactive", "--input", "--photon",
                          "--maxvoidstep", "--saveexit", "--saveref", "--gscatter", "--mediabyte",
                          "--momentum", "--specular", "--bc", "--workload", "--savedetflag",
                          "--internalsrc", "--bench", "--dumpjson", "--zip", "--json", "--atomic",
-                         "--srcid", "--trajstokes", ""
+                         "--srcid", "--trajstokes", "--serve", "--cache", "--cachesize",
+                         "--shard", "--merge", "--brick", "--globalprop", "--patterntol",
+                         "--autotune", "--tunefile", "--trajsample", "--trajsort", "--trajquant",
+                         "--halfdet", "--pyramid", "--pyramidtol", "--compact", "--svmc",
+                         "--mixfactor", "--dcsmodel", "--dcsdisp", "--rffreq", ""
                         };
 
 /**
@@ -139,7 +157,7 @@ const char* fullopt[] = {"--help", "--interactive", "--input", "--photon",
  * j: jacobian for mua
  * p: scattering counts for computing Jacobians for mus
  * m: momentum transfer in replay
- * r: frequency domain/RF mua Jacobian by replay
+ * r: frequency domain/RF mua Jacobian by replay, or forward FD fluence otherwise
  * l: total path lengths in each voxel
  */
 
@@ -215,11 +233,18 @@ const char* srctypeid[] = {"pencil", "isotropic", "cone", "gaussian", "planar",
  * User can specify the source type using a string
  */
 
-const unsigned int mediaformatid[] = {1, 2, 4, 96, 97, 98, 99, 100, 101, 102, 103, 104, 0};
-const char* mediaformat[] = {"byte", "short", "integer", "asgn_float", "svmc", "mixlabel", "labelplus",
+const unsigned int mediaformatid[] = {1, 2, 4, 94, 95, 96, 97, 98, 99, 100, 101, 102, 103, 104, 0};
+const char* mediaformat[] = {"byte", "short", "integer", "label8", "label4", "asgn_float", "svmc", "mixlabel", "labelplus",
                              "muamus_float", "mua_float", "muamus_half", "asgn_byte", "muamus_short", ""
                             };
 
+/**
+ * Displacement models of the DCS g1 computed from the detected photons
+ * The index of each model matches MCX_DCS_NONE, MCX_DCS_BROWNIAN and MCX_DCS_RANDOMFLOW
+ */
+
+const char* dcsmodel[] = {"none", "brownian", "random_flow", ""};
+
 /**
  * Flag to decide if parameter has been initialized over command line
  */
@@ -286,6 +311,7 @@ void mcx_initcfg(Config* cfg) {
     cfg->seed = 0x623F9A9E;  /** default RNG seed, a big integer, with a hidden meaning :) */
     cfg->exportfield = NULL;
     cfg->exportdetected = NULL;
+    cfg->exportg1 = NULL;
     cfg->energytot = 0.f;
     cfg->energyabs = 0.f;
     cfg->energyesc = 0.f;
@@ -293,6 +319,12 @@ void mcx_initcfg(Config* cfg) {
     cfg->zipid = zmZlib;
 #endif
     cfg->omega = 0.f;
+    cfg->rffreq = NULL;
+    cfg->rffreqnum = 0;
+    cfg->biasprob = 0.f;
+    cfg->biasangle = 0.f;
+    cfg->biasdet = NULL;
+    cfg->biasdetnum = 0;
     cfg->lambda = 0.f;
     /*cfg->his=(History){{'M','C','X','H'},1,0,0,0,0,0,0,1.f,{0,0,0,0,0,0,0}};*/   /** This format is only supported by C99 */
     memset(&cfg->his, 0, sizeof(History));
@@ -316,11 +348,18 @@ void mcx_initcfg(Config* cfg) {
     cfg->issaveexit = 0;
     cfg->istrajstokes = 0;
     cfg->ismomentum = 0;
+    cfg->dcsmodel = MCX_DCS_NONE;
+    cfg->dcsdisp = 0.f;
+    cfg->dcsntau = 0;
+    cfg->dcstau = NULL;
     cfg->internalsrc = 0;
+    cfg->isserve = 0;
+    cfg->isnested = 0;
     cfg->replay.seed = NULL;
     cfg->replay.weight = NULL;
     cfg->replay.tof = NULL;
     cfg->replay.detid = NULL;
+    cfg->replay.seedbyte = 0;
     cfg->replaydet = 0;
     cfg->seedfile[0] = '\0';
     cfg->outputtype = otFlux;
@@ -343,6 +382,45 @@ void mcx_initcfg(Config* cfg) {
     cfg->his.totalsource = cfg->extrasrclen + 1;
     cfg->srcdata = NULL;
     memset(cfg->jsonfile, 0, MAX_PATH_LENGTH);
+    memset(cfg->serveaddr, 0, MAX_PATH_LENGTH);
+    memset(cfg->cachedir, 0, MAX_PATH_LENGTH);
+    cfg->cachesize = 0.f;
+    cfg->iscachehit = 0;
+    cfg->shardid = 0;
+    cfg->shardnum = 0;
+    cfg->ismerge = 0;
+    cfg->issnapshot = 0;
+    cfg->isbrick = 0;
+    cfg->brickvol = NULL;
+    cfg->bricklen = 0;
+    cfg->mediabits = 0;
+    cfg->isglobalprop = 0;
+    cfg->patterntol = 0.f;
+    cfg->patternrank = 0;
+    cfg->patternbasis = NULL;
+    cfg->patterncoef = NULL;
+    cfg->autotune = 0;
+    memset(cfg->tunefile, 0, MAX_PATH_LENGTH);
+    cfg->trajphoton = 1;
+    cfg->trajstep = 1;
+    cfg->istrajsort = 0;
+    cfg->trajquant = 0.f;
+    cfg->trajidbase = 0;
+    memset(&(cfg->detfilter), 0, sizeof(DetFilter));
+    cfg->ishalfdet = 0;
+    cfg->muavol = NULL;
+    cfg->pyramid = 0;
+    cfg->pyramidtol = 1e-5f;
+    cfg->pyramidvol = NULL;
+    memset(&(cfg->pyramiddim), 0, sizeof(uint3));
+    cfg->iscompact = 1;
+    cfg->issvmc = 0;
+    cfg->mixfactor = 0;
+    memset(&(cfg->fulldim), 0, sizeof(uint3));
+    memset(&(cfg->compactoffset), 0, sizeof(uint3));
+    cfg->isroi = 0;
+    memset(&(cfg->roi0), 0, sizeof(uint3));
+    memset(&(cfg->roi1), 0, sizeof(uint3));
     memset(cfg->bc, 0, 13);
     memset(&(cfg->srcparam1), 0, sizeof(float4));
     memset(&(cfg->srcparam2), 0, sizeof(float4));
@@ -404,6 +482,26 @@ void mcx_clearcfg(Config* cfg) {
         free(cfg->srcpattern);
     }
 
+    if (cfg->brickvol) {
+        free(cfg->brickvol);
+    }
+
+    if (cfg->patternbasis) {
+        free(cfg->patternbasis);
+    }
+
+    if (cfg->patterncoef) {
+        free(cfg->patterncoef);
+    }
+
+    if (cfg->muavol) {
+        free(cfg->muavol);
+    }
+
+    if (cfg->pyramidvol) {
+        free(cfg->pyramidvol);
+    }
+
     if (cfg->replay.weight) {
         free(cfg->replay.weight);
     }
@@ -440,6 +538,22 @@ void mcx_clearcfg(Config* cfg) {
         free(cfg->exportdetected);
     }
 
+    if (cfg->exportg1) {
+        free(cfg->exportg1);
+    }
+
+    if (cfg->dcstau) {
+        free(cfg->dcstau);
+    }
+
+    if (cfg->rffreq) {
+        free(cfg->rffreq);
+    }
+
+    if (cfg->biasdet) {
+        free(cfg->biasdet);
+    }
+
     if (cfg->exportdebugdata) {
         free(cfg->exportdebugdata);
     }
@@ -473,6 +587,37 @@ void mcx_clearcfg(Config* cfg) {
 
 #ifndef MCX_CONTAINER
 
+/**
+ * @brief Return the voxel size along each axis to be stored in the output headers
+ *
+ * For a non-uniform grid, the mean edge length along each axis is returned, the
+ * edge lengths of all voxels are stored separately in the JNIfTI headers
+ *
+ * @param[in] cfg: simulation configuration
+ * @param[out] voxelsize: the voxel sizes (in mm) along x, y and z
+ */
+
+static void mcx_voxelsize(Config* cfg, float voxelsize[3]) {
+    float* table[3] = {cfg->dx, cfg->dy, cfg->dz};
+    unsigned int len[3] = {cfg->dim.x, cfg->dim.y, cfg->dim.z}, i, j;
+
+    voxelsize[0] = cfg->steps.x;
+    voxelsize[1] = cfg->steps.y;
+    voxelsize[2] = cfg->steps.z;
+
+    for (i = 0; i < 3; i++) {
+        if (voxelsize[i] < 0.f && table[i] && len[i]) {
+            double sum = 0.0;
+
+            for (j = 0; j < len[i]; j++) {
+                sum += table[i][j];
+            }
+
+            voxelsize[i] = (float)(sum / len[i]);
+        }
+    }
+}
+
 /**
  * @brief Save volumetric output (fluence etc) to an Nifty format binary file
  *
@@ -501,9 +646,7 @@ void mcx_savenii(float* dat, size_t len, char* name, int type32bit, int outputfo
     hdr.dim[4] = len / (cfg->dim.x * cfg->dim.y * cfg->dim.z);
     hdr.datatype = type32bit;
     hdr.bitpix = 32;
-    hdr.pixdim[1] = cfg->unitinmm;
-    hdr.pixdim[2] = cfg->unitinmm;
-    hdr.pixdim[3] = cfg->unitinmm;
+    mcx_voxelsize(cfg, hdr.pixdim + 1);
     hdr.intent_code = NIFTI_INTENT_NONE;
 
     if (type32bit == NIFTI_TYPE_FLOAT32) {
@@ -652,6 +795,19 @@ void mcx_savebnii(float* vol, int ndim, uint* dims, float* voxelsize, char* name
     UBJ_WRITE_KEY(root, "FirstSliceID", uint8, 0);
     ubjw_write_key(root, "VoxelSize");
     UBJ_WRITE_ARRAY(root, single, ndim, voxelsize);
+
+    if (cfg->steps.x < 0.f) {
+        ubjw_write_key(root, "VoxelEdges");
+        ubjw_begin_object(root, UBJ_MIXED, 3);
+        ubjw_write_key(root, "Dx");
+        UBJ_WRITE_ARRAY(root, single, cfg->dim.x, cfg->dx);
+        ubjw_write_key(root, "Dy");
+        UBJ_WRITE_ARRAY(root, single, cfg->dim.y, cfg->dy);
+        ubjw_write_key(root, "Dz");
+        UBJ_WRITE_ARRAY(root, single, cfg->dim.z, cfg->dz);
+        ubjw_end(root);
+    }
+
     ubjw_write_key(root, "Orientation");
     ubjw_begin_object(root, UBJ_MIXED, 3);
     UBJ_WRITE_KEY(root, "x", char, 'r');
@@ -792,6 +948,15 @@ void mcx_savejnii(float* vol, int ndim, uint* dims, float* voxelsize, char* name
     cJSON_AddNumberToObject(hdr, "BitDepth", 32);
     cJSON_AddNumberToObject(hdr, "FirstSliceID", 0);
     cJSON_AddItemToObject(hdr, "VoxelSize", cJSON_CreateFloatArray(voxelsize, ndim));
+
+    /** the edge lengths of all voxels of a non-uniform grid */
+    if (cfg->steps.x < 0.f) {
+        cJSON_AddItemToObject(hdr, "VoxelEdges", sub = cJSON_CreateObject());
+        cJSON_AddItemToObject(sub, "Dx", cJSON_CreateFloatArray(cfg->dx, cfg->dim.x));
+        cJSON_AddItemToObject(sub, "Dy", cJSON_CreateFloatArray(cfg->dy, cfg->dim.y));
+        cJSON_AddItemToObject(sub, "Dz", cJSON_CreateFloatArray(cfg->dz, cfg->dim.z));
+    }
+
     cJSON_AddItemToObject(hdr, "Orientation", sub = cJSON_CreateObject());
     cJSON_AddStringToObject(sub, "x", "r");
     cJSON_AddStringToObject(sub, "y", "a");
@@ -898,6 +1063,8 @@ void mcx_savedata(float* dat, size_t len, Config* cfg) {
         uint dims[6] = {cfg->dim.x, cfg->dim.y, cfg->dim.z, cfg->maxgate, cfg->srcnum, 1};
         float voxelsize[6] = {cfg->steps.x, cfg->steps.y, cfg->steps.z, cfg->tstep, 1, 1};
 
+        mcx_voxelsize(cfg, voxelsize);
+
         if (cfg->extrasrclen && cfg->srcid == -1) {
             dims[5] = cfg->extrasrclen + 1;
         }
@@ -906,7 +1073,7 @@ void mcx_savedata(float* dat, size_t len, Config* cfg) {
             dims[5] *= cfg->detnum;
         }
 
-        if (cfg->seed == SEED_FROM_FILE && cfg->outputtype == otRF) {
+        if (cfg->outputtype == otRF) {
             dims[5] *= 2;
         }
 
@@ -1018,6 +1185,11 @@ void mcx_savejdet(float* ppath, void* seeds, uint count, int doappend, Config* c
     cJSON_AddNumberToObject(hdr, "SrcNum", cfg->his.srcnum);
     cJSON_AddNumberToObject(hdr, "SaveDetFlag", cfg->his.savedetflag);
     cJSON_AddNumberToObject(hdr, "TotalSource", cfg->his.totalsource);
+
+    if (cfg->his.ishalf) {
+        cJSON_AddNumberToObject(hdr, "HalfPrecision", 1);
+    }
+
     cJSON_AddItemToObject(hdr, "Media", sub = cJSON_CreateArray());
 
     for (int i = 0; i < cfg->medianum; i++) {
@@ -1033,11 +1205,28 @@ void mcx_savejdet(float* ppath, void* seeds, uint count, int doappend, Config* c
         char* dtype[] = {"uint32", "single", "single", "uint32", "single"};
         char* dname[] = {"photonid", "p", "w0", "srcid", "iquv"};
         int activecol = sizeof(colnum) - (cfg->his.totalsource == 1);
+        int* dp = (cfg->trajquant > 0.f) ? mcx_traj_quantize(ppath, count, cfg->his.colcount, cfg->trajquant) : NULL;
         cJSON_AddItemToObject(obj, "Trajectory", dat = cJSON_CreateObject());
 
         for (int id = 0; id < activecol; id++) {
             uint dims[2] = {count, colnum[id]};
-            float* buf = (float*)calloc(dims[0] * dims[1], sizeof(float));
+            float* buf = NULL;
+
+            /** quantized positions are stored as per-photon deltas, p is the cumulative sum of dp over each photon times PositionQuant */
+            if (id == 1 && dp) {
+                cJSON_AddNumberToObject(hdr, "PositionQuant", cfg->trajquant);
+                cJSON_AddItemToObject(dat, "dp", sub = cJSON_CreateObject());
+
+                if (mcx_jdataencode(dp, 2, dims, "int32", 4, cfg->zipid, sub, 0, 0, cfg)) {
+                    MCX_ERROR(-1, "error when converting to JSON");
+                }
+
+                free(dp);
+                col += dims[1];
+                continue;
+            }
+
+            buf = (float*)calloc(dims[0] * dims[1], sizeof(float));
 
             for (int i = 0; i < dims[0]; i++)
                 for (int j = 0; j < dims[1]; j++) {
@@ -1067,6 +1256,27 @@ void mcx_savejdet(float* ppath, void* seeds, uint count, int doappend, Config* c
                 uint*  ibuf = NULL;
                 int hassrcid = ((cfg->his.totalsource > 1) && id == 1);
 
+                /** half-precision ppath/mom columns are saved as the raw IEEE 754 half bits, see mcx_detfilter.h */
+                if (cfg->his.ishalf && (id == 2 || id == 3)) {
+                    unsigned short* hbuf = (unsigned short*)calloc(dims[0] * dims[1], sizeof(unsigned short));
+
+                    for (int i = 0; i < dims[0]; i++)
+                        for (int j = 0; j < dims[1]; j++) {
+                            uint pair = ((uint*)ppath)[i * cfg->his.colcount + col + (j >> 1)];
+                            hbuf[i * dims[1] + j] = (unsigned short)((j & 1) ? (pair >> 16) : (pair & 0xFFFF));
+                        }
+
+                    cJSON_AddItemToObject(dat, dname[id], sub = cJSON_CreateObject());
+
+                    if (mcx_jdataencode(hbuf, 2, dims, "uint16", 2, cfg->zipid, sub, 0, 0, cfg)) {
+                        MCX_ERROR(-1, "error when converting to JSON");
+                    }
+
+                    free(hbuf);
+                    col += (dims[1] + 1) >> 1;
+                    continue;
+                }
+
                 if (!strcmp(dtype[id], "uint32")) {
                     ibuf = (uint*)calloc(dims[0] * dims[1], sizeof(uint));
 
@@ -1166,6 +1376,153 @@ void mcx_savejdet(float* ppath, void* seeds, uint count, int doappend, Config* c
     }
 }
 
+/**
+ * @brief Save the energy tallies and normalization factors of a photon shard
+ *
+ * A run with --shard k/N saves its volumetric output without normalization; the
+ * factors it would have applied, together with the simulated photon number and
+ * energy tallies, are written to <session>_shard.json next to the outputs, so
+ * that mcx --merge can combine all shards into the result of a single run. On a
+ * non-uniform grid, the voxel spacings are saved as well, as the merged fluence
+ * must also be divided by the volume of each voxel.
+ *
+ * @param[in] cfg: simulation configuration
+ * @param[in] scale: the normalization factors of each source, NULL if not normalized
+ */
+
+void mcx_saveshard(float* scale, Config* cfg) {
+    FILE* fp;
+    char fname[MAX_FULL_PATH + 16];
+    cJSON* root = NULL, *obj = NULL;
+    char* jsonstr = NULL;
+
+    root = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, "MCXShard", obj = cJSON_CreateObject());
+    cJSON_AddNumberToObject(obj, "Version", 1);
+    cJSON_AddNumberToObject(obj, "Id", cfg->shardid);
+    cJSON_AddNumberToObject(obj, "Count", cfg->shardnum);
+    cJSON_AddNumberToObject(obj, "Seed", cfg->seed);
+    cJSON_AddNumberToObject(obj, "Photons", cfg->nphoton);
+    cJSON_AddNumberToObject(obj, "Repeat", cfg->respin);
+    cJSON_AddNumberToObject(obj, "EnergyTotal", cfg->energytot);
+    cJSON_AddNumberToObject(obj, "EnergyEscape", cfg->energyesc);
+    cJSON_AddNumberToObject(obj, "EnergyAbsorbed", cfg->energytot - cfg->energyesc);
+    cJSON_AddNumberToObject(obj, "SrcNum", cfg->srcnum);
+    cJSON_AddNumberToObject(obj, "Normalize", (scale ? cfg->isnormalized : 0));
+    cJSON_AddItemToObject(obj, "Normalizer", (scale ? cJSON_CreateFloatArray(scale, cfg->srcnum) : cJSON_CreateArray()));
+
+    /** on a non-uniform grid, the merged fluence is further divided by the relative voxel volumes saved here */
+    if (scale && cfg->steps.x < 0.f && (cfg->outputtype == otFlux || cfg->outputtype == otFluence
+                                        || (cfg->outputtype == otRF && cfg->seed != SEED_FROM_FILE))) {
+        cJSON* grid;
+        int griddim[3] = {(int)cfg->dim.x, (int)cfg->dim.y, (int)cfg->dim.z};
+
+        cJSON_AddItemToObject(obj, "Grid", grid = cJSON_CreateObject());
+        cJSON_AddItemToObject(grid, "Dim", cJSON_CreateIntArray(griddim, 3));
+        cJSON_AddNumberToObject(grid, "UnitInMM", cfg->unitinmm);
+        cJSON_AddItemToObject(grid, "Dx", cJSON_CreateFloatArray(cfg->dx, cfg->dim.x));
+        cJSON_AddItemToObject(grid, "Dy", cJSON_CreateFloatArray(cfg->dy, cfg->dim.y));
+        cJSON_AddItemToObject(grid, "Dz", cJSON_CreateFloatArray(cfg->dz, cfg->dim.z));
+    }
+
+    if (cfg->issave2pt) {
+        if (cfg->outputformat == ofAnalyze || cfg->outputformat == ofUBJSON) {
+            MCX_FPRINTF(cfg->flog, S_RED "WARNING: the %s output format can not be merged\n" S_RESET, outputformat[(int)cfg->outputformat]);
+        }
+
+        sprintf(fname, "%s.%s", cfg->session, outputformat[(int)cfg->outputformat]);
+        cJSON_AddStringToObject(obj, "Field", fname);
+    }
+
+    if (cfg->issavedet && cfg->exportdetected) {
+        if (cfg->outputformat == ofJNifti || cfg->outputformat == ofBJNifti) {
+            sprintf(fname, "%s_detp.jdat", cfg->session);
+        } else {
+            sprintf(fname, "%s.mch", cfg->session);
+        }
+
+        cJSON_AddStringToObject(obj, "Detected", fname);
+        cJSON_AddNumberToObject(obj, "DetectedPhoton", cfg->detectedcount);
+    }
+
+    jsonstr = cJSON_Print(root);
+
+    if (jsonstr == NULL) {
+        MCX_ERROR(-1, "error when converting to JSON");
+    }
+
+    if (cfg->rootpath[0]) {
+        sprintf(fname, "%s%c%s_shard.json", cfg->rootpath, pathsep, cfg->session);
+    } else {
+        sprintf(fname, "%s_shard.json", cfg->session);
+    }
+
+    fp = fopen(fname, "wt");
+
+    if (fp == NULL) {
+        MCX_ERROR(-2, "can not save data to disk");
+    }
+
+    fprintf(fp, "%s\n", jsonstr);
+    fclose(fp);
+    free(jsonstr);
+    cJSON_Delete(root);
+}
+
+/**
+ * @brief Save the DCS g1 curves of all detectors
+ *
+ * The g1 curves computed from the detected photons (cfg->exportg1) are written to
+ * <session>_g1.json together with the displacement model and the correlation times.
+ *
+ * @param[in] cfg: simulation configuration
+ */
+
+void mcx_savedcs(Config* cfg) {
+    FILE* fp;
+    char fname[MAX_FULL_PATH + 16];
+    cJSON* root = NULL, *obj = NULL, *g1 = NULL;
+    char* jsonstr = NULL;
+    unsigned int i;
+
+    root = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, "MCXDCS", obj = cJSON_CreateObject());
+    cJSON_AddStringToObject(obj, "Model", dcsmodel[(int)cfg->dcsmodel]);
+    cJSON_AddNumberToObject(obj, "Disp", cfg->dcsdisp);
+    cJSON_AddNumberToObject(obj, "WaveLength", (cfg->lambda > 0.f) ? cfg->lambda : MCX_DCS_LAMBDA);
+    cJSON_AddNumberToObject(obj, "DetNum", cfg->detnum);
+    cJSON_AddNumberToObject(obj, "DetectedPhoton", cfg->detectedcount);
+    cJSON_AddItemToObject(obj, "Tau", cJSON_CreateFloatArray(cfg->dcstau, cfg->dcsntau));
+    cJSON_AddItemToObject(obj, "G1", g1 = cJSON_CreateArray());
+
+    for (i = 0; i < cfg->detnum; i++) {
+        cJSON_AddItemToArray(g1, cJSON_CreateFloatArray(cfg->exportg1 + (size_t)i * cfg->dcsntau, cfg->dcsntau));
+    }
+
+    jsonstr = cJSON_Print(root);
+
+    if (jsonstr == NULL) {
+        MCX_ERROR(-1, "error when converting to JSON");
+    }
+
+    if (cfg->rootpath[0]) {
+        sprintf(fname, "%s%c%s_g1.json", cfg->rootpath, pathsep, cfg->session);
+    } else {
+        sprintf(fname, "%s_g1.json", cfg->session);
+    }
+
+    fp = fopen(fname, "wt");
+
+    if (fp == NULL) {
+        MCX_ERROR(-2, "can not save data to disk");
+    }
+
+    fprintf(fp, "%s\n", jsonstr);
+    fclose(fp);
+    free(jsonstr);
+    cJSON_Delete(root);
+}
+
 #endif
 
 /**
@@ -1252,6 +1609,61 @@ float mcx_updatemua(unsigned int mediaid, Config* cfg) {
     return mua;
 }
 
+/**
+ * @brief Decode the mua of all voxels once and cache the result in the configuration
+ *
+ * The decoded array is shared by the post-processing steps of a simulation, such as
+ * converting the fluence of the photon-sharing patterns to absorbed energy, and is
+ * released by mcx_prepdomain and mcx_clearcfg. Besides the formats handled by
+ * mcx_updatemua, the half-precision (as_f2h, as_half, asgn_f2h, label_half) and
+ * mixed-label (2label_mix, svmc) formats are also decoded; a split voxel of the
+ * svmc format uses the mua of its lower label.
+ *
+ * @param[in,out] cfg: simulation configuration, cfg->muavol stores the decoded array
+ * @return the mua (in 1/grid unit) of all voxels, or NULL if the domain is not loaded
+ */
+
+const float* mcx_muavolume(Config* cfg) {
+    size_t dimxyz = (size_t)cfg->dim.x * cfg->dim.y * cfg->dim.z;
+    long long i;
+
+    if (cfg->muavol || cfg->vol == NULL || dimxyz == 0) {
+        return cfg->muavol;
+    }
+
+    cfg->muavol = (float*)malloc(dimxyz * sizeof(float));
+
+    #pragma omp parallel for schedule(static) num_threads(mcx_norm_threadnum(dimxyz))
+
+    for (i = 0; i < (long long)dimxyz; i++) {
+        unsigned int mediaid = cfg->vol[i];
+        union {
+            unsigned int i;
+            unsigned short h[2];
+            unsigned char c[4];
+        } val;
+
+        val.i = mediaid & MED_MASK;
+
+        if (cfg->mediabyte == MEDIA_AS_F2H || cfg->mediabyte == MEDIA_AS_HALF || cfg->mediabyte == MEDIA_ASGN_F2H) {
+            cfg->muavol[i] = fabs(mcx_half2float(val.h[0]));
+        } else if (cfg->mediabyte == MEDIA_LABEL_HALF) {
+            /** the upper 2 bits of the lower half select which property is stored in the upper half, 0 for mua */
+            cfg->muavol[i] = ((val.h[0] >> 14) == 0) ? fabs(mcx_half2float(val.h[1])) : cfg->prop[val.h[0] & 0x3FFF].mua;
+        } else if (cfg->mediabyte == MEDIA_2LABEL_MIX) {
+            float ratio = val.h[1] * (1.f / 32767.f);
+
+            cfg->muavol[i] = ratio * cfg->prop[val.c[1]].mua + (1.f - ratio) * cfg->prop[val.c[0]].mua;
+        } else if (cfg->mediabyte == MEDIA_2LABEL_SPLIT) {
+            cfg->muavol[i] = cfg->prop[(mediaid & LOWER_MASK) >> 24].mua;
+        } else {
+            cfg->muavol[i] = mcx_updatemua(mediaid, cfg);
+        }
+    }
+
+    return cfg->muavol;
+}
+
 /**
  * @brief Force flush the command line to print the message
  *
@@ -1281,6 +1693,7 @@ void mcx_error(const int id, const char* msg, const char* file, const int linenu
 #ifdef MCX_CONTAINER
     mcx_throw_exception(id, msg, file, linenum);
 #else
+    mcx_serve_trap(id, msg);
     MCX_FPRINTF(stdout, S_RED "\nMCX ERROR(%d):%s in unit %s:%d\n" S_RESET, id, msg, file, linenum);
 
     if (id == -MCX_CUDA_ERROR_LAUNCH_FAILED) {
@@ -1341,9 +1754,9 @@ void mcx_assert(int ret) {
 #ifndef MCX_CONTAINER
 
 /**
- * @brief Read simulation settings from a configuration file (.inp or .json)
+ * @brief Read simulation settings from a configuration file (.inp, .json or .bjd)
  *
- * @param[in] fname: the name of the input file (.inp or .json)
+ * @param[in] fname: the name of the input file (.inp, .json, .bjd/.jdb or a .mcxs snapshot)
  * @param[in] cfg: simulation configuration
  */
 
@@ -1357,7 +1770,26 @@ void mcx_readconfig(char* fname, Config* cfg) {
             MCX_ERROR(-2, "can not load the specified config file");
         }
 
-        if (strstr(fname, ".json") != NULL || fname[0] == '{') {
+        if (strstr(fname, MCX_SNAPSHOT_SUFFIX) != NULL && fp != NULL) {
+            mcx_snapshot_load(fname, cfg);
+        } else if (mcx_bjd_issuffix(fname) && fp != NULL) {
+            unsigned char* bjdbuf;
+            size_t len;
+
+            fclose(fp);
+            fp = fopen(fname, "rb");
+            fseek(fp, 0, SEEK_END);
+            len = ftell(fp);
+            bjdbuf = (unsigned char*)malloc(len + 1);
+            rewind(fp);
+
+            if (len > 0 && fread(bjdbuf, len, 1, fp) != 1) {
+                MCX_ERROR(-2, "reading input file is terminated");
+            }
+
+            mcx_loadbjdata(bjdbuf, len, cfg);
+            free(bjdbuf);
+        } else if (strstr(fname, ".json") != NULL || fname[0] == '{') {
             char* jbuf;
             int len;
             cJSON* jroot;
@@ -1379,7 +1811,7 @@ void mcx_readconfig(char* fname, Config* cfg) {
                 jbuf = fname;
             }
 
-            jroot = cJSON_Parse(jbuf);
+            jroot = mcx_fastjson_parse(jbuf);
 
             if (jroot) {
                 mcx_loadjson(jroot, cfg);
@@ -1440,6 +1872,32 @@ void mcx_readconfig(char* fname, Config* cfg) {
     }
 }
 
+/**
+ * @brief Load user inputs from a BJData (binary JSON) document
+ *
+ * The document is converted to the cJSON tree of the equivalent JSON input
+ * and loaded by mcx_loadjson. Typed arrays are decoded without text parsing,
+ * and the JData payloads of the volume and the source pattern are copied in
+ * their binary form by mcx_jdatadecode.
+ *
+ * @param[in] buf: the content of a .bjd/.jdb input file
+ * @param[in] len: length of the document in bytes
+ * @param[in] cfg: simulation configuration
+ */
+
+void mcx_loadbjdata(const unsigned char* buf, size_t len, Config* cfg) {
+    size_t errpos = 0;
+    cJSON* jroot = mcx_bjd_parse(buf, len, &errpos);
+
+    if (jroot == NULL) {
+        MCX_FPRINTF(stderr, "BJData parsing stopped at byte %lu of %lu\n", (unsigned long)errpos, (unsigned long)len);
+        MCX_ERROR(-9, "invalid BJData input file");
+    }
+
+    mcx_loadjson(jroot, cfg);
+    cJSON_Delete(jroot);
+}
+
 /**
  * @brief Write simulation settings to an inp file
  *
@@ -1464,6 +1922,323 @@ void mcx_writeconfig(char* fname, Config* cfg) {
 
 #endif
 
+/**
+ * @brief Rescale the position and the length parameters of a source to a coarser grid
+ *
+ * @param[in] srctype: the source type
+ * @param[in,out] pos: the source position
+ * @param[in,out] dir: the source direction, dir.w is the focal length
+ * @param[in,out] p1: srcparam1 of the source
+ * @param[in,out] p2: srcparam2 of the source
+ * @param[in] scale: the ratio of the input voxel size to the new voxel size
+ */
+
+static void mcx_mixlabel_scalesrc(int srctype, float4* pos, float4* dir, float4* p1, float4* p2, float scale) {
+    pos->x *= scale;
+    pos->y *= scale;
+    pos->z *= scale;
+    dir->w *= scale;
+
+    /** angles, spatial frequencies and counts are kept, only the lengths in grid unit are scaled */
+    if (srctype == MCX_SRC_PLANAR || srctype == MCX_SRC_PATTERN || srctype == MCX_SRC_FOURIER || srctype == MCX_SRC_PENCILARRAY) {
+        p1->x *= scale;
+        p1->y *= scale;
+        p1->z *= scale;
+        p2->x *= scale;
+        p2->y *= scale;
+        p2->z *= scale;
+    } else if (srctype == MCX_SRC_LINE || srctype == MCX_SRC_SLIT) {
+        p1->x *= scale;
+        p1->y *= scale;
+        p1->z *= scale;
+    } else if (srctype == MCX_SRC_FOURIERX || srctype == MCX_SRC_FOURIERX2D) {
+        p1->x *= scale;
+        p1->y *= scale;
+        p1->z *= scale;
+        p1->w *= scale;
+    } else if (srctype == MCX_SRC_DISK || srctype == MCX_SRC_RING || srctype == MCX_SRC_GAUSSIAN) {
+        p1->x *= scale;
+        p1->y *= scale;
+    } else if (srctype == MCX_SRC_HYPERBOLOID_GAUSSIAN) {
+        p1->x *= scale;
+        p1->y *= scale;
+        p1->z *= scale;
+    }
+}
+
+/**
+ * @brief Downsample a label volume by cfg->mixfactor to the mixed-label format
+ *
+ * Each voxel of the coarse grid stores the two most frequent labels of the block of
+ * input voxels it covers and their mixing ratio (MEDIA_2LABEL_MIX). The voxel size
+ * (cfg->unitinmm) grows by the factor, and the sources, detectors and the optical
+ * properties, all in grid unit, are rescaled accordingly.
+ *
+ * @param[in,out] cfg: simulation configuration
+ * @param[in] maxlabel: the largest label in the input volume
+ */
+
+static void mcx_mixlabeldomain(Config* cfg, unsigned int maxlabel) {
+    unsigned int dim[3] = {cfg->dim.x, cfg->dim.y, cfg->dim.z}, newdim[3];
+    unsigned int* newvol;
+    float scale = 1.f / cfg->mixfactor;
+    unsigned int i;
+
+    if (maxlabel > MCX_MIXLABEL_MAXLABEL) {
+        MCX_ERROR(-4, "the mixed-label media format supports up to 255 labels");
+    }
+
+    if (cfg->issvmc || cfg->mediabits || cfg->polmedianum || cfg->steps.x < 0.f) {
+        MCX_ERROR(-4, "mixed-label downsampling does not support svmc, packed labels, polarized media or anisotropic voxels");
+    }
+
+    if (cfg->srctype == MCX_SRC_PATTERN3D) {
+        MCX_ERROR(-4, "mixed-label downsampling does not support the pattern3d source");
+    }
+
+    newvol = mcx_mixlabel_downsample(cfg->vol, dim, cfg->mixfactor, newdim);
+
+    if (newvol == NULL) {
+        MCX_ERROR(-7, "can not allocate memory");
+    }
+
+    free(cfg->vol);
+    cfg->vol = newvol;
+    cfg->dim.x = newdim[0];
+    cfg->dim.y = newdim[1];
+    cfg->dim.z = newdim[2];
+    cfg->mediabyte = MEDIA_2LABEL_MIX;
+
+    cfg->unitinmm *= cfg->mixfactor;
+
+    if (cfg->steps.x > 0.f) {
+        cfg->steps.x = cfg->unitinmm;
+        cfg->steps.y = cfg->unitinmm;
+        cfg->steps.z = cfg->unitinmm;
+    }
+
+    for (i = 1; i < cfg->medianum; i++) {
+        cfg->prop[i].mus *= cfg->mixfactor;
+        cfg->prop[i].mua *= cfg->mixfactor;
+    }
+
+    mcx_mixlabel_scalesrc(cfg->srctype, &cfg->srcpos, &cfg->srcdir, &cfg->srcparam1, &cfg->srcparam2, scale);
+
+    for (i = 0; i < cfg->extrasrclen; i++) {
+        mcx_mixlabel_scalesrc(cfg->srctype, &cfg->srcdata[i].srcpos, &cfg->srcdata[i].srcdir, &cfg->srcdata[i].srcparam1, &cfg->srcdata[i].srcparam2, scale);
+    }
+
+    for (i = 0; i < cfg->detnum; i++) {
+        cfg->detpos[i].x *= scale;
+        cfg->detpos[i].y *= scale;
+        cfg->detpos[i].z *= scale;
+        cfg->detpos[i].w *= scale;
+    }
+}
+
+/**
+ * @brief Grow a bounding box to include the region where a source launches photons
+ *
+ * @param[in,out] lo: the lower corner of the box, in grid unit
+ * @param[in,out] hi: the upper corner of the box, in grid unit
+ * @param[in] srctype: the source type
+ * @param[in] pos: the source position
+ * @param[in] p1: srcparam1 of the source
+ * @param[in] p2: srcparam2 of the source
+ */
+
+static void mcx_compact_addsrc(float lo[3], float hi[3], int srctype, float4 pos, float4 p1, float4 p2) {
+    float corner[4][3] = {{0.f, 0.f, 0.f}, {p1.x, p1.y, p1.z}, {p2.x, p2.y, p2.z}, {p1.x + p2.x, p1.y + p2.y, p1.z + p2.z}};
+    float radius = 0.f;
+    int ncorner = 1, i, j;
+
+    /** area sources span srcparam1/srcparam2.{x,y,z}, 3D patterns, lines and slits srcparam1.{x,y,z} */
+    if (srctype == MCX_SRC_PLANAR || srctype == MCX_SRC_PATTERN || srctype == MCX_SRC_FOURIER || srctype == MCX_SRC_PENCILARRAY) {
+        ncorner = 4;
+    } else if (srctype == MCX_SRC_PATTERN3D || srctype == MCX_SRC_LINE || srctype == MCX_SRC_SLIT) {
+        ncorner = 2;
+    } else if (srctype == MCX_SRC_FOURIERX || srctype == MCX_SRC_FOURIERX2D) {
+        radius = sqrtf(p1.x * p1.x + p1.y * p1.y + p1.z * p1.z) + fabsf(p1.w);
+    } else if (srctype == MCX_SRC_DISK || srctype == MCX_SRC_RING || srctype == MCX_SRC_GAUSSIAN || srctype == MCX_SRC_HYPERBOLOID_GAUSSIAN) {
+        radius = fabsf(p1.x);
+    }
+
+    for (i = 0; i < ncorner; i++) {
+        float x[3] = {pos.x + corner[i][0], pos.y + corner[i][1], pos.z + corner[i][2]};
+
+        for (j = 0; j < 3; j++) {
+            lo[j] = MIN(lo[j], x[j] - radius);
+            hi[j] = MAX(hi[j], x[j] + radius);
+        }
+    }
+}
+
+/**
+ * @brief Crop the zero padding of the media volume and remove the unused labels
+ *
+ * The volume is cropped to the bounding box of its non-background voxels, grown to
+ * include the sources and detectors and then by MCX_COMPACT_MARGIN voxels, so that
+ * photons still escape through background voxels. The sources and detectors are moved
+ * to the cropped grid; cfg->fulldim and cfg->compactoffset record the input grid, in
+ * which mcx_save_outputs embeds the volumetric outputs. The labels of a label volume are
+ * then renumbered densely and the unused rows of cfg->prop are removed.
+ *
+ * Only standalone simulations are compacted, except those saving detected photons,
+ * trajectories or replay outputs, as their records refer to the grid and the labels.
+ *
+ * @param[in,out] cfg: simulation configuration
+ */
+
+static void mcx_compactdomain(Config* cfg) {
+    unsigned int dim[3] = {cfg->dim.x, cfg->dim.y, cfg->dim.z}, bbox0[3], bbox1[3], offset[3], cropdim[3], i;
+    size_t dimxyz = (size_t)dim[0] * dim[1] * dim[2];
+    float lo[3], hi[3];
+
+    if (!cfg->iscompact || cfg->vol == NULL || cfg->parentid != mpStandalone || cfg->issavedet || cfg->seed == SEED_FROM_FILE
+            || (cfg->debuglevel & (MCX_DEBUG_MOVE | MCX_DEBUG_MOVE_ONLY)) || cfg->isdumpjson || cfg->isdumpmask
+            || cfg->mediabyte == MEDIA_2LABEL_SPLIT || cfg->mediabyte == MEDIA_ASGN_F2H || cfg->steps.x < 0.f) {
+        return;
+    }
+
+    if (mcx_compact_bbox(cfg->vol, dim, bbox0, bbox1)) {
+        for (i = 0; i < 3; i++) {
+            lo[i] = bbox0[i];
+            hi[i] = bbox1[i];
+        }
+
+        mcx_compact_addsrc(lo, hi, cfg->srctype, cfg->srcpos, cfg->srcparam1, cfg->srcparam2);
+
+        for (i = 0; i < cfg->extrasrclen; i++) {
+            mcx_compact_addsrc(lo, hi, cfg->srctype, cfg->srcdata[i].srcpos, cfg->srcdata[i].srcparam1, cfg->srcdata[i].srcparam2);
+        }
+
+        for (i = 0; i < cfg->detnum; i++) {
+            float4 det = cfg->detpos[i];
+
+            lo[0] = MIN(lo[0], det.x - det.w);
+            lo[1] = MIN(lo[1], det.y - det.w);
+            lo[2] = MIN(lo[2], det.z - det.w);
+            hi[0] = MAX(hi[0], det.x + det.w);
+            hi[1] = MAX(hi[1], det.y + det.w);
+            hi[2] = MAX(hi[2], det.z + det.w);
+        }
+
+        for (i = 0; i < 3; i++) {
+            int start = MAX((int)floorf(MAX(lo[i], -1.f)) - MCX_COMPACT_MARGIN, 0);
+            int end = MIN((int)floorf(MIN(hi[i], (float)dim[i])) + MCX_COMPACT_MARGIN, (int)dim[i] - 1);
+
+            /** cyclic and mirror boundaries act on the faces of the domain, such axes are not cropped */
+            if (cfg->bc[i] == 'c' || cfg->bc[i] == 'm' || cfg->bc[i + 3] == 'c' || cfg->bc[i + 3] == 'm') {
+                start = 0;
+                end = dim[i] - 1;
+            }
+
+            offset[i] = start;
+            cropdim[i] = end - start + 1;
+        }
+
+        if ((double)cropdim[0] * cropdim[1] * cropdim[2] <= dimxyz * (1.0 - MCX_COMPACT_MINSAVING)) {
+            unsigned int* newvol = mcx_compact_crop(cfg->vol, dim, offset, cropdim);
+
+            if (newvol == NULL) {
+                MCX_ERROR(-7, "can not allocate memory");
+            }
+
+            free(cfg->vol);
+            cfg->vol = newvol;
+
+            /** a volume that was cropped before, such as one restored from a snapshot, keeps its input grid */
+            if (cfg->fulldim.x == 0) {
+                cfg->fulldim = cfg->dim;
+            }
+
+            cfg->compactoffset.x += offset[0];
+            cfg->compactoffset.y += offset[1];
+            cfg->compactoffset.z += offset[2];
+            cfg->dim.x = cropdim[0];
+            cfg->dim.y = cropdim[1];
+            cfg->dim.z = cropdim[2];
+            dimxyz = (size_t)cropdim[0] * cropdim[1] * cropdim[2];
+
+            cfg->srcpos.x -= offset[0];
+            cfg->srcpos.y -= offset[1];
+            cfg->srcpos.z -= offset[2];
+
+            for (i = 0; i < cfg->extrasrclen; i++) {
+                cfg->srcdata[i].srcpos.x -= offset[0];
+                cfg->srcdata[i].srcpos.y -= offset[1];
+                cfg->srcdata[i].srcpos.z -= offset[2];
+            }
+
+            for (i = 0; i < cfg->detnum; i++) {
+                cfg->detpos[i].x -= offset[0];
+                cfg->detpos[i].y -= offset[1];
+                cfg->detpos[i].z -= offset[2];
+            }
+        }
+    }
+
+    /** the properties of polarized media are derived from cfg->polprop, their labels are kept */
+    if (cfg->mediabyte <= 4 && cfg->polmedianum == 0 && cfg->medianum > 1) {
+        unsigned int* labelmap = (unsigned int*)malloc(cfg->medianum * sizeof(unsigned int));
+        unsigned int count = mcx_compact_labels(cfg->vol, dimxyz, cfg->medianum, labelmap);
+
+        /** labelmap[i] >= i, the rows can be moved in place */
+        for (i = 0; i < count; i++) {
+            cfg->prop[i] = cfg->prop[labelmap[i]];
+        }
+
+        cfg->medianum = count;
+        free(labelmap);
+    }
+}
+
+/**
+ * @brief Expand the voxel sizes of an anisotropic or non-uniform grid to per-axis tables
+ *
+ * A grid made of identical cubic voxels is left unchanged. Otherwise, cfg->dx/dy/dz are
+ * expanded to store the edge lengths (in mm) of all voxels along each axis, and
+ * cfg->steps.x/y/z are set to -2 to mark the non-uniform grid. An axis without a
+ * given size uses its Domain.Step value, or cfg->unitinmm if it is not set.
+ *
+ * @param[in,out] cfg: simulation configuration
+ */
+
+static void mcx_prepgrid(Config* cfg) {
+    float* step[3] = {&(cfg->steps.x), &(cfg->steps.y), &(cfg->steps.z)};
+    float** table[3] = {&(cfg->dx), &(cfg->dy), &(cfg->dz)};
+    unsigned int len[3] = {cfg->dim.x, cfg->dim.y, cfg->dim.z}, i, j;
+
+    if (cfg->steps.x > 0.f && cfg->steps.x == cfg->steps.y && cfg->steps.y == cfg->steps.z) {
+        return;
+    }
+
+    if (cfg->mediabyte == MEDIA_2LABEL_SPLIT) {
+        MCX_ERROR(-4, "the svmc media format does not support anisotropic or non-uniform voxels");
+    }
+
+    for (i = 0; i < 3; i++) {
+        if (*step[i] != -2.f) {
+            float edge = (*step[i] == -1.f) ? (*table[i])[0] : ((*step[i] > 0.f && *step[i] != 1.f) ? *step[i] : cfg->unitinmm);
+
+            free(*table[i]);
+            *table[i] = (float*)malloc(sizeof(float) * len[i]);
+
+            for (j = 0; j < len[i]; j++) {
+                (*table[i])[j] = edge;
+            }
+
+            *step[i] = -2.f;
+        }
+
+        for (j = 0; j < len[i]; j++) {
+            if (!((*table[i])[j] > 0.f)) {
+                MCX_ERROR(-4, "the voxel sizes in Domain.VoxelSize must be positive");
+            }
+        }
+    }
+}
+
 /**
  * @brief Preprocess user input and prepare the cfg data structure
  *
@@ -1493,6 +2268,37 @@ void mcx_preprocess(Config* cfg) {
         cfg->issavedet = 0;
     }
 
+    mcx_labelformat(cfg);
+
+    /**
+     * In the sharded mode, this run only simulates the k-th of N near-equal slices of the photons,
+     * using an RNG seed derived from the user seed and k so that shards never share a random sequence
+     */
+    if (cfg->shardnum > 0) {
+        size_t totalphoton = cfg->nphoton;
+        unsigned int hash = (unsigned int)cfg->seed + 0x9E3779B9u * (unsigned int)cfg->shardid;
+
+        if (cfg->seed == SEED_FROM_FILE) {
+            MCX_ERROR(-6, "photon replay can not be sharded");
+        }
+
+        cfg->nphoton = totalphoton / cfg->shardnum + ((size_t)(cfg->shardid - 1) < totalphoton % cfg->shardnum);
+
+        if (cfg->nphoton == 0) {
+            MCX_ERROR(-6, "the shard number exceeds the total photon number");
+        }
+
+        hash = (hash ^ (hash >> 16)) * 0x85EBCA6Bu; /* murmur3 finalizer */
+        hash = (hash ^ (hash >> 13)) * 0xC2B2AE35u;
+        hash ^= hash >> 16;
+        cfg->seed = (int)((hash & 0x7FFFFFFF) | 1);
+    }
+
+    // step sampling and quantization work on the positions grouped by photon
+    if (cfg->trajstep > 1 || cfg->trajquant > 0.f) {
+        cfg->istrajsort = 1;
+    }
+
     // if neither trajectory or polarization is enabled, disable istrajstokes flag
     if (!(cfg->debuglevel & (MCX_DEBUG_MOVE | MCX_DEBUG_MOVE_ONLY)) || !((cfg->mediabyte <= 4) && (cfg->polmedianum > 0))) {
         cfg->istrajstokes = 0;
@@ -1549,14 +2355,19 @@ void mcx_preprocess(Config* cfg) {
         MCX_ERROR(-4, "the 'srcpattern' field can not be empty when your 'srctype' is 'pattern'");
     }
 
-    if (cfg->steps.x != 1.f && cfg->unitinmm == 1.f) {
+    /** a non-uniform grid keeps cfg->unitinmm as the reference length, cfg->steps stores the -2 flags */
+    mcx_prepgrid(cfg);
+
+    if (cfg->steps.x > 0.f && cfg->steps.x != 1.f && cfg->unitinmm == 1.f) {
         cfg->unitinmm = cfg->steps.x;
     }
 
     if (cfg->unitinmm != 1.f) {
-        cfg->steps.x = cfg->unitinmm;
-        cfg->steps.y = cfg->unitinmm;
-        cfg->steps.z = cfg->unitinmm;
+        if (cfg->steps.x > 0.f) {
+            cfg->steps.x = cfg->unitinmm;
+            cfg->steps.y = cfg->unitinmm;
+            cfg->steps.z = cfg->unitinmm;
+        }
 
         for (int i = 1; i < cfg->medianum; i++) {
             cfg->prop[i].mus *= cfg->unitinmm;
@@ -1578,6 +2389,109 @@ void mcx_preprocess(Config* cfg) {
         cfg->isrowmajor = 0;
     }
 
+    /** the DCS g1 is computed from the detector ID, partial path and momentum transfer of the detected photons */
+    if (cfg->dcsmodel != MCX_DCS_NONE) {
+        if (cfg->dcsmodel < 0 || cfg->dcsmodel > MCX_DCS_RANDOMFLOW) {
+            MCX_ERROR(-4, "unsupported DCS displacement model");
+        }
+
+        if (cfg->detnum == 0 || cfg->mediabyte >= 100) {
+            MCX_ERROR(-4, "DCS g1 requires detectors and a label-based volume");
+        }
+
+        if (cfg->dcsdisp <= 0.f) {
+            cfg->dcsdisp = MCX_DCS_DISP;
+        }
+
+        if (cfg->dcstau == NULL) {
+            cfg->dcsntau = MCX_DCS_NTAU;
+            cfg->dcstau = mcx_dcs_taulist(cfg->dcsntau);
+        }
+
+        cfg->issavedet = 1;
+        cfg->ismomentum = 1;
+        cfg->savedetflag = SET_SAVE_DETID(cfg->savedetflag);
+        cfg->savedetflag = SET_SAVE_PPATH(cfg->savedetflag);
+    }
+
+    /** outside of the replay mode, -O R tallies the forward FD fluence, one output frame per modulation frequency in place of the time gates */
+    if (cfg->outputtype == otRF && cfg->seed != SEED_FROM_FILE) {
+        unsigned int i;
+
+        if (cfg->rffreqnum == 0) {
+            if (cfg->omega <= 0.f) {
+                MCX_ERROR(-4, "forward RF output requires the modulation frequencies, set Optode.Source.Frequency or --rffreq");
+            }
+
+            cfg->rffreqnum = 1;
+            cfg->rffreq = (float*)malloc(sizeof(float));
+            cfg->rffreq[0] = cfg->omega / TWO_PI;
+        }
+
+        for (i = 0; i < cfg->rffreqnum; i++) {
+            if (cfg->rffreq[i] < 0.f) {
+                MCX_ERROR(-4, "modulation frequencies can not be negative");
+            }
+        }
+
+        if (cfg->issaveref || ABS(cfg->respin) > 1 || ((cfg->srctype == MCX_SRC_PATTERN || cfg->srctype == MCX_SRC_PATTERN3D) && cfg->srcnum > 1)) {
+            MCX_ERROR(-4, "forward RF output does not support diffuse reflectance, repetitions or multiple source patterns");
+        }
+
+        cfg->omega = TWO_PI * cfg->rffreq[0];
+        cfg->tstep = (cfg->tend - cfg->tstart) / cfg->rffreqnum;
+        cfg->maxgate = cfg->rffreqnum;
+    }
+
+    /** the biased launch mixes the source angular distribution with cones toward the target detectors; the mixture density must be positive wherever the source density is */
+    if (cfg->biasprob > 0.f) {
+        unsigned int i;
+
+        if (cfg->biasprob >= 1.f) {
+            MCX_ERROR(-4, "the biased launch probability Optode.Bias.Prob must be between 0 and 1");
+        }
+
+        if (cfg->srctype != MCX_SRC_ISOTROPIC && cfg->srctype != MCX_SRC_ARCSINE) {
+            MCX_ERROR(-4, "the biased launch only supports isotropic and arcsine sources");
+        }
+
+        if (cfg->detnum == 0 || cfg->nangle || cfg->seed == SEED_FROM_FILE || cfg->dim.x == 1 || cfg->dim.y == 1 || cfg->dim.z == 1) {
+            MCX_ERROR(-4, "the biased launch requires detectors and a 3D domain, and does not support replay or Optode.Source.AngleInverseCDF");
+        }
+
+        if (cfg->biasangle <= 0.f) {
+            cfg->biasangle = ONE_PI / 6.f;
+        }
+
+        if (cfg->biasangle > ONE_PI) {
+            MCX_ERROR(-4, "the biased launch half-angle Optode.Bias.Angle can not exceed pi");
+        }
+
+        if (cfg->biasdet == NULL || cfg->biasdetnum == 0) {
+            if (cfg->biasdet) {
+                free(cfg->biasdet);
+            }
+
+            cfg->biasdetnum = cfg->detnum;
+            cfg->biasdet = (unsigned int*)malloc(cfg->biasdetnum * sizeof(unsigned int));
+
+            for (i = 0; i < cfg->biasdetnum; i++) {
+                cfg->biasdet[i] = i + 1;
+            }
+        }
+
+        for (i = 0; i < cfg->biasdetnum; i++) {
+            if (cfg->biasdet[i] < 1 || cfg->biasdet[i] > cfg->detnum) {
+                MCX_ERROR(-4, "the biased launch target detector index exceeds the detector number");
+            }
+        }
+
+        /** the launch weight correction is recorded in the w0 column so that the detected photon weights remain unbiased */
+        if (cfg->issavedet) {
+            cfg->savedetflag = SET_SAVE_W0(cfg->savedetflag);
+        }
+    }
+
     if (cfg->issavedet && cfg->detnum == 0 && isbcdet == 0) {
         cfg->issavedet = 0;
     }
@@ -1653,7 +2567,38 @@ void mcx_preprocess(Config* cfg) {
             if (cfg->medianum <= maxlabel) {
                 MCX_ERROR(-4, "input media optical properties are less than the labels in the volume");
             }
-        } else if (cfg->mediabyte == MEDIA_2LABEL_SPLIT) {
+
+            /** the split-voxel volume is created in the raw 8-byte layout, and decoded as a loaded svmc volume below */
+            if (cfg->issvmc) {
+                unsigned int dim[3] = {cfg->dim.x, cfg->dim.y, cfg->dim.z};
+                unsigned char* svmcvol;
+
+                if (maxlabel > MCX_SVMC_MAXLABEL) {
+                    MCX_ERROR(-4, "the svmc media format supports up to 255 labels");
+                }
+
+                if (cfg->mediabits || cfg->polmedianum || cfg->steps.x < 0.f) {
+                    MCX_ERROR(-4, "the svmc media format does not support packed labels, polarized media or anisotropic voxels");
+                }
+
+                svmcvol = mcx_svmc_encode(cfg->vol, dim, 1, 1);
+
+                if (svmcvol == NULL) {
+                    MCX_ERROR(-7, "can not allocate memory");
+                }
+
+                free(cfg->vol);
+                cfg->vol = (unsigned int*)svmcvol;
+                cfg->mediabyte = MEDIA_2LABEL_SPLIT;
+            }
+
+            if (cfg->mixfactor > 1) {
+                mcx_mixlabeldomain(cfg, maxlabel);
+                dimxyz = cfg->dim.x * cfg->dim.y * cfg->dim.z;
+            }
+        }
+
+        if (cfg->mediabyte == MEDIA_2LABEL_SPLIT) {
             unsigned char* val = (unsigned char*)(cfg->vol);
             unsigned int* newvol = (unsigned int*)malloc(dimxyz << 3);
             union {
@@ -1682,6 +2627,8 @@ void mcx_preprocess(Config* cfg) {
         }
     }
 
+    mcx_compactdomain(cfg);
+
     // for all point sources, precompute launch voxel index and media value and store those in srcparam2.z/.w internally
     if (cfg->srctype <= MCX_SRC_CONE || cfg->srctype == MCX_SRC_ARCSINE || cfg->srctype == MCX_SRC_ZGAUSSIAN) {
         if (cfg->srcpos.x < 0.f || cfg->srcpos.y < 0.f || cfg->srcpos.z < 0.f || cfg->srcpos.x >= cfg->dim.x || cfg->srcpos.y >= cfg->dim.y || cfg->srcpos.z >= cfg->dim.z) {
@@ -1711,6 +2658,142 @@ void mcx_preprocess(Config* cfg) {
         mcx_maskdet(cfg);
     }
 
+    /**
+     * Packed label volumes (label4/label8) must only contain labels that fit in the packed width,
+     * the detector mask bit is stored separately on the GPU
+     */
+    if (cfg->mediabits && cfg->vol) {
+        size_t i, dimxyz = (size_t)cfg->dim.x * cfg->dim.y * cfg->dim.z;
+
+        if (cfg->mediabits != 4 && cfg->mediabits != 8) {
+            MCX_ERROR(-4, "mediabits must be 0, 4 or 8");
+        }
+
+        if (cfg->mediabyte > 4) {
+            MCX_ERROR(-4, "packed labels (label4/label8) require a label-based media format");
+        }
+
+        if (cfg->isbrick) {
+            MCX_ERROR(-4, "packed labels (label4/label8) can not be combined with brick-compressed media");
+        }
+
+        for (i = 0; i < dimxyz; i++) {
+            if ((cfg->vol[i] & MED_MASK) >> cfg->mediabits) {
+                MCX_ERROR(-4, "medium index exceeds the range of the packed label format");
+            }
+        }
+    }
+
+    /**
+     * The media properties share the 4000-entry constant memory with the detectors and the extra
+     * sources; larger property tables are read from global memory, keeping a hot set of the
+     * lowest labels in the constant memory
+     */
+    if (cfg->medianum + cfg->detnum + (cfg->extrasrclen << 2) > MAX_PROP_AND_DETECTORS) {
+        cfg->isglobalprop = 1;
+    }
+
+    if (cfg->isglobalprop) {
+        if (cfg->mediabyte >= 100) {
+            MCX_ERROR(-4, "the global-memory property table only supports label-based media formats");
+        }
+
+        if (cfg->detnum + (cfg->extrasrclen << 2) + 1 > MAX_PROP_AND_DETECTORS) {
+            MCX_ERROR(-4, "detector number plus additional sources exceeds the maximum total (4000)");
+        }
+    }
+
+    /**
+     * When requested, the final media volume (including the detector mask) is compressed into 8x8x8
+     * bricks and only the compressed copy is uploaded to the GPU; the dense volume stays on the host
+     */
+    if (cfg->isbrick && cfg->vol) {
+        unsigned int count[3];
+
+        if (cfg->mediabyte == MEDIA_2LABEL_SPLIT || cfg->mediabyte == MEDIA_ASGN_F2H) {
+            MCX_ERROR(-4, "brick-compressed media does not support the svmc and asgn_float media formats");
+        }
+
+        if (cfg->brickvol) {
+            free(cfg->brickvol);
+        }
+
+        cfg->brickvol = mcx_brick_encode(cfg->vol, cfg->dim.x, cfg->dim.y, cfg->dim.z, &cfg->bricklen, count);
+
+        if (cfg->brickvol == NULL) {
+            MCX_ERROR(-4, "the media volume is too large to be brick-compressed");
+        }
+
+        MCX_FPRINTF(cfg->flog, "brick-compressed media: %u uniform, %u palette, %u dense bricks, %.1f MB -> %.1f MB\n",
+                    count[MCX_BRICK_UNIFORM], count[MCX_BRICK_PALETTE], count[MCX_BRICK_DENSE],
+                    (double)cfg->dim.x * cfg->dim.y * cfg->dim.z * sizeof(unsigned int) / 1048576.0, (double)cfg->bricklen * sizeof(unsigned int) / 1048576.0);
+    }
+
+    /**
+     * When requested, correlated photon-sharing patterns are replaced by a truncated orthogonal
+     * basis; only the basis is simulated and the outputs of each pattern are reconstructed afterwards
+     */
+    if (cfg->patternbasis) {
+        free(cfg->patternbasis);
+        free(cfg->patterncoef);
+        cfg->patternbasis = NULL;
+        cfg->patterncoef = NULL;
+    }
+
+    cfg->patternrank = 0;
+
+    if (cfg->patterntol > 0.f && cfg->srcnum > 1 && cfg->srcpattern && (cfg->srctype == MCX_SRC_PATTERN || cfg->srctype == MCX_SRC_PATTERN3D)) {
+        size_t pixelnum = (cfg->srctype == MCX_SRC_PATTERN) ? (size_t)cfg->srcparam1.w * (size_t)cfg->srcparam2.w :
+                          (size_t)cfg->srcparam1.x * (size_t)cfg->srcparam1.y * (size_t)cfg->srcparam1.z;
+        float err = 0.f;
+
+        if (cfg->seed == SEED_FROM_FILE) {
+            MCX_ERROR(-4, "the low-rank pattern basis can not be used in photon replay");
+        }
+
+        cfg->patternrank = mcx_lowrank_basis(cfg->srcpattern, pixelnum, cfg->srcnum, cfg->patterntol, &cfg->patternbasis, &cfg->patterncoef, &err);
+
+        if (cfg->patternrank) {
+            MCX_FPRINTF(cfg->flog, "low-rank pattern basis: simulating %u basis patterns for %u patterns, relative error %e\n", cfg->patternrank, cfg->srcnum, err);
+        } else {
+            MCX_FPRINTF(cfg->flog, "low-rank pattern basis: no basis with fewer patterns meets the tolerance, simulating all %u patterns\n", cfg->srcnum);
+        }
+    }
+
+    /**
+     * When requested, the media volume is downsampled into a pyramid; the coarsest level is used
+     * by a fast pre-run that locates the region tallied by the full-resolution simulation
+     */
+    if (cfg->pyramidvol) {
+        free(cfg->pyramidvol);
+        cfg->pyramidvol = NULL;
+    }
+
+    if (cfg->pyramid > 0 && cfg->vol) {
+        unsigned int dim[3] = {cfg->dim.x, cfg->dim.y, cfg->dim.z}, coarsedim[3];
+
+        if (cfg->pyramid > MCX_PYRAMID_MAXLEVEL) {
+            MCX_ERROR(-4, "the pyramid level must be between 0 and 4");
+        }
+
+        if (cfg->seed == SEED_FROM_FILE) {
+            MCX_ERROR(-4, "the multi-resolution pyramid can not be used in photon replay");
+        }
+
+        if (cfg->mediabyte == MEDIA_2LABEL_SPLIT || cfg->mediabyte == MEDIA_ASGN_F2H || cfg->steps.x < 0.f) {
+            MCX_ERROR(-4, "the multi-resolution pyramid does not support the svmc and asgn_float media formats or non-uniform grids");
+        }
+
+        if (cfg->extrasrclen || cfg->srctype == MCX_SRC_PATTERN3D) {
+            MCX_ERROR(-4, "the multi-resolution pyramid does not support multiple sources or 3D pattern sources");
+        }
+
+        cfg->pyramidvol = mcx_pyramid_build(cfg->vol, dim, cfg->mediabyte, cfg->pyramid, coarsedim);
+        cfg->pyramiddim.x = coarsedim[0];
+        cfg->pyramiddim.y = coarsedim[1];
+        cfg->pyramiddim.z = coarsedim[2];
+    }
+
     for (int i = 0; i < MAX_DEVICE; i++)
         if (cfg->deviceid[i] == '0') {
             cfg->deviceid[i] = '\0';
@@ -1765,6 +2848,21 @@ void mcx_preprocess(Config* cfg) {
 
         cfg->savedetflag = 0x5;
     }
+
+    /**
+     * Per-medium detected photon data are stored in the shared memory, which can not hold
+     * a record for each medium when the property table exceeds the constant memory
+     */
+    if (cfg->medianum > MAX_PROP_AND_DETECTORS && (SAVE_NSCAT(cfg->savedetflag) || SAVE_PPATH(cfg->savedetflag) || SAVE_MOM(cfg->savedetflag))) {
+        if (cfg->issaveref > 1) {
+            MCX_ERROR(-4, "issaveref greater than 1 does not support more than 4000 media");
+        }
+
+        MCX_FPRINTF(cfg->flog, "per-medium detected photon data (savedetflag s/p/m) are disabled for more than %d media\n", MAX_PROP_AND_DETECTORS);
+        cfg->savedetflag = UNSET_SAVE_NSCAT(cfg->savedetflag);
+        cfg->savedetflag = UNSET_SAVE_PPATH(cfg->savedetflag);
+        cfg->savedetflag = UNSET_SAVE_MOM(cfg->savedetflag);
+    }
 }
 
 /**
@@ -1879,6 +2977,17 @@ void mcx_prep_polarized(Config* cfg) {
  */
 
 void mcx_prepdomain(char* filename, Config* cfg) {
+    /** the decoded mua of the previous domain is no longer valid */
+    if (cfg->muavol) {
+        free(cfg->muavol);
+        cfg->muavol = NULL;
+    }
+
+    if (cfg->pyramidvol) {
+        free(cfg->pyramidvol);
+        cfg->pyramidvol = NULL;
+    }
+
     if (filename[0] || cfg->vol) {
         if (cfg->vol == NULL) {
             mcx_loadvolume(filename, cfg, 0);
@@ -2052,10 +3161,6 @@ void mcx_loadconfig(FILE* in, Config* cfg) {
     MCX_ASSERT(fscanf(in, "%f %u %u %u", &(cfg->steps.z), &(cfg->dim.z), &(cfg->crop0.z), &(cfg->crop1.z)) == 4);
     comm = fgets(comment, MAX_PATH_LENGTH, in);
 
-    if (cfg->steps.x != cfg->steps.y || cfg->steps.y != cfg->steps.z) {
-        MCX_ERROR(-9, "MCX currently does not support anisotropic voxels");
-    }
-
     if (cfg->steps.x != 1.f && cfg->unitinmm == 1.f) {
         cfg->unitinmm = cfg->steps.x;
     }
@@ -2126,10 +3231,6 @@ void mcx_loadconfig(FILE* in, Config* cfg) {
         fprintf(stdout, "%d %f\n", cfg->detnum, cfg->detradius);
     }
 
-    if (cfg->medianum + cfg->detnum + (cfg->extrasrclen << 2) > MAX_PROP_AND_DETECTORS) {
-        MCX_ERROR(-4, "input media types plus detector number plus additional sources exceeds the maximum total (4000)");
-    }
-
     cfg->detpos = (float4*)malloc(sizeof(float4) * cfg->detnum);
 
     for (i = 0; i < cfg->detnum; i++) {
@@ -2239,6 +3340,40 @@ void mcx_loadconfig(FILE* in, Config* cfg) {
     }
 }
 
+/**
+ * @brief Read a 2-D JData annotated array stored in a binary buffer into a float matrix
+ *
+ * Such arrays are created by the BJData reader and the fast JSON parser for
+ * large matrices, such as the media or detector lists.
+ *
+ * @param[in] obj: the annotated object with _ArraySize_ and _ArrayData_
+ * @param[out] dims: the numbers of rows and columns
+ * @return the row-major matrix (must be freed by the caller), or NULL if obj is not such an array
+ */
+
+static float* mcx_jdatamatrix(cJSON* obj, uint dims[2]) {
+    cJSON* size = cJSON_GetObjectItem(obj, "_ArraySize_");
+    cJSON* data = cJSON_GetObjectItem(obj, "_ArrayData_");
+    float* mat;
+    size_t len;
+
+    if (!mcx_bjd_isbuffer(data) || cJSON_GetArraySize(size) != 2) {
+        return NULL;
+    }
+
+    dims[0] = size->child->valueint;
+    dims[1] = size->child->next->valueint;
+    len = (size_t)dims[0] * dims[1];
+    mat = (float*)malloc(len * sizeof(float) + 1);
+
+    if (mcx_bjd_copy(data, mat, len, 'd') < len) {
+        free(mat);
+        return NULL;
+    }
+
+    return mat;
+}
+
 /**
  * @brief Load user inputs from a .json input file
  *
@@ -2294,9 +3429,27 @@ int mcx_loadjson(cJSON* root, Config* cfg) {
             cfg->unitinmm = FIND_JSON_KEY("LengthUnit", "Domain.LengthUnit", Domain, 1.f, valuedouble);
         }
 
+        cfg->isbrick = FIND_JSON_KEY("MediaBrick", "Domain.MediaBrick", Domain, cfg->isbrick, valueint);
+        cfg->issvmc = FIND_JSON_KEY("SVMC", "Domain.SVMC", Domain, cfg->issvmc, valueint);
+        cfg->mixfactor = FIND_JSON_KEY("MixFactor", "Domain.MixFactor", Domain, cfg->mixfactor, valueint);
+
         meds = FIND_JSON_OBJ("Media", "Domain.Media", Domain);
 
-        if (meds) {
+        if (meds && cJSON_GetObjectItem(meds, "_ArraySize_")) {
+            uint dims[2];
+            float* mat = mcx_jdatamatrix(meds, dims);
+
+            if (mat == NULL || dims[1] != 4) {
+                MCX_ERROR(-1, "Domain.Media must be an Nx4 array of [mua, mus, g, n]");
+            }
+
+            if (cfg->prop) {
+                free(cfg->prop);
+            }
+
+            cfg->medianum = dims[0];
+            cfg->prop = (Medium*)mat;
+        } else if (meds) {
             cJSON* med = meds->child;
 
             if (med) {
@@ -2453,10 +3606,6 @@ int mcx_loadjson(cJSON* root, Config* cfg) {
             }
         }
 
-        if (cfg->steps.x != cfg->steps.y || cfg->steps.y != cfg->steps.z) {
-            MCX_ERROR(-9, "MCX currently does not support anisotropic voxels");
-        }
-
         if (cfg->steps.x != 1.f && cfg->unitinmm == 1.f) {
             cfg->unitinmm = cfg->steps.x;
         }
@@ -2491,7 +3640,9 @@ int mcx_loadjson(cJSON* root, Config* cfg) {
         val = FIND_JSON_OBJ("VoxelSize", "Domain.VoxelSize", Domain);
 
         if (val) {
-            val = FIND_JSON_OBJ("Dx", "Domain.VoxelSize.Dx", Domain);
+            cJSON* voxelsize = val;
+
+            val = FIND_JSON_OBJ("Dx", "Domain.VoxelSize.Dx", voxelsize);
 
             if (cJSON_GetArraySize(val) >= 1) {
                 int len = cJSON_GetArraySize(val);
@@ -2513,7 +3664,7 @@ int mcx_loadjson(cJSON* root, Config* cfg) {
                 }
             }
 
-            val = FIND_JSON_OBJ("Dy", "Domain.VoxelSize.Dy", Domain);
+            val = FIND_JSON_OBJ("Dy", "Domain.VoxelSize.Dy", voxelsize);
 
             if (cJSON_GetArraySize(val) >= 1) {
                 int len = cJSON_GetArraySize(val);
@@ -2535,7 +3686,7 @@ int mcx_loadjson(cJSON* root, Config* cfg) {
                 }
             }
 
-            val = FIND_JSON_OBJ("Dz", "Domain.VoxelSize.Dz", Domain);
+            val = FIND_JSON_OBJ("Dz", "Domain.VoxelSize.Dz", voxelsize);
 
             if (cJSON_GetArraySize(val) >= 1) {
                 int len = cJSON_GetArraySize(val);
@@ -2874,8 +4025,26 @@ int mcx_loadjson(cJSON* root, Config* cfg) {
             }
 
             if (FIND_JSON_OBJ("Frequency", "Optode.Source.Frequency", src)) {
-                cfg->omega = FIND_JSON_KEY("Frequency", "Optode.Source.Frequency", src, 0.f, valuedouble);
-                cfg->omega *= TWO_PI;
+                cJSON* freq = FIND_JSON_OBJ("Frequency", "Optode.Source.Frequency", src);
+
+                /** an array of frequencies sets one output frame per frequency for the forward FD output */
+                if (cJSON_IsArray(freq) && cJSON_GetArraySize(freq) > 0) {
+                    if (cfg->rffreq) {
+                        free(cfg->rffreq);
+                    }
+
+                    cfg->rffreqnum = cJSON_GetArraySize(freq);
+                    cfg->rffreq = (float*)malloc(cfg->rffreqnum * sizeof(float));
+
+                    for (i = 0; i < (int)cfg->rffreqnum; i++) {
+                        cfg->rffreq[i] = cJSON_GetArrayItem(freq, i)->valuedouble;
+                    }
+
+                    cfg->omega = TWO_PI * cfg->rffreq[0];
+                } else {
+                    cfg->omega = FIND_JSON_KEY("Frequency", "Optode.Source.Frequency", src, 0.f, valuedouble);
+                    cfg->omega *= TWO_PI;
+                }
             }
 
             if (FIND_JSON_OBJ("WaveLength", "Optode.Source.WaveLength", src)) {
@@ -2886,6 +4055,10 @@ int mcx_loadjson(cJSON* root, Config* cfg) {
                 cfg->srcnum = FIND_JSON_KEY("SrcNum", "Optode.Source.SrcNum", src, cfg->srcnum, valueint);
             }
 
+            if (FIND_JSON_OBJ("PatternTol", "Optode.Source.PatternTol", src)) {
+                cfg->patterntol = FIND_JSON_KEY("PatternTol", "Optode.Source.PatternTol", src, cfg->patterntol, valuedouble);
+            }
+
             if (FIND_JSON_OBJ("ID", "Optode.Source.ID", src)) {
                 cfg->srcid = FIND_JSON_KEY("ID", "Optode.Source.ID", src, cfg->srcid, valueint);
             }
@@ -2893,7 +4066,7 @@ int mcx_loadjson(cJSON* root, Config* cfg) {
             subitem = FIND_JSON_OBJ("Pattern", "Optode.Source.Pattern", src);
 
             if (subitem) {
-                if (FIND_JSON_OBJ("_ArrayZipData_", "Optode.Source.Pattern._ArrayZipData_", subitem)) {
+                if (FIND_JSON_OBJ("_ArrayZipData_", "Optode.Source.Pattern._ArrayZipData_", subitem) || FIND_JSON_OBJ("_ArrayData_", "Optode.Source.Pattern._ArrayData_", subitem)) {
                     int ndim;
                     uint dims[3] = {1, 1, 1};
                     char* type = NULL;
@@ -2923,7 +4096,17 @@ int mcx_loadjson(cJSON* root, Config* cfg) {
                     if (nx > 0 && ny > 0) {
                         cJSON* pat = FIND_JSON_OBJ("Data", "Optode.Source.Pattern.Data", subitem);
 
-                        if (pat && pat->child) {
+                        if (mcx_bjd_isbuffer(pat)) {
+                            if (cfg->srcpattern) {
+                                free(cfg->srcpattern);
+                            }
+
+                            cfg->srcpattern = (float*)calloc(nx * ny * nz * cfg->srcnum, sizeof(float));
+
+                            if (mcx_bjd_copy(pat, cfg->srcpattern, nx * ny * nz * cfg->srcnum, 'd') < (size_t)(nx * ny * nz * cfg->srcnum)) {
+                                MCX_ERROR(-1, "Incomplete pattern data");
+                            }
+                        } else if (pat && pat->child) {
                             int i;
                             pat = pat->child;
 
@@ -2985,7 +4168,25 @@ int mcx_loadjson(cJSON* root, Config* cfg) {
 
         dets = FIND_JSON_OBJ("Detector", "Optode.Detector", Optode);
 
-        if (dets) {
+        if (dets && cJSON_GetObjectItem(dets, "_ArraySize_")) {
+            uint dims[2];
+            float* mat = mcx_jdatamatrix(dets, dims);
+
+            if (mat == NULL || dims[1] != 4) {
+                MCX_ERROR(-1, "Optode.Detector must be an Nx4 array of [x, y, z, radius]");
+            }
+
+            cfg->detnum = dims[0];
+            cfg->detpos = (float4*)mat;
+
+            if (!cfg->issrcfrom0) {
+                for (i = 0; i < cfg->detnum; i++) {
+                    cfg->detpos[i].x--;
+                    cfg->detpos[i].y--;
+                    cfg->detpos[i].z--;  /*convert to C index*/
+                }
+            }
+        } else if (dets) {
             cJSON* det = dets->child;
 
             if (det) {
@@ -2996,7 +4197,10 @@ int mcx_loadjson(cJSON* root, Config* cfg) {
                     cJSON* pos = dets, *rad = NULL;
                     rad = FIND_JSON_OBJ("R", "Optode.Detector.R", det);
 
-                    if (cJSON_GetArraySize(det) == 2) {
+                    if (cJSON_IsArray(det)) {
+                        pos = det;
+                        rad = cJSON_GetArrayItem(det, 3);
+                    } else if (cJSON_GetArraySize(det) == 2) {
                         pos = FIND_JSON_OBJ("Pos", "Optode.Detector.Pos", det);
                     }
 
@@ -3024,10 +4228,70 @@ int mcx_loadjson(cJSON* root, Config* cfg) {
                 }
             }
         }
-    }
 
-    if (cfg->medianum + cfg->detnum + (cfg->extrasrclen << 2) > MAX_PROP_AND_DETECTORS) {
-        MCX_ERROR(-4, "input media types plus detector number plus additional sources exceeds the maximum total (4000)");
+        dets = FIND_JSON_OBJ("DetFilter", "Optode.DetFilter", Optode);
+
+        if (dets) {
+            DetFilter* filter = &(cfg->detfilter);
+
+            memset(filter, 0, sizeof(DetFilter));
+            subitem = FIND_JSON_OBJ("DetID", "Optode.DetFilter.DetID", dets);
+
+            if (subitem) {
+                cJSON* id = (cJSON_IsArray(subitem) ? subitem->child : subitem);
+
+                for (; id; id = (cJSON_IsArray(subitem) ? id->next : NULL)) {
+                    if (id->valueint < 1 || id->valueint > MAX_FILTER_DET) {
+                        MCX_ERROR(-1, "Optode.DetFilter.DetID must contain detector indices between 1 and 256");
+                    }
+
+                    filter->detmask[(id->valueint - 1) >> 5] |= 1u << ((id->valueint - 1) & 31);
+                    filter->isdetmask = 1;
+                }
+            }
+
+            subitem = FIND_JSON_OBJ("TimeWindow", "Optode.DetFilter.TimeWindow", dets);
+
+            if (subitem) {
+                if (cJSON_GetArraySize(subitem) != 2) {
+                    MCX_ERROR(-1, "Optode.DetFilter.TimeWindow must be a 2-element array [tmin,tmax] in s");
+                }
+
+                filter->tmin = subitem->child->valuedouble;
+                filter->tmax = subitem->child->next->valuedouble;
+            }
+
+            filter->minweight = FIND_JSON_KEY("MinWeight", "Optode.DetFilter.MinWeight", dets, 0.0, valuedouble);
+            filter->maxscat = FIND_JSON_KEY("MaxScatter", "Optode.DetFilter.MaxScatter", dets, 0, valueint);
+            filter->enabled = (filter->isdetmask || filter->tmax > filter->tmin || filter->minweight > 0.f || filter->maxscat > 0);
+        }
+
+        dets = FIND_JSON_OBJ("Bias", "Optode.Bias", Optode);
+
+        if (dets) {
+            cfg->biasprob = FIND_JSON_KEY("Prob", "Optode.Bias.Prob", dets, 0.0, valuedouble);
+            cfg->biasangle = FIND_JSON_KEY("Angle", "Optode.Bias.Angle", dets, 0.0, valuedouble);
+            subitem = FIND_JSON_OBJ("Det", "Optode.Bias.Det", dets);
+
+            if (subitem) {
+                cJSON* id = (cJSON_IsArray(subitem) ? subitem->child : subitem);
+
+                if (cfg->biasdet) {
+                    free(cfg->biasdet);
+                }
+
+                cfg->biasdetnum = (cJSON_IsArray(subitem) ? cJSON_GetArraySize(subitem) : 1);
+                cfg->biasdet = (unsigned int*)malloc(MAX(cfg->biasdetnum, 1) * sizeof(unsigned int));
+
+                for (i = 0; id; id = (cJSON_IsArray(subitem) ? id->next : NULL)) {
+                    if (id->valueint < 1) {
+                        MCX_ERROR(-1, "Optode.Bias.Det must contain 1-based detector indices");
+                    }
+
+                    cfg->biasdet[i++] = id->valueint;
+                }
+            }
+        }
     }
 
     if (Session) {
@@ -3045,6 +4309,10 @@ int mcx_loadjson(cJSON* root, Config* cfg) {
             cfg->maxdetphoton = FIND_JSON_KEY("MaxDetPhoton", "Session.MaxDetPhoton", Session, cfg->maxdetphoton, valuedouble);
         }
 
+        if (cfg->ishalfdet == 0) {
+            cfg->ishalfdet = FIND_JSON_KEY("HalfDetPhoton", "Session.HalfDetPhoton", Session, cfg->ishalfdet, valueint);
+        }
+
         if (cfg->session[0] == '\0') {
             strncpy(cfg->session, FIND_JSON_KEY("ID", "Session.ID", Session, "default", valuestring), MAX_SESSION_LENGTH);
         }
@@ -3053,6 +4321,55 @@ int mcx_loadjson(cJSON* root, Config* cfg) {
             strncpy(cfg->rootpath, FIND_JSON_KEY("RootPath", "Session.RootPath", Session, "", valuestring), MAX_PATH_LENGTH);
         }
 
+        if (cfg->cachedir[0] == '\0') {
+            strncpy(cfg->cachedir, FIND_JSON_KEY("CacheDir", "Session.CacheDir", Session, "", valuestring), MAX_PATH_LENGTH - 1);
+        }
+
+        if (cfg->cachesize == 0.f) {
+            cfg->cachesize = FIND_JSON_KEY("CacheSize", "Session.CacheSize", Session, 0.0, valuedouble);
+        }
+
+        if (cfg->pyramid == 0) {
+            cfg->pyramid = FIND_JSON_KEY("Pyramid", "Session.Pyramid", Session, cfg->pyramid, valueint);
+            cfg->pyramidtol = FIND_JSON_KEY("PyramidTol", "Session.PyramidTol", Session, cfg->pyramidtol, valuedouble);
+        }
+
+        if (cfg->iscompact == 1) {
+            cfg->iscompact = FIND_JSON_KEY("Compact", "Session.Compact", Session, cfg->iscompact, valueint);
+        }
+
+        if (cfg->dcsmodel == MCX_DCS_NONE) {
+            cJSON* model = FIND_JSON_OBJ("DCSModel", "Session.DCSModel", Session);
+
+            if (model) {
+                cfg->dcsmodel = cJSON_IsString(model) ? mcx_keylookup(model->valuestring, dcsmodel) : model->valueint;
+            }
+        }
+
+        if (cfg->dcsdisp == 0.f) {
+            cfg->dcsdisp = FIND_JSON_KEY("DCSDisp", "Session.DCSDisp", Session, cfg->dcsdisp, valuedouble);
+        }
+
+        cJSON* tau = FIND_JSON_OBJ("DCSTau", "Session.DCSTau", Session);
+
+        if (tau && cJSON_GetArraySize(tau) > 0) {
+            if (cfg->dcstau) {
+                free(cfg->dcstau);
+            }
+
+            cfg->dcsntau = cJSON_GetArraySize(tau);
+            cfg->dcstau = (float*)malloc(cfg->dcsntau * sizeof(float));
+            tau = tau->child;
+
+            for (i = 0; i < (int)cfg->dcsntau; i++, tau = tau->next) {
+                cfg->dcstau[i] = tau->valuedouble;
+
+                if (cfg->dcstau[i] < 0.f) {
+                    MCX_ERROR(-1, "Session.DCSTau must not contain negative correlation times");
+                }
+            }
+        }
+
         if (!flagset['B']) {
             char* bc = FIND_JSON_KEY("BCFlags", "Session.BCFlags", Session, NULL, valuestring);
 
@@ -3292,6 +4609,15 @@ void mcx_savejdata(char* filename, Config* cfg) {
     cJSON_AddBoolToObject(obj, "DoSaveSeed", cfg->issaveseed);
     cJSON_AddBoolToObject(obj, "DoAutoThread", cfg->autopilot);
     cJSON_AddBoolToObject(obj, "DoDCS", cfg->ismomentum);
+
+    if (cfg->dcsmodel > MCX_DCS_NONE && cfg->dcsmodel <= MCX_DCS_RANDOMFLOW) {
+        cJSON_AddStringToObject(obj, "DCSModel", dcsmodel[(int)cfg->dcsmodel]);
+        cJSON_AddNumberToObject(obj, "DCSDisp", cfg->dcsdisp);
+
+        if (cfg->dcstau) {
+            cJSON_AddItemToObject(obj, "DCSTau", cJSON_CreateFloatArray(cfg->dcstau, cfg->dcsntau));
+        }
+    }
     cJSON_AddBoolToObject(obj, "DoSpecular", cfg->isspecular);
 
     if (cfg->rootpath[0] != '\0') {
@@ -3311,6 +4637,15 @@ void mcx_savejdata(char* filename, Config* cfg) {
         cJSON_AddStringToObject(obj, "OutputType", outputtypestr);
     }
 
+    if (cfg->pyramid > 0) {
+        cJSON_AddNumberToObject(obj, "Pyramid", cfg->pyramid);
+        cJSON_AddNumberToObject(obj, "PyramidTol", cfg->pyramidtol);
+    }
+
+    if (cfg->iscompact == 0) {
+        cJSON_AddNumberToObject(obj, "Compact", cfg->iscompact);
+    }
+
     /* the "Forward" section */
     cJSON_AddItemToObject(root, "Forward", obj = cJSON_CreateObject());
     cJSON_AddNumberToObject(obj, "T0", cfg->tstart);
@@ -3320,14 +4655,38 @@ void mcx_savejdata(char* filename, Config* cfg) {
     /* the "Domain" section */
     cJSON_AddItemToObject(root, "Domain", obj = cJSON_CreateObject());
 
-    for (int i = 0; i < sizeof(mediaformatid) / sizeof(int); i++) {
-        if (cfg->mediabyte == mediaformatid[i]) {
-            cJSON_AddStringToObject(obj, "MediaFormat", mediaformat[i]);
-            break;
+    if (cfg->mediabits && cfg->mediabyte == 1) {
+        cJSON_AddStringToObject(obj, "MediaFormat", (cfg->mediabits == 4) ? "label4" : "label8");
+    } else {
+        for (int i = 0; i < sizeof(mediaformatid) / sizeof(int); i++) {
+            if (cfg->mediabyte == mediaformatid[i]) {
+                cJSON_AddStringToObject(obj, "MediaFormat", mediaformat[i]);
+                break;
+            }
         }
     }
 
     cJSON_AddNumberToObject(obj, "LengthUnit", cfg->unitinmm);
+
+    if (cfg->steps.x < 0.f) {
+        cJSON_AddItemToObject(obj, "VoxelSize", sub = cJSON_CreateObject());
+        cJSON_AddItemToObject(sub, "Dx", cJSON_CreateFloatArray(cfg->dx, cfg->dim.x));
+        cJSON_AddItemToObject(sub, "Dy", cJSON_CreateFloatArray(cfg->dy, cfg->dim.y));
+        cJSON_AddItemToObject(sub, "Dz", cJSON_CreateFloatArray(cfg->dz, cfg->dim.z));
+    }
+
+    if (cfg->isbrick) {
+        cJSON_AddBoolToObject(obj, "MediaBrick", cfg->isbrick);
+    }
+
+    if (cfg->issvmc && cfg->mediabyte != MEDIA_2LABEL_SPLIT) {
+        cJSON_AddBoolToObject(obj, "SVMC", cfg->issvmc);
+    }
+
+    if (cfg->mixfactor > 1 && cfg->mediabyte != MEDIA_2LABEL_MIX) {
+        cJSON_AddNumberToObject(obj, "MixFactor", cfg->mixfactor);
+    }
+
     cJSON_AddItemToObject(obj, "Media", sub = cJSON_CreateArray());
 
     for (int i = 0; i < cfg->medianum; i++) {
@@ -3355,6 +4714,16 @@ void mcx_savejdata(char* filename, Config* cfg) {
     cJSON_AddItemToObject(sub, "Param2", cJSON_CreateFloatArray(&(cfg->srcparam2.x), 4));
     cJSON_AddNumberToObject(sub, "SrcNum", cfg->srcnum);
 
+    if (cfg->rffreqnum > 1) {
+        cJSON_AddItemToObject(sub, "Frequency", cJSON_CreateFloatArray(cfg->rffreq, cfg->rffreqnum));
+    } else if (cfg->omega > 0.f) {
+        cJSON_AddNumberToObject(sub, "Frequency", cfg->omega / TWO_PI);
+    }
+
+    if (cfg->patterntol > 0.f) {
+        cJSON_AddNumberToObject(sub, "PatternTol", cfg->patterntol);
+    }
+
     if (cfg->srcpattern) {
         uint dims[3];
         dims[0] = cfg->srcnum;
@@ -3362,7 +4731,7 @@ void mcx_savejdata(char* filename, Config* cfg) {
         dims[2] = cfg->srcparam2.w;
         cJSON_AddItemToObject(sub, "Pattern", tmp = cJSON_CreateObject());
 
-        int ret = mcx_jdataencode(cfg->srcpattern, 2 + (cfg->srcnum > 1), dims + (cfg->srcnum == 1), "single", dims[0] * dims[1] * dims[2], cfg->zipid, tmp, 0, 0, cfg);
+        int ret = mcx_jdataencode(cfg->srcpattern, 2 + (cfg->srcnum > 1), dims + (cfg->srcnum == 1), "single", sizeof(float), cfg->zipid, tmp, 0, 0, cfg);
 
         if (ret) {
             MCX_ERROR(ret, "data compression or base64 encoding failed");
@@ -3377,6 +4746,16 @@ void mcx_savejdata(char* filename, Config* cfg) {
         cJSON_AddNumberToObject(tmp, "R", cfg->detpos[i].w);
     }
 
+    if (cfg->biasprob > 0.f) {
+        cJSON_AddItemToObject(obj, "Bias", sub = cJSON_CreateObject());
+        cJSON_AddNumberToObject(sub, "Prob", cfg->biasprob);
+        cJSON_AddNumberToObject(sub, "Angle", cfg->biasangle);
+
+        if (cfg->biasdet) {
+            cJSON_AddItemToObject(sub, "Det", cJSON_CreateIntArray((int*)cfg->biasdet, cfg->biasdetnum));
+        }
+    }
+
     /* save "Shapes" constructs, prioritize over saving volume for smaller size */
     if (cfg->shapedata) {
         cJSON* shape = cJSON_Parse(cfg->shapedata), *sp;
@@ -3506,6 +4885,11 @@ void mcx_loadvolume(char* filename, Config* cfg, int isbuf) {
             return;
         }
 
+        if (cfg->isserve && mcx_serve_fetchvol(filename, cfg)) {
+            mcx_labelformat(cfg);
+            return;
+        }
+
         fp = fopen(filename, "rb");
 
         if (fp == NULL) {
@@ -3526,13 +4910,20 @@ void mcx_loadvolume(char* filename, Config* cfg, int isbuf) {
             inputvol = (unsigned char*)malloc(sizeof(unsigned char) * (datalen << 3));
         } else if (cfg->mediabyte == MEDIA_ASGN_F2H) {
             inputvol = (unsigned char*)malloc(sizeof(unsigned char) * (datalen << 4));
+        } else if (cfg->mediabyte == MEDIA_LABEL8 || cfg->mediabyte == MEDIA_LABEL4) {
+            inputvol = (unsigned char*)malloc(sizeof(unsigned char) * datalen);
         } else if (cfg->mediabyte >= 4) {
             inputvol = (unsigned char*)(cfg->vol);
         } else {
             inputvol = (unsigned char*)malloc(sizeof(unsigned char) * cfg->mediabyte * datalen);
         }
 
-        res = fread(inputvol, sizeof(unsigned char) * ((cfg->mediabyte == MEDIA_ASGN_F2H) ? 16 : ((cfg->mediabyte == MEDIA_AS_F2H || cfg->mediabyte == MEDIA_2LABEL_SPLIT) ? 8 : MIN(cfg->mediabyte, 4))), datalen, fp);
+        if (cfg->mediabyte == MEDIA_LABEL4) { /*two 4-bit labels per byte*/
+            res = (fread(inputvol, sizeof(unsigned char), (datalen + 1) >> 1, fp) == ((datalen + 1) >> 1)) ? datalen : 0;
+        } else {
+            res = fread(inputvol, sizeof(unsigned char) * ((cfg->mediabyte == MEDIA_ASGN_F2H) ? 16 : ((cfg->mediabyte == MEDIA_AS_F2H || cfg->mediabyte == MEDIA_2LABEL_SPLIT) ? 8 : (cfg->mediabyte == MEDIA_LABEL8 ? 1 : MIN(cfg->mediabyte, 4)))), datalen, fp);
+        }
+
         fclose(fp);
 
         if (res != datalen) {
@@ -3542,12 +4933,18 @@ void mcx_loadvolume(char* filename, Config* cfg, int isbuf) {
         inputvol = (unsigned char*)filename;
     }
 
-    if (cfg->mediabyte == 1) { /*convert all format into 4-byte int index*/
+    if (cfg->mediabyte == 1 || cfg->mediabyte == MEDIA_LABEL8) { /*convert all format into 4-byte int index*/
         unsigned char* val = inputvol;
 
         for (i = 0; i < datalen; i++) {
             cfg->vol[i] = val[i];
         }
+    } else if (cfg->mediabyte == MEDIA_LABEL4) { /*the low 4 bits store the first voxel*/
+        unsigned char* val = inputvol;
+
+        for (i = 0; i < datalen; i++) {
+            cfg->vol[i] = (val[i >> 1] >> ((i & 1) << 2)) & 0xF;
+        }
     } else if (cfg->mediabyte == 2) {
         unsigned short* val = (unsigned short*)inputvol;
 
@@ -3600,20 +4997,29 @@ void mcx_loadvolume(char* filename, Config* cfg, int isbuf) {
         }
     } else if (cfg->mediabyte == MEDIA_2LABEL_SPLIT) {
         memcpy(cfg->vol, inputvol, (datalen << 3));
+    } else if (cfg->mediabyte == 4 && isbuf) { /*file input was read into cfg->vol directly*/
+        memcpy(cfg->vol, inputvol, (datalen << 2));
     }
 
     int medianum = MAX(cfg->medianum, cfg->polmedianum + 1);
 
-    if (cfg->mediabyte <= 4)
+    if (cfg->mediabyte <= 4 || cfg->mediabyte == MEDIA_LABEL8 || cfg->mediabyte == MEDIA_LABEL4)
         for (i = 0; i < datalen; i++) {
             if (cfg->vol[i] >= medianum) {
                 MCX_ERROR(-6, "medium index exceeds the specified medium types");
             }
         }
 
-    if (!isbuf && (cfg->mediabyte < 4 || cfg->mediabyte == MEDIA_AS_F2H || cfg->mediabyte == MEDIA_ASGN_F2H)) {
+    if (!isbuf && (cfg->mediabyte < 4 || cfg->mediabyte == MEDIA_AS_F2H || cfg->mediabyte == MEDIA_ASGN_F2H
+                   || cfg->mediabyte == MEDIA_LABEL8 || cfg->mediabyte == MEDIA_LABEL4)) {
         free(inputvol);
     }
+
+    if (!isbuf && cfg->isserve) {
+        mcx_serve_storevol(filename, cfg);
+    }
+
+    mcx_labelformat(cfg);
 }
 
 #endif
@@ -3654,6 +5060,7 @@ void mcx_replayinit(Config* cfg, float* detps, int dimdetps[2], int seedbyte) {
         MCX_ERROR(-6, "please rerun the baseline simulation and save detector ID (D) and partial-path (P) using cfg.savedetflag='dp' ");
     }
 
+    cfg->replay.seedbyte = seedbyte;
     cfg->replay.weight = (float*) malloc(cfg->nphoton * sizeof(float));
     cfg->replay.tof = (float*) calloc(cfg->nphoton, sizeof(float));
     cfg->replay.detid = (int*) calloc(cfg->nphoton, sizeof(int));
@@ -3758,6 +5165,10 @@ void mcx_validatecfg(Config* cfg, float* detps, int dimdetps[2], int seedbyte) {
         + SAVE_W0(cfg->savedetflag);
     hostdetreclen += cfg->polmedianum ? (4 * SAVE_IQUV(cfg->savedetflag)) : 0; // for polarized photon simulation
 
+    if (cfg->issnapshot) { /*settings restored from a snapshot were already preprocessed*/
+        return;
+    }
+
     if (!cfg->issrcfrom0) {
         cfg->srcpos.x--;
         cfg->srcpos.y--;
@@ -3822,7 +5233,7 @@ void mcx_validatecfg(Config* cfg, float* detps, int dimdetps[2], int seedbyte) {
         cfg->seed = time(NULL);
     }
 
-    if ((cfg->outputtype == otJacobian || cfg->outputtype == otWP || cfg->outputtype == otDCS || cfg->outputtype == otRF)
+    if ((cfg->outputtype == otJacobian || cfg->outputtype == otWP || cfg->outputtype == otDCS)
             && cfg->seed != SEED_FROM_FILE) {
         MCX_ERROR(-6, "Jacobian output is only valid in the reply mode. Please define cfg.seed");
     }
@@ -3855,6 +5266,14 @@ void mcx_validatecfg(Config* cfg, float* detps, int dimdetps[2], int seedbyte) {
 
     mcx_preprocess(cfg);
 
+    if (cfg->detfilter.maxscat && !SAVE_NSCAT(cfg->savedetflag)) {
+        MCX_ERROR(-6, "Optode.DetFilter.MaxScatter requires the scattering counts, please add 'S' to the -w flag");
+    }
+
+    if (!SAVE_PPATH(cfg->savedetflag) && !SAVE_MOM(cfg->savedetflag)) {
+        cfg->ishalfdet = 0;
+    }
+
     cfg->his.maxmedia = cfg->medianum - 1; /*skip medium 0*/
     cfg->his.detnum = cfg->detnum;
     cfg->his.srcnum = cfg->srcnum;
@@ -3947,8 +5366,20 @@ void mcx_loadseedjdat(char* filename, Config* cfg) {
             mcx_jdatadecode((void**)&ppath, &ndim, dims, 2, &type, ppathdata, cfg);
             his.maxmedia = dims[1];
 
+            if (info && FIND_JSON_KEY("HalfPrecision", "HalfPrecision", info, 0, valueint)) {
+                float* fpath = (float*)malloc(dims[0] * dims[1] * sizeof(float));
+
+                for (int i = 0; i < dims[0] * dims[1]; i++) {
+                    fpath[i] = mcx_half2float(((unsigned short*)ppath)[i]);
+                }
+
+                free(ppath);
+                ppath = fpath;
+            }
+
             mcx_jdatadecode((void**)&cfg->replay.seed, &ndim, dims, 2, &type, seed, cfg);
             mcx_jdatadecode((void**)&cfg->replay.detid, &ndim, dims, 2, &type, detid, cfg);
+            cfg->replay.seedbyte = his.seedbyte;
 
             cfg->replay.weight = (float*)malloc(his.savedphoton * sizeof(float));
             cfg->replay.tof = (float*)calloc(his.savedphoton, sizeof(float));
@@ -4008,6 +5439,7 @@ void mcx_loadseedfile(Config* cfg) {
 
     cfg->seed = SEED_FROM_FILE;
     cfg->nphoton = his.savedphoton;
+    cfg->replay.seedbyte = his.seedbyte;
 
     if (cfg->outputtype == otJacobian || cfg->outputtype == otWP || cfg->outputtype == otDCS  || cfg->outputtype == otRF) { //cfg->replaydet>0
         int i, j, hasdetid = 0, offset;
@@ -4029,10 +5461,20 @@ void mcx_loadseedfile(Config* cfg) {
             MCX_ERROR(-7, "error when reading the seed data");
         }
 
+        if (his.ishalf) {
+            his.colcount += mcx_detfilter_halfsaving(his.savedetflag, his.maxmedia, 1);
+            ppath = mcx_detfilter_expand(ppath, his.savedphoton, his.savedetflag, his.maxmedia, his.colcount);
+
+            if (ppath == NULL) {
+                MCX_ERROR(-7, "can not allocate memory");
+            }
+        }
+
         cfg->nphoton = 0;
 
         for (i = 0; i < his.savedphoton; i++)
-            if (cfg->replaydet <= 0 || cfg->replaydet == (int)(ppath[i * his.colcount])) {
+            if ((cfg->replaydet <= 0 || cfg->replaydet == (int)(ppath[i * his.colcount]))
+                    && (!cfg->detfilter.enabled || mcx_detfilter_record(ppath + i * his.colcount, &his, cfg))) {
                 if (i != cfg->nphoton) {
                     memcpy((char*)(cfg->replay.seed) + cfg->nphoton * his.seedbyte, (char*)(cfg->replay.seed) + i * his.seedbyte, his.seedbyte);
                 }
@@ -4205,6 +5647,24 @@ int mcx_svmc_bgvoxel(int vol) {
     return !lower;
 }
 
+/**
+ * @brief Map the packed label media formats to byte labels
+ *
+ * The label8 and label4 formats only differ from the byte format by how the
+ * labels are stored on the GPU. Once the volume is decoded into 32-bit labels,
+ * the format is replaced by the byte format and the storage width is kept in
+ * cfg->mediabits, so that the rest of the host code handles them as labels.
+ *
+ * @param[in,out] cfg: simulation configuration
+ */
+
+void mcx_labelformat(Config* cfg) {
+    if (cfg->mediabyte == MEDIA_LABEL8 || cfg->mediabyte == MEDIA_LABEL4) {
+        cfg->mediabits = (cfg->mediabyte == MEDIA_LABEL4) ? 4 : 8;
+        cfg->mediabyte = 1;
+    }
+}
+
 /**
  * @brief Pre-label the voxel near a detector for easy photon detection
  *
@@ -4359,8 +5819,10 @@ void mcx_dumpmask(Config* cfg) {
     if (cfg->outputformat == ofJNifti || cfg->outputformat == ofBJNifti) {
         uint dims[] = {cfg->dim.x, cfg->dim.y, cfg->dim.z};
         size_t datalen = sizeof(uint) * cfg->dim.x * cfg->dim.y * cfg->dim.z;
-        float voxelsize[] = {cfg->steps.x, cfg->steps.y, cfg->steps.z};
+        float voxelsize[3];
         uint* buf = malloc(datalen);
+
+        mcx_voxelsize(cfg, voxelsize);
         memcpy(buf, cfg->vol, datalen);
         mcx_convertcol2row((uint**)(&buf), (uint3*)dims);
 
@@ -4410,9 +5872,14 @@ int  mcx_jdatadecode(void** vol, int* ndim, uint* dims, int maxdim, char** type,
         vdata = cJSON_GetObjectItem(obj, "_ArrayZipData_");
     }
 
-    if (!flagset['K'] && vtype) {
+    mcx_labelformat(cfg); /*JData label4/label8 volumes store one label per array element*/
+
+    if (vtype) {
         *type = vtype->valuestring;
+    }
 
+    /** the array type sets the media format, unless it is given by -K or Domain.MediaFormat */
+    if (!flagset['K'] && vtype) {
         if (strstr(*type, "int8")) {
             cfg->mediabyte = 1;
         } else if (strstr(*type, "int16")) {
@@ -4428,6 +5895,7 @@ int  mcx_jdatadecode(void** vol, int* ndim, uint* dims, int maxdim, char** type,
 
     if (vdata) {
         size_t elemnum = 0;
+        int isfloat = (*type && (strstr(*type, "single") || strstr(*type, "float")));
 
         if (vsize) {
             cJSON* tmp = vsize->child;
@@ -4446,7 +5914,19 @@ int  mcx_jdatadecode(void** vol, int* ndim, uint* dims, int maxdim, char** type,
             int status = 0;
             char* buf = NULL;
             int zipid = mcx_keylookup((char*)(ztype->valuestring), zipformat);
-            ret = zmat_decode(strlen(vdata->valuestring), (uchar*)vdata->valuestring, &len, (uchar**)&buf, zmBase64, &status);
+
+            if (mcx_bjd_isbuffer(vdata)) {
+                /** BJData stores the compressed stream as a uint8 array instead of a base64 string */
+                if (vdata->valueint != 'U') {
+                    MCX_ERROR(-1, "_ArrayZipData_ must be a uint8 array");
+                }
+
+                len = (size_t)vdata->valuedouble;
+                buf = (char*)malloc(len + 1);
+                memcpy(buf, vdata->valuestring, len);
+            } else {
+                ret = zmat_decode(strlen(vdata->valuestring), (uchar*)vdata->valuestring, &len, (uchar**)&buf, zmBase64, &status);
+            }
 
             if (!ret && vsize) {
                 if (*vol) {
@@ -4460,6 +5940,20 @@ int  mcx_jdatadecode(void** vol, int* ndim, uint* dims, int maxdim, char** type,
                 free(buf);
             }
 
+            cfg->isrowmajor = 1;
+        } else if (mcx_bjd_isbuffer(vdata)) {
+            char dsttype = (cfg->mediabyte == 1) ? 'U' : ((cfg->mediabyte == 2) ? 'I' : ((cfg->mediabyte == MEDIA_2LABEL_SPLIT) ? 'L' : (isfloat ? 'd' : 'l')));
+
+            if (*vol) {
+                free(*vol);
+            }
+
+            *vol = calloc(cfg->mediabyte == MEDIA_2LABEL_SPLIT ? 8 : cfg->mediabyte, elemnum);
+
+            if (mcx_bjd_copy(vdata, *vol, elemnum, dsttype) < elemnum) {
+                MCX_ERROR(-1, "_ArrayData_ has fewer elements than _ArraySize_");
+            }
+
             cfg->isrowmajor = 1;
         } else if (cJSON_IsArray(vdata)) {
             size_t arraylen = cJSON_GetArraySize(vdata);
@@ -4486,6 +5980,11 @@ int  mcx_jdatadecode(void** vol, int* ndim, uint* dims, int maxdim, char** type,
                     ((short*)(*vol))[i] = tmp->valueint;
                     tmp = tmp->next;
                 }
+            } else if (cfg->mediabyte == 4 && isfloat) {
+                for (i = 0; i < arraylen; i++) {
+                    ((float*)(*vol))[i] = tmp->valuedouble;
+                    tmp = tmp->next;
+                }
             } else if (cfg->mediabyte == 4) {
                 for (i = 0; i < arraylen; i++) {
                     ((int*)(*vol))[i] = tmp->valueint;
@@ -5160,6 +6659,87 @@ void mcx_parsecmd(int argc, char* argv[], Config* cfg) {
                         i = mcx_readarg(argc, argv, i, &(cfg->istrajstokes), "int");
                     } else if (strcmp(argv[i] + 2, "internalsrc") == 0) {
                         i = mcx_readarg(argc, argv, i, &(cfg->internalsrc), "int");
+                    } else if (strcmp(argv[i] + 2, "serve") == 0) {
+                        cfg->isserve = 1;
+
+                        if (i + 1 < argc && (argv[i + 1][0] != '-' || argv[i + 1][1] == '\0')) {
+                            strncpy(cfg->serveaddr, argv[++i], MAX_PATH_LENGTH - 1);
+                        }
+                    } else if (strcmp(argv[i] + 2, "cache") == 0) {
+                        i = mcx_readarg(argc, argv, i, cfg->cachedir, "string");
+                    } else if (strcmp(argv[i] + 2, "cachesize") == 0) {
+                        i = mcx_readarg(argc, argv, i, &(cfg->cachesize), "float");
+                    } else if (strcmp(argv[i] + 2, "shard") == 0) {
+                        if (i + 1 >= argc || sscanf(argv[i + 1], "%d/%d", &(cfg->shardid), &(cfg->shardnum)) != 2
+                                || cfg->shardnum < 1 || cfg->shardid < 1 || cfg->shardid > cfg->shardnum) {
+                            MCX_ERROR(-1, "--shard expects k/N, where 1<=k<=N");
+                        }
+
+                        i++;
+                    } else if (strcmp(argv[i] + 2, "brick") == 0) {
+                        i = mcx_readarg(argc, argv, i, &(cfg->isbrick), "char");
+                    } else if (strcmp(argv[i] + 2, "globalprop") == 0) {
+                        i = mcx_readarg(argc, argv, i, &(cfg->isglobalprop), "char");
+                    } else if (strcmp(argv[i] + 2, "patterntol") == 0) {
+                        i = mcx_readarg(argc, argv, i, &(cfg->patterntol), "float");
+                    } else if (strcmp(argv[i] + 2, "autotune") == 0) {
+                        i = mcx_readarg(argc, argv, i, &(cfg->autotune), "char");
+                    } else if (strcmp(argv[i] + 2, "tunefile") == 0) {
+                        i = mcx_readarg(argc, argv, i, cfg->tunefile, "string");
+                    } else if (strcmp(argv[i] + 2, "trajsample") == 0) {
+                        if (i + 1 >= argc || sscanf(argv[i + 1], "%u,%u", &(cfg->trajphoton), &(cfg->trajstep)) < 1
+                                || cfg->trajphoton < 1 || cfg->trajstep < 1) {
+                            MCX_ERROR(-1, "--trajsample expects k or k,s, where k and s are positive integers");
+                        }
+
+                        i++;
+                    } else if (strcmp(argv[i] + 2, "trajsort") == 0) {
+                        i = mcx_readarg(argc, argv, i, &(cfg->istrajsort), "char");
+                    } else if (strcmp(argv[i] + 2, "trajquant") == 0) {
+                        i = mcx_readarg(argc, argv, i, &(cfg->trajquant), "float");
+                    } else if (strcmp(argv[i] + 2, "halfdet") == 0) {
+                        i = mcx_readarg(argc, argv, i, &(cfg->ishalfdet), "char");
+                    } else if (strcmp(argv[i] + 2, "pyramid") == 0) {
+                        i = mcx_readarg(argc, argv, i, &(cfg->pyramid), "int");
+                    } else if (strcmp(argv[i] + 2, "pyramidtol") == 0) {
+                        i = mcx_readarg(argc, argv, i, &(cfg->pyramidtol), "float");
+                    } else if (strcmp(argv[i] + 2, "compact") == 0) {
+                        i = mcx_readarg(argc, argv, i, &(cfg->iscompact), "char");
+                    } else if (strcmp(argv[i] + 2, "svmc") == 0) {
+                        i = mcx_readarg(argc, argv, i, &(cfg->issvmc), "char");
+                    } else if (strcmp(argv[i] + 2, "mixfactor") == 0) {
+                        i = mcx_readarg(argc, argv, i, &(cfg->mixfactor), "int");
+                    } else if (strcmp(argv[i] + 2, "dcsmodel") == 0) {
+                        if (i + 1 < argc && isalpha(argv[i + 1][0])) {
+                            cfg->dcsmodel = mcx_keylookup(argv[++i], dcsmodel);
+                        } else {
+                            i = mcx_readarg(argc, argv, i, &(cfg->dcsmodel), "char");
+                        }
+                    } else if (strcmp(argv[i] + 2, "dcsdisp") == 0) {
+                        i = mcx_readarg(argc, argv, i, &(cfg->dcsdisp), "float");
+                    } else if (strcmp(argv[i] + 2, "rffreq") == 0) {
+                        if (i + 1 < argc) {
+                            char* c = argv[i + 1];
+
+                            if (cfg->rffreq) {
+                                free(cfg->rffreq);
+                            }
+
+                            /** count the frequencies separated by space, comma or semicolon before parsing the list */
+                            for (cfg->rffreqnum = 0; *c; c++) {
+                                cfg->rffreqnum += (strchr(" ,;", *c) == NULL && (c == argv[i + 1] || strchr(" ,;", c[-1]) != NULL));
+                            }
+
+                            cfg->rffreq = (float*)calloc(MAX(cfg->rffreqnum, 1), sizeof(float));
+                        }
+
+                        i = mcx_readarg(argc, argv, i, cfg->rffreq, "floatlist");
+                    } else if (strcmp(argv[i] + 2, "merge") == 0) {
+                        cfg->ismerge = 1;
+
+                        while (i + 1 < argc && argv[i + 1][0] != '-') { /* input files are collected by mcx_merge */
+                            i++;
+                        }
                     } else {
                         MCX_FPRINTF(cfg->flog, "unknown verbose option: --%s\n", argv[i] + 2);
                     }
@@ -5186,11 +6766,11 @@ void mcx_parsecmd(int argc, char* argv[], Config* cfg) {
         }
     }
 
-    if ((cfg->outputtype == otJacobian || cfg->outputtype == otWP || cfg->outputtype == otDCS  || cfg->outputtype == otRF) && cfg->seed != SEED_FROM_FILE) {
+    if ((cfg->outputtype == otJacobian || cfg->outputtype == otWP || cfg->outputtype == otDCS) && cfg->seed != SEED_FROM_FILE) {
         MCX_ERROR(-1, "Jacobian output is only valid in the reply mode. Please give an mch file after '-E'.");
     }
 
-    if (cfg->isgpuinfo != 2) { /*print gpu info only*/
+    if (cfg->isgpuinfo != 2 && !cfg->isserve && !cfg->ismerge) { /*print gpu info only, wait for jobs in the server mode, or merge shards*/
         if (isinteractive) {
             mcx_readconfig((char*)"", cfg);
         } else if (jsoninput) {
@@ -5199,8 +6779,12 @@ void mcx_parsecmd(int argc, char* argv[], Config* cfg) {
             mcx_readconfig(filename, cfg);
         }
 
+        if (cfg->extrajson && cfg->issnapshot) {
+            MCX_ERROR(-1, "--json can not be applied to a preprocessed snapshot");
+        }
+
         if (cfg->extrajson) {
-            cJSON* jroot = cJSON_Parse(cfg->extrajson);
+            cJSON* jroot = mcx_fastjson_parse(cfg->extrajson);
 
             if (jroot) {
                 cfg->extrajson[0] = '_';
@@ -5213,7 +6797,12 @@ void mcx_parsecmd(int argc, char* argv[], Config* cfg) {
     }
 
     if (cfg->isdumpjson == 1) {
-        mcx_savejdata(cfg->jsonfile, cfg);
+        if (strstr(cfg->jsonfile, MCX_SNAPSHOT_SUFFIX) != NULL) {
+            mcx_snapshot_save(cfg->jsonfile, cfg);
+        } else {
+            mcx_savejdata(cfg->jsonfile, cfg);
+        }
+
         exit(0);
     }
 }
@@ -5412,38 +7001,62 @@ int mcx_float2half2(float input[2]) {
 #ifndef MCX_CONTAINER
 
 /**
- * @brief Run MCX simulations from a JSON input in a persistent session
+ * @brief Run MCX simulations of a loaded configuration on all selected GPUs
  *
- * @param[in] jsonstr: a string in the JSON format, the content of the .json input file
+ * @param[in] cfg: simulation configuration, cleared on return
  */
 
-int mcx_run_from_json(char* jsonstr) {
-    Config  mcxconfig;            /** mcxconfig: structure to store all simulation parameters */
+static int mcx_run_loaded(Config* cfg) {
     GPUInfo* gpuinfo = NULL;      /** gpuinfo: structure to store GPU information */
     unsigned int activedev = 0;   /** activedev: count of total active GPUs to be used */
 
-    mcx_initcfg(&mcxconfig);
-    mcx_readconfig(jsonstr, &mcxconfig);
-
-    if (!(activedev = mcx_list_gpu(&mcxconfig, &gpuinfo))) {
+    if (!(activedev = mcx_list_gpu(cfg, &gpuinfo))) {
         MCX_ERROR(-1, "No GPU device found\n");
     }
 
 #ifdef _OPENMP
-    omp_set_num_threads(activedev);
-    #pragma omp parallel
+    #pragma omp parallel num_threads(activedev)
     {
 #endif
-        mcx_run_simulation(&mcxconfig, gpuinfo);
+        mcx_run_simulation(cfg, gpuinfo);
 #ifdef _OPENMP
     }
 #endif
 
     mcx_cleargpuinfo(&gpuinfo);
-    mcx_clearcfg(&mcxconfig);
+    mcx_clearcfg(cfg);
     return 0;
 }
 
+/**
+ * @brief Run MCX simulations from a JSON input in a persistent session
+ *
+ * @param[in] jsonstr: a string in the JSON format, the content of the .json input file
+ */
+
+int mcx_run_from_json(char* jsonstr) {
+    Config  mcxconfig;            /** mcxconfig: structure to store all simulation parameters */
+
+    mcx_initcfg(&mcxconfig);
+    mcx_readconfig(jsonstr, &mcxconfig);
+    return mcx_run_loaded(&mcxconfig);
+}
+
+/**
+ * @brief Run MCX simulations from a BJData input held in memory
+ *
+ * @param[in] buf: the content of a .bjd/.jdb input file
+ * @param[in] len: length of the document in bytes
+ */
+
+int mcx_run_from_bjdata(const unsigned char* buf, size_t len) {
+    Config  mcxconfig;            /** mcxconfig: structure to store all simulation parameters */
+
+    mcx_initcfg(&mcxconfig);
+    mcx_loadbjdata(buf, len, &mcxconfig);
+    return mcx_run_loaded(&mcxconfig);
+}
+
 #endif
 
 /**
@@ -5491,9 +7104,13 @@ usage: %s <param1> <param2> ...\n\
 where possible parameters include (the first value in [*|*] is the default)\n\
 \n"S_BOLD S_CYAN"\
 == Required option ==\n" S_RESET"\
- -f config     (--input)       read an input file in .json or .inp format\n\
+ -f config     (--input)       read an input file in .json, .bjd or .inp format\n\
                                if the string starts with '{', it is parsed as\n\
                                an inline JSON input file\n\
+                               a preprocessed .mcxs snapshot saved by --dumpjson\n\
+                               is loaded without any pre-processing; only the\n\
+                               device, thread, log, session and output-folder\n\
+                               options are applied on top of it\n\
       or\n\
  --bench ['cube60','skinvessel',..] run a buint-in benchmark specified by name\n\
                                run --bench without parameter to get a list\n\
@@ -5542,6 +7159,13 @@ where possible parameters include (the first value in [*|*] is the default)\n\
  -t [16384|int](--thread)      total thread number\n\
  -T [64|int]   (--blocksize)   thread number per block\n\
  -A [1|int]    (--autopilot)   1 let mcx decide thread/block size, 0 use -T/-t\n\
+ --autotune [0|1|2]            with -A 1, 1: time short calibration runs to find\n\
+                               the fastest block size and thread number of each\n\
+                               device, kernel variant and media format, and\n\
+                               reuse them from the cache file afterwards;\n\
+                               2: always retune and update the cache file\n\
+ --tunefile [''|string]        cache file of the tuned configurations; if\n\
+                               empty, use .mcxtune.json in the home folder\n\
  -G [0|int]    (--gpu)         specify which GPU to use, list GPU by -L; 0 auto\n\
       or\n\
  -G '1101'     (--gpu)         using multiple devices (1 enable, 0 disable)\n\
@@ -5563,8 +7187,12 @@ where possible parameters include (the first value in [*|*] is the default)\n\
        for 4-byte integer, [s:] for 2-byte short, [h:] for 2-byte half float,\n\
        [f:] for 4-byte float; on Little-Endian systems, least-sig. bit on left\n\
                                1 or byte: 0-128 tissue labels\n\
-                               2 or short: 0-65535 (max to 4000) tissue labels\n\
+                               2 or short: 0-65535 tissue labels\n\
                                4 or integer: integer tissue labels \n\
+                              94 or label8: 0-255 labels, 1 byte per voxel,\n\
+                                kept at 8 bits per voxel on the GPU\n\
+                              95 or label4: 0-15 labels, 2 voxels per byte\n\
+                                {[low 4bit: voxel 1][high 4bit: voxel 2]}\n\
                               96 or asgn_float: mua/mus/g/n 4xfloat format\n\
                                 {[f:mua][f:mus][f:g][f:n]}\n\
                               97 or svmc: split-voxel MC 8-byte format\n\
@@ -5587,6 +7215,26 @@ where possible parameters include (the first value in [*|*] is the default)\n\
        binary data must be pre-scaled by voxel size (unitinmm) if it is not 1.\n\
        pre-scaling is not needed when using these 2 formats in mcxlab/pmcx\n\
  -a [0|1]      (--array)       1 for C array (row-major); 0 for Matlab array\n\
+ --brick [0|1]                 1 to store the media on the GPU as 8x8x8 bricks;\n\
+                               uniform bricks are collapsed to a single value\n\
+                               and mixed ones are palette-encoded, saving GPU\n\
+                               memory for mostly homogeneous domains at a small\n\
+                               lookup cost; not for svmc/asgn_float formats\n\
+ --globalprop [0|1]            1 to read the media properties from a global-memory\n\
+                               table, only label 0 is kept in constant memory;\n\
+                               used automatically when the media plus detectors\n\
+                               exceed the 4000-entry constant memory\n\
+ --svmc [0|1]                  1 to convert a label volume (up to 255 labels) to\n\
+                               the split-voxel format (-K svmc) before the\n\
+                               simulation, as utils/mcxsvmc.m, representing the\n\
+                               smoothed curved interfaces inside mixed voxels\n\
+ --mixfactor [0|int]           if above 1, downsample a label volume (up to 255\n\
+                               labels) by this integer factor to the mixed-label\n\
+                               format (-K mixlabel): each voxel stores the two\n\
+                               most frequent labels of the block it covers and\n\
+                               their volume fractions; the voxel size, sources\n\
+                               and detectors are rescaled, outputs are on the\n\
+                               coarse grid\n\
 \n"S_BOLD S_CYAN"\
 == Output options ==\n" S_RESET"\
  -s sessionid  (--session)     a string to label all output file names\n\
@@ -5594,7 +7242,13 @@ where possible parameters include (the first value in [*|*] is the default)\n\
     /case insensitive/         J - Jacobian (replay mode),   P - scattering, \n\
                                event counts at each voxel (replay mode only)\n\
                                M - momentum transfer; R - RF/FD Jacobian\n\
+                               (replay mode) or forward FD fluence (otherwise)\n\
                                L - total pathlength\n\
+ --rffreq [f1,f2,...]          modulation frequencies (Hz) of the forward FD\n\
+                               fluence (-O R), one output frame per frequency\n\
+                               storing sum(w*cos(2*pi*f*t)), followed by the\n\
+                               frames of sum(w*sin(2*pi*f*t)); the time gates\n\
+                               are not used, tend only limits the photon life\n\
  -d [1|0-3]    (--savedet)     1 to save photon info at detectors; 0 not save\n\
                                2 reserved, 3 terminate simulation when detected\n\
                                photon buffer is filled\n\
@@ -5619,6 +7273,19 @@ where possible parameters include (the first value in [*|*] is the default)\n\
  -q [0|1]      (--saveseed)    1 to save photon RNG seed for replay; 0 not save\n\
  -M [0|1]      (--dumpmask)    1 to dump detector volume masks; 0 do not save\n\
  -H [1000000] (--maxdetphoton) max number of detected photons\n\
+ --halfdet      [0|1]          1 to store the partial path-lengths (P) and\n\
+                               momentum transfer (M) of the detected photons as\n\
+                               half-precision floats on the GPU and in the\n\
+                               output files (unwanted detected photons can be\n\
+                               skipped on the GPU with Optode.DetFilter in the\n\
+                               JSON input, see README)\n\
+ --dcsmodel [0|1|2]            compute the DCS g1 of each detector from the\n\
+                               momentum transfer of the detected photons, as\n\
+                               utils/mcxdcsg1.m (implies -m 1), saved to\n\
+                               <session>_g1.json; the mean square displacement\n\
+                               is 1 or brownian: 6*Db*tau; 2 or random_flow:\n\
+                               (V*tau)^2\n\
+ --dcsdisp [1e-7|float]        Db (mm^2/s) or V (mm/s) of the DCS g1 model\n\
  -S [1|0]      (--save2pt)     1 to save the flux field; 0 do not save\n\
  -F [jnii|...](--outputformat) fluence data output format:\n\
                                mc2 - MCX mc2 format (binary 32bit float)\n\
@@ -5650,6 +7317,9 @@ where possible parameters include (the first value in [*|*] is the default)\n\
                                name is specified; by default, prints settings\n\
                                after pre-processing; '--dumpjson 2' prints \n\
                                raw inputs before pre-processing\n\
+                               if the file name ends with .mcxs, a binary\n\
+                               snapshot of the pre-processed settings and arrays\n\
+                               is saved instead for instant restart using -f\n\
 \n"S_BOLD S_CYAN"\
 == User IO options ==\n" S_RESET"\
  -h            (--help)        print this message\n\
@@ -5674,6 +7344,23 @@ where possible parameters include (the first value in [*|*] is the default)\n\
  --srcid  [0|-1,0,1,2,..]      -1 simulate multi-source separately;0 all sources\n\
                                together; a positive integer runs a single source\n\
  --internalsrc  [0|1]          set to 1 to skip entry search to speedup launch\n\
+ --patterntol   [0|float]      photon sharing (srcnum>1) only: simulate a few\n\
+                               orthogonal basis patterns instead, the fewest\n\
+                               that reconstruct all patterns within this\n\
+                               relative error (e.g. 1e-3), and rebuild the\n\
+                               output of each pattern from the basis outputs\n\
+ --pyramid      [0|1-4]        run a fast simulation on the media volume\n\
+                               downsampled n times by 2 (labels by majority\n\
+                               vote, continuous formats by averaging), then\n\
+                               only tally the output within the bounding box\n\
+                               of its significant fluence at full resolution\n\
+ --pyramidtol   [1e-5|float]   with --pyramid, the fluence threshold of the\n\
+                               tallied region, relative to the coarse maximum\n\
+ --compact      [1|0]          1 to crop the zero padding of the volume, keeping\n\
+                               the sources and detectors, and remove the unused\n\
+                               labels before the simulation; the outputs are\n\
+                               saved on the input grid. Not applied when saving\n\
+                               detected photons, trajectories or in replay\n\
  --trajstokes   [0|1]          set to 1 to save Stokes IQUV in trajectory data\n\
  --maxvoidstep  [1000|int]     maximum distance (in voxel unit) of a photon that\n\
                                can travel before entering the domain, if \n\
@@ -5681,6 +7368,39 @@ where possible parameters include (the first value in [*|*] is the default)\n\
  --maxjumpdebug [10000000|int] when trajectory is requested (i.e. -D M),\n\
                                use this parameter to set the maximum positions\n\
                                stored (default: 1e7)\n\
+ --trajsample   [1|k or 'k,s'] with -D M, record the trajectory of every k-th\n\
+                               photon only; with s>1, keep every s-th position\n\
+                               of each photon and its last position\n\
+ --trajsort     [0|1]          with -D M, store the positions of each photon\n\
+                               contiguously, sorted by photon ID (unique across\n\
+                               devices and repetitions)\n\
+ --trajquant    [0|float]      with -D M and -F jnii/bnii, save the positions of\n\
+                               each photon as deltas of integer coordinates in\n\
+                               units of this step (e.g. 1e-3 grid), which\n\
+                               compress better; implies --trajsort 1\n\
+ --serve        ['-'|path]     run as a persistent server: read JSON inputs\n\
+                               back-to-back from stdin ('-') or from clients of\n\
+                               a Unix socket (path), run them on warm devices\n\
+                               and reply one line of JSON per job, listing the\n\
+                               output files or the error of a failed job; other\n\
+                               command line options apply to every job\n\
+ --cache        [''|string]    folder of the output cache; a simulation with\n\
+                               the same domain, source, detectors, seed and\n\
+                               output settings as a cached one is loaded from\n\
+                               the cache instead of running on the GPU\n\
+ --cachesize    [1024|float]   maximum size (in MB) of the cache folder, the\n\
+                               least recently used outputs are removed first;\n\
+                               a negative value disables the size limit\n\
+ --shard        [''|k/N]       simulate only the k-th (starting from 1) of N\n\
+                               near-equal slices of the photons, with an RNG\n\
+                               seed derived from the seed (-E) and k; the\n\
+                               volumetric output is saved un-normalized, and\n\
+                               the energy tallies and normalization factors are\n\
+                               saved to <session>_shard.json\n\
+ --merge        file1 file2 .. sum the outputs of sharded runs (.jnii/.bnii/.mc2/\n\
+                               .nii/.tx3 volumes, .mch/_detp.jdat detected photons)\n\
+                               and normalize them as a single run, saved with\n\
+                               the session name (-s, default \"merged\")\n\
 \n"S_BOLD S_CYAN"\
 == Example ==\n" S_RESET"\
 example: (list built-in benchmarks)\n"S_MAGENTA"\
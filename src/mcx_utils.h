@@ -52,6 +52,7 @@
 #define MAX_PATH_LENGTH     1024                         /**< max characters in a full file name string */
 #define MAX_SESSION_LENGTH  256                          /**< max session name length */
 #define MAX_DEVICE          256                          /**< max number of GPUs to be used */
+#define MAX_FILTER_DET      256                          /**< max detector ID that can be selected by the detected photon filter */
 
 #define MCX_CUDA_ERROR_LAUNCH_FAILED    719              /**< CUDA kernel launch error code */
 
@@ -129,9 +130,23 @@ typedef struct MCXHistoryHeader {
     unsigned int  srcnum;          /**< number of sources for simultaneous pattern sources */
     unsigned int  savedetflag;     /**< bit-mask for storage of different types of detected photon data */
     unsigned int  totalsource;     /**< total source number when multiple sources are defined */
-    int reserved[1];               /**< reserved fields for future extension */
+    unsigned int  ishalf;          /**< 1 if the ppath and mom columns store pairs of half-precision values, see mcx_detfilter.h */
 } History;
 
+/**
+ * Criteria to select the detected photons worth a slot in the detected photon buffer
+ */
+
+typedef struct MCXDetFilter {
+    unsigned int enabled;          /**< 1 if any of the criteria below is set */
+    unsigned int isdetmask;        /**< 1 if only the detectors flagged in detmask are kept */
+    unsigned int detmask[MAX_FILTER_DET >> 5]; /**< bit (i-1) is set if photons of detector i are kept */
+    float tmin;                    /**< shortest time-of-flight (in s) of a kept photon */
+    float tmax;                    /**< longest time-of-flight (in s) of a kept photon, the time window is ignored if tmax<=tmin */
+    float minweight;               /**< minimum exit weight of a kept photon */
+    unsigned int maxscat;          /**< maximum total scattering count of a kept photon, 0 to disable */
+} DetFilter;
+
 /**
  * Data structure for photon replay
  */
@@ -141,6 +156,7 @@ typedef struct PhotonReplay {
     void*  seed;                  /**< pointer to the seeds of the replayed photon */
     float* weight;                /**< pointer to the detected photon weight array */
     float* tof;                   /**< pointer to the detected photon time-of-fly array */
+    unsigned int seedbyte;        /**< number of bytes per replayed seed */
 } Replay;
 
 /**
@@ -197,6 +213,10 @@ typedef struct MCXConfig {
     Medium* prop;                 /**<optical property mapping table*/
     POLMedium* polprop;           /**<absorption and scatterer mapping table for polarized photon simulation*/
     float4* detpos;               /**<detector positions and radius, overwrite detradius*/
+    float biasprob;               /**<probability of launching a photon toward the target detectors, 0 disables the biased launch*/
+    float biasangle;              /**<half-angle (in radian) of the biased launch cone around each target detector*/
+    unsigned int biasdetnum;      /**<number of target detectors of the biased launch*/
+    unsigned int* biasdet;        /**<1-based indices of the target detectors of the biased launch, NULL for all detectors*/
     float4* smatrix;              /**<scattering Mueller matrix */
 
     unsigned int maxgate;         /**<simultaneous recording gates*/
@@ -225,6 +245,8 @@ typedef struct MCXConfig {
     char istrajstokes;           /**<1 to save Stokes vector for trajectory data only */
     char isdumpjson;             /**<1 to save json */
     char internalsrc;            /**<1 all photons launch positions are inside non-zero voxels, 0 let mcx search entry point*/
+    char isserve;                /**<1 run as a persistent server, keep devices and decoded volumes between jobs*/
+    char isnested;               /**<1 an internal run of an enclosing simulation (autotuning, coarse pyramid level), keep the device and save no output*/
     int  zipid;                  /**<data zip method "zlib","gzip","base64","lzip","lzma","lz4","lz4hc"*/
     char srctype;                /**<0:pencil,1:isotropic,2:cone,3:gaussian,4:planar,5:pattern,\
                                          6:fourier,7:arcsine,8:disk,9:fourierx,10:fourierx2d,11:zgaussian,\
@@ -235,11 +257,18 @@ typedef struct MCXConfig {
     float minenergy;             /**<minimum energy to propagate photon*/
     float unitinmm;              /**<defines the length unit in mm for grid*/
     float omega;                 /**<modulation angular frequency (2*pi*f), in rad/s, for FD/RF replay*/
-    float lambda;                /**<light wavelength (in nm), for polarized light simulation*/
+    float* rffreq;               /**<modulation frequencies (Hz) of the forward FD output (-O R without replay), one output frame per frequency*/
+    unsigned int rffreqnum;      /**<number of modulation frequencies in rffreq*/
+    float lambda;                /**<light wavelength (in nm), for polarized light simulation and DCS g1*/
+    char dcsmodel;               /**<displacement model of the DCS g1 computed from the detected photons: 0 none, 1 Brownian, 2 random flow*/
+    float dcsdisp;               /**<Brownian diffusion coefficient Db (mm^2/s) or mean flow speed V (mm/s) of the DCS g1 model*/
+    unsigned int dcsntau;        /**<number of DCS correlation times*/
+    float* dcstau;               /**<DCS correlation times (in s)*/
     FILE* flog;                  /**<stream handle to print log information*/
     History his;                 /**<header info of the history file*/
     float* exportfield;          /**<memory buffer when returning the flux to external programs such as matlab*/
     float* exportdetected;       /**<memory buffer when returning the partial length info to external programs such as matlab*/
+    float* exportg1;             /**<DCS g1 of each detector, dcsntau values per detector, if dcsmodel is set*/
     unsigned long int detectedcount;  /**<total number of detected photons*/
     char rootpath[MAX_PATH_LENGTH]; /**<sets the input and output root folder*/
     char* shapedata;             /**<a pointer points to a string defining the JSON-formatted shape data*/
@@ -255,6 +284,45 @@ typedef struct MCXConfig {
     int replaydet;               /**<the detector id for which to replay the detected photons, start from 1*/
     char seedfile[MAX_PATH_LENGTH];/**<if the seed is specified as a file (mch), mcx will replay the photons*/
     char jsonfile[MAX_PATH_LENGTH];/**<if the seed is specified as a file (mch), mcx will replay the photons*/
+    char serveaddr[MAX_PATH_LENGTH];/**<Unix socket path for the server mode, '-' or empty to read jobs from stdin*/
+    char cachedir[MAX_PATH_LENGTH];/**<folder of the content-addressed output cache, empty to disable caching*/
+    float cachesize;             /**<size limit of the output cache folder in MB, 0 for the default limit, negative for unlimited*/
+    char iscachehit;             /**<set to 1 if the outputs of the last simulation were loaded from the cache*/
+    int shardid;                 /**<index (starting from 1) of the photon shard simulated by this run*/
+    int shardnum;                /**<total number of photon shards, 0 to disable sharding*/
+    char ismerge;                /**<1 to merge the outputs of sharded runs instead of simulating*/
+    char issnapshot;             /**<1 if the preprocessed settings were restored from a binary snapshot, skips mcx_validatecfg*/
+    char isbrick;                /**<1 to store the media volume on the GPU as compressed 8x8x8 bricks*/
+    unsigned int* brickvol;      /**<brick-compressed media volume (see mcx_brick.h), NULL if not used*/
+    size_t bricklen;             /**<length of brickvol in 32-bit words*/
+    char mediabits;              /**<0 to store 32-bit labels on the GPU, 4 or 8 to pack the labels at 4 or 8 bits per voxel (label4/label8 formats)*/
+    char isglobalprop;           /**<1 to read the media properties from a global-memory table, set automatically if they exceed the constant memory*/
+    float patterntol;            /**<max relative error of the low-rank basis replacing the photon-sharing patterns, 0 to simulate all patterns*/
+    unsigned int patternrank;    /**<number of basis patterns simulated on the GPU, 0 if the patterns are simulated directly*/
+    float* patternbasis;         /**<basis patterns (pixels x patternrank) uploaded to the GPU in place of srcpattern*/
+    float* patterncoef;          /**<coefficients (srcnum x patternrank) to reconstruct the outputs of each pattern*/
+    char autotune;               /**<with autopilot, 1 to reuse the cached tuned thread/block sizes (tuning the device on a miss), 2 to always retune, 0 to disable*/
+    char tunefile[MAX_PATH_LENGTH];/**<JSON cache of the tuned launch configurations, empty for ~/.mcxtune.json*/
+    unsigned int trajphoton;     /**<with -D M, record the trajectory of every trajphoton-th photon, 1 to record all*/
+    unsigned int trajstep;       /**<keep every trajstep-th position of each trajectory and its last position, 1 to keep all*/
+    char istrajsort;             /**<1 to store the positions of each photon contiguously, sorted by photon ID*/
+    float trajquant;             /**<if positive, save the trajectory positions to .jdat as per-photon deltas quantized at this step (in grid unit)*/
+    unsigned int trajidbase;     /**<ID offset of the next batch of trajectory records, keeps the IDs unique between respins and devices*/
+    DetFilter detfilter;         /**<criteria applied on the GPU before a detected photon claims a slot in the buffer*/
+    char ishalfdet;              /**<1 to store the ppath and mom columns of the detected photons as half-precision floats*/
+    float* muavol;               /**<cached mua (1/grid unit) of every voxel decoded by mcx_muavolume, NULL if not yet decoded*/
+    unsigned int pyramid;        /**<number of 2x downsampling levels of the coarse pre-run locating the tallied region, 0 to disable*/
+    float pyramidtol;            /**<voxels whose coarse fluence is below this fraction of the maximum are not tallied at full resolution*/
+    unsigned int* pyramidvol;    /**<media volume of the coarsest pyramid level built by mcx_preprocess, NULL if not used*/
+    uint3 pyramiddim;            /**<dimensions of pyramidvol*/
+    char isroi;                  /**<1 if only the voxels within [roi0, roi1] accumulate the volumetric output*/
+    uint3 roi0;                  /**<lower corner (0-based voxel index, inclusive) of the tallied region*/
+    uint3 roi1;                  /**<upper corner (inclusive) of the tallied region*/
+    char issvmc;                 /**<1 to convert the label volume to the split-voxel (svmc) format before the simulation*/
+    int mixfactor;               /**<if above 1, downsample the label volume by this factor to the mixed-label (MEDIA_2LABEL_MIX) format*/
+    char iscompact;              /**<1 to crop the zero padding of the volume and remove the unused labels before the simulation*/
+    uint3 fulldim;               /**<dimensions of the input volume if cropped by iscompact, 0 otherwise*/
+    uint3 compactoffset;         /**<position (in voxels) of the cropped volume in the input volume*/
     unsigned int debuglevel;     /**<a flag to control the printing of the debug information*/
     unsigned int savedetflag;    /**<a flag to control the output fields of detected photon data*/
     char deviceid[MAX_DEVICE];   /**<a 0-1 mask for all the GPUs, a mask of 1 means this GPU will be used*/
@@ -307,6 +375,7 @@ int  mcx_readarg(int argc, char* argv[], int id, void* output, const char* type)
 void mcx_printlog(Config* cfg, char* str);
 int  mcx_remap(char* opt);
 void mcx_maskdet(Config* cfg);
+void mcx_labelformat(Config* cfg);
 void mcx_dumpmask(Config* cfg);
 void mcx_version(Config* cfg);
 void mcx_convertrow2col(unsigned int* vol, uint3* dim);
@@ -314,6 +383,7 @@ void mcx_convertrow2col64(size_t* vol, uint3* dim);
 void mcx_convertcol2row(unsigned int** vol, uint3* dim);
 void mcx_convertcol2row4d(unsigned int** vol, uint4* dim);
 int  mcx_loadjson(cJSON* root, Config* cfg);
+void mcx_loadbjdata(const unsigned char* buf, size_t len, Config* cfg);
 int  mcx_keylookup(char* key, const char* table[]);
 int  mcx_lookupindex(char* key, const char* index);
 int  mcx_parsedebugopt(char* debugopt, const char* debugflag);
@@ -324,13 +394,17 @@ int  mcx_isbinstr(const char* str);
 void mcx_progressbar(float percent, Config* cfg);
 void mcx_flush(Config* cfg);
 int  mcx_run_from_json(char* jsonstr);
+int  mcx_run_from_bjdata(const unsigned char* buf, size_t len);
 float mcx_updatemua(unsigned int mediaid, Config* cfg);
+const float* mcx_muavolume(Config* cfg);
 void mcx_savejdata(char* filename, Config* cfg);
 int  mcx_jdataencode(void* vol,  int ndim, uint* dims, char* type, int byte, int zipid, void* obj, int isubj, int iscol, Config* cfg);
 int  mcx_jdatadecode(void** vol, int* ndim, uint* dims, int maxdim, char** type, cJSON* obj, Config* cfg);
 void mcx_savejnii(float* vol, int ndim, uint* dims, float* voxelsize, char* name, int isfloat, int iscol, Config* cfg);
 void mcx_savebnii(float* vol, int ndim, uint* dims, float* voxelsize, char* name, int isfloat, int iscol, Config* cfg);
 void mcx_savejdet(float* ppath, void* seeds, uint count, int doappend, Config* cfg);
+void mcx_saveshard(float* scale, Config* cfg);
+void mcx_savedcs(Config* cfg);
 int  mcx_svmc_bgvoxel(int vol);
 void mcx_loadseedjdat(char* filename, Config* cfg);
 void mcx_prep_polarized(Config* cfg);
@@ -42,6 +42,7 @@
 #include "mcx_utils.h"
 #include "mcx_core.h"
 #include "mcx_shapes.h"
+#include "mcx_snapshot.h"
 
 #ifdef _OPENMP
     #include <omp.h>
@@ -98,12 +99,13 @@ void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
     int        ifield, jstruct;
     int        ncfg, nfields;
     dimtype    fielddim[6];
+    mxArray*   fieldarray = NULL;
     int        activedev = 0;
     int        errorflag = 0;
     int        threadid = 0;
     const char*       outputtag[] = {"data"};
-    const char*       datastruct[] = {"data", "stat", "dref", "prop"};
-    const char*       statstruct[] = {"runtime", "nphoton", "energytot", "energyabs", "normalizer", "unitinmm", "workload"};
+    const char*       datastruct[] = {"data", "stat", "dref", "prop", "g1"};
+    const char*       statstruct[] = {"runtime", "nphoton", "energytot", "energyabs", "normalizer", "unitinmm", "workload", "cached"};
     const char*       gpuinfotag[] = {"name", "id", "devcount", "major", "minor", "globalmem",
                                       "constmem", "sharedmem", "regcount", "clock", "sm", "core",
                                       "autoblock", "autothread", "maxgate"
@@ -185,7 +187,7 @@ void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
      * The function can return 1-5 outputs (i.e. the LHS)
      */
     if (nlhs >= 1 || (cfg.debuglevel & MCX_DEBUG_MOVE_ONLY)) {
-        plhs[0] = mxCreateStructMatrix(ncfg, 1, 4, datastruct);
+        plhs[0] = mxCreateStructMatrix(ncfg, 1, 5, datastruct);
     }
 
     if (nlhs >= 2) {
@@ -259,23 +261,32 @@ void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
                 mexErrMsgTxt("No active GPU device found");
             }
 
-            /** Initialize all buffers necessary to store the output variables */
+            /**
+             * Initialize all buffers necessary to store the output variables; the volumetric output is
+             * created as the returned array up front, so that MCX accumulates directly into its storage
+             */
             if (nlhs >= 1) {
-                int fieldlen = cfg.dim.x * cfg.dim.y * cfg.dim.z * (int)((cfg.tend - cfg.tstart) / cfg.tstep + 0.5) * cfg.srcnum;
+                fielddim[0] = cfg.srcnum * cfg.dim.x;
+                fielddim[1] = cfg.dim.y;
+                fielddim[2] = cfg.dim.z;
+                fielddim[3] = (int)((cfg.tend - cfg.tstart) / cfg.tstep + 0.5);
+                fielddim[4] = 1;
+                fielddim[5] = 1;
 
                 if (cfg.replay.seed != NULL && cfg.replaydet == -1) {
-                    fieldlen *= cfg.detnum;
+                    fielddim[4] = cfg.detnum;
                 }
 
-                if (cfg.replay.seed != NULL && cfg.outputtype == otRF) {
-                    fieldlen *= 2;
+                if (cfg.outputtype == otRF) {
+                    fielddim[5] = 2;
                 }
 
                 if (cfg.extrasrclen && cfg.srcid == -1) {
-                    fieldlen *= (cfg.extrasrclen + 1);
+                    fielddim[5] *= (cfg.extrasrclen + 1);
                 }
 
-                cfg.exportfield = (float*)calloc(fieldlen, sizeof(float));
+                fieldarray = mxCreateNumericArray(((fielddim[5] > 1) ? 6 : (4 + (fielddim[4] > 1))), fielddim, mxSINGLE_CLASS, mxREAL);
+                cfg.exportfield = (float*)mxGetPr(fieldarray);
             }
 
             if (nlhs >= 2) {
@@ -293,8 +304,7 @@ void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
 
             /** Start multiple threads, one thread to run portion of the simulation on one CUDA GPU, all in parallel */
 #ifdef _OPENMP
-            omp_set_num_threads(activedev);
-            #pragma omp parallel shared(errorflag)
+            #pragma omp parallel num_threads(activedev) shared(errorflag)
             {
                 threadid = omp_get_thread_num();
 #endif
@@ -324,9 +334,6 @@ void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
                 mexErrMsgTxt("MCXLAB Terminated due to an exception!");
             }
 
-            fielddim[4] = 1;
-            fielddim[5] = 1;
-
             /** if 5th output presents, output the photon trajectory data */
             if (nlhs >= 5 || (cfg.debuglevel & MCX_DEBUG_MOVE_ONLY)) {
                 int outputidx = (cfg.debuglevel & MCX_DEBUG_MOVE_ONLY) ? 0 : 4;
@@ -392,63 +399,38 @@ void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
 
             /** if the 1st output presents, output the fluence/energy-deposit volume data */
             if (nlhs >= 1) {
-                int fieldlen;
-                fielddim[0] = cfg.srcnum * cfg.dim.x;
-                fielddim[1] = cfg.dim.y;
-                fielddim[2] = cfg.dim.z;
-                fielddim[3] = (int)((cfg.tend - cfg.tstart) / cfg.tstep + 0.5);
-
-                if (cfg.replay.seed != NULL && cfg.replaydet == -1) {
-                    fielddim[4] = cfg.detnum;
-                }
-
-                if (cfg.replay.seed != NULL && cfg.outputtype == otRF) {
-                    fielddim[5] = 2;
-                }
-
-                if (cfg.extrasrclen && cfg.srcid == -1) {
-                    fielddim[5] *= (cfg.extrasrclen + 1);
-                }
-
-                fieldlen = fielddim[0] * fielddim[1] * fielddim[2] * fielddim[3] * fielddim[4] * fielddim[5];
-
+                /** the diffuse reflectance of the background voxels is moved from the volumetric output to dref in place */
                 if (cfg.issaveref) {
-                    int highdim = fielddim[3] * fielddim[4] * fielddim[5];
-                    int voxellen = cfg.dim.x * cfg.dim.y * cfg.dim.z;
-                    float* dref = (float*)malloc(fieldlen * sizeof(float));
-                    memcpy(dref, cfg.exportfield, fieldlen * sizeof(float));
-
-                    for (int voxelid = 0; voxelid < voxellen; voxelid++) {
-                        if (cfg.vol[voxelid]) {
-                            for (int gate = 0; gate < highdim; gate++)
-                                for (int srcid = 0; srcid < cfg.srcnum; srcid++) {
-                                    dref[(gate * voxellen + voxelid) * cfg.srcnum + srcid] = 0.f;
-                                }
-                        } else {
-                            for (int gate = 0; gate < highdim; gate++)
-                                for (int srcid = 0; srcid < cfg.srcnum; srcid++) {
-                                    dref[(gate * voxellen + voxelid) * cfg.srcnum + srcid] = -dref[(gate * voxellen + voxelid) * cfg.srcnum + srcid];
-                                    cfg.exportfield[(gate * voxellen + voxelid) * cfg.srcnum + srcid] = 0.f;
+                    mxArray* refarray = mxCreateNumericArray(mxGetNumberOfDimensions(fieldarray), mxGetDimensions(fieldarray), mxSINGLE_CLASS, mxREAL);
+                    float* dref = (float*)mxGetPr(refarray);
+                    size_t voxellen = (size_t)cfg.dim.x * cfg.dim.y * cfg.dim.z;
+                    size_t highdim = mxGetNumberOfElements(fieldarray) / (voxellen * cfg.srcnum);
+
+                    for (size_t gate = 0; gate < highdim; gate++) {
+                        for (size_t voxelid = 0; voxelid < voxellen; voxelid++) {
+                            if (cfg.vol[voxelid] == 0) {
+                                for (size_t idx = (gate * voxellen + voxelid) * cfg.srcnum; idx < (gate * voxellen + voxelid + 1) * cfg.srcnum; idx++) {
+                                    dref[idx] = -cfg.exportfield[idx];
+                                    cfg.exportfield[idx] = 0.f;
                                 }
+                            }
                         }
                     }
 
-                    mxSetFieldByNumber(plhs[0], jstruct, 2, mxCreateNumericArray(((fielddim[5] > 1) ? 6 : (4 + (fielddim[4] > 1))), fielddim, mxSINGLE_CLASS, mxREAL));
-                    memcpy((float*)mxGetPr(mxGetFieldByNumber(plhs[0], jstruct, 2)), dref, fieldlen * sizeof(float));
-                    free(dref);
+                    mxSetFieldByNumber(plhs[0], jstruct, 2, refarray);
                 }
 
                 if (cfg.issave2pt) {
-                    mxSetFieldByNumber(plhs[0], jstruct, 0, mxCreateNumericArray(((fielddim[5] > 1) ? 6 : (4 + (fielddim[4] > 1))), fielddim, mxSINGLE_CLASS, mxREAL));
-                    memcpy((float*)mxGetPr(mxGetFieldByNumber(plhs[0], jstruct, 0)), cfg.exportfield,
-                           fieldlen * sizeof(float));
+                    mxSetFieldByNumber(plhs[0], jstruct, 0, fieldarray);
+                } else {
+                    mxDestroyArray(fieldarray);
                 }
 
-                free(cfg.exportfield);
+                fieldarray = NULL;
                 cfg.exportfield = NULL;
 
                 /** also return the run-time info in outut.runtime */
-                mxArray* stat = mxCreateStructMatrix(1, 1, 7, statstruct);
+                mxArray* stat = mxCreateStructMatrix(1, 1, 8, statstruct);
                 mxArray* val = mxCreateDoubleMatrix(1, 1, mxREAL);
                 *mxGetPr(val) = cfg.runtime;
                 mxSetFieldByNumber(stat, 0, 0, val);
@@ -487,6 +469,9 @@ void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
 
                 mxSetFieldByNumber(stat, 0, 6, val);
 
+                /** return if the outputs were loaded from the output cache */
+                mxSetFieldByNumber(stat, 0, 7, mxCreateLogicalScalar(cfg.iscachehit));
+
                 mxSetFieldByNumber(plhs[0], jstruct, 1, stat);
 
                 /** return the final optical properties for polarized MCX simulation */
@@ -502,6 +487,13 @@ void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
                     mxSetFieldByNumber(plhs[0], jstruct, 3, mxCreateNumericArray(2, propdim, mxSINGLE_CLASS, mxREAL));
                     memcpy((float*)mxGetPr(mxGetFieldByNumber(plhs[0], jstruct, 3)), cfg.prop, cfg.medianum * 4 * sizeof(float));
                 }
+
+                /** return the DCS g1 curves, one column per detector */
+                if (cfg.exportg1) {
+                    dimtype g1dim[2] = {(dimtype)cfg.dcsntau, (dimtype)cfg.detnum};
+                    mxSetFieldByNumber(plhs[0], jstruct, 4, mxCreateNumericArray(2, g1dim, mxSINGLE_CLASS, mxREAL));
+                    memcpy((float*)mxGetPr(mxGetFieldByNumber(plhs[0], jstruct, 4)), cfg.exportg1, g1dim[0] * g1dim[1] * sizeof(float));
+                }
             }
         } catch (const char* err) {
             mexPrintf("Error: %s\n", err);
@@ -516,6 +508,13 @@ void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
             free(detps);
         }
 
+        /** the volumetric output storage belongs to MATLAB, it is released with its array if the run failed */
+        if (fieldarray) {
+            mxDestroyArray(fieldarray);
+            fieldarray = NULL;
+            cfg.exportfield = NULL;
+        }
+
         mcx_cleargpuinfo(&gpuinfo);
         mcx_clearcfg(&cfg);
     }
@@ -573,17 +572,31 @@ void mcx_set_field(const mxArray* root, const mxArray* item, int idx, Config* cf
     GET_ONE_FIELD(cfg, issaveexit)
     GET_ONE_FIELD(cfg, ismomentum)
     GET_ONE_FIELD(cfg, isspecular)
+    GET_ONE_FIELD(cfg, isbrick)
+    GET_ONE_FIELD(cfg, issvmc)
+    GET_ONE_FIELD(cfg, mixfactor)
+    GET_ONE_FIELD(cfg, dcsmodel)
+    GET_ONE_FIELD(cfg, dcsdisp)
+    GET_ONE_FIELD(cfg, biasprob)
+    GET_ONE_FIELD(cfg, biasangle)
+    GET_ONE_FIELD(cfg, mediabits)
+    GET_ONE_FIELD(cfg, patterntol)
+    GET_ONE_FIELD(cfg, autotune)
     GET_ONE_FIELD(cfg, istrajstokes)
     GET_ONE_FIELD(cfg, replaydet)
     GET_ONE_FIELD(cfg, faststep)
     GET_ONE_FIELD(cfg, maxvoidstep)
     GET_ONE_FIELD(cfg, maxjumpdebug)
+    GET_ONE_FIELD(cfg, trajphoton)
+    GET_ONE_FIELD(cfg, trajstep)
+    GET_ONE_FIELD(cfg, istrajsort)
     GET_ONE_FIELD(cfg, gscatter)
     GET_ONE_FIELD(cfg, srcnum)
     GET_ONE_FIELD(cfg, srcid)
     GET_ONE_FIELD(cfg, omega)
     GET_ONE_FIELD(cfg, issave2pt)
     GET_ONE_FIELD(cfg, lambda)
+    GET_ONE_FIELD(cfg, cachesize)
     GET_VEC3_FIELD(cfg, steps)
     GET_VEC3_FIELD(cfg, crop0)
     GET_VEC3_FIELD(cfg, crop1)
@@ -1011,6 +1024,47 @@ void mcx_set_field(const mxArray* root, const mxArray* item, int idx, Config* cf
         }
 
         printf("mcx.session='%s';\n", cfg->session);
+    } else if (strcmp(name, "cachedir") == 0) {
+        int len = mxGetNumberOfElements(item);
+
+        if (!mxIsChar(item)) {
+            mexErrMsgTxt("the 'cachedir' field must be a string");
+        }
+
+        if (len >= MAX_PATH_LENGTH) {
+            mexErrMsgTxt("the 'cachedir' field is too long");
+        }
+
+        mxGetString(item, cfg->cachedir, MAX_PATH_LENGTH);
+        printf("mcx.cachedir='%s';\n", cfg->cachedir);
+    } else if (strcmp(name, "tunefile") == 0) {
+        int len = mxGetNumberOfElements(item);
+
+        if (!mxIsChar(item)) {
+            mexErrMsgTxt("the 'tunefile' field must be a string");
+        }
+
+        if (len >= MAX_PATH_LENGTH) {
+            mexErrMsgTxt("the 'tunefile' field is too long");
+        }
+
+        mxGetString(item, cfg->tunefile, MAX_PATH_LENGTH);
+        printf("mcx.tunefile='%s';\n", cfg->tunefile);
+    } else if (strcmp(name, "snapshot") == 0) {
+        char snapfile[MAX_PATH_LENGTH] = {'\0'};
+        int len = mxGetNumberOfElements(item);
+
+        if (!mxIsChar(item) || len == 0) {
+            mexErrMsgTxt("the 'snapshot' field must be a non-empty string");
+        }
+
+        if (len >= MAX_PATH_LENGTH) {
+            mexErrMsgTxt("the 'snapshot' field is too long");
+        }
+
+        mxGetString(item, snapfile, MAX_PATH_LENGTH);
+        mcx_snapshot_load(snapfile, cfg);
+        printf("mcx.snapshot='%s';\n", snapfile);
     } else if (strcmp(name, "srctype") == 0) {
         int len = mxGetNumberOfElements(item);
         const char* srctypeid[] = {"pencil", "isotropic", "cone", "gaussian", "planar",
@@ -1180,6 +1234,62 @@ void mcx_set_field(const mxArray* root, const mxArray* item, int idx, Config* cf
         }
 
         printf("mcx.angleinvcdf=[%ld];\n", cfg->nangle);
+    } else if (strcmp(name, "dcstau") == 0) {
+        dimtype ntau = mxGetNumberOfElements(item);
+        double* val = mxGetPr(item);
+
+        if (cfg->dcstau) {
+            free(cfg->dcstau);
+        }
+
+        cfg->dcsntau = (unsigned int)ntau;
+        cfg->dcstau = (float*)calloc(cfg->dcsntau, sizeof(float));
+
+        for (i = 0; i < ntau; i++) {
+            cfg->dcstau[i] = val[i];
+
+            if (val[i] < 0.0) {
+                mexErrMsgTxt("cfg.dcstau must not contain negative correlation times");
+            }
+        }
+
+        printf("mcx.dcstau=[%ld];\n", cfg->dcsntau);
+    } else if (strcmp(name, "rffreq") == 0) {
+        dimtype nfreq = mxGetNumberOfElements(item);
+        double* val = mxGetPr(item);
+
+        if (cfg->rffreq) {
+            free(cfg->rffreq);
+        }
+
+        cfg->rffreqnum = (unsigned int)nfreq;
+        cfg->rffreq = (float*)calloc(cfg->rffreqnum, sizeof(float));
+
+        for (i = 0; i < nfreq; i++) {
+            cfg->rffreq[i] = val[i];
+        }
+
+        printf("mcx.rffreq=[%ld];\n", cfg->rffreqnum);
+    } else if (strcmp(name, "biasdet") == 0) {
+        dimtype ndet = mxGetNumberOfElements(item);
+        double* val = mxGetPr(item);
+
+        if (cfg->biasdet) {
+            free(cfg->biasdet);
+        }
+
+        cfg->biasdetnum = (unsigned int)ndet;
+        cfg->biasdet = (unsigned int*)calloc(MAX(cfg->biasdetnum, 1), sizeof(unsigned int));
+
+        for (i = 0; i < ndet; i++) {
+            if (val[i] < 1.0) {
+                mexErrMsgTxt("the 'biasdet' field must contain 1-based detector indices");
+            }
+
+            cfg->biasdet[i] = (unsigned int)val[i];
+        }
+
+        printf("mcx.biasdet=[%ld];\n", cfg->biasdetnum);
     } else if (strcmp(name, "shapes") == 0) {
         int len = mxGetNumberOfElements(item);
 
@@ -40,6 +40,7 @@
 #include "mcx_core.h"
 #include "mcx_const.h"
 #include "mcx_shapes.h"
+#include "mcx_snapshot.h"
 #include <pybind11/iostream.h>
 
 // Python binding for runtime_error exception in Python.
@@ -425,16 +426,30 @@ void parse_config(const py::dict& user_cfg, Config& mcx_config) {
     GET_SCALAR_FIELD(user_cfg, mcx_config, issaveexit, py::bool_);
     GET_SCALAR_FIELD(user_cfg, mcx_config, ismomentum, py::bool_);
     GET_SCALAR_FIELD(user_cfg, mcx_config, isspecular, py::bool_);
+    GET_SCALAR_FIELD(user_cfg, mcx_config, isbrick, py::bool_);
+    GET_SCALAR_FIELD(user_cfg, mcx_config, issvmc, py::bool_);
+    GET_SCALAR_FIELD(user_cfg, mcx_config, mixfactor, py::int_);
+    GET_SCALAR_FIELD(user_cfg, mcx_config, dcsmodel, py::int_);
+    GET_SCALAR_FIELD(user_cfg, mcx_config, dcsdisp, py::float_);
+    GET_SCALAR_FIELD(user_cfg, mcx_config, biasprob, py::float_);
+    GET_SCALAR_FIELD(user_cfg, mcx_config, biasangle, py::float_);
+    GET_SCALAR_FIELD(user_cfg, mcx_config, mediabits, py::int_);
+    GET_SCALAR_FIELD(user_cfg, mcx_config, patterntol, py::float_);
+    GET_SCALAR_FIELD(user_cfg, mcx_config, autotune, py::int_);
     GET_SCALAR_FIELD(user_cfg, mcx_config, istrajstokes, py::bool_);
     GET_SCALAR_FIELD(user_cfg, mcx_config, replaydet, py::int_);
     GET_SCALAR_FIELD(user_cfg, mcx_config, faststep, py::bool_);
     GET_SCALAR_FIELD(user_cfg, mcx_config, maxvoidstep, py::int_);
     GET_SCALAR_FIELD(user_cfg, mcx_config, maxjumpdebug, py::int_);
+    GET_SCALAR_FIELD(user_cfg, mcx_config, trajphoton, py::int_);
+    GET_SCALAR_FIELD(user_cfg, mcx_config, trajstep, py::int_);
+    GET_SCALAR_FIELD(user_cfg, mcx_config, istrajsort, py::bool_);
     GET_SCALAR_FIELD(user_cfg, mcx_config, gscatter, py::int_);
     GET_SCALAR_FIELD(user_cfg, mcx_config, srcnum, py::int_);
     GET_SCALAR_FIELD(user_cfg, mcx_config, srcid, py::int_);
     GET_SCALAR_FIELD(user_cfg, mcx_config, omega, py::float_);
     GET_SCALAR_FIELD(user_cfg, mcx_config, lambda, py::float_);
+    GET_SCALAR_FIELD(user_cfg, mcx_config, cachesize, py::float_);
     GET_VEC3_FIELD(user_cfg, mcx_config, steps, float);
     GET_VEC3_FIELD(user_cfg, mcx_config, crop0, uint);
     GET_VEC3_FIELD(user_cfg, mcx_config, crop1, uint);
@@ -736,6 +751,26 @@ void parse_config(const py::dict& user_cfg, Config& mcx_config) {
         strncpy(mcx_config.session, session.c_str(), MAX_SESSION_LENGTH);
     }
 
+    if (user_cfg.contains("cachedir")) {
+        std::string cachedir = py::str(user_cfg["cachedir"]);
+
+        if (cachedir.size() >= MAX_PATH_LENGTH) {
+            throw py::value_error("the 'cachedir' field is too long");
+        }
+
+        strncpy(mcx_config.cachedir, cachedir.c_str(), MAX_PATH_LENGTH - 1);
+    }
+
+    if (user_cfg.contains("tunefile")) {
+        std::string tunefile = py::str(user_cfg["tunefile"]);
+
+        if (tunefile.size() >= MAX_PATH_LENGTH) {
+            throw py::value_error("the 'tunefile' field is too long");
+        }
+
+        strncpy(mcx_config.tunefile, tunefile.c_str(), MAX_PATH_LENGTH - 1);
+    }
+
     if (user_cfg.contains("srctype")) {
         std::string src_type = py::str(user_cfg["srctype"]);
         const char* srctypeid[] = {"pencil", "isotropic", "cone", "gaussian", "planar",
@@ -891,6 +926,80 @@ void parse_config(const py::dict& user_cfg, Config& mcx_config) {
         }
     }
 
+    if (user_cfg.contains("dcstau")) {
+        auto f_style_volume = py::array_t < float, py::array::f_style | py::array::forcecast >::ensure(user_cfg["dcstau"]);
+
+        if (!f_style_volume) {
+            throw py::value_error("Invalid dcstau field value");
+        }
+
+        auto buffer_info = f_style_volume.request();
+        float* val = static_cast<float*>(buffer_info.ptr);
+
+        if (mcx_config.dcstau) {
+            free(mcx_config.dcstau);
+        }
+
+        mcx_config.dcsntau = buffer_info.size;
+        mcx_config.dcstau = (float*) calloc(mcx_config.dcsntau, sizeof(float));
+
+        for (int i = 0; i < (int)mcx_config.dcsntau; i++) {
+            mcx_config.dcstau[i] = val[i];
+
+            if (val[i] < 0.f) {
+                throw py::value_error("cfg.dcstau must not contain negative correlation times");
+            }
+        }
+    }
+
+    if (user_cfg.contains("rffreq")) {
+        auto f_style_volume = py::array_t < float, py::array::f_style | py::array::forcecast >::ensure(user_cfg["rffreq"]);
+
+        if (!f_style_volume) {
+            throw py::value_error("Invalid rffreq field value");
+        }
+
+        auto buffer_info = f_style_volume.request();
+        float* val = static_cast<float*>(buffer_info.ptr);
+
+        if (mcx_config.rffreq) {
+            free(mcx_config.rffreq);
+        }
+
+        mcx_config.rffreqnum = buffer_info.size;
+        mcx_config.rffreq = (float*) calloc(mcx_config.rffreqnum, sizeof(float));
+
+        for (int i = 0; i < (int)mcx_config.rffreqnum; i++) {
+            mcx_config.rffreq[i] = val[i];
+        }
+    }
+
+    if (user_cfg.contains("biasdet")) {
+        auto f_style_volume = py::array_t < int, py::array::f_style | py::array::forcecast >::ensure(user_cfg["biasdet"]);
+
+        if (!f_style_volume) {
+            throw py::value_error("Invalid biasdet field value");
+        }
+
+        auto buffer_info = f_style_volume.request();
+        int* val = static_cast<int*>(buffer_info.ptr);
+
+        if (mcx_config.biasdet) {
+            free(mcx_config.biasdet);
+        }
+
+        mcx_config.biasdetnum = buffer_info.size;
+        mcx_config.biasdet = (unsigned int*) calloc(MAX(mcx_config.biasdetnum, 1), sizeof(unsigned int));
+
+        for (int i = 0; i < (int)mcx_config.biasdetnum; i++) {
+            if (val[i] < 1) {
+                throw py::value_error("the 'biasdet' field must contain 1-based detector indices");
+            }
+
+            mcx_config.biasdet[i] = val[i];
+        }
+    }
+
     if (user_cfg.contains("shapes")) {
         std::string shapes_string = py::str(user_cfg["shapes"]);
 
@@ -1029,6 +1138,17 @@ void parse_config(const py::dict& user_cfg, Config& mcx_config) {
         }
     }
 
+    // A preprocessed snapshot replaces the simulation settings and arrays given above
+    if (user_cfg.contains("snapshot")) {
+        std::string snapshot = py::str(user_cfg["snapshot"]);
+
+        if (snapshot.empty()) {
+            throw py::value_error("the 'snapshot' field must be a non-empty string");
+        }
+
+        mcx_snapshot_load(snapshot.c_str(), &mcx_config);
+    }
+
     // Output arguments parsing
     GET_SCALAR_FIELD(user_cfg, mcx_config, issave2pt, py::bool_);
     GET_SCALAR_FIELD(user_cfg, mcx_config, issavedet, py::bool_);
@@ -1104,7 +1224,7 @@ py::dict pmcx_interface(const py::dict& user_cfg) {
                 field_len *= mcx_config.detnum;
             }
 
-            if (mcx_config.replay.seed != nullptr && mcx_config.outputtype == otRF) {
+            if (mcx_config.outputtype == otRF) {
                 field_len *= 2;
             }
 
@@ -1129,8 +1249,7 @@ py::dict pmcx_interface(const py::dict& user_cfg) {
 
         /** Start multiple threads, one thread to run portion of the simulation on one CUDA GPU, all in parallel */
 #ifdef _OPENMP
-        omp_set_num_threads(active_dev);
-        #pragma omp parallel shared(exception_msgs)
+        #pragma omp parallel num_threads(active_dev) shared(exception_msgs)
         {
             thread_id = omp_get_thread_num();
 #endif
@@ -1233,7 +1352,7 @@ py::dict pmcx_interface(const py::dict& user_cfg) {
                 field_dim[4] = mcx_config.detnum;
             }
 
-            if (mcx_config.replay.seed != nullptr && mcx_config.outputtype == otRF) {
+            if (mcx_config.outputtype == otRF) {
                 field_dim[5] = 2;
             }
 
@@ -1290,6 +1409,7 @@ py::dict pmcx_interface(const py::dict& user_cfg) {
             stat_dict["energyabs"] = mcx_config.energyabs;
             stat_dict["normalizer"] = mcx_config.normalizer;
             stat_dict["unitinmm"] = mcx_config.unitinmm;
+            stat_dict["cached"] = (bool)mcx_config.iscachehit;
             py::list workload;
 
             for (int i = 0; i < active_dev; i++) {
@@ -1311,6 +1431,13 @@ py::dict pmcx_interface(const py::dict& user_cfg) {
                 memcpy(opt_properties.mutable_data(), mcx_config.prop, mcx_config.medianum * 4 * sizeof(float));
                 output["prop"] = opt_properties;
             }
+
+            /** return the DCS g1 curves, one column per detector */
+            if (mcx_config.exportg1) {
+                auto g1 = py::array_t<float, py::array::f_style>({int(mcx_config.dcsntau), int(mcx_config.detnum)});
+                memcpy(g1.mutable_data(), mcx_config.exportg1, mcx_config.dcsntau * mcx_config.detnum * sizeof(float));
+                output["g1"] = g1;
+            }
         }
     } catch (const char* err) {
         cleanup_configs(gpu_info, mcx_config);
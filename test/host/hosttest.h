@@ -0,0 +1,51 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    hosttest.h
+
+@brief   Assertion helpers shared by the host-side unit tests
+
+The host tests exercise the CPU modules of MCX (the tuner, the caches, the
+media encoders and the output post-processing) without a GPU. Each test is a
+standalone program returning 0 if all checks pass; they are built and run by
+"make hosttest" in the src folder, or by ctest in a CMake build.
+*******************************************************************************/
+
+#ifndef _MCEXTREME_HOSTTEST_H
+#define _MCEXTREME_HOSTTEST_H
+
+#include <stdio.h>
+
+static int hosttest_failed = 0;   /**< number of failed checks */
+static int hosttest_total = 0;    /**< number of checks */
+
+/**
+ * Record a check, print the location and the message if it fails
+ */
+
+#define HT_CHECK(cond, ...)  do { \
+        hosttest_total++; \
+        if (!(cond)) { \
+            hosttest_failed++; \
+            fprintf(stderr, "%s:%d: check failed: %s: ", __FILE__, __LINE__, #cond); \
+            fprintf(stderr, __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+        } \
+    } while (0)
+
+/**
+ * Print the summary of a test program and return its exit code
+ */
+
+#define HT_REPORT(name)  (printf("%s: %d of %d checks passed\n", (name), hosttest_total - hosttest_failed, hosttest_total), \
+                          (hosttest_failed > 0))
+
+#endif
@@ -0,0 +1,204 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    testbias.c
+
+@brief   Host test of the direction sampling and weight correction of the biased launch
+
+Launch directions of an isotropic and an arcsine source are drawn as the GPU
+kernel does, half of them within the cones toward three target detectors (two
+of which overlap), using the functions of mcx_bias.h. The mean weight must be 1,
+and the weighted histogram of the directions, in bins of equal source
+probability, must match the source density within 4.5 standard errors; the
+weighted fraction of directions inside a target cone must match its source
+probability, while the unweighted fraction must be biased toward it.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mcx_bias.h"
+#include "hosttest.h"
+
+#define BS_PHOTONS    2000000  /**< number of launches per source type */
+#define BS_THETABIN   10       /**< bins of the zenith angle, of equal source probability */
+#define BS_PHIBIN     12       /**< bins of the azimuth angle */
+#define BS_DETNUM     3        /**< number of target detectors */
+#define BS_PROB       0.5f     /**< probability of a biased launch */
+#define BS_ANGLE      0.3f     /**< half-angle of the cones */
+
+static unsigned int bs_state = 2654435761u;
+
+/**
+ * @brief A uniform random number in [0,1), xorshift32
+ */
+
+static float bs_rand(void) {
+    bs_state ^= bs_state << 13;
+    bs_state ^= bs_state >> 17;
+    bs_state ^= bs_state << 5;
+    return (float)((bs_state >> 8) * (1.0 / 16777216.0));
+}
+
+/**
+ * @brief Rotate a unit vector by the zenith angle (stheta, ctheta) and azimuth (sphi, cphi) about itself
+ */
+
+static float4 bs_rotate(float4 v, float stheta, float ctheta, float sphi, float cphi) {
+    float4 out = v;
+
+    if (v.z > -1.f + EPS && v.z < 1.f - EPS) {
+        float tmp0 = 1.f - v.z * v.z, tmp1 = stheta / sqrtf(tmp0);
+
+        out.x = tmp1 * (v.x * v.z * cphi - v.y * sphi) + v.x * ctheta;
+        out.y = tmp1 * (v.y * v.z * cphi + v.x * sphi) + v.y * ctheta;
+        out.z = -tmp1 * tmp0 * cphi + v.z * ctheta;
+    } else {
+        out.x = stheta * cphi;
+        out.y = stheta * sphi;
+        out.z = (v.z > 0.f) ? ctheta : -ctheta;
+    }
+
+    return out;
+}
+
+static float4 bs_vec(float x, float y, float z) {
+    float4 v;
+
+    v.x = x;
+    v.y = y;
+    v.z = z;
+    v.w = 0.f;
+    return v;
+}
+
+static void test_source(int srctype) {
+    float4 pos = bs_vec(30.f, 30.f, 10.f), srcdir = bs_vec(0.f, 0.f, 1.f), det[BS_DETNUM];
+    float biascos = cosf(BS_ANGLE);
+    double hist[BS_THETABIN][BS_PHIBIN], hist2[BS_THETABIN][BS_PHIBIN], wsum = 0.0, w2sum = 0.0;
+    double conew = 0.0, conew2 = 0.0, conecount = 0.0, conep;
+    int i, j, bad = 0;
+
+    memset(hist, 0, sizeof(hist));
+    memset(hist2, 0, sizeof(hist2));
+
+    /** the first two cones overlap, the third one is alone and straddles the equator of the source */
+    det[0] = bs_vec(38.f, 30.f, 20.f);
+    det[1] = bs_vec(37.f, 32.f, 21.f);
+    det[2] = bs_vec(20.f, 25.f, 10.5f);
+
+    for (i = 0; i < BS_PHOTONS; i++) {
+        float4 v;
+        float ang, stheta, ctheta, sphi, cphi, w, hits = 0.f;
+        int isbiased = (bs_rand() < BS_PROB), it, ip;
+
+        ang = TWO_PI * bs_rand();
+        sphi = sinf(ang);
+        cphi = cosf(ang);
+
+        if (isbiased) {
+            v = mcx_bias_axis(pos, det[mcx_bias_pickdet(bs_rand(), BS_DETNUM)], srcdir);
+            ctheta = mcx_bias_conecos(bs_rand(), biascos);
+            stheta = sqrtf(fmaxf(1.f - ctheta * ctheta, 0.f));
+        } else {
+            v = srcdir;
+            ang = (srctype == MCX_SRC_ISOTROPIC) ? acosf(2.f * bs_rand() - 1.f) : ONE_PI * bs_rand();
+            stheta = sinf(ang);
+            ctheta = cosf(ang);
+        }
+
+        v = bs_rotate(v, stheta, ctheta, sphi, cphi);
+
+        for (j = 0; j < BS_DETNUM; j++) {
+            hits += mcx_bias_incone(v, pos, det[j], srcdir, biascos);
+        }
+
+        w = mcx_bias_weight(mcx_bias_srcdensity(srctype, v, srcdir), hits, BS_DETNUM, biascos, BS_PROB);
+        wsum += w;
+        w2sum += (double)w * w;
+
+        /** bins of equal source probability: uniform in cos(theta) for isotropic, in theta for arcsine */
+        ctheta = fminf(fmaxf(v.z, -1.f), 1.f);
+        ang = (srctype == MCX_SRC_ISOTROPIC) ? (1.f - ctheta) * 0.5f : acosf(ctheta) * R_PI;
+        it = (int)(ang * BS_THETABIN);
+        ip = (int)((atan2f(v.y, v.x) * R_PI * 0.5f + 0.5f) * BS_PHIBIN);
+        it = (it < BS_THETABIN) ? it : BS_THETABIN - 1;
+        ip = (ip < BS_PHIBIN) ? ip : BS_PHIBIN - 1;
+        hist[it][ip] += w;
+        hist2[it][ip] += (double)w * w;
+
+        if (mcx_bias_incone(v, pos, det[2], srcdir, biascos)) {
+            conew += w;
+            conew2 += (double)w * w;
+            conecount++;
+        }
+    }
+
+    /** the mean weight is 1 */
+    {
+        double mean = wsum / BS_PHOTONS, se = sqrt((w2sum / BS_PHOTONS - mean * mean) / BS_PHOTONS);
+
+        HT_CHECK(fabs(mean - 1.0) < 4.5 * se, "source %d: mean weight %.6f, standard error %.2e", srctype, mean, se);
+    }
+
+    /** each bin holds 1/(BS_THETABIN*BS_PHIBIN) of the source */
+    for (i = 0; i < BS_THETABIN; i++) {
+        for (j = 0; j < BS_PHIBIN; j++) {
+            double p = hist[i][j] / BS_PHOTONS, se = sqrt((hist2[i][j] / BS_PHOTONS - p * p) / BS_PHOTONS);
+            double ref = 1.0 / (BS_THETABIN * BS_PHIBIN);
+
+            if (!(fabs(p - ref) < 4.5 * se) && bad++ == 0) {
+                fprintf(stderr, "source %d: bin (%d,%d) holds %.6f instead of %.6f, standard error %.2e\n", srctype, i, j, p, ref, se);
+            }
+        }
+    }
+
+    HT_CHECK(bad == 0, "source %d: %d of %d bins of the weighted direction histogram differ from the source density", srctype, bad,
+             BS_THETABIN * BS_PHIBIN);
+
+    /** the source probability of the third cone, integrated over its zenith angles about the source axis */
+    {
+        float4 axis = mcx_bias_axis(pos, det[2], srcdir);
+        double cax = axis.z, sax = sqrt(1.0 - cax * cax), se, p = conew / BS_PHOTONS;
+        int k, nk = 20000;
+
+        conep = 0.0;
+
+        /** the azimuthal fraction of the cone at each zenith angle theta about the source axis */
+        for (k = 0; k < nk; k++) {
+            double theta = ONE_PI * (k + 0.5) / nk, ct = cos(theta), st = sin(theta), frac = 0.0, arg;
+
+            if (st * sax > 0.0) {
+                arg = (biascos - ct * cax) / (st * sax);
+                frac = (arg <= -1.0) ? 1.0 : ((arg >= 1.0) ? 0.0 : acos(arg) / ONE_PI);
+            }
+
+            conep += frac * ((srctype == MCX_SRC_ISOTROPIC) ? 0.5 * st : 1.0 / ONE_PI) * ONE_PI / nk;
+        }
+
+        se = sqrt((conew2 / BS_PHOTONS - p * p) / BS_PHOTONS);
+        HT_CHECK(fabs(p - conep) < 4.5 * se + 1e-5, "source %d: weighted cone fraction %.6f instead of %.6f, standard error %.2e",
+                 srctype, p, conep, se);
+        HT_CHECK(conecount / BS_PHOTONS > BS_PROB / BS_DETNUM, "source %d: only %.4f of the launches are in the cone of a target",
+                 srctype, conecount / BS_PHOTONS);
+    }
+}
+
+int main(void) {
+    HT_CHECK(mcx_bias_pickdet(0.f, 3) == 0 && mcx_bias_pickdet(0.5f, 3) == 1 && mcx_bias_pickdet(nextafterf(1.f, 0.f), 3) == 2
+             && mcx_bias_pickdet(1.f, 3) == 2, "the target detectors are not picked uniformly");
+    HT_CHECK(mcx_bias_conecos(0.f, 0.5f) == 1.f && mcx_bias_conecos(1.f, 0.5f) == 0.5f, "the cone is not sampled between its axis and rim");
+
+    test_source(MCX_SRC_ISOTROPIC);
+    test_source(MCX_SRC_ARCSINE);
+    return HT_REPORT("testbias");
+}
@@ -0,0 +1,388 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    testbjdata.c
+
+@brief   Host test of the BJData input reader against the JSON reader
+
+A JSON input with a label volume, detectors and a 2-pattern source is
+exported by mcx_savejdata, as done by --dumpjson, which zips the volume and
+the pattern into _ArrayZipData_. The export, with its media and detectors
+rewritten as Nx4 matrices, is saved as JSON text and as BJData, where the
+numeric vectors and matrices are strongly-typed 1-D and N-D arrays and the
+zipped payloads are binary uint8 arrays. Both files are read by
+mcx_readconfig; the loaded settings and their --dumpjson exports must be
+identical.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mcx_utils.h"
+#include "cjson/cJSON.h"
+#include "zmat/zmatlib.h"
+#include "hosttest.h"
+
+#define BJD_DIM       8
+#define BJD_PATNUM    2
+#define BJD_PATSIZE   4
+
+#define BJD_INPUT     "testbjdata_input.json"
+#define BJD_EXPORT    "testbjdata_export.json"
+#define BJD_JSON      "testbjdata.json"
+#define BJD_BJD       "testbjdata.bjd"
+#define BJD_DUMPJSON  "testbjdata_json_dump.json"
+#define BJD_DUMPBJD   "testbjdata_bjd_dump.json"
+
+/**
+ * A growing byte buffer receiving the BJData document
+ */
+
+typedef struct BJDBuffer {
+    unsigned char* data;
+    size_t len;
+    size_t maxlen;
+} BJDBuffer;
+
+static void bjd_put(BJDBuffer* buf, const void* data, size_t len) {
+    if (buf->len + len > buf->maxlen) {
+        buf->maxlen = (buf->len + len) * 2;
+        buf->data = (unsigned char*)realloc(buf->data, buf->maxlen);
+    }
+
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+static void bjd_putmarker(BJDBuffer* buf, char marker) {
+    bjd_put(buf, &marker, 1);
+}
+
+static void bjd_putlength(BJDBuffer* buf, size_t len) {
+    int val = (int)len;
+
+    bjd_putmarker(buf, 'l');
+    bjd_put(buf, &val, sizeof(int));
+}
+
+static void bjd_putstring(BJDBuffer* buf, const char* str) {
+    bjd_putlength(buf, strlen(str));
+    bjd_put(buf, str, strlen(str));
+}
+
+/**
+ * @brief Return 1 if all elements of a cJSON array are numbers, 2 if all are integers in [0,255]
+ */
+
+static int bjd_isnumeric(const cJSON* arr) {
+    const cJSON* item;
+    int isbyte = 1;
+
+    if (arr->child == NULL) {
+        return 0;
+    }
+
+    for (item = arr->child; item; item = item->next) {
+        if (!cJSON_IsNumber(item)) {
+            return 0;
+        }
+
+        isbyte = isbyte && item->valuedouble >= 0.0 && item->valuedouble <= 255.0 && item->valuedouble == floor(item->valuedouble);
+    }
+
+    return 1 + isbyte;
+}
+
+/**
+ * @brief Write the elements of a numeric cJSON array as the payload of a typed array
+ */
+
+static void bjd_putpayload(BJDBuffer* buf, const cJSON* arr, char type) {
+    const cJSON* item;
+
+    for (item = arr->child; item; item = item->next) {
+        if (type == 'U') {
+            unsigned char val = (unsigned char)item->valuedouble;
+            bjd_put(buf, &val, 1);
+        } else {
+            double val = item->valuedouble;
+            bjd_put(buf, &val, sizeof(double));
+        }
+    }
+}
+
+/**
+ * @brief Convert a cJSON node to BJData: numeric vectors and matrices become typed arrays, zipped payloads become uint8 arrays
+ */
+
+static void bjd_encode(BJDBuffer* buf, const cJSON* node, const char* key) {
+    const cJSON* item;
+
+    if (cJSON_IsObject(node)) {
+        bjd_putmarker(buf, '{');
+
+        for (item = node->child; item; item = item->next) {
+            bjd_putstring(buf, item->string);
+            bjd_encode(buf, item, item->string);
+        }
+
+        bjd_putmarker(buf, '}');
+    } else if (cJSON_IsArray(node)) {
+        int numeric = bjd_isnumeric(node), rows = cJSON_GetArraySize(node), cols = 0, ismatrix = (rows > 0);
+
+        for (item = node->child; item && ismatrix; item = item->next) {
+            ismatrix = cJSON_IsArray(item) && bjd_isnumeric(item) && (cols == 0 || cJSON_GetArraySize(item) == cols);
+            cols = ismatrix ? cJSON_GetArraySize(item) : 0;
+        }
+
+        if (numeric) {
+            char type = (numeric == 2) ? 'U' : 'D';
+
+            bjd_put(buf, (type == 'U') ? "[$U#" : "[$D#", 4);
+            bjd_putlength(buf, rows);
+            bjd_putpayload(buf, node, type);
+        } else if (ismatrix) {
+            int dims[2] = {rows, cols};
+
+            bjd_put(buf, "[$D#[$l#U\x02", 10);
+            bjd_put(buf, dims, sizeof(dims));
+
+            for (item = node->child; item; item = item->next) {
+                bjd_putpayload(buf, item, 'D');
+            }
+        } else {
+            bjd_putmarker(buf, '[');
+
+            for (item = node->child; item; item = item->next) {
+                bjd_encode(buf, item, NULL);
+            }
+
+            bjd_putmarker(buf, ']');
+        }
+    } else if (cJSON_IsString(node)) {
+        if (key && strcmp(key, "_ArrayZipData_") == 0) {
+            size_t len = 0;
+            unsigned char* bin = NULL;
+            int status = 0;
+
+            HT_CHECK(zmat_decode(strlen(node->valuestring), (unsigned char*)node->valuestring, &len, &bin, zmBase64, &status) == 0,
+                     "can not decode the base64 payload");
+            bjd_put(buf, "[$U#", 4);
+            bjd_putlength(buf, len);
+            bjd_put(buf, bin, len);
+            free(bin);
+        } else {
+            bjd_putmarker(buf, 'S');
+            bjd_putstring(buf, node->valuestring);
+        }
+    } else if (cJSON_IsBool(node)) {
+        bjd_putmarker(buf, cJSON_IsTrue(node) ? 'T' : 'F');
+    } else if (cJSON_IsNumber(node)) {
+        if (node->valuedouble == floor(node->valuedouble) && fabs(node->valuedouble) < 2147483647.0) {
+            bjd_putlength(buf, (size_t)node->valueint);
+        } else {
+            double val = node->valuedouble;
+
+            bjd_putmarker(buf, 'D');
+            bjd_put(buf, &val, sizeof(double));
+        }
+    } else {
+        bjd_putmarker(buf, 'Z');
+    }
+}
+
+static char* bjd_readfile(const char* fname, size_t* len) {
+    FILE* fp = fopen(fname, "rb");
+    char* buf = NULL;
+
+    *len = 0;
+
+    if (fp) {
+        fseek(fp, 0, SEEK_END);
+        *len = ftell(fp);
+        rewind(fp);
+        buf = (char*)calloc(*len + 1, 1);
+
+        if (fread(buf, 1, *len, fp) != *len) {
+            *len = 0;
+        }
+
+        fclose(fp);
+    }
+
+    return buf;
+}
+
+static void bjd_writefile(const char* fname, const void* data, size_t len) {
+    FILE* fp = fopen(fname, "wb");
+
+    HT_CHECK(fp != NULL, "can not write %s", fname);
+
+    if (fp) {
+        fwrite(data, 1, len, fp);
+        fclose(fp);
+    }
+}
+
+/**
+ * @brief Write the JSON input with a label volume, a media matrix, detectors and a 2-pattern source
+ */
+
+static void bjd_writeinput(void) {
+    FILE* fp = fopen(BJD_INPUT, "wt");
+    int i;
+
+    HT_CHECK(fp != NULL, "can not write %s", BJD_INPUT);
+
+    if (fp == NULL) {
+        return;
+    }
+
+    fprintf(fp, "{\"Session\":{\"ID\":\"testbjdata\",\"Photons\":12345,\"RNGSeed\":7,\"DoMismatch\":true},\n"
+            "\"Forward\":{\"T0\":0,\"T1\":5e-09,\"Dt\":1e-09},\n"
+            "\"Domain\":{\"OriginType\":1,\"LengthUnit\":0.5,\"Media\":[[0,0,1,1],[0.005,1,0.01,1.37],[0.1,10.5,0.9,1.45]]},\n"
+            "\"Optode\":{\"Source\":{\"Type\":\"pattern\",\"Pos\":[0,0,0],\"Dir\":[0,0,1],\"Param1\":[%d,0,0,%d],\"Param2\":[0,%d,0,%d],\"SrcNum\":%d,\n"
+            "\"Pattern\":{\"Nx\":%d,\"Ny\":%d,\"Data\":[", BJD_DIM, BJD_PATSIZE, BJD_DIM, BJD_PATSIZE, BJD_PATNUM, BJD_PATSIZE, BJD_PATSIZE);
+
+    for (i = 0; i < BJD_PATSIZE * BJD_PATSIZE * BJD_PATNUM; i++) {
+        fprintf(fp, "%s%.4f", i ? "," : "", (i % 7) * 0.125 + (i % 3) * 0.01);
+    }
+
+    fprintf(fp, "]}},\n\"Detector\":[[2,2,0,1],[6,5,0,1.5],[4,4,8,2]]},\n"
+            "\"Shapes\":{\"_ArrayType_\":\"uint8\",\"_ArraySize_\":[%d,%d,%d],\"_ArrayData_\":[", BJD_DIM, BJD_DIM, BJD_DIM);
+
+    for (i = 0; i < BJD_DIM * BJD_DIM * BJD_DIM; i++) {
+        fprintf(fp, "%s%d", i ? "," : "", ((i / BJD_DIM) % BJD_DIM > BJD_DIM / 2) ? 2 : (i % 11 != 0));
+    }
+
+    fprintf(fp, "]}}\n");
+    fclose(fp);
+}
+
+/**
+ * @brief Replace the media and detector objects of an exported input by the Nx4 matrix forms
+ */
+
+static void bjd_matrixform(cJSON* root) {
+    cJSON* domain = cJSON_GetObjectItem(root, "Domain"), *optode = cJSON_GetObjectItem(root, "Optode");
+    cJSON* media = cJSON_GetObjectItem(domain, "Media"), *det = cJSON_GetObjectItem(optode, "Detector"), *item, *mat;
+    double row[4];
+
+    HT_CHECK(cJSON_IsArray(media) && cJSON_IsArray(det), "the exported input has no media or detectors");
+
+    if (!cJSON_IsArray(media) || !cJSON_IsArray(det)) {
+        return;
+    }
+
+    mat = cJSON_CreateArray();
+
+    for (item = media->child; item; item = item->next) {
+        row[0] = cJSON_GetObjectItem(item, "mua")->valuedouble;
+        row[1] = cJSON_GetObjectItem(item, "mus")->valuedouble;
+        row[2] = cJSON_GetObjectItem(item, "g")->valuedouble;
+        row[3] = cJSON_GetObjectItem(item, "n")->valuedouble;
+        cJSON_AddItemToArray(mat, cJSON_CreateDoubleArray(row, 4));
+    }
+
+    cJSON_ReplaceItemInObject(domain, "Media", mat);
+    mat = cJSON_CreateArray();
+
+    for (item = det->child; item; item = item->next) {
+        cJSON* pos = cJSON_GetObjectItem(item, "Pos");
+
+        row[0] = cJSON_GetArrayItem(pos, 0)->valuedouble;
+        row[1] = cJSON_GetArrayItem(pos, 1)->valuedouble;
+        row[2] = cJSON_GetArrayItem(pos, 2)->valuedouble;
+        row[3] = cJSON_GetObjectItem(item, "R")->valuedouble;
+        cJSON_AddItemToArray(mat, cJSON_CreateDoubleArray(row, 4));
+    }
+
+    cJSON_ReplaceItemInObject(optode, "Detector", mat);
+}
+
+static void bjd_load(const char* fname, Config* cfg) {
+    mcx_initcfg(cfg);
+    cfg->flog = stderr;
+    mcx_readconfig((char*)fname, cfg);
+    cfg->isdumpjson = 1;
+}
+
+static void test_bjdata(void) {
+    Config ref, jcfg, bcfg;
+    BJDBuffer bjd = {NULL, 0, 0};
+    cJSON* root;
+    char* text, *dump1, *dump2;
+    size_t len, len1, len2, voxels = BJD_DIM * BJD_DIM * BJD_DIM;
+
+    bjd_writeinput();
+    bjd_load(BJD_INPUT, &ref);
+    mcx_savejdata(BJD_EXPORT, &ref);
+
+    text = bjd_readfile(BJD_EXPORT, &len);
+    HT_CHECK(text && strstr(text, "_ArrayZipData_"), "the exported input has no zipped payload");
+
+    /** the export, with the media and detectors as matrices, in JSON and in BJData with typed arrays and binary payloads */
+    root = cJSON_Parse(text);
+    HT_CHECK(root != NULL, "can not parse the exported input");
+    free(text);
+
+    if (root) {
+        bjd_matrixform(root);
+        text = cJSON_Print(root);
+        bjd_writefile(BJD_JSON, text, strlen(text));
+        bjd_encode(&bjd, root, NULL);
+        bjd_writefile(BJD_BJD, bjd.data, bjd.len);
+        cJSON_Delete(root);
+    }
+
+    bjd_load(BJD_JSON, &jcfg);
+    bjd_load(BJD_BJD, &bcfg);
+
+    /** the settings loaded from JSON and BJData match each other and the original input */
+    HT_CHECK(jcfg.dim.x == BJD_DIM && bcfg.dim.x == BJD_DIM && bcfg.dim.y == BJD_DIM && bcfg.dim.z == BJD_DIM, "volume size %u", bcfg.dim.x);
+    HT_CHECK(jcfg.mediabyte == bcfg.mediabyte && jcfg.vol && bcfg.vol && memcmp(jcfg.vol, bcfg.vol, voxels * bcfg.mediabyte) == 0,
+             "the volumes differ");
+    HT_CHECK(ref.mediabyte == bcfg.mediabyte && memcmp(ref.vol, bcfg.vol, voxels * bcfg.mediabyte) == 0, "the volume differs from the input");
+    HT_CHECK(bcfg.medianum == 3 && memcmp(jcfg.prop, bcfg.prop, bcfg.medianum * sizeof(Medium)) == 0, "the media differ");
+    HT_CHECK(bcfg.detnum == 3 && memcmp(jcfg.detpos, bcfg.detpos, bcfg.detnum * sizeof(float4)) == 0, "the detectors differ");
+    HT_CHECK(bcfg.srcnum == BJD_PATNUM && bcfg.srcpattern
+             && memcmp(ref.srcpattern, bcfg.srcpattern, BJD_PATSIZE * BJD_PATSIZE * BJD_PATNUM * sizeof(float)) == 0
+             && memcmp(jcfg.srcpattern, bcfg.srcpattern, BJD_PATSIZE * BJD_PATSIZE * BJD_PATNUM * sizeof(float)) == 0, "the patterns differ");
+    HT_CHECK(jcfg.nphoton == bcfg.nphoton && jcfg.seed == bcfg.seed && jcfg.unitinmm == bcfg.unitinmm && jcfg.tend == bcfg.tend
+             && jcfg.isreflect == bcfg.isreflect && jcfg.srctype == bcfg.srctype, "the scalar settings differ");
+
+    /** and export the same --dumpjson output */
+    mcx_savejdata(BJD_DUMPJSON, &jcfg);
+    mcx_savejdata(BJD_DUMPBJD, &bcfg);
+    dump1 = bjd_readfile(BJD_DUMPJSON, &len1);
+    dump2 = bjd_readfile(BJD_DUMPBJD, &len2);
+    HT_CHECK(dump1 && dump2 && len1 == len2 && memcmp(dump1, dump2, len1) == 0, "the exports of the JSON and BJData inputs differ");
+
+    mcx_clearcfg(&ref);
+    mcx_clearcfg(&jcfg);
+    mcx_clearcfg(&bcfg);
+    free(bjd.data);
+    free(text);
+    free(dump1);
+    free(dump2);
+    remove(BJD_INPUT);
+    remove(BJD_EXPORT);
+    remove(BJD_JSON);
+    remove(BJD_BJD);
+    remove(BJD_DUMPJSON);
+    remove(BJD_DUMPBJD);
+}
+
+int main(void) {
+    test_bjdata();
+    return HT_REPORT("testbjdata");
+}
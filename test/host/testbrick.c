@@ -0,0 +1,185 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    testbrick.c
+
+@brief   Host test of the brick-compressed media volume
+
+Each brick of the test volumes is filled with a single value, with 2, 3, 11
+or 200 distinct values (1, 2, 4 and 8-bit palettes) or with more than 256
+values (dense), the domain sizes leave partial bricks on the +x/+y/+z faces,
+and more than 64 bricks hold distinct uniform values. mcx_brick_lookup must
+return the dense value of every voxel; the storage class and length of each
+brick must match those predicted from its distinct values.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mcx_brick.h"
+#include "hosttest.h"
+
+#define BRICK_KINDS   9        /**< uniform (4 kinds), palettes of 2, 3, 11 and 200 values, dense */
+
+static unsigned int br_state = 2463534242u;
+
+/**
+ * @brief A random 32-bit integer, xorshift32
+ */
+
+static unsigned int br_rand(void) {
+    br_state ^= br_state << 13;
+    br_state ^= br_state >> 17;
+    br_state ^= br_state << 5;
+    return br_state;
+}
+
+/**
+ * @brief Fill a volume brick by brick, the value set of brick b is chosen by b % BRICK_KINDS
+ */
+
+static void br_fill(unsigned int* vol, unsigned int dimx, unsigned int dimy, unsigned int dimz) {
+    static const unsigned int palnum[BRICK_KINDS] = {1, 1, 1, 1, 2, 3, 11, 200, 0};
+    unsigned int bx = (dimx + MCX_BRICK_MASK) >> MCX_BRICK_BITS, by = (dimy + MCX_BRICK_MASK) >> MCX_BRICK_BITS;
+    unsigned int x, y, z;
+
+    for (z = 0; z < dimz; z++) {
+        for (y = 0; y < dimy; y++) {
+            for (x = 0; x < dimx; x++) {
+                unsigned int b = ((z >> MCX_BRICK_BITS) * by + (y >> MCX_BRICK_BITS)) * bx + (x >> MCX_BRICK_BITS);
+                unsigned int kind = b % BRICK_KINDS, *v = vol + ((size_t)z * dimy + y) * dimx + x;
+
+                if (kind < 3) {
+                    *v = 1000 + b;                        /* a distinct uniform value per brick */
+                } else if (kind == 3) {
+                    *v = (b / BRICK_KINDS) % 4;           /* uniform values repeated across bricks */
+                } else if (palnum[kind]) {
+                    *v = (br_rand() % palnum[kind]) * 0x01010101u + ((kind == 7) ? 0x80000000u : 0);
+                } else {
+                    *v = br_rand();
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Count the distinct values of the in-domain voxels of a brick
+ */
+
+static unsigned int br_distinct(const unsigned int* vol, unsigned int dimx, unsigned int dimy, unsigned int dimz,
+                                unsigned int ix, unsigned int iy, unsigned int iz) {
+    unsigned int seen[MCX_BRICK_VOXELS], num = 0, x, y, z, i;
+
+    for (z = iz; z < iz + MCX_BRICK_SIZE && z < dimz; z++) {
+        for (y = iy; y < iy + MCX_BRICK_SIZE && y < dimy; y++) {
+            for (x = ix; x < ix + MCX_BRICK_SIZE && x < dimx; x++) {
+                unsigned int val = vol[((size_t)z * dimy + y) * dimx + x];
+
+                for (i = 0; i < num && seen[i] != val; i++);
+
+                if (i == num) {
+                    seen[num++] = val;
+                }
+            }
+        }
+    }
+
+    return num;
+}
+
+static void test_roundtrip(unsigned int dimx, unsigned int dimy, unsigned int dimz) {
+    unsigned int bx = (dimx + MCX_BRICK_MASK) >> MCX_BRICK_BITS, by = (dimy + MCX_BRICK_MASK) >> MCX_BRICK_BITS;
+    unsigned int bz = (dimz + MCX_BRICK_MASK) >> MCX_BRICK_BITS, nbrick = bx * by * bz;
+    unsigned int* vol = (unsigned int*)calloc((size_t)dimx * dimy * dimz, sizeof(unsigned int)), *brick;
+    unsigned int count[3], expected[3] = {0, 0, 0}, widths[9] = {0}, shared[64], sharednum = 0, uniquenum = 0;
+    unsigned int x, y, z, b, i, badvoxel = 0, badbrick = 0;
+    size_t len = 0, explen = nbrick;
+
+    br_fill(vol, dimx, dimy, dimz);
+    brick = mcx_brick_encode(vol, dimx, dimy, dimz, &len, count);
+    HT_CHECK(brick != NULL, "can not encode a %ux%ux%u volume", dimx, dimy, dimz);
+
+    if (brick == NULL) {
+        free(vol);
+        return;
+    }
+
+    for (z = 0; z < dimz; z++) {
+        for (y = 0; y < dimy; y++) {
+            for (x = 0; x < dimx; x++) {
+                if (mcx_brick_lookup(brick, bx, by, x, y, z) != vol[((size_t)z * dimy + y) * dimx + x] && badvoxel++ == 0) {
+                    fprintf(stderr, "voxel (%u,%u,%u) reads %u instead of %u\n", x, y, z,
+                            mcx_brick_lookup(brick, bx, by, x, y, z), vol[((size_t)z * dimy + y) * dimx + x]);
+                }
+            }
+        }
+    }
+
+    HT_CHECK(badvoxel == 0, "%u of %u voxels of a %ux%ux%u volume differ", badvoxel, dimx * dimy * dimz, dimx, dimy, dimz);
+
+    /** the storage class of each brick, and the encoded length, follow from its distinct values */
+    for (b = 0; b < nbrick; b++) {
+        unsigned int ix = (b % bx) << MCX_BRICK_BITS, iy = ((b / bx) % by) << MCX_BRICK_BITS, iz = (b / (bx * by)) << MCX_BRICK_BITS;
+        unsigned int num = br_distinct(vol, dimx, dimy, dimz, ix, iy, iz), type = brick[b] & 3, bits;
+
+        if (num == 1) {
+            unsigned int val = vol[((size_t)iz * dimy + iy) * dimx + ix];
+
+            for (i = 0; i < sharednum && shared[i] != val; i++);
+
+            if (i == sharednum) {
+                /** the first 64 uniform values share their data word, later values take one word per brick */
+                explen++;
+                uniquenum++;
+
+                if (sharednum < 64) {
+                    shared[sharednum++] = val;
+                }
+            }
+
+            badbrick += (type != MCX_BRICK_UNIFORM);
+        } else if (num <= 256) {
+            for (bits = 1; (1u << bits) < num; bits <<= 1);
+
+            explen += 1 + (1u << bits) + ((MCX_BRICK_VOXELS * bits) >> 5);
+            badbrick += (type != MCX_BRICK_PALETTE || brick[brick[b] >> 2] != bits);
+            widths[bits]++;
+        } else {
+            explen += MCX_BRICK_VOXELS;
+            badbrick += (type != MCX_BRICK_DENSE);
+        }
+
+        expected[(num == 1) ? MCX_BRICK_UNIFORM : ((num <= 256) ? MCX_BRICK_PALETTE : MCX_BRICK_DENSE)]++;
+    }
+
+    HT_CHECK(badbrick == 0, "%u bricks of a %ux%ux%u volume are not stored as expected", badbrick, dimx, dimy, dimz);
+    HT_CHECK(memcmp(count, expected, sizeof(count)) == 0, "counted %u/%u/%u bricks, expected %u/%u/%u",
+             count[0], count[1], count[2], expected[0], expected[1], expected[2]);
+    HT_CHECK(len == explen, "encoded %lu words, expected %lu", (unsigned long)len, (unsigned long)explen);
+
+    /** the large volume covers every storage class */
+    if (nbrick > 64 * BRICK_KINDS / 3) {
+        HT_CHECK(uniquenum > 64, "only %u bricks hold distinct uniform values", uniquenum);
+        HT_CHECK(widths[1] && widths[2] && widths[4] && widths[8] && count[MCX_BRICK_DENSE],
+                 "palettes of %u/%u/%u/%u bricks, %u dense bricks", widths[1], widths[2], widths[4], widths[8], count[MCX_BRICK_DENSE]);
+    }
+
+    free(brick);
+    free(vol);
+}
+
+int main(void) {
+    test_roundtrip(85, 46, 35);    /* partial bricks on all faces */
+    test_roundtrip(24, 16, 8);     /* whole bricks only */
+    test_roundtrip(1, 1, 1);
+    return HT_REPORT("testbrick");
+}
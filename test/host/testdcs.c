@@ -0,0 +1,198 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    testdcs.c
+
+@brief   Host test of the DCS g1 computed from synthetic detected photon records
+
+Records of random detectors, partial paths, momentum transfers and initial
+weights are stored in full precision and in the compact half-precision layout,
+with values that are exact in half precision. For the Brownian and the random
+flow models, mcx_dcs_g1 must reproduce the formula of utils/mcxdcsg1.m, with
+the sums over the photons of each detector weighted by their initial weights,
+and must give g1(0)=1; both layouts must give identical curves. Records of
+unknown detectors are skipped, and a detector without photons has g1=0.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mcx_dcs.h"
+#include "mcx_const.h"
+#include "mcx_detfilter.h"
+#include "hosttest.h"
+
+#define DC_RECORDS   5000     /**< number of records, summed in several blocks */
+#define DC_MEDIA     3        /**< number of media, excluding the background */
+#define DC_DETNUM    3        /**< number of detectors, the last one detects no photon */
+#define DC_NTAU      6        /**< number of correlation times, the first one is 0 */
+#define DC_FLAG      0x4F     /**< detid, nscat, ppath, mom and w0 */
+#define DC_FULLLEN   (2 + 3 * DC_MEDIA)                         /**< floats per record in full precision */
+#define DC_HALFLEN   (2 + DC_MEDIA + 2 * ((DC_MEDIA + 1) / 2))  /**< floats per record in half precision */
+
+static unsigned int dc_state = 1013904223u;
+
+/**
+ * @brief A random 32-bit integer, xorshift32
+ */
+
+static unsigned int dc_rand(void) {
+    dc_state ^= dc_state << 13;
+    dc_state ^= dc_state >> 17;
+    dc_state ^= dc_state << 5;
+    return dc_state;
+}
+
+/**
+ * @brief Set the media, detectors and correlation times of the test
+ */
+
+static void dc_init(Config* cfg, int model, float disp) {
+    static const float tau[DC_NTAU] = {0.f, 1e-6f, 1e-5f, 1e-4f, 3e-4f, 1e-3f};
+    unsigned int i;
+
+    mcx_initcfg(cfg);
+    cfg->medianum = DC_MEDIA + 1;
+    cfg->detnum = DC_DETNUM;
+    cfg->savedetflag = DC_FLAG;
+    cfg->prop = (Medium*)calloc(DC_MEDIA + 1, sizeof(Medium));
+
+    for (i = 1; i <= DC_MEDIA; i++) {
+        cfg->prop[i].mua = 0.002f + 0.004f * i;
+        cfg->prop[i].mus = 1.f;
+        cfg->prop[i].g = 0.9f;
+        cfg->prop[i].n = 1.3f + 0.05f * i;
+    }
+
+    cfg->dcsmodel = model;
+    cfg->dcsdisp = disp;
+    cfg->dcsntau = DC_NTAU;
+    cfg->dcstau = (float*)malloc(DC_NTAU * sizeof(float));
+    memcpy(cfg->dcstau, tau, sizeof(tau));
+}
+
+/**
+ * @brief The g1 of utils/mcxdcsg1.m in double precision, each photon weighted by its initial weight
+ */
+
+static double dc_reference(const float* full, const Config* cfg, unsigned int detid, float tau) {
+    double lambda = MCX_DCS_LAMBDA * 1e-6, rmsdisp, num = 0.0, den = 0.0;
+    unsigned int p, i;
+
+    rmsdisp = (cfg->dcsmodel == MCX_DCS_BROWNIAN) ? 6.0 * cfg->dcsdisp * tau : (double)cfg->dcsdisp * cfg->dcsdisp * tau * tau;
+
+    for (p = 0; p < DC_RECORDS; p++) {
+        const float* rec = full + p * DC_FULLLEN;
+        double atten = 0.0, mom = 0.0;
+
+        if ((unsigned int)rec[0] != detid) {
+            continue;
+        }
+
+        for (i = 0; i < DC_MEDIA; i++) {
+            double k0 = TWO_PI * cfg->prop[i + 1].n / lambda;
+
+            atten += cfg->prop[i + 1].mua * rec[1 + DC_MEDIA + i];
+            mom += k0 * k0 * rmsdisp / 3.0 * rec[1 + 2 * DC_MEDIA + i];
+        }
+
+        num += rec[DC_FULLLEN - 1] * exp(-mom - atten);
+        den += rec[DC_FULLLEN - 1] * exp(-atten);
+    }
+
+    return (den > 0.0) ? num / den : 0.0;
+}
+
+static void test_model(const float* full, const float* packed, int model, float disp) {
+    Config cfg;
+    float g1[DC_DETNUM * DC_NTAU], g1half[DC_DETNUM * DC_NTAU];
+    unsigned int d, t, bad = 0;
+
+    dc_init(&cfg, model, disp);
+
+    cfg.his.colcount = DC_FULLLEN;
+    HT_CHECK(mcx_dcs_g1(full, DC_RECORDS, &cfg, g1) == 0, "model %d: g1 is not computed", model);
+
+    cfg.his.colcount = DC_HALFLEN;
+    cfg.his.ishalf = 1;
+    HT_CHECK(mcx_dcs_g1(packed, DC_RECORDS, &cfg, g1half) == 0, "model %d: g1 is not computed from half-precision records", model);
+    HT_CHECK(memcmp(g1, g1half, sizeof(g1)) == 0, "model %d: the half-precision records give a different g1", model);
+
+    for (d = 0; d < DC_DETNUM; d++) {
+        for (t = 0; t < DC_NTAU; t++) {
+            double ref = dc_reference(full, &cfg, d + 1, cfg.dcstau[t]), val = g1[d * DC_NTAU + t];
+
+            if (!(fabs(val - ref) <= 1e-5 * ref + 1e-7) && bad++ == 0) {
+                fprintf(stderr, "model %d, detector %u, tau %g: g1 %.9g instead of %.9g\n", model, d + 1, cfg.dcstau[t], val, ref);
+            }
+        }
+    }
+
+    HT_CHECK(bad == 0, "model %d: %u g1 values differ from mcxdcsg1.m", model, bad);
+    HT_CHECK(g1[0] == 1.f && g1[DC_NTAU] == 1.f, "model %d: g1(0) is %.9g and %.9g instead of 1", model, g1[0], g1[DC_NTAU]);
+    HT_CHECK(g1[DC_NTAU - 1] < 0.5f && g1[DC_NTAU - 1] > 0.f, "model %d: g1 decays to %.9g", model, g1[DC_NTAU - 1]);
+    HT_CHECK(g1[(DC_DETNUM - 1) * DC_NTAU] == 0.f, "model %d: g1 of a detector without photons is not 0", model);
+
+    /** the records must contain both the partial paths and the momentum transfers */
+    cfg.savedetflag = DC_FLAG & ~0x8;
+    HT_CHECK(mcx_dcs_g1(packed, DC_RECORDS, &cfg, g1half) == -1, "model %d: g1 is computed without momentum transfers", model);
+
+    mcx_clearcfg(&cfg);
+}
+
+int main(void) {
+    float* full = (float*)malloc(sizeof(float) * DC_RECORDS * DC_FULLLEN), *packed = (float*)malloc(sizeof(float) * DC_RECORDS * DC_HALFLEN);
+    unsigned int r, i, g;
+
+    for (r = 0; r < DC_RECORDS; r++) {
+        float* rec = full + r * DC_FULLLEN, *dst = packed + r * DC_HALFLEN;
+        unsigned short bits[2][DC_MEDIA + 1] = {{0}};
+        unsigned int* word = (unsigned int*)(dst + 1 + DC_MEDIA);
+
+        /** detectors 1 and 2, and a few records of the unknown detectors 0 and 4 */
+        rec[0] = (float)((r % 50 == 7) ? 4 * (r & 1) : 1 + (dc_rand() & 1));
+
+        for (i = 0; i < DC_MEDIA; i++) {
+            rec[1 + i] = (float)(dc_rand() % 60);
+        }
+
+        /** partial paths in [1,64) and momentum transfers in [1,8) grid units, exact in half precision */
+        for (g = 0; g < 2; g++) {
+            for (i = 0; i < DC_MEDIA; i++) {
+                unsigned short h = (unsigned short)(0x3C00 + dc_rand() % (g ? 0x0C00 : 0x1800));
+
+                bits[g][i] = h;
+                rec[1 + (1 + g) * DC_MEDIA + i] = mcx_half2float(h);
+            }
+        }
+
+        rec[DC_FULLLEN - 1] = 0.5f + (dc_rand() % 1000) * 1e-3f;
+
+        /** the compact layout: each group as pairs of halves with the first in the lower bits */
+        memcpy(dst, rec, sizeof(float) * (1 + DC_MEDIA));
+
+        for (g = 0; g < 2; g++) {
+            for (i = 0; i < (DC_MEDIA + 1) / 2; i++) {
+                word[g * ((DC_MEDIA + 1) / 2) + i] = bits[g][2 * i] | ((unsigned int)bits[g][2 * i + 1] << 16);
+            }
+        }
+
+        dst[DC_HALFLEN - 1] = rec[DC_FULLLEN - 1];
+    }
+
+    test_model(full, packed, MCX_DCS_BROWNIAN, 1e-6f);
+    test_model(full, packed, MCX_DCS_RANDOMFLOW, 0.1f);
+
+    free(full);
+    free(packed);
+    return HT_REPORT("testdcs");
+}
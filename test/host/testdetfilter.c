@@ -0,0 +1,338 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    testdetfilter.c
+
+@brief   Host test of the detected photon filter and the half-precision records
+
+Detected photon records with known detector IDs, scattering counts, partial
+paths and initial weights are tested against each criterion of the filter,
+at and across its bounds, with mcx_detfilter_pass and mcx_detfilter_record;
+criteria whose columns are not saved must be skipped. All 65536 half-precision
+bit patterns are decoded by mcx_half2float and compared with their exact
+values, and records packed with half-precision ppath/mom columns are expanded
+by mcx_detfilter_expand and must filter as their single-precision originals.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mcx_detfilter.h"
+#include "hosttest.h"
+
+#define DF_MEDIA      3        /**< number of media, excluding the background */
+#define DF_RECORDS    17       /**< number of records expanded from half precision */
+#define DF_FLAG       0x4F     /**< saved columns: detid, nscat, ppath, mom and w0 */
+#define DF_FULLLEN    (1 + 3 * DF_MEDIA + 1)   /**< floats per single-precision record */
+
+static unsigned int df_state = 3141592653u;
+
+/**
+ * @brief A random 32-bit integer, xorshift32
+ */
+
+static unsigned int df_rand(void) {
+    df_state ^= df_state << 13;
+    df_state ^= df_state >> 17;
+    df_state ^= df_state << 5;
+    return df_state;
+}
+
+/**
+ * @brief Set up the media and the header of the test records
+ */
+
+static void df_init(Config* cfg, History* his) {
+    unsigned int i;
+
+    mcx_initcfg(cfg);
+    cfg->medianum = DF_MEDIA + 1;
+    cfg->prop = (Medium*)calloc(cfg->medianum, sizeof(Medium));
+
+    for (i = 1; i <= DF_MEDIA; i++) {
+        cfg->prop[i].mua = 0.01f * i;
+        cfg->prop[i].mus = 10.f;
+        cfg->prop[i].g = 0.9f;
+        cfg->prop[i].n = 1.f + 0.2f * i;
+    }
+
+    memset(his, 0, sizeof(History));
+    his->maxmedia = DF_MEDIA;
+    his->savedetflag = DF_FLAG;
+    his->colcount = DF_FULLLEN;
+    his->unitinmm = 0.5f;
+    his->totalsource = 1;
+}
+
+/**
+ * @brief Fill a single-precision record in the DF_FLAG layout
+ */
+
+static void df_record(float* rec, float detid, const float* nscat, const float* ppath, float w0) {
+    unsigned int i;
+
+    rec[0] = detid;
+
+    for (i = 0; i < DF_MEDIA; i++) {
+        rec[1 + i] = nscat[i];
+        rec[1 + DF_MEDIA + i] = ppath[i];
+        rec[1 + 2 * DF_MEDIA + i] = 0.125f * i;
+    }
+
+    rec[1 + 3 * DF_MEDIA] = w0;
+}
+
+/**
+ * @brief The time-of-flight and exit weight of a record, computed as the host reference does
+ */
+
+static void df_expect(const Config* cfg, const History* his, const float* ppath, float w0, float* tof, float* weight) {
+    unsigned int i;
+
+    *tof = 0.f;
+    *weight = w0;
+
+    for (i = 0; i < DF_MEDIA; i++) {
+        float plen = ppath[i] * his->unitinmm;
+
+        *weight *= expf(-cfg->prop[i + 1].mua * plen);
+        *tof += plen * R_C0 * cfg->prop[i + 1].n;
+    }
+}
+
+static void test_pass(void) {
+    DetFilter filter;
+
+    memset(&filter, 0, sizeof(filter));
+    HT_CHECK(mcx_detfilter_pass(&filter, 7, 1e-9f, 1e-6f, 1e4f) == 1, "an empty filter discards a photon");
+
+    /** detector subset {1, 3, 256} */
+    filter.isdetmask = 1;
+    filter.detmask[0] = 0x5;
+    filter.detmask[(MAX_FILTER_DET - 1) >> 5] = 1u << ((MAX_FILTER_DET - 1) & 31);
+    HT_CHECK(mcx_detfilter_pass(&filter, 1, 0.f, 1.f, 0.f) && mcx_detfilter_pass(&filter, 3, 0.f, 1.f, 0.f)
+             && mcx_detfilter_pass(&filter, MAX_FILTER_DET, 0.f, 1.f, 0.f), "a listed detector is discarded");
+    HT_CHECK(!mcx_detfilter_pass(&filter, 2, 0.f, 1.f, 0.f) && !mcx_detfilter_pass(&filter, 0, 0.f, 1.f, 0.f)
+             && !mcx_detfilter_pass(&filter, MAX_FILTER_DET + 1, 0.f, 1.f, 0.f) && !mcx_detfilter_pass(&filter, -1, 0.f, 1.f, 0.f),
+             "an unlisted detector is kept");
+    filter.isdetmask = 0;
+
+    /** the time window includes its bounds, and is ignored if tmax<=tmin */
+    filter.tmin = 1e-10f;
+    filter.tmax = 2e-9f;
+    HT_CHECK(mcx_detfilter_pass(&filter, 1, 1e-10f, 1.f, 0.f) && mcx_detfilter_pass(&filter, 1, 2e-9f, 1.f, 0.f)
+             && mcx_detfilter_pass(&filter, 1, 1e-9f, 1.f, 0.f), "a photon inside the time window is discarded");
+    HT_CHECK(!mcx_detfilter_pass(&filter, 1, nextafterf(1e-10f, 0.f), 1.f, 0.f) && !mcx_detfilter_pass(&filter, 1, nextafterf(2e-9f, 1.f), 1.f, 0.f),
+             "a photon outside the time window is kept");
+    filter.tmax = filter.tmin;
+    HT_CHECK(mcx_detfilter_pass(&filter, 1, 1.f, 1.f, 0.f), "an empty time window discards a photon");
+    filter.tmin = filter.tmax = 0.f;
+
+    /** the minimum weight is inclusive */
+    filter.minweight = 1e-4f;
+    HT_CHECK(mcx_detfilter_pass(&filter, 1, 0.f, 1e-4f, 0.f) && !mcx_detfilter_pass(&filter, 1, 0.f, nextafterf(1e-4f, 0.f), 0.f),
+             "the minimum weight is not inclusive");
+    filter.minweight = 0.f;
+
+    /** the maximum scattering count is inclusive, 0 disables it */
+    filter.maxscat = 100;
+    HT_CHECK(mcx_detfilter_pass(&filter, 1, 0.f, 1.f, 100.f) && !mcx_detfilter_pass(&filter, 1, 0.f, 1.f, 101.f),
+             "the maximum scattering count is not inclusive");
+}
+
+static void test_record(void) {
+    Config cfg;
+    History his;
+    float rec[DF_FULLLEN], tof, weight;
+    float nscat[DF_MEDIA] = {20.f, 30.f, 50.f}, ppath[DF_MEDIA] = {10.f, 40.f, 25.f};
+
+    df_init(&cfg, &his);
+    df_record(rec, 3.f, nscat, ppath, 0.8f);
+    df_expect(&cfg, &his, ppath, 0.8f, &tof, &weight);
+
+    cfg.detfilter.enabled = 1;
+    HT_CHECK(mcx_detfilter_record(rec, &his, &cfg) == 1, "an empty filter discards a record");
+
+    /** detector subset, the source index in the upper 16 bits is ignored with multiple sources */
+    cfg.detfilter.isdetmask = 1;
+    cfg.detfilter.detmask[0] = 0x4;
+    HT_CHECK(mcx_detfilter_record(rec, &his, &cfg) == 1, "a record of detector 3 is discarded by the subset {3}");
+    rec[0] = 2.f;
+    HT_CHECK(mcx_detfilter_record(rec, &his, &cfg) == 0, "a record of detector 2 is kept by the subset {3}");
+    rec[0] = (float)((2 << 16) | 3);
+    his.totalsource = 2;
+    HT_CHECK(mcx_detfilter_record(rec, &his, &cfg) == 1, "a record of source 2, detector 3 is discarded by the subset {3}");
+    his.totalsource = 1;
+    his.savedetflag = DF_FLAG & ~0x1;
+    HT_CHECK(mcx_detfilter_record(rec + 1, &his, &cfg) == 1, "the detector subset is applied without the detid column");
+    his.savedetflag = DF_FLAG;
+    rec[0] = 3.f;
+    cfg.detfilter.isdetmask = 0;
+
+    /** the time-of-flight is recomputed from the partial paths */
+    cfg.detfilter.tmin = tof * 0.999f;
+    cfg.detfilter.tmax = tof * 1.001f;
+    HT_CHECK(mcx_detfilter_record(rec, &his, &cfg) == 1, "a record of %g s is discarded by the window [%g %g]", tof, cfg.detfilter.tmin, cfg.detfilter.tmax);
+    cfg.detfilter.tmax = tof * 0.9995f;
+    HT_CHECK(mcx_detfilter_record(rec, &his, &cfg) == 0, "a record of %g s is kept by the window [%g %g]", tof, cfg.detfilter.tmin, cfg.detfilter.tmax);
+    cfg.detfilter.tmin = tof * 1.0005f;
+    cfg.detfilter.tmax = tof * 1.001f;
+    HT_CHECK(mcx_detfilter_record(rec, &his, &cfg) == 0, "a record of %g s is kept by the window [%g %g]", tof, cfg.detfilter.tmin, cfg.detfilter.tmax);
+    cfg.detfilter.tmin = cfg.detfilter.tmax = 0.f;
+
+    /** the exit weight is the initial weight attenuated along the partial paths */
+    cfg.detfilter.minweight = weight * 0.999f;
+    HT_CHECK(mcx_detfilter_record(rec, &his, &cfg) == 1, "a record of weight %g is discarded by the minimum %g", weight, cfg.detfilter.minweight);
+    cfg.detfilter.minweight = weight * 1.001f;
+    HT_CHECK(mcx_detfilter_record(rec, &his, &cfg) == 0, "a record of weight %g is kept by the minimum %g", weight, cfg.detfilter.minweight);
+
+    /** without the w0 column, the initial weight is 1 */
+    his.savedetflag = DF_FLAG & ~0x40;
+    cfg.detfilter.minweight = weight / 0.8f * 0.999f;
+    HT_CHECK(mcx_detfilter_record(rec, &his, &cfg) == 1, "the initial weight is not 1 without the w0 column");
+    his.savedetflag = DF_FLAG;
+    cfg.detfilter.minweight = 0.f;
+
+    /** the scattering count is summed over all media */
+    cfg.detfilter.maxscat = 100;
+    HT_CHECK(mcx_detfilter_record(rec, &his, &cfg) == 1, "a record of 100 scattering events is discarded by the maximum 100");
+    cfg.detfilter.maxscat = 99;
+    HT_CHECK(mcx_detfilter_record(rec, &his, &cfg) == 0, "a record of 100 scattering events is kept by the maximum 99");
+
+    /** without the nscat column, the maximum scattering count is skipped */
+    his.savedetflag = DF_FLAG & ~0x2;
+    memmove(rec + 1, rec + 1 + DF_MEDIA, sizeof(float) * (DF_FULLLEN - 1 - DF_MEDIA));
+    HT_CHECK(mcx_detfilter_record(rec, &his, &cfg) == 1, "the maximum scattering count is applied without the nscat column");
+
+    /** without the ppath column, the time window and the minimum weight are skipped */
+    his.savedetflag = DF_FLAG & ~0x6;
+    cfg.detfilter.maxscat = 0;
+    cfg.detfilter.tmin = 1.f;
+    cfg.detfilter.tmax = 2.f;
+    cfg.detfilter.minweight = 2.f;
+    memmove(rec + 1, rec + 1 + DF_MEDIA, sizeof(float) * (DF_FULLLEN - 1 - 2 * DF_MEDIA));
+    HT_CHECK(mcx_detfilter_record(rec, &his, &cfg) == 1, "the time window or the minimum weight is applied without the ppath column");
+
+    mcx_clearcfg(&cfg);
+}
+
+static void test_half2float(void) {
+    unsigned int h, bad = 0;
+
+    for (h = 0; h < 0x10000; h++) {
+        unsigned int expo = (h >> 10) & 0x1F, mant = h & 0x3FF;
+        float val = mcx_half2float((unsigned short)h);
+        double ref;
+
+        if (expo == 0x1F) {
+            bad += (mant ? !isnan(val) : !isinf(val)) || (!mant && (signbit(val) != 0) != ((h & 0x8000) != 0));
+            continue;
+        }
+
+        ref = expo ? ldexp(1.0 + mant / 1024.0, (int)expo - 15) : ldexp(mant / 1024.0, -14);
+        ref = (h & 0x8000) ? -ref : ref;
+
+        if (((double)val != ref || (signbit(val) != 0) != ((h & 0x8000) != 0)) && bad++ == 0) {
+            fprintf(stderr, "half 0x%04X decodes to %.9g instead of %.9g\n", h, val, ref);
+        }
+    }
+
+    HT_CHECK(bad == 0, "%u of 65536 half-precision values are not decoded exactly", bad);
+    HT_CHECK(mcx_half2float(0x3C00) == 1.f && mcx_half2float(0xC000) == -2.f && mcx_half2float(0x7BFF) == 65504.f,
+             "1, -2 or 65504 is not decoded");
+}
+
+static void test_expand(void) {
+    Config cfg;
+    History his;
+    unsigned int halflen = DF_FULLLEN - mcx_detfilter_halfsaving(DF_FLAG, DF_MEDIA, 1), r, i, bad = 0, badfilter = 0;
+    float* full = (float*)malloc(sizeof(float) * DF_RECORDS * DF_FULLLEN), *packed = (float*)malloc(sizeof(float) * DF_RECORDS * halflen);
+    float* expanded;
+
+    HT_CHECK(mcx_detfilter_halfsaving(DF_FLAG, DF_MEDIA, 1) == 2 && mcx_detfilter_halfsaving(DF_FLAG, DF_MEDIA, 0) == 0
+             && mcx_detfilter_halfsaving(0x5, 4, 1) == 2, "unexpected number of words saved by half-precision records");
+
+    df_init(&cfg, &his);
+
+    for (r = 0; r < DF_RECORDS; r++) {
+        float* rec = full + r * DF_FULLLEN, *dst = packed + r * halflen;
+        unsigned short bits[2][DF_MEDIA + 1] = {{0}};
+        unsigned int* word = (unsigned int*)(dst + 1 + DF_MEDIA);
+        unsigned int g;
+
+        rec[0] = (float)(1 + r % 4);
+
+        for (i = 0; i < DF_MEDIA; i++) {
+            rec[1 + i] = (float)(df_rand() % 60);
+        }
+
+        /** random ppath/mom values that are exact in half precision, including denormals */
+        for (g = 0; g < 2; g++) {
+            for (i = 0; i < DF_MEDIA; i++) {
+                unsigned short h = (unsigned short)(df_rand() % 0x7C00);
+
+                bits[g][i] = h;
+                rec[1 + (1 + g) * DF_MEDIA + i] = mcx_half2float(h);
+            }
+        }
+
+        rec[DF_FULLLEN - 1] = 0.5f + (df_rand() % 1000) * 5e-4f;
+
+        /** the compact layout: detid and nscat, then each group as pairs of halves with the first in the lower bits */
+        memcpy(dst, rec, sizeof(float) * (1 + DF_MEDIA));
+
+        for (g = 0; g < 2; g++) {
+            for (i = 0; i < (DF_MEDIA + 1) / 2; i++) {
+                word[g * ((DF_MEDIA + 1) / 2) + i] = bits[g][2 * i] | ((unsigned int)bits[g][2 * i + 1] << 16);
+            }
+        }
+
+        dst[halflen - 1] = rec[DF_FULLLEN - 1];
+    }
+
+    expanded = mcx_detfilter_expand(packed, DF_RECORDS, DF_FLAG, DF_MEDIA, DF_FULLLEN);
+    HT_CHECK(expanded != NULL, "can not expand the half-precision records");
+
+    if (expanded) {
+        bad = (memcmp(expanded, full, sizeof(float) * DF_RECORDS * DF_FULLLEN) != 0);
+        HT_CHECK(bad == 0, "the expanded records differ from the originals");
+
+        /** the expanded records must be filtered as the originals */
+        cfg.detfilter.enabled = 1;
+        cfg.detfilter.isdetmask = 1;
+        cfg.detfilter.detmask[0] = 0xB;
+        cfg.detfilter.maxscat = 90;
+
+        for (r = 0; r < DF_RECORDS; r++) {
+            badfilter += (mcx_detfilter_record(expanded + r * DF_FULLLEN, &his, &cfg) != mcx_detfilter_record(full + r * DF_FULLLEN, &his, &cfg));
+        }
+
+        HT_CHECK(badfilter == 0, "%u expanded records are filtered differently", badfilter);
+        free(expanded);
+    }
+
+    /** records without half-precision columns are returned unchanged */
+    packed = (float*)malloc(sizeof(float) * DF_FULLLEN);
+    HT_CHECK(mcx_detfilter_expand(packed, 1, 0x41, DF_MEDIA, 2) == packed, "records without ppath/mom are reallocated");
+    free(packed);
+
+    free(full);
+    mcx_clearcfg(&cfg);
+}
+
+int main(void) {
+    test_pass();
+    test_record();
+    test_half2float();
+    test_expand();
+    return HT_REPORT("testdetfilter");
+}
@@ -0,0 +1,307 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    testfastjson.c
+
+@brief   Host test of the fast JSON array parser against cJSON
+
+A document with large random vectors and Nx4 Media/Detector matrices is
+parsed by mcx_fastjson_parse and by cJSON_Parse. The numbers mix the exact
+fast path with every strtod fallback: more than 19 significant digits,
+decimal exponents beyond +/-22, integers of 2^53 and above, subnormals,
+overflows and negative zeros. Each element of a binary buffer must be
+bit-identical to the cJSON value converted to the buffer type, the rest of
+the tree must be identical.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mcx_fastjson.h"
+#include "mcx_bjdata.h"
+#include "hosttest.h"
+
+#define FJ_VECLEN     3000     /**< length of the large vectors */
+#define FJ_ROWS       400      /**< rows of the large matrices */
+
+static unsigned long long fj_state = 0x2545F4914F6CDD1DULL;
+
+/**
+ * Hand-picked numbers at the limits of the fast path
+ */
+
+static const char* fj_edgereal[] = {
+    "-0.0", "-0e5", "-0.000E-3", "0.0", "0.1", "0.30000000000000004", "1.7976931348623157e308",
+    "2.2250738585072014e-308", "4.9e-324", "2e-324", "1e-400", "1e400", "-1e400", "3.4028235677973366e38",
+    "1.401298464324817e-45", "0.12345678901234567890123", "1.000000000000000000001", "9999999999999999999.5",
+    "1e22", "1e23", "9007199254740991e22", "123456e-22", "123456e-23", "8.5e-23", NULL
+};
+
+static const char* fj_edgeint[] = {
+    "-0", "0", "9007199254740991", "9007199254740992", "9007199254740993", "-9007199254740995",
+    "1234567890123456789", "18446744073709551615", "18446744073709551617", "123456789012345678901234567890",
+    "2147483647", "-2147483648", "2147483648", "-2147483649", NULL
+};
+
+/**
+ * @brief A uniform random integer in [0,n), xorshift64
+ */
+
+static unsigned int fj_rand(unsigned int n) {
+    fj_state ^= fj_state << 13;
+    fj_state ^= fj_state >> 7;
+    fj_state ^= fj_state << 17;
+    return (unsigned int)((fj_state >> 11) % n);
+}
+
+/**
+ * @brief Write a random JSON number of 1 to 25 digits, a fraction unless isint is set, and an optional exponent
+ */
+
+static char* fj_number(char* p, int isint) {
+    const char** edge = isint ? fj_edgeint : fj_edgereal;
+    int digits = 1 + fj_rand(25), point = isint ? digits : 1 + fj_rand(digits), i, count = 0;
+
+    if (fj_rand(5) == 0) {
+        while (edge[count]) {
+            count++;
+        }
+
+        return p + sprintf(p, "%s", edge[fj_rand(count)]);
+    }
+
+    if (fj_rand(2)) {
+        *p++ = '-';
+    }
+
+    for (i = 0; i < digits; i++) {
+        if (i == point) {
+            *p++ = '.';
+        }
+
+        *p++ = (char)('0' + ((i == 0 && digits > 1) ? 1 + fj_rand(9) : fj_rand(10)));
+    }
+
+    if (!isint && fj_rand(3) == 0) {
+        unsigned int range = fj_rand(2) ? 50 : 660;
+        p += sprintf(p, "%c%+d", fj_rand(2) ? 'e' : 'E', (int)fj_rand(range) - (int)range / 2);
+    } else if (!isint && point == digits) {
+        p += sprintf(p, ".%u", fj_rand(10));
+    }
+
+    return p;
+}
+
+/**
+ * @brief Write a JSON vector of random numbers, the separators mix spaces, tabs and new lines
+ */
+
+static char* fj_vector(char* p, size_t len, int isint) {
+    static const char* sep[] = {",", ", ", ",\n\t", " ,\r\n"};
+    size_t i;
+
+    *p++ = '[';
+
+    for (i = 0; i < len; i++) {
+        p = fj_number(p, isint);
+        p += sprintf(p, "%s", (i + 1 < len) ? sep[fj_rand(4)] : "]");
+    }
+
+    return p;
+}
+
+/**
+ * @brief Compare one element of a binary buffer with a cJSON number converted to the buffer type
+ */
+
+static int fj_sameelem(const cJSON* buf, size_t idx, const cJSON* ref) {
+    double dval;
+    float fval, refval;
+    int ival;
+
+    switch (buf->valueint) {
+        case 'l':
+            memcpy(&ival, buf->valuestring + idx * sizeof(int), sizeof(int));
+            return ival == ref->valueint;
+
+        case 'D':
+            memcpy(&dval, buf->valuestring + idx * sizeof(double), sizeof(double));
+            return memcmp(&dval, &ref->valuedouble, sizeof(double)) == 0;
+
+        case 'd':
+            /** the loader stores non-integers in single precision */
+            memcpy(&fval, buf->valuestring + idx * sizeof(float), sizeof(float));
+            refval = (float)ref->valuedouble;
+            return memcmp(&fval, &refval, sizeof(float)) == 0;
+
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Compare the elements of a binary buffer with the numbers of a cJSON vector, or the rows of a matrix
+ *
+ * @return the number of mismatched elements
+ */
+
+static size_t fj_samebuffer(const cJSON* buf, const cJSON* ref, const char* name) {
+    size_t idx = 0, bad = 0, count = (size_t)buf->valuedouble;
+    const cJSON* row, *elem;
+
+    for (row = ref->child; row; row = row->next) {
+        /** the elements of a vector, or of the rows of a matrix */
+        for (elem = cJSON_IsArray(row) ? row->child : row; elem; idx++) {
+            if (idx >= count || !cJSON_IsNumber(elem) || !fj_sameelem(buf, idx, elem)) {
+                if (bad++ == 0) {
+                    fprintf(stderr, "%s: element %lu of type '%c' differs from %.17g\n", name, (unsigned long)idx,
+                            buf->valueint, elem->valuedouble);
+                }
+            }
+
+            elem = cJSON_IsArray(row) ? elem->next : NULL;
+        }
+    }
+
+    return bad + (idx != count);
+}
+
+/**
+ * @brief Compare the fast-parsed tree with the cJSON tree, node by node
+ *
+ * @param[in] fast: the first node of a sibling list of the fast-parsed tree
+ * @param[in] ref: the first node of the same sibling list of the cJSON tree
+ * @param[in,out] nbuffer: number of compared binary buffers
+ * @return the number of differences
+ */
+
+static size_t fj_sametree(const cJSON* fast, const cJSON* ref, int* nbuffer) {
+    size_t bad = 0;
+
+    for (; fast && ref; fast = fast->next, ref = ref->next) {
+        const char* name = ref->string ? ref->string : "(item)";
+
+        if ((fast->string == NULL) != (ref->string == NULL) || (fast->string && strcmp(fast->string, ref->string))) {
+            fprintf(stderr, "key %s differs\n", name);
+            bad++;
+        } else if (mcx_bjd_isbuffer(fast)) {
+            (*nbuffer)++;
+            bad += fj_samebuffer(fast, ref, name);
+        } else if (cJSON_IsObject(fast) && cJSON_IsArray(ref) && mcx_bjd_isbuffer(cJSON_GetObjectItem(fast, "_ArrayData_"))) {
+            const cJSON* size = cJSON_GetObjectItem(fast, "_ArraySize_");
+
+            (*nbuffer)++;
+            bad += (cJSON_GetArraySize(size) != 2 || cJSON_GetArrayItem(size, 0)->valueint != cJSON_GetArraySize(ref)
+                    || cJSON_GetArrayItem(size, 1)->valueint != cJSON_GetArraySize(ref->child));
+            bad += fj_samebuffer(cJSON_GetObjectItem(fast, "_ArrayData_"), ref, name);
+        } else if (fast->type != ref->type) {
+            fprintf(stderr, "%s has a different type\n", name);
+            bad++;
+        } else if (cJSON_IsNumber(fast) && (memcmp(&fast->valuedouble, &ref->valuedouble, sizeof(double)) || fast->valueint != ref->valueint)) {
+            fprintf(stderr, "%s: %.17g differs from %.17g\n", name, fast->valuedouble, ref->valuedouble);
+            bad++;
+        } else if (cJSON_IsString(fast) && strcmp(fast->valuestring, ref->valuestring)) {
+            fprintf(stderr, "%s: %s differs from %s\n", name, fast->valuestring, ref->valuestring);
+            bad++;
+        } else {
+            bad += fj_sametree(fast->child, ref->child, nbuffer);
+        }
+    }
+
+    return bad + (fast != NULL || ref != NULL);
+}
+
+/**
+ * @brief Write a Nx4 matrix, the columns are random numbers, integers where isint[] is set
+ */
+
+static char* fj_matrix(char* p, size_t rows, const int isint[4]) {
+    size_t i, j;
+
+    *p++ = '[';
+
+    for (i = 0; i < rows; i++) {
+        *p++ = '[';
+
+        for (j = 0; j < 4; j++) {
+            p = fj_number(p, isint[j]);
+            *p++ = (j < 3) ? ',' : ']';
+        }
+
+        p += sprintf(p, "%s", (i + 1 < rows) ? ",\n" : "]");
+    }
+
+    return p;
+}
+
+static void test_bitidentity(void) {
+    static const int mediacol[4] = {0, 0, 0, 0}, detcol[4] = {1, 1, 1, 0};
+    char* text = (char*)malloc(FJ_VECLEN * 200 + FJ_ROWS * 4 * 100 * 2), *p = text;
+    cJSON* fast, *ref;
+    int nbuffer = 0;
+    size_t bad, i;
+
+    p += sprintf(p, "{\"Domain\":{\"LengthUnit\":0.5,\"Media\":");
+    p = fj_matrix(p, FJ_ROWS, mediacol);
+    p += sprintf(p, "},\n\"Optode\":{\"Source\":{\"Pattern\":{\"Nx\":%d,\"Ny\":1,\"Data\":", FJ_VECLEN);
+    p = fj_vector(p, FJ_VECLEN, 0);
+    p += sprintf(p, "}},\"Detector\":");
+    p = fj_matrix(p, FJ_ROWS, detcol);
+    p += sprintf(p, "},\n\"Shapes\":{\"_ArrayType_\":\"int32\",\"_ArrayData_\":[");
+
+    /** a 32-bit integer volume, with a negative zero */
+    for (i = 0; i < FJ_VECLEN; i++) {
+        p += (i == 7) ? sprintf(p, ",-0") : sprintf(p, "%s%d", i ? "," : "", (int)fj_rand(0x7fffffff) - 0x3fffffff);
+    }
+
+    p += sprintf(p, "]},\n\"Big\":{\"Data\":");
+    p = fj_vector(p, FJ_VECLEN, 1);
+    p += sprintf(p, "},\"Small\":{\"Data\":");
+    p = fj_vector(p, 8, 0);
+    p += sprintf(p, ",\"Empty\":[],\"Text\":\"[1,2]\"}}");
+
+    fast = mcx_fastjson_parse(text);
+    ref = cJSON_Parse(text);
+    HT_CHECK(fast != NULL && ref != NULL, "can not parse the test document");
+
+    if (fast && ref) {
+        const cJSON* pattern = cJSON_GetObjectItem(cJSON_GetObjectItem(cJSON_GetObjectItem(cJSON_GetObjectItem(fast, "Optode"), "Source"), "Pattern"), "Data");
+        const cJSON* big = cJSON_GetObjectItem(cJSON_GetObjectItem(fast, "Big"), "Data");
+        const cJSON* shapes = cJSON_GetObjectItem(cJSON_GetObjectItem(fast, "Shapes"), "_ArrayData_");
+        const cJSON* media = cJSON_GetObjectItem(cJSON_GetObjectItem(fast, "Domain"), "Media");
+
+        /** the vectors and matrices are read by the fast path, with the expected buffer types */
+        HT_CHECK(mcx_bjd_isbuffer(pattern) && pattern->valueint == 'd', "the pattern is not a float32 buffer");
+        HT_CHECK(mcx_bjd_isbuffer(big) && big->valueint == 'D', "the large integers are not a float64 buffer");
+        HT_CHECK(mcx_bjd_isbuffer(shapes) && shapes->valueint == 'l', "the volume is not an int32 buffer");
+        HT_CHECK(cJSON_IsObject(media) && mcx_bjd_isbuffer(cJSON_GetObjectItem(media, "_ArrayData_")), "the media are not a matrix buffer");
+
+        bad = fj_sametree(fast, ref, &nbuffer);
+        HT_CHECK(bad == 0, "%lu differences from cJSON", (unsigned long)bad);
+        HT_CHECK(nbuffer == 5, "compared %d binary buffers", nbuffer);
+    }
+
+    cJSON_Delete(fast);
+    cJSON_Delete(ref);
+
+    /** a syntax error after a large array is reported as by cJSON */
+    strcpy(p - 2, "]}");
+    fast = mcx_fastjson_parse(text);
+    HT_CHECK(fast == NULL && cJSON_GetErrorPtr() != NULL, "parsed a document with a syntax error");
+    cJSON_Delete(fast);
+
+    free(text);
+}
+
+int main(void) {
+    test_bitidentity();
+    return HT_REPORT("testfastjson");
+}
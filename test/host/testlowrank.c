@@ -0,0 +1,231 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    testlowrank.c
+
+@brief   Host test of the low-rank basis of photon-sharing source patterns
+
+The pattern stacks are built from a known number of random nonnegative
+patterns; the basis must recover that rank, reconstruct the stack within the
+reported error, and the expanded basis outputs of a linear model of the
+simulation must match the outputs of the patterns.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mcx_lowrank.h"
+#include "hosttest.h"
+
+#define LR_PIXEL   400     /**< pixel number of each pattern */
+#define LR_SRC     12      /**< number of patterns */
+#define LR_CELL    50      /**< output cells of the linear model */
+
+static unsigned long long lr_state = 0x9E3779B97F4A7C15ULL;
+
+/**
+ * @brief A uniform random number in [0,1), xorshift64
+ */
+
+static double lr_rand(void) {
+    lr_state ^= lr_state << 13;
+    lr_state ^= lr_state >> 7;
+    lr_state ^= lr_state << 17;
+    return (lr_state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * @brief Fill pattern[i*LR_SRC+s] with mixtures of rank random patterns, plus uniform noise of the given amplitude
+ */
+
+static void lr_stack(float* pattern, unsigned int rank, double noise) {
+    double* gen = (double*)malloc(sizeof(double) * LR_PIXEL * rank);
+    double* mix = (double*)malloc(sizeof(double) * LR_SRC * rank);
+    unsigned int i, s, j;
+
+    for (i = 0; i < LR_PIXEL * rank; i++) {
+        gen[i] = lr_rand();
+    }
+
+    for (i = 0; i < LR_SRC * rank; i++) {
+        mix[i] = lr_rand();
+    }
+
+    for (i = 0; i < LR_PIXEL; i++) {
+        for (s = 0; s < LR_SRC; s++) {
+            double val = noise * lr_rand();
+
+            for (j = 0; j < rank; j++) {
+                val += gen[i * rank + j] * mix[s * rank + j];
+            }
+
+            pattern[i * LR_SRC + s] = (float)val;
+        }
+    }
+
+    free(gen);
+    free(mix);
+}
+
+/**
+ * @brief The relative Frobenius error of basis*coef' against the patterns
+ */
+
+static double lr_recon_error(const float* pattern, const float* basis, const float* coef, unsigned int rank) {
+    double err = 0.0, total = 0.0;
+    unsigned int i, s, j;
+
+    for (i = 0; i < LR_PIXEL; i++) {
+        for (s = 0; s < LR_SRC; s++) {
+            double val = 0.0;
+
+            for (j = 0; j < rank; j++) {
+                val += (double)basis[i * rank + j] * coef[s * rank + j];
+            }
+
+            err += (val - pattern[i * LR_SRC + s]) * (val - pattern[i * LR_SRC + s]);
+            total += (double)pattern[i * LR_SRC + s] * pattern[i * LR_SRC + s];
+        }
+    }
+
+    return sqrt(err / total);
+}
+
+static void test_exact_rank(void) {
+    float* pattern = (float*)malloc(sizeof(float) * LR_PIXEL * LR_SRC), *basis, *coef, err = -1.f;
+    unsigned int rank, i, j;
+
+    lr_stack(pattern, 3, 0.0);
+    rank = mcx_lowrank_basis(pattern, LR_PIXEL, LR_SRC, 1e-4f, &basis, &coef, &err);
+
+    HT_CHECK(rank == 3, "rank %u of a rank-3 stack", rank);
+
+    if (rank) {
+        double actual = lr_recon_error(pattern, basis, coef, rank);
+
+        HT_CHECK(err >= 0.f && err <= 1e-4f, "reported error %g", err);
+        HT_CHECK(actual <= 1e-5, "reconstruction error %g", actual);
+
+        /** the basis patterns are orthogonal and launch a positive total weight */
+        for (j = 0; j < rank; j++) {
+            double sum = 0.0, dot = 0.0, norm = 0.0;
+
+            for (i = 0; i < LR_PIXEL; i++) {
+                sum += basis[i * rank + j];
+                norm += (double)basis[i * rank + j] * basis[i * rank + j];
+                dot += (double)basis[i * rank + j] * basis[i * rank + (j + 1) % rank];
+            }
+
+            HT_CHECK(sum > 0.0, "basis %u has a total weight of %g", j, sum);
+            HT_CHECK(fabs(dot) <= 1e-5 * norm, "basis %u and %u are not orthogonal: %g", j, (j + 1) % rank, dot / norm);
+        }
+    }
+
+    free(basis);
+    free(coef);
+    free(pattern);
+}
+
+static void test_noisy_rank(void) {
+    float* pattern = (float*)malloc(sizeof(float) * LR_PIXEL * LR_SRC), *basis, *coef, err = -1.f;
+    unsigned int rank, i;
+
+    /** the noise is below the tolerance, the basis keeps the rank of the mixtures */
+    lr_stack(pattern, 4, 1e-3);
+    rank = mcx_lowrank_basis(pattern, LR_PIXEL, LR_SRC, 1e-2f, &basis, &coef, &err);
+    HT_CHECK(rank == 4, "rank %u of a noisy rank-4 stack", rank);
+
+    if (rank) {
+        double actual = lr_recon_error(pattern, basis, coef, rank);
+
+        HT_CHECK(err > 0.f && err <= 1e-2f, "reported error %g", err);
+        HT_CHECK(fabs(actual - err) <= 1e-3 * err + 1e-6, "reconstruction error %g, reported %g", actual, err);
+    }
+
+    free(basis);
+    free(coef);
+
+    /** a stack of disjoint patterns is full-rank, no basis with fewer patterns meets the tolerance */
+    for (i = 0; i < LR_PIXEL * LR_SRC; i++) {
+        pattern[i] = ((i / LR_SRC) % LR_SRC == i % LR_SRC) ? 1.f : 0.f;
+    }
+
+    rank = mcx_lowrank_basis(pattern, LR_PIXEL, LR_SRC, 1e-3f, &basis, &coef, &err);
+    HT_CHECK(rank == 0 && basis == NULL && coef == NULL, "rank %u of a full-rank stack", rank);
+
+    /** 2 patterns are always simulated directly */
+    rank = mcx_lowrank_basis(pattern, LR_PIXEL, 2, 1.f, &basis, &coef, &err);
+    HT_CHECK(rank == 0, "rank %u of 2 patterns", rank);
+
+    free(pattern);
+}
+
+static void test_expand(void) {
+    float* pattern = (float*)malloc(sizeof(float) * LR_PIXEL * LR_SRC), *basis, *coef, err;
+    double* model = (double*)malloc(sizeof(double) * LR_CELL * LR_PIXEL);
+    float* field = (float*)calloc(LR_CELL * LR_SRC, sizeof(float));
+    double diff = 0.0, total = 0.0;
+    unsigned int rank, c, i, j, s;
+
+    /** a random linear model of the simulation, output(c) = sum_i model(c,i) * launch weight(i) */
+    for (i = 0; i < LR_CELL * LR_PIXEL; i++) {
+        model[i] = lr_rand();
+    }
+
+    lr_stack(pattern, 3, 0.0);
+    rank = mcx_lowrank_basis(pattern, LR_PIXEL, LR_SRC, 1e-4f, &basis, &coef, &err);
+    HT_CHECK(rank == 3, "rank %u of a rank-3 stack", rank);
+
+    if (rank) {
+        for (c = 0; c < LR_CELL; c++) {
+            for (j = 0; j < rank; j++) {
+                double val = 0.0;
+
+                for (i = 0; i < LR_PIXEL; i++) {
+                    val += model[c * LR_PIXEL + i] * basis[i * rank + j];
+                }
+
+                field[c * rank + j] = (float)val;
+            }
+        }
+
+        mcx_lowrank_expand(field, LR_CELL, rank, LR_SRC, coef);
+
+        for (c = 0; c < LR_CELL; c++) {
+            for (s = 0; s < LR_SRC; s++) {
+                double val = 0.0;
+
+                for (i = 0; i < LR_PIXEL; i++) {
+                    val += model[c * LR_PIXEL + i] * pattern[i * LR_SRC + s];
+                }
+
+                diff += (field[c * LR_SRC + s] - val) * (field[c * LR_SRC + s] - val);
+                total += val * val;
+            }
+        }
+
+        HT_CHECK(sqrt(diff / total) <= 1e-5, "expanded outputs differ by %g", sqrt(diff / total));
+    }
+
+    free(basis);
+    free(coef);
+    free(field);
+    free(model);
+    free(pattern);
+}
+
+int main(void) {
+    test_exact_rank();
+    test_noisy_rank();
+    test_expand();
+    return HT_REPORT("testlowrank");
+}
@@ -0,0 +1,175 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    testmixlabel.c
+
+@brief   Host test of the downsampling of label volumes to the mixed-label format
+
+A label volume whose dimensions are not multiples of the factor is filled
+block by block with known counts of three labels in random order, so that the
+less frequent label may come first, and with the detector flag set on some
+voxels. Each packed word must hold the most frequent label as label1, the
+second one as label2 and the fraction of label2 among the two scaled to 32767,
+counting only the voxels inside the domain for the truncated edge blocks. A
+block of background remains 0, a block of one label is not mixed, and a block
+mostly made of background mixes label 0 with the other label.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mcx_mixlabel.h"
+#include "mcx_const.h"
+#include "hosttest.h"
+
+#define ML_DIMX     10       /**< domain size along x, the last block is truncated to 1 voxel */
+#define ML_DIMY     8        /**< domain size along y, the last block is truncated to 2 voxels */
+#define ML_DIMZ     9        /**< domain size along z, a multiple of the factor */
+#define ML_FACTOR   3        /**< downsampling factor */
+#define ML_NEWX     4        /**< downsampled size along x */
+#define ML_NEWY     3        /**< downsampled size along y */
+#define ML_NEWZ     3        /**< downsampled size along z */
+
+static unsigned int ml_state = 362436069u;
+
+/**
+ * @brief A random 32-bit integer, xorshift32
+ */
+
+static unsigned int ml_rand(void) {
+    ml_state ^= ml_state << 13;
+    ml_state ^= ml_state >> 17;
+    ml_state ^= ml_state << 5;
+    return ml_state;
+}
+
+/**
+ * @brief Fill a block with n1 voxels of label1, n2 of label2 and the rest of label3 in random order
+ *
+ * @param[in,out] vol: the label volume
+ * @param[in] b: the block index along x, y and z
+ * @param[in] n1, n2: the numbers of voxels of label1 and label2
+ * @param[in] label1, label2, label3: the labels
+ * @param[in] isfirst2: 1 to place a voxel of label2 first in the scanning order
+ * @return the number of voxels in the block
+ */
+
+static unsigned int ml_fillblock(unsigned int* vol, const unsigned int b[3], unsigned int n1, unsigned int n2,
+                                 unsigned int label1, unsigned int label2, unsigned int label3, int isfirst2) {
+    unsigned int x0 = b[0] * ML_FACTOR, y0 = b[1] * ML_FACTOR, z0 = b[2] * ML_FACTOR, x, y, z, i, n = 0;
+    unsigned int labels[ML_FACTOR * ML_FACTOR * ML_FACTOR];
+
+    for (z = z0; z < z0 + ML_FACTOR && z < ML_DIMZ; z++) {
+        for (y = y0; y < y0 + ML_FACTOR && y < ML_DIMY; y++) {
+            for (x = x0; x < x0 + ML_FACTOR && x < ML_DIMX; x++) {
+                labels[n] = (n < n1) ? label1 : ((n < n1 + n2) ? label2 : label3);
+                n++;
+            }
+        }
+    }
+
+    for (i = n - 1; i > 0; i--) {
+        unsigned int j = ml_rand() % (i + 1), tmp = labels[i];
+
+        labels[i] = labels[j];
+        labels[j] = tmp;
+    }
+
+    for (i = 0; isfirst2 && labels[0] != label2; i++) {
+        if (labels[i] == label2) {
+            labels[i] = labels[0];
+            labels[0] = label2;
+        }
+    }
+
+    n = 0;
+
+    for (z = z0; z < z0 + ML_FACTOR && z < ML_DIMZ; z++) {
+        for (y = y0; y < y0 + ML_FACTOR && y < ML_DIMY; y++) {
+            for (x = x0; x < x0 + ML_FACTOR && x < ML_DIMX; x++) {
+                vol[((size_t)z * ML_DIMY + y) * ML_DIMX + x] = labels[n++] | ((ml_rand() & 3) ? 0 : DET_MASK);
+            }
+        }
+    }
+
+    return n;
+}
+
+int main(void) {
+    unsigned int dim[3] = {ML_DIMX, ML_DIMY, ML_DIMZ}, newdim[3] = {0}, b[3], ref[ML_NEWX * ML_NEWY * ML_NEWZ];
+    unsigned int* vol = (unsigned int*)calloc(ML_DIMX * ML_DIMY * ML_DIMZ, sizeof(unsigned int)), *newvol;
+    unsigned int bad = 0, i;
+
+    for (b[2] = 0; b[2] < ML_NEWZ; b[2]++) {
+        for (b[1] = 0; b[1] < ML_NEWY; b[1]++) {
+            for (b[0] = 0; b[0] < ML_NEWX; b[0]++) {
+                unsigned int idx = (b[2] * ML_NEWY + b[1]) * ML_NEWX + b[0], n, n1, n2;
+
+                /** the block sizes are 27, 9 (truncated along x), 18 (along y) and 6 (both) voxels */
+                if (idx == 0) {
+                    /** all background */
+                    ml_fillblock(vol, b, ML_FACTOR * ML_FACTOR * ML_FACTOR, 0, 0, 0, 0, 0);
+                    ref[idx] = 0;
+                } else if (idx == 1) {
+                    /** a single label */
+                    ml_fillblock(vol, b, ML_FACTOR * ML_FACTOR * ML_FACTOR, 0, 37, 0, 0, 0);
+                    ref[idx] = 37;
+                } else if (idx == 2) {
+                    /** mostly background, 20:7 */
+                    ml_fillblock(vol, b, 20, 7, 0, 3, 0, 1);
+                    ref[idx] = (8495u << 16) | (3 << 8) | 0;
+                } else {
+                    n = ml_fillblock(vol, b, 0, 0, 0, 0, 0, 0);
+                    n2 = n / 3;
+                    n1 = n - n2 - n / 6;
+                    ml_fillblock(vol, b, n1, n2, 1 + idx % 50, 100 + idx, 255, (idx & 1));
+                    ref[idx] = ((unsigned int)(((unsigned long long)n2 * MCX_MIXLABEL_FULL + ((n1 + n2) >> 1)) / (n1 + n2)) << 16)
+                               | ((100 + idx) << 8) | (1 + idx % 50);
+                }
+            }
+        }
+    }
+
+    /** the ratios of the 14:9, 5:3, 9:6 and 3:2 blocks, rounded */
+    HT_CHECK((ref[4] >> 16) == 12822 && (ref[3] >> 16) == 12288 && (ref[8] >> 16) == 13107 && (ref[11] >> 16) == 13107,
+             "unexpected reference ratios %u %u %u %u", ref[4] >> 16, ref[3] >> 16, ref[8] >> 16, ref[11] >> 16);
+
+    newvol = mcx_mixlabel_downsample(vol, dim, ML_FACTOR, newdim);
+    HT_CHECK(newvol != NULL, "the volume is not downsampled");
+    HT_CHECK(newdim[0] == ML_NEWX && newdim[1] == ML_NEWY && newdim[2] == ML_NEWZ, "the downsampled size is %u x %u x %u",
+             newdim[0], newdim[1], newdim[2]);
+
+    if (newvol) {
+        for (i = 0; i < ML_NEWX * ML_NEWY * ML_NEWZ; i++) {
+            if (newvol[i] != ref[i] && bad++ == 0) {
+                fprintf(stderr, "voxel %u: label1 %u label2 %u ratio %u instead of label1 %u label2 %u ratio %u\n", i,
+                        newvol[i] & 0xFF, (newvol[i] >> 8) & 0xFF, newvol[i] >> 16, ref[i] & 0xFF, (ref[i] >> 8) & 0xFF, ref[i] >> 16);
+            }
+        }
+
+        HT_CHECK(bad == 0, "%u of %u downsampled voxels differ", bad, ML_NEWX * ML_NEWY * ML_NEWZ);
+        free(newvol);
+
+        /** a factor of 1 keeps every label unmixed */
+        newvol = mcx_mixlabel_downsample(vol, dim, 1, newdim);
+        bad = 0;
+
+        for (i = 0; newvol && i < ML_DIMX * ML_DIMY * ML_DIMZ; i++) {
+            bad += (newvol[i] != (vol[i] & MCX_MIXLABEL_MAXLABEL));
+        }
+
+        HT_CHECK(newvol && bad == 0 && newdim[0] == ML_DIMX, "%u voxels are changed by a factor of 1", bad);
+        free(newvol);
+    }
+
+    free(vol);
+    return HT_REPORT("testmixlabel");
+}
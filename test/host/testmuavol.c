@@ -0,0 +1,128 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    testmuavol.c
+
+@brief   Host test of the cached mua volume against the per-voxel decoder
+
+For each media format decoded by mcx_updatemua (1, 2 and 4-byte labels,
+mua_float, asgn_byte and as_short), a volume of random voxels, with and
+without the detector flag in the upper bit, is decoded by mcx_muavolume;
+every voxel must be bit-identical to mcx_updatemua, and the decoded array
+must be cached until it is released.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mcx_utils.h"
+#include "mcx_const.h"
+#include "hosttest.h"
+
+#define MV_DIMX      64       /**< domain size along x */
+#define MV_DIMY      48       /**< domain size along y */
+#define MV_DIMZ      30       /**< domain size along z, the volume is long enough to be decoded in parallel */
+#define MV_MEDIANUM  7        /**< number of media, including the background */
+
+static unsigned int mv_state = 521288629u;
+
+/**
+ * @brief A random 32-bit integer, xorshift32
+ */
+
+static unsigned int mv_rand(void) {
+    mv_state ^= mv_state << 13;
+    mv_state ^= mv_state >> 17;
+    mv_state ^= mv_state << 5;
+    return mv_state;
+}
+
+/**
+ * @brief Fill the volume with random voxels of the given media format
+ */
+
+static void mv_fill(Config* cfg) {
+    size_t i, dimxyz = (size_t)cfg->dim.x * cfg->dim.y * cfg->dim.z;
+
+    for (i = 0; i < dimxyz; i++) {
+        unsigned int val = mv_rand();
+
+        if (cfg->mediabyte <= 4) {
+            val = (val % MV_MEDIANUM) | (val & DET_MASK);
+        } else if (cfg->mediabyte == MEDIA_MUA_FLOAT) {
+            float mua = (float)((val & 0xFFFF) * 1e-4) * ((val & DET_MASK) ? -1.f : 1.f);
+
+            memcpy(&val, &mua, sizeof(val));
+        }
+
+        cfg->vol[i] = val;
+    }
+}
+
+static void test_format(unsigned int mediabyte) {
+    Config cfg;
+    size_t i, dimxyz = (size_t)MV_DIMX * MV_DIMY * MV_DIMZ, bad = 0;
+    const float* muavol;
+
+    mcx_initcfg(&cfg);
+    cfg.dim.x = MV_DIMX;
+    cfg.dim.y = MV_DIMY;
+    cfg.dim.z = MV_DIMZ;
+    cfg.mediabyte = mediabyte;
+    cfg.medianum = MV_MEDIANUM;
+    cfg.prop = (Medium*)calloc(MV_MEDIANUM, sizeof(Medium));
+    cfg.vol = (unsigned int*)malloc(dimxyz * sizeof(unsigned int));
+
+    for (i = 1; i < MV_MEDIANUM; i++) {
+        cfg.prop[i].mua = 0.005f + 0.013f * i;
+        cfg.prop[i].mus = 1.f + i;
+        cfg.prop[i].g = 0.9f;
+        cfg.prop[i].n = 1.37f;
+    }
+
+    mv_fill(&cfg);
+    muavol = mcx_muavolume(&cfg);
+    HT_CHECK(muavol != NULL, "format %u is not decoded", mediabyte);
+
+    if (muavol) {
+        for (i = 0; i < dimxyz; i++) {
+            float mua = mcx_updatemua(cfg.vol[i], &cfg);
+
+            if (memcmp(&mua, muavol + i, sizeof(float)) != 0 && bad++ == 0) {
+                fprintf(stderr, "format %u voxel %lu (0x%08X): %.9g instead of %.9g\n", mediabyte, (unsigned long)i,
+                        cfg.vol[i], muavol[i], mua);
+            }
+        }
+
+        HT_CHECK(bad == 0, "%lu of %lu voxels of format %u differ", (unsigned long)bad, (unsigned long)dimxyz, mediabyte);
+
+        /** the decoded array is cached, and decoded again once released */
+        HT_CHECK(mcx_muavolume(&cfg) == muavol, "format %u is decoded twice", mediabyte);
+        free(cfg.muavol);
+        cfg.muavol = NULL;
+        muavol = mcx_muavolume(&cfg);
+        HT_CHECK(muavol != NULL && mcx_updatemua(cfg.vol[dimxyz - 1], &cfg) == muavol[dimxyz - 1], "format %u is not decoded again", mediabyte);
+    }
+
+    mcx_clearcfg(&cfg);
+}
+
+int main(void) {
+    static const unsigned int formats[] = {1, 2, 4, MEDIA_MUA_FLOAT, MEDIA_ASGN_BYTE, MEDIA_AS_SHORT};
+    size_t i;
+
+    for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        test_format(formats[i]);
+    }
+
+    return HT_REPORT("testmuavol");
+}
@@ -0,0 +1,285 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    testnorm.c
+
+@brief   Host test of the parallel normalization reductions
+
+The column sums, label sums and column scaling of multi-pattern outputs are
+compared with naive double-precision loops, and repeated with 1, 2, 3, 7 and
+the default number of OpenMP threads; the outputs must be bit-identical for
+all thread numbers. The arrays are long enough to be split into many blocks,
+including more blocks than MCX_NORM_MAXBLOCK.
+
+The voxel-volume division of a non-uniform grid, in which every z-slice of a
+uniform grid is split into two repeated slices of half the thickness, each
+holding half of the raw output, must reproduce the fluence of the uniform grid.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+#include "mcx_norm.h"
+#include "hosttest.h"
+
+#define NORM_ROWS     100003   /**< rows of the multi-pattern arrays */
+#define NORM_COLS     5        /**< patterns per row */
+#define NORM_LONG     700001   /**< length of the single-column and labeled arrays */
+#define NORM_LABELS   8        /**< number of detectors */
+#define NORM_WEIGHTS  61       /**< length of the row weights */
+#define NORM_GRIDX    13       /**< non-uniform grid size along x */
+#define NORM_GRIDY    7        /**< non-uniform grid size along y */
+#define NORM_GRIDZ    9        /**< number of z-slices of the uniform grid, each split into two */
+#define NORM_FRAMES   3        /**< time gates of the non-uniform grid output */
+
+static unsigned int nm_state = 88675123u;
+
+/**
+ * @brief A uniform random number in [lo, hi), xorshift32
+ */
+
+static float nm_rand(float lo, float hi) {
+    nm_state ^= nm_state << 13;
+    nm_state ^= nm_state >> 17;
+    nm_state ^= nm_state << 5;
+    return lo + (hi - lo) * (float)((nm_state >> 8) * (1.0 / 16777216.0));
+}
+
+/**
+ * @brief Test if two sums agree within the rounding error of summing values of total magnitude abssum
+ */
+
+static int nm_close(double sum, double ref, double abssum) {
+    return fabs(sum - ref) <= 1e-12 * abssum;
+}
+
+/**
+ * The inputs and the outputs of one run of the reductions
+ */
+
+typedef struct NormRun {
+    double colsum[NORM_COLS];           /**< column sums of the multi-pattern array */
+    double weightsum[NORM_COLS];        /**< weighted column sums of the multi-pattern array */
+    double longsum;                     /**< sum of the single-column array */
+    double labelsum[NORM_LABELS];       /**< per-label sums */
+    float* scaled;                      /**< the multi-pattern array scaled with option 1 */
+    float* clipped;                     /**< the multi-pattern array scaled with option 2 */
+} NormRun;
+
+static void nm_run(NormRun* run, const float* data, const float* longdata, const int* label, const float* weight, const float* scale) {
+    mcx_norm_colsum(data, NORM_ROWS, NORM_COLS, NULL, 0, run->colsum);
+    mcx_norm_colsum(data, NORM_ROWS, NORM_COLS, weight, NORM_WEIGHTS, run->weightsum);
+    mcx_norm_colsum(longdata, NORM_LONG, 1, NULL, 0, &run->longsum);
+    mcx_norm_labelsum(longdata, label, NORM_LONG, NORM_LABELS, run->labelsum);
+
+    memcpy(run->scaled, data, sizeof(float) * NORM_ROWS * NORM_COLS);
+    mcx_norm_scale(run->scaled, NORM_ROWS, NORM_COLS, scale, 1);
+    memcpy(run->clipped, data, sizeof(float) * NORM_ROWS * NORM_COLS);
+    mcx_norm_scale(run->clipped, NORM_ROWS, NORM_COLS, scale, 2);
+}
+
+static void test_reference(const NormRun* run, const float* data, const float* longdata, const int* label,
+                           const float* weight, const float* scale) {
+    double colsum[NORM_COLS] = {0.0}, weightsum[NORM_COLS] = {0.0}, colabs[NORM_COLS] = {0.0}, weightabs[NORM_COLS] = {0.0};
+    double labelsum[NORM_LABELS] = {0.0}, labelabs[NORM_LABELS] = {0.0}, longsum = 0.0, longabs = 0.0;
+    size_t i, badscale = 0;
+    unsigned int j;
+
+    for (i = 0; i < NORM_ROWS; i++) {
+        for (j = 0; j < NORM_COLS; j++) {
+            double val = data[i * NORM_COLS + j];
+
+            colsum[j] += val;
+            colabs[j] += fabs(val);
+            weightsum[j] += val * weight[i % NORM_WEIGHTS];
+            weightabs[j] += fabs(val * weight[i % NORM_WEIGHTS]);
+
+            /** the scaling is one float multiplication per value, it must be exact */
+            badscale += (run->scaled[i * NORM_COLS + j] != data[i * NORM_COLS + j] * scale[j]);
+            badscale += (run->clipped[i * NORM_COLS + j] != ((val < 0.0) ? data[i * NORM_COLS + j] : data[i * NORM_COLS + j] * scale[j]));
+        }
+    }
+
+    for (i = 0; i < NORM_LONG; i++) {
+        longsum += longdata[i];
+        longabs += fabs(longdata[i]);
+
+        if (label[i] > 0 && label[i] <= NORM_LABELS) {
+            labelsum[label[i] - 1] += longdata[i];
+            labelabs[label[i] - 1] += fabs(longdata[i]);
+        }
+    }
+
+    for (j = 0; j < NORM_COLS; j++) {
+        HT_CHECK(nm_close(run->colsum[j], colsum[j], colabs[j]), "column %u sums to %.17g instead of %.17g", j, run->colsum[j], colsum[j]);
+        HT_CHECK(nm_close(run->weightsum[j], weightsum[j], weightabs[j]), "weighted column %u sums to %.17g instead of %.17g",
+                 j, run->weightsum[j], weightsum[j]);
+    }
+
+    for (j = 0; j < NORM_LABELS; j++) {
+        HT_CHECK(nm_close(run->labelsum[j], labelsum[j], labelabs[j]), "label %u sums to %.17g instead of %.17g", j + 1, run->labelsum[j], labelsum[j]);
+    }
+
+    HT_CHECK(nm_close(run->longsum, longsum, longabs), "the long array sums to %.17g instead of %.17g", run->longsum, longsum);
+    HT_CHECK(badscale == 0, "%lu scaled values differ", (unsigned long)badscale);
+}
+
+static void test_threads(void) {
+    static const int threadnum[] = {1, 2, 3, 7, 0};
+    float* data = (float*)malloc(sizeof(float) * NORM_ROWS * NORM_COLS), *longdata = (float*)malloc(sizeof(float) * NORM_LONG);
+    float weight[NORM_WEIGHTS], scale[NORM_COLS];
+    int* label = (int*)malloc(sizeof(int) * NORM_LONG);
+    NormRun first, run;
+    size_t i;
+    int t, defaultnum = 1;
+
+    /** values spanning several orders of magnitude, the negative ones are kept by option 2 */
+    for (i = 0; i < NORM_ROWS * NORM_COLS; i++) {
+        data[i] = nm_rand(-0.2f, 1.f) * powf(10.f, nm_rand(-6.f, 6.f));
+    }
+
+    for (i = 0; i < NORM_LONG; i++) {
+        longdata[i] = nm_rand(0.f, 1.f) * powf(10.f, nm_rand(-3.f, 3.f));
+        label[i] = (int)nm_rand(-1.f, NORM_LABELS + 2.f);
+    }
+
+    for (i = 0; i < NORM_WEIGHTS; i++) {
+        weight[i] = nm_rand(0.f, 2.f);
+    }
+
+    for (i = 0; i < NORM_COLS; i++) {
+        scale[i] = nm_rand(0.1f, 10.f);
+    }
+
+    first.scaled = (float*)malloc(sizeof(float) * NORM_ROWS * NORM_COLS);
+    first.clipped = (float*)malloc(sizeof(float) * NORM_ROWS * NORM_COLS);
+    run.scaled = (float*)malloc(sizeof(float) * NORM_ROWS * NORM_COLS);
+    run.clipped = (float*)malloc(sizeof(float) * NORM_ROWS * NORM_COLS);
+
+#ifdef _OPENMP
+    defaultnum = omp_get_max_threads();
+#endif
+
+    for (t = 0; t < (int)(sizeof(threadnum) / sizeof(threadnum[0])); t++) {
+        int num = threadnum[t] ? threadnum[t] : defaultnum;
+        NormRun* cur = (t == 0) ? &first : &run;
+
+#ifdef _OPENMP
+        omp_set_num_threads(num);
+        HT_CHECK(mcx_norm_threadnum(NORM_LONG) == num, "%d threads requested, %d used", num, mcx_norm_threadnum(NORM_LONG));
+#endif
+        nm_run(cur, data, longdata, label, weight, scale);
+
+        if (t == 0) {
+            test_reference(&first, data, longdata, label, weight, scale);
+            continue;
+        }
+
+        HT_CHECK(memcmp(run.colsum, first.colsum, sizeof(first.colsum)) == 0
+                 && memcmp(run.weightsum, first.weightsum, sizeof(first.weightsum)) == 0
+                 && memcmp(&run.longsum, &first.longsum, sizeof(first.longsum)) == 0,
+                 "the column sums differ with %d threads", num);
+        HT_CHECK(memcmp(run.labelsum, first.labelsum, sizeof(first.labelsum)) == 0, "the label sums differ with %d threads", num);
+        HT_CHECK(memcmp(run.scaled, first.scaled, sizeof(float) * NORM_ROWS * NORM_COLS) == 0
+                 && memcmp(run.clipped, first.clipped, sizeof(float) * NORM_ROWS * NORM_COLS) == 0,
+                 "the scaled outputs differ with %d threads", num);
+    }
+
+    free(first.scaled);
+    free(first.clipped);
+    free(run.scaled);
+    free(run.clipped);
+    free(label);
+    free(longdata);
+    free(data);
+}
+
+static void test_voxelvolume(void) {
+    const unsigned int coarsedim[3] = {NORM_GRIDX, NORM_GRIDY, NORM_GRIDZ}, finedim[3] = {NORM_GRIDX, NORM_GRIDY, 2 * NORM_GRIDZ};
+    const float unitinmm = 0.5f;
+    size_t slicelen = NORM_GRIDX * NORM_GRIDY, coarselen = slicelen * NORM_GRIDZ * NORM_FRAMES * NORM_COLS;
+    float* coarse = (float*)malloc(sizeof(float) * coarselen), *fine = (float*)malloc(sizeof(float) * coarselen * 2);
+    float* orig = (float*)malloc(sizeof(float) * coarselen * 2);
+    float dx[NORM_GRIDX], dy[NORM_GRIDY], coarsedz[NORM_GRIDZ], finedz[2 * NORM_GRIDZ];
+    size_t i, frame, z, bad = 0;
+
+    for (i = 0; i < NORM_GRIDX; i++) {
+        dx[i] = nm_rand(0.2f, 2.f);
+    }
+
+    for (i = 0; i < NORM_GRIDY; i++) {
+        dy[i] = nm_rand(0.2f, 2.f);
+    }
+
+    /** the fine grid repeats each slice of the uniform grid twice, at half the thickness */
+    for (i = 0; i < NORM_GRIDZ; i++) {
+        coarsedz[i] = 2.f * unitinmm;
+        finedz[2 * i] = finedz[2 * i + 1] = unitinmm;
+    }
+
+    for (i = 0; i < coarselen; i++) {
+        coarse[i] = nm_rand(0.f, 1.f) * powf(10.f, nm_rand(-3.f, 3.f));
+    }
+
+    /** each half slice receives half of the raw output of the uniform slice */
+    for (frame = 0; frame < NORM_FRAMES; frame++) {
+        for (z = 0; z < 2 * NORM_GRIDZ; z++) {
+            const float* src = coarse + (frame * NORM_GRIDZ + z / 2) * slicelen * NORM_COLS;
+
+            for (i = 0; i < slicelen * NORM_COLS; i++) {
+                fine[(frame * 2 * NORM_GRIDZ + z) * slicelen * NORM_COLS + i] = src[i] * 0.5f;
+            }
+        }
+    }
+
+    memcpy(orig, fine, sizeof(float) * coarselen * 2);
+    mcx_norm_voxelvolume(coarse, coarsedim, dx, dy, coarsedz, unitinmm, NORM_FRAMES, NORM_COLS);
+    mcx_norm_voxelvolume(fine, finedim, dx, dy, finedz, unitinmm, NORM_FRAMES, NORM_COLS);
+
+    for (frame = 0; frame < NORM_FRAMES; frame++) {
+        for (z = 0; z < 2 * NORM_GRIDZ; z++) {
+            const float* ref = coarse + (frame * NORM_GRIDZ + z / 2) * slicelen * NORM_COLS;
+            const float* val = fine + (frame * 2 * NORM_GRIDZ + z) * slicelen * NORM_COLS;
+
+            bad += (memcmp(ref, val, sizeof(float) * slicelen * NORM_COLS) != 0);
+        }
+    }
+
+    HT_CHECK(bad == 0, "%lu of %d slices of the non-uniform grid differ from the uniform grid", (unsigned long)bad, 2 * NORM_GRIDZ * NORM_FRAMES);
+
+    /** a grid of unitinmm voxels is left unchanged */
+    for (i = 0; i < NORM_GRIDX; i++) {
+        dx[i] = unitinmm;
+    }
+
+    for (i = 0; i < NORM_GRIDY; i++) {
+        dy[i] = unitinmm;
+    }
+
+    memcpy(fine, orig, sizeof(float) * coarselen * 2);
+    mcx_norm_voxelvolume(fine, finedim, dx, dy, finedz, unitinmm, NORM_FRAMES, NORM_COLS);
+    HT_CHECK(memcmp(fine, orig, sizeof(float) * coarselen * 2) == 0, "a grid of reference voxels is modified");
+
+    free(orig);
+    free(fine);
+    free(coarse);
+}
+
+int main(void) {
+    test_threads();
+    test_voxelvolume();
+    return HT_REPORT("testnorm");
+}
@@ -0,0 +1,202 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    testsvmc.c
+
+@brief   Host test of the split-voxel (svmc) encoder on planar interfaces
+
+A slab of label 3 between labels 1 and 2 has two interfaces aligned with the
+grid, whose isosurfaces are known exactly: with the samples of voxel i placed
+at i+1, the interface between voxels i-1 and i lies at i+0.5, in the middle of
+voxel i. Each packed MEDIA_2LABEL_SPLIT record of these voxels must hold the
+lower and upper labels, the reference point at the center of the plane patch
+and the axis normal pointing from the lower to the upper label; all other
+voxels must be unsplit. A tilted plane checks that the reference points of the
+split voxels lie near the plane and their normals are close to its normal.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mcx_svmc.h"
+#include "mcx_const.h"
+#include "hosttest.h"
+
+#define SV_DIMX     24       /**< domain size along x of the slab */
+#define SV_DIMY     12       /**< domain size along y of the slab */
+#define SV_DIMZ     10       /**< domain size along z of the slab */
+#define SV_SLAB0    8        /**< first voxel of the slab */
+#define SV_SLAB1    16       /**< first voxel after the slab */
+#define SV_TILTDIM  32       /**< domain size of the tilted plane */
+
+/**
+ * @brief Check the record of a voxel against the expected bytes, report the first mismatch
+ */
+
+static int sv_record(const unsigned char* rec, const unsigned char* ref, size_t idx, int* bad) {
+    if (memcmp(rec, ref, 8) != 0) {
+        if ((*bad)++ == 0) {
+            fprintf(stderr, "voxel %lu: [%u %u %u %u %u %u %u %u] instead of [%u %u %u %u %u %u %u %u]\n", (unsigned long)idx,
+                    rec[0], rec[1], rec[2], rec[3], rec[4], rec[5], rec[6], rec[7], ref[0], ref[1], ref[2], ref[3], ref[4], ref[5], ref[6], ref[7]);
+        }
+
+        return 1;
+    }
+
+    return 0;
+}
+
+static void test_slab(int issmooth) {
+    unsigned int dim[3] = {SV_DIMX, SV_DIMY, SV_DIMZ}, x, y, z;
+    unsigned int* vol = (unsigned int*)malloc(SV_DIMX * SV_DIMY * SV_DIMZ * sizeof(unsigned int));
+    unsigned char* svmc;
+    int bad = 0, split = 0;
+
+    for (z = 0; z < SV_DIMZ; z++) {
+        for (y = 0; y < SV_DIMY; y++) {
+            for (x = 0; x < SV_DIMX; x++) {
+                vol[(z * SV_DIMY + y) * SV_DIMX + x] = (x < SV_SLAB0) ? 1 : ((x < SV_SLAB1) ? 3 : 2);
+            }
+        }
+    }
+
+    svmc = mcx_svmc_encode(vol, dim, issmooth, 0);
+    HT_CHECK(svmc != NULL, "the slab is not encoded");
+
+    if (svmc == NULL) {
+        free(vol);
+        return;
+    }
+
+    for (z = 0; z < SV_DIMZ; z++) {
+        for (y = 0; y < SV_DIMY; y++) {
+            for (x = 0; x < SV_DIMX; x++) {
+                size_t idx = (z * SV_DIMY + y) * SV_DIMX + x;
+                unsigned char ref[8] = {0};
+
+                ref[0] = (unsigned char)vol[idx];
+
+                /**
+                 * the cells start at the samples 0 to dim-2, and cover the voxels 1 to dim-1;
+                 * the plane patch of a voxel is centered at 0.5 along all axes, floor(0.5*255)=127,
+                 * and the normal +x or -x is mapped to 254 or 0, with 127 for the other components
+                 */
+                if ((x == SV_SLAB0 || x == SV_SLAB1) && y > 0 && z > 0) {
+                    ref[0] = (x == SV_SLAB0) ? 1 : 2;
+                    ref[1] = 3;
+                    ref[2] = ref[3] = ref[4] = 127;
+                    ref[5] = (x == SV_SLAB0) ? 254 : 0;
+                    ref[6] = ref[7] = 127;
+                    split++;
+                }
+
+                sv_record(svmc + (idx << 3), ref, idx, &bad);
+            }
+        }
+    }
+
+    HT_CHECK(bad == 0, "smooth %d: %d voxels of the slab are encoded incorrectly", issmooth, bad);
+    HT_CHECK(split == 2 * (SV_DIMY - 1) * (SV_DIMZ - 1), "smooth %d: %d split voxels", issmooth, split);
+
+    free(svmc);
+    free(vol);
+}
+
+static void test_tilted(void) {
+    const double n[3] = {0.48, 0.6, 0.64}, c = 27.3;    /** the plane n.s=c with a unit normal, in sample coordinates */
+    unsigned int dim[3] = {SV_TILTDIM, SV_TILTDIM, SV_TILTDIM}, x, y, z;
+    size_t dimxyz = (size_t)SV_TILTDIM * SV_TILTDIM * SV_TILTDIM;
+    unsigned int* vol = (unsigned int*)malloc(dimxyz * sizeof(unsigned int));
+    unsigned char* svmc;
+    double maxdist = 0.0, mincos = 1.0, sum[3] = {0.0, 0.0, 0.0}, sumlen;
+    int badlabel = 0, missing = 0, split = 0;
+
+    for (z = 0; z < SV_TILTDIM; z++) {
+        for (y = 0; y < SV_TILTDIM; y++) {
+            for (x = 0; x < SV_TILTDIM; x++) {
+                double s = n[0] * (x + 1) + n[1] * (y + 1) + n[2] * (z + 1);
+
+                vol[(z * SV_TILTDIM + y) * SV_TILTDIM + x] = (s < c) ? 1 : 2;
+            }
+        }
+    }
+
+    svmc = mcx_svmc_encode(vol, dim, 1, 1);
+    HT_CHECK(svmc != NULL, "the tilted plane is not encoded");
+
+    if (svmc == NULL) {
+        free(vol);
+        return;
+    }
+
+    for (z = 1; z < SV_TILTDIM; z++) {
+        for (y = 1; y < SV_TILTDIM; y++) {
+            for (x = 1; x < SV_TILTDIM; x++) {
+                size_t idx = (z * SV_TILTDIM + y) * SV_TILTDIM + x;
+                const unsigned char* rec = svmc + (idx << 3);
+                double p[3], m[3], len, dist;
+                int i;
+
+                /** the voxel x covers the sample coordinates [x, x+1] */
+                if (rec[1] == 0) {
+                    double center = n[0] * (x + 0.5) + n[1] * (y + 0.5) + n[2] * (z + 0.5);
+
+                    missing += (fabs(center - c) < 0.2);
+                    badlabel += (rec[0] != vol[idx]);
+                    continue;
+                }
+
+                split++;
+                badlabel += (rec[0] != 1 || rec[1] != 2);
+
+                for (i = 0; i < 3; i++) {
+                    p[i] = (i == 0 ? x : (i == 1 ? y : z)) + (rec[2 + i] + 0.5) / 255.0;
+                    m[i] = (rec[5 + i] + 0.5) / 127.5 - 1.0;
+                }
+
+                len = sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+                dist = fabs(n[0] * p[0] + n[1] * p[1] + n[2] * p[2] - c);
+                maxdist = (dist > maxdist) ? dist : maxdist;
+
+                /** the replicated edges bend the smoothed surface, the normals are only compared away from them */
+                if (x > 1 && y > 1 && z > 1 && x + 2 < SV_TILTDIM && y + 2 < SV_TILTDIM && z + 2 < SV_TILTDIM) {
+                    mincos = fmin(mincos, (n[0] * m[0] + n[1] * m[1] + n[2] * m[2]) / len);
+
+                    for (i = 0; i < 3; i++) {
+                        sum[i] += m[i] / len;
+                    }
+                }
+            }
+        }
+    }
+
+    HT_CHECK(split > SV_TILTDIM * SV_TILTDIM, "only %d voxels of the tilted plane are split", split);
+    HT_CHECK(badlabel == 0, "%d voxels of the tilted plane have wrong labels", badlabel);
+    HT_CHECK(missing == 0, "%d voxels crossed by the tilted plane are not split", missing);
+    HT_CHECK(maxdist < 0.25, "a reference point is %.3f voxel away from the tilted plane", maxdist);
+    HT_CHECK(mincos > cos(10.0 * ONE_PI / 180.0), "a normal deviates by %.2f degrees from the tilted plane", acos(mincos) * 180.0 / ONE_PI);
+
+    /** the staircase errors of the voxel normals cancel out on average */
+    sumlen = sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+    HT_CHECK(sumlen > 0.0 && (n[0] * sum[0] + n[1] * sum[1] + n[2] * sum[2]) / sumlen > cos(1.0 * ONE_PI / 180.0),
+             "the mean normal deviates from the tilted plane by more than 1 degree");
+
+    free(svmc);
+    free(vol);
+}
+
+int main(void) {
+    test_slab(1);
+    test_slab(0);
+    test_tilted();
+    return HT_REPORT("testsvmc");
+}
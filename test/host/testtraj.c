@@ -0,0 +1,214 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    testtraj.c
+
+@brief   Host test of the grouping, sampling and quantization of photon trajectories
+
+The trajectories of photons with random IDs and lengths are interleaved at
+random, keeping the order of the positions of each photon, as the GPU threads
+append them. After the IDs are shifted, mcx_traj_compact must group the records
+by photon ID with the positions of each photon in their original order, keep
+every k-th position and the last one, and give the same output with 1 to 7
+threads. The cumulative sums of the deltas of mcx_traj_quantize must recover
+the rounded positions of each photon.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+#include "mcx_traj.h"
+#include "hosttest.h"
+
+#define TR_PHOTONS   400      /**< number of photons */
+#define TR_MAXSTEP   40       /**< max number of positions of a photon */
+#define TR_RECLEN    6        /**< photon ID, x, y, z, w and source ID */
+#define TR_BASE      1000     /**< offset added to the photon IDs */
+#define TR_QUANT     0.25f    /**< quantization step of the positions */
+
+static unsigned int tr_state = 88675123u;
+
+/**
+ * @brief A random 32-bit integer, xorshift32
+ */
+
+static unsigned int tr_rand(void) {
+    tr_state ^= tr_state << 13;
+    tr_state ^= tr_state >> 17;
+    tr_state ^= tr_state << 5;
+    return tr_state;
+}
+
+/**
+ * @brief Return the photon ID stored in the bits of the first float of a record
+ */
+
+static unsigned int tr_id(const float* rec) {
+    unsigned int id;
+
+    memcpy(&id, rec, sizeof(id));
+    return id;
+}
+
+/**
+ * @brief Group and sample a copy of the records with a given number of threads
+ */
+
+static float* tr_compact(const float* rec, unsigned int count, unsigned int stepstride, int nthread, unsigned int* kept, size_t* photons) {
+    float* copy = (float*)malloc(count * TR_RECLEN * sizeof(float));
+
+    memcpy(copy, rec, count * TR_RECLEN * sizeof(float));
+    *kept = count;
+#ifdef _OPENMP
+    omp_set_num_threads(nthread);
+#else
+    (void)nthread;
+#endif
+    return mcx_traj_compact(copy, kept, TR_RECLEN, stepstride, photons);
+}
+
+int main(void) {
+    unsigned int len[TR_PHOTONS], id[TR_PHOTONS], next[TR_PHOTONS], stride, n = 0, i, p;
+    float* rec;
+    size_t photons;
+
+    /** distinct random IDs below 4*TR_PHOTONS, and 1 to TR_MAXSTEP positions per photon */
+    for (p = 0; p < TR_PHOTONS; p++) {
+        len[p] = 1 + tr_rand() % TR_MAXSTEP;
+        id[p] = p * 4 + tr_rand() % 4;
+        next[p] = 0;
+        n += len[p];
+    }
+
+    for (p = TR_PHOTONS - 1; p > 0; p--) {
+        unsigned int j = tr_rand() % (p + 1), tmp = id[p];
+
+        id[p] = id[j];
+        id[j] = tmp;
+    }
+
+    /** interleave the photons at random, each appending its next position; w holds the step index */
+    rec = (float*)malloc(n * TR_RECLEN * sizeof(float));
+
+    for (i = 0; i < n; i++) {
+        float* r = rec + i * TR_RECLEN;
+
+        do {
+            p = tr_rand() % TR_PHOTONS;
+        } while (next[p] == len[p]);
+
+        memcpy(r, id + p, sizeof(float));
+        r[1] = 0.1f * (id[p] % 37) + 0.37f * next[p];
+        r[2] = 60.f - 0.23f * next[p];
+        r[3] = (float)(tr_rand() % 6000) * 0.01f;
+        r[4] = (float)next[p]++;
+        r[5] = 1.f;
+    }
+
+    /** the IDs of a batch are shifted, and the next batch starts after the largest one */
+    {
+        unsigned int maxid = 0;
+
+        for (p = 0; p < TR_PHOTONS; p++) {
+            maxid = (id[p] > maxid) ? id[p] : maxid;
+        }
+
+        HT_CHECK(mcx_traj_shiftid(rec, n, TR_RECLEN, TR_BASE) == TR_BASE + maxid + 1, "the offset of the next batch is wrong");
+        HT_CHECK(tr_id(rec) >= TR_BASE && mcx_traj_shiftid(rec, 0, TR_RECLEN, 7) == 7, "the IDs are not shifted");
+    }
+
+    for (stride = 1; stride <= 4; stride += 3) {
+        unsigned int count, expected = 0, bad = 0, badthread = 0, start;
+        float* out = tr_compact(rec, n, stride, 1, &count, &photons);
+        int nthread;
+
+        for (p = 0; p < TR_PHOTONS; p++) {
+            expected += (len[p] - 1) / stride + 1 + ((len[p] - 1) % stride != 0);
+        }
+
+        HT_CHECK(photons == TR_PHOTONS && count == expected, "stride %u: %lu photons and %u records instead of %u and %u", stride,
+                 (unsigned long)photons, count, TR_PHOTONS, expected);
+
+        /** ascending IDs; each photon starts at step 0, advances by the stride and ends at its last step */
+        for (i = 0, start = 0; count == expected && i < count; i++) {
+            const float* r = out + i * TR_RECLEN;
+            int isfirst = (i == 0 || tr_id(r) != tr_id(r - TR_RECLEN)), islast = (i + 1 == count || tr_id(r) != tr_id(r + TR_RECLEN));
+            unsigned int step = (unsigned int)r[4], plen = 0;
+
+            for (p = 0; p < TR_PHOTONS; p++) {
+                plen = (id[p] + TR_BASE == tr_id(r)) ? len[p] : plen;
+            }
+
+            if (isfirst) {
+                bad += (step != 0 || (i > 0 && tr_id(r) <= tr_id(r - TR_RECLEN)));
+                start = i;
+            } else if (islast) {
+                bad += (step != plen - 1 || step <= r[4 - TR_RECLEN]);
+            } else {
+                bad += (step != (i - start) * stride);
+            }
+
+            bad += (r[1] != 0.1f * ((tr_id(r) - TR_BASE) % 37) + 0.37f * step);
+        }
+
+        HT_CHECK(bad == 0, "stride %u: %u records are out of order or not sampled", stride, bad);
+
+        for (nthread = 2; nthread <= 7; nthread += 5) {
+            unsigned int count2;
+            size_t photons2;
+            float* out2 = tr_compact(rec, n, stride, nthread, &count2, &photons2);
+
+            badthread += (count2 != count || photons2 != photons || memcmp(out, out2, count * TR_RECLEN * sizeof(float)) != 0);
+            free(out2);
+        }
+
+        HT_CHECK(badthread == 0, "stride %u: the grouped records depend on the thread number", stride);
+
+        /** the cumulative sum of the deltas of each photon recovers its rounded positions */
+        {
+            int* dp, *dp1, sum[3] = {0, 0, 0}, j;
+
+#ifdef _OPENMP
+            omp_set_num_threads(5);
+            dp = mcx_traj_quantize(out, count, TR_RECLEN, TR_QUANT);
+            omp_set_num_threads(1);
+#else
+            dp = mcx_traj_quantize(out, count, TR_RECLEN, TR_QUANT);
+#endif
+            dp1 = mcx_traj_quantize(out, count, TR_RECLEN, TR_QUANT);
+            bad = 0;
+
+            for (i = 0; i < count; i++) {
+                const float* r = out + i * TR_RECLEN;
+
+                for (j = 0; j < 3; j++) {
+                    sum[j] = ((i == 0 || tr_id(r) != tr_id(r - TR_RECLEN)) ? 0 : sum[j]) + dp[i * 3 + j];
+                    bad += (sum[j] != (int)floorf(r[j + 1] / TR_QUANT + 0.5f) || fabsf(sum[j] * TR_QUANT - r[j + 1]) > TR_QUANT * 0.5f);
+                }
+            }
+
+            HT_CHECK(bad == 0, "stride %u: %u quantized positions are not recovered by the cumulative sums", stride, bad);
+            HT_CHECK(memcmp(dp, dp1, count * 3 * sizeof(int)) == 0, "stride %u: the deltas depend on the thread number", stride);
+            free(dp);
+            free(dp1);
+        }
+
+        free(out);
+    }
+
+    free(rec);
+    return HT_REPORT("testtraj");
+}
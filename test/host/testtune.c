@@ -0,0 +1,138 @@
+/***************************************************************************//**
+**  \mainpage Monte Carlo eXtreme - GPU accelerated Monte Carlo Photon Migration
+**
+**  \author Qianqian Fang <q.fang at neu.edu>
+**  \copyright Qianqian Fang, 2009-2024
+**
+**  \section slicense License
+**          GPL v3, see LICENSE.txt for details
+*******************************************************************************/
+
+/***************************************************************************//**
+\file    testtune.c
+
+@brief   Host test of the launch-configuration autotuner and its JSON cache
+
+The search is driven by a synthetic timer with a known fastest block size and
+thread multiplier, the cache is written to and read back from a scratch file.
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mcx_tune.h"
+#include "hosttest.h"
+
+#define TUNE_SCRATCH  "testtune_cache.json"
+
+/**
+ * State of the synthetic timer
+ */
+
+typedef struct SynthTimer {
+    int sm;                        /**< number of SMs of the mock device */
+    int maxmpthread;               /**< max resident threads per SM of the mock device */
+    int maxblock;                  /**< larger blocks can not be launched */
+    int calls;                     /**< number of timed runs, including the warm-up */
+} SynthTimer;
+
+/**
+ * @brief Run time (ms) of a mock device, fastest at 256 threads/block and 4x the thread capacity
+ *
+ * The first call models the context warm-up and is 100x slower, the search must discard it.
+ */
+
+static double synth_timer(void* ctx, int blocksize, int threadnum) {
+    SynthTimer* t = (SynthTimer*)ctx;
+    double capacity = (double)((t->maxmpthread / blocksize) * blocksize * t->sm);
+    double ms = 100.0 * (1.0 + fabs(log2(blocksize / 256.0))) * (1.0 + 0.5 * fabs(log2(threadnum / capacity / 4.0)));
+
+    if (t->calls++, blocksize > t->maxblock) {
+        return -1.0;
+    }
+
+    return (t->calls == 1) ? ms * 100.0 : ms;
+}
+
+/**
+ * @brief Timer of a device on which no configuration can be launched
+ */
+
+static double fail_timer(void* ctx, int blocksize, int threadnum) {
+    return -1.0;
+}
+
+static void test_search(void) {
+    SynthTimer t = {80, 2048, 512, 0};
+    TuneResult best;
+    int count;
+
+    /** 4 launchable block sizes at the default multiplier, then 3 other multipliers, plus the warm-up */
+    count = mcx_tune_search(t.sm, t.maxmpthread, 1e6, synth_timer, &t, &best, NULL);
+    HT_CHECK(count == 7, "timed %d candidates", count);
+    HT_CHECK(t.calls == 9, "called the timer %d times", t.calls);
+    HT_CHECK(best.blocksize == 256, "chose block %d", best.blocksize);
+    HT_CHECK(best.threadnum == 2048 * 80 * 4, "chose %d threads", best.threadnum);
+    HT_CHECK(fabs(best.speed - 1e6 / 100.0) < 1e-9, "speed %f", best.speed);
+
+    /** block sizes larger than the resident threads of an SM are skipped, thread numbers are multiples of the block */
+    t.sm = 3;
+    t.maxmpthread = 768;
+    t.maxblock = 1024;
+    t.calls = 0;
+    count = mcx_tune_search(t.sm, t.maxmpthread, 1e6, synth_timer, &t, &best, NULL);
+    HT_CHECK(count == 7, "timed %d candidates", count);
+    HT_CHECK(best.blocksize == 256, "chose block %d", best.blocksize);
+    HT_CHECK(best.threadnum == 768 * 3 * 4, "chose %d threads", best.threadnum);
+    HT_CHECK(best.threadnum % best.blocksize == 0, "%d threads are not a multiple of block %d", best.threadnum, best.blocksize);
+
+    count = mcx_tune_search(t.sm, t.maxmpthread, 1e6, fail_timer, NULL, &best, NULL);
+    HT_CHECK(count == 0 && best.blocksize == 0 && best.threadnum == 0, "tuned block %d on a failing device", best.blocksize);
+
+    count = mcx_tune_search(0, t.maxmpthread, 1e6, synth_timer, &t, &best, NULL);
+    HT_CHECK(count == 0, "tuned a device without SM");
+}
+
+static void test_cache(void) {
+    TuneResult a = {256, 655360, 12345.678901234567}, b = {128, 163840, 0.1}, res;
+    FILE* fp;
+
+    remove(TUNE_SCRATCH);
+    HT_CHECK(mcx_tune_load(TUNE_SCRATCH, "devA|k00100|m1", &res) == 0, "loaded from a missing file");
+
+    HT_CHECK(mcx_tune_save(TUNE_SCRATCH, "devA|k00100|m1", &a), "can not write %s", TUNE_SCRATCH);
+    HT_CHECK(mcx_tune_save(TUNE_SCRATCH, "devB|k00100|m4b4", &b), "can not write %s", TUNE_SCRATCH);
+
+    HT_CHECK(mcx_tune_load(TUNE_SCRATCH, "devA|k00100|m1", &res), "devA not found");
+    HT_CHECK(res.blocksize == a.blocksize && res.threadnum == a.threadnum && res.speed == a.speed,
+             "devA loaded as %d %d %.17g", res.blocksize, res.threadnum, res.speed);
+    HT_CHECK(mcx_tune_load(TUNE_SCRATCH, "devB|k00100|m4b4", &res), "devB not found");
+    HT_CHECK(res.blocksize == b.blocksize && res.threadnum == b.threadnum && res.speed == b.speed,
+             "devB loaded as %d %d %.17g", res.blocksize, res.threadnum, res.speed);
+    HT_CHECK(mcx_tune_load(TUNE_SCRATCH, "devA|k00100|m2", &res) == 0, "loaded an unknown key");
+
+    /** replacing an entry keeps the others */
+    a.blocksize = 512;
+    HT_CHECK(mcx_tune_save(TUNE_SCRATCH, "devA|k00100|m1", &a), "can not update %s", TUNE_SCRATCH);
+    HT_CHECK(mcx_tune_load(TUNE_SCRATCH, "devA|k00100|m1", &res) && res.blocksize == 512, "devA not updated");
+    HT_CHECK(mcx_tune_load(TUNE_SCRATCH, "devB|k00100|m4b4", &res) && res.blocksize == 128, "devB lost after the update");
+
+    /** a corrupted cache is a miss, and is replaced on the next save */
+    if ((fp = fopen(TUNE_SCRATCH, "wb")) != NULL) {
+        fputs("{\"devA|k00100|m1\":{\"BlockSize\":", fp);
+        fclose(fp);
+    }
+
+    HT_CHECK(mcx_tune_load(TUNE_SCRATCH, "devA|k00100|m1", &res) == 0, "loaded from a corrupted file");
+    HT_CHECK(mcx_tune_save(TUNE_SCRATCH, "devB|k00100|m4b4", &b) && mcx_tune_load(TUNE_SCRATCH, "devB|k00100|m4b4", &res),
+             "can not replace a corrupted file");
+
+    remove(TUNE_SCRATCH);
+}
+
+int main(void) {
+    test_search();
+    test_cache();
+    return HT_REPORT("testtune");
+}
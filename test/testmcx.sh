@@ -89,6 +89,25 @@ echo "test isotropic source ... "
 temp=`"$MCX" --bench cube60 --json '{"Optode":{"Source":{"Type":"isotropic","Pos":[29,29,29]}}}' -d 0 -S 0 $PARAM | grep -o -E 'absorbed:.*88\.[0-9]+%'`
 if [ -z "$temp" ]; then echo "fail to run isotropic source"; fail=$((fail+1)); else echo "ok"; fi
 
+echo "test isotropic source with a biased launch toward the detectors ... "
+temp=`"$MCX" --bench cube60 --json '{"Optode":{"Source":{"Type":"isotropic","Pos":[29,29,29]},"Bias":{"Prob":0.5,"Angle":0.3}}}' -d 0 -S 0 $PARAM | grep -o -E 'absorbed:.*88\.[0-9]+%'`
+if [ -z "$temp" ]; then echo "fail to run isotropic source with a biased launch"; fail=$((fail+1)); else echo "ok"; fi
+
+echo "test the detected weight of a biased launch against an unbiased launch ... "
+rm -f testbias.txt
+BIASSRC='"Source":{"Type":"isotropic","Pos":[29,29,5]}'
+"$MCX" --bench cube60 --json "{\"Optode\":{$BIASSRC}}" -w DPW -F mc2 -s testbias0 $PARAM > /dev/null
+"$MCX" --bench cube60 --json "{\"Optode\":{$BIASSRC,\"Bias\":{\"Prob\":0.5,\"Angle\":0.3}}}" -w DPW -F mc2 -s testbias1 -E 1234567 $PARAM > /dev/null
+# each .mch record holds the detector, the partial paths in the 2 media and the initial weight after the 64-byte header
+for run in 0 1; do
+    photons=`od -An -t u4 -j 20 -N 4 testbias$run.mch 2> /dev/null`
+    od -An -v -t f4 -j 64 -w16 testbias$run.mch 2> /dev/null | awk -v n="$photons" '{w=$4*exp(-0.005*$2-0.002*$3);s+=w;s2+=w*w}
+        END{if(n>0){m=s/n;print m, sqrt((s2/n-m*m)/n)}}' >> testbias.txt
+done
+temp=`awk '{m[NR]=$1;se[NR]=$2}END{d=m[1]-m[2];if(NR==2 && m[1]>0 && m[2]>0 && d*d<16*(se[1]*se[1]+se[2]*se[2]))print "ok"}' testbias.txt 2> /dev/null`
+rm -f testbias0.* testbias1.* testbias.txt
+if [ -z "$temp" ]; then echo "fail to keep the detected weight unbiased with the biased launch"; fail=$((fail+1)); else echo "ok"; fi
+
 echo "test cone beam source ... "
 temp=`"$MCX" --bench cube60 --json '{"Domain":{"Media":[[0,0,1,1],[0.001,0.001,0,1]]},"Optode":{"Source":{"Type":"cone","Param1":[0.5,0,0,0]}}}' -d 0 -S 0 $PARAM | grep -o -E 'absorbed:.*6\.[0-9]+%'`
 if [ -z "$temp" ]; then echo "fail to run cone beam source"; fail=$((fail+1)); else echo "ok"; fi
@@ -152,6 +171,177 @@ echo "test saving trajectory feature -D M ... "
 temp=`"$MCX" --bench cube60 -D M -S 0 -d 0 $PARAM -n 1e2 | grep -o -E 'saved [6-9][0-9]+ trajectory'`
 if [ -z "$temp" ]; then echo "fail to save trajectory data via -D M"; fail=$((fail+1)); else echo "ok"; fi
 
+echo "test server mode --serve ... "
+temp=`("$MCX" --bench cube60 --dumpjson -; echo '{"Domain":{"VolumeFile":"nonexist.bin"}}') | "$MCX" --serve - -S 0 -n 1e4 $PARAM 2> /dev/null | grep -o -E '"JobID":[12],"Status":(0|-[0-9]+)' | wc -l`
+if [ "$temp" -ne "2" ]; then echo "fail to run jobs in the server mode"; fail=$((fail+1)); else echo "ok"; fi
+
+echo "test the server mode continuing after a job fails in the simulation ... "
+temp=`(echo '{"Domain":{"Dim":[60,60,1],"Media":[[0,0,1,1],[0.005,1,0,1.37]]},"Shapes":[{"Grid":{"Tag":1,"Size":[60,60,1]}}],"Optode":{"Source":{"Pos":[30,30,0],"Dir":[0,0.6,0.8]}},"Forward":{"T0":0,"T1":5e-9,"Dt":5e-9}}'; "$MCX" --bench cube60 --dumpjson -) | "$MCX" --serve - -S 0 -n 1e4 $PARAM 2> /dev/null | grep -o -E '"JobID":1,"Status":-[0-9]+|"JobID":2,"Status":0' | wc -l`
+if [ "$temp" -ne "2" ]; then echo "fail to recover from a failed job in the server mode"; fail=$((fail+1)); else echo "ok"; fi
+
+echo "test the server mode continuing after a job fails at the end of the simulation ... "
+rm -rf servejob.* servejob_*
+temp=`("$MCX" --bench cube60 -s nonexist_dir/servejob --dumpjson -; "$MCX" --bench cube60 -s servejob --dumpjson -; "$MCX" --bench cube60 -s servejob --dumpjson -) | "$MCX" --serve - -D M -F jnii -n 1e4 $PARAM 2> /dev/null | grep -o -E '"JobID":1,"Status":-[0-9]+|"JobID":[23],"Status":0' | wc -l`
+if [ "$temp" -ne "3" ] || [ ! -f servejob.jnii ]; then echo "fail to run jobs after a job fails while saving its outputs in the server mode"; fail=$((fail+1)); else echo "ok"; fi
+rm -rf servejob.* servejob_*
+
+echo "test output cache --cache ... "
+rm -rf mcxcache_test
+"$MCX" --bench cube60 --cache mcxcache_test -S 0 -n 1e4 $PARAM > /dev/null 2>&1
+temp=`"$MCX" --bench cube60 --cache mcxcache_test -S 0 -n 1e4 $PARAM 2>&1 | grep -o -E 'outputs from cache [0-9a-f]{32}'`
+rm -rf mcxcache_test
+if [ -z "$temp" ]; then echo "fail to load outputs from the cache"; fail=$((fail+1)); else echo "ok"; fi
+
+echo "test sharded run and merge --shard/--merge ... "
+"$MCX" --bench cube60 -s mcxshard1 --shard 1/2 -n 1e4 $PARAM > /dev/null 2>&1
+"$MCX" --bench cube60 -s mcxshard2 --shard 2/2 -n 1e4 $PARAM > /dev/null 2>&1
+temp=`"$MCX" --merge mcxshard1.jnii mcxshard2.jnii -s mcxshardall 2>&1 | grep -o -E 'merging 2 shards: 10000 photons'`
+haserror=`ls mcxshardall.jnii 2> /dev/null`
+rm -f mcxshard1* mcxshard2* mcxshardall*
+if [ -z "$temp" ] || [ -z "$haserror" ]; then echo "fail to merge sharded outputs"; fail=$((fail+1)); else echo "ok"; fi
+
+echo "test merging binary JNIfTI shards --merge ... "
+"$MCX" --bench cube60 -s mcxshard1 --shard 1/2 -n 1e4 -F bnii $PARAM > /dev/null 2>&1
+"$MCX" --bench cube60 -s mcxshard2 --shard 2/2 -n 1e4 -F bnii $PARAM > /dev/null 2>&1
+temp=`"$MCX" --merge mcxshard1.bnii mcxshard2.bnii -s mcxshardall 2>&1 | grep -o -E 'merged volumetric output is saved to mcxshardall.bnii'`
+haserror=`ls mcxshardall.bnii 2> /dev/null`
+rm -f mcxshard1* mcxshard2* mcxshardall*
+if [ -z "$temp" ] || [ -z "$haserror" ]; then echo "fail to merge binary JNIfTI shards"; fail=$((fail+1)); else echo "ok"; fi
+
+echo "test merged normalization factor and detected photon headers --merge ... "
+"$MCX" --bench cube60 -s mcxshard1 --shard 1/2 -n 1e4 -F mc2 -d 1 $PARAM > /dev/null 2>&1
+"$MCX" --bench cube60 -s mcxshard2 --shard 2/2 -n 1e4 -F mc2 -d 1 $PARAM > /dev/null 2>&1
+alpha=`"$MCX" --merge mcxshard1.mc2 mcxshard2.mch -s mcxshardall 2>&1 | grep -o -E 'alpha=[0-9.eE+-]+' | sed 's/alpha=//'`
+a1=`tr -d ' \t\n' < mcxshard1_shard.json | grep -o -E '"Normalizer":\[[^],]+' | sed 's/.*\[//'`
+a2=`tr -d ' \t\n' < mcxshard2_shard.json | grep -o -E '"Normalizer":\[[^],]+' | sed 's/.*\[//'`
+temp=`echo "$alpha $a1 $a2" | awk 'NF==3 && $2>0 && $3>0 {ref=1/(1/$2+1/$3); if((($1-ref)^2)^0.5 <= 1e-5*ref+1e-6) print "ok"}'`
+his1=`od -An -t u4 -j 20 -N 12 mcxshard1.mch 2> /dev/null`
+his2=`od -An -t u4 -j 20 -N 12 mcxshard2.mch 2> /dev/null`
+hisall=`od -An -t u4 -j 20 -N 12 mcxshardall.mch 2> /dev/null`
+norm=`for f in mcxshard1 mcxshard2 mcxshardall; do od -An -t f4 -j 40 -N 4 $f.mch 2> /dev/null; done | tr '\n' ' '`
+haserror=`echo "$his1 $his2 $hisall $norm" | awk 'NF!=12 || $1+$4!=$7 || $2+$5!=$8 || $3+$6!=$9 || $10<=0 || $11<=0 {print "bad"; exit}
+    {ref=1/(1/$10+1/$11); if((($12-ref)^2)^0.5 > 1e-5*ref) print "bad"}'`
+rm -f mcxshard1* mcxshard2* mcxshardall*
+if [ -z "$temp" ] || [ ! -z "$haserror" ]; then echo "merged normalizer or detected photon counts do not add up: $alpha vs $a1,$a2; $his1 + $his2 = $hisall; $norm"; fail=$((fail+1)); else echo "ok"; fi
+
+echo "test brick-compressed media volume --brick 1 ... "
+temp=`"$MCX" --bench cube60b --brick 1 -S 0 $PARAM | grep -o -E 'absorbed:.*27\.[0-9]+%'`
+if [ -z "$temp" ]; then echo "fail to run with a brick-compressed media volume"; fail=$((fail+1)); else echo "ok"; fi
+
+echo "test packed 4-bit label media format -K label4 ... "
+temp=`"$MCX" --bench cube60b -K label4 -S 0 $PARAM | grep -o -E 'absorbed:.*27\.[0-9]+%'`
+if [ -z "$temp" ]; then echo "fail to run with the packed 4-bit label format"; fail=$((fail+1)); else echo "ok"; fi
+
+echo "test global-memory property table --globalprop 1 ... "
+temp=`"$MCX" --bench cube60 --globalprop 1 -S 0 $PARAM | grep -o -E 'absorbed:.*17\.[0-9]+%'`
+if [ -z "$temp" ]; then echo "fail to run with the global-memory property table"; fail=$((fail+1)); else echo "ok"; fi
+
+echo "test detected photon filter with half-precision records ... "
+rm -f detfiltertest.*
+filter='{"Optode":{"DetFilter":{"MaxScatter":100,"TimeWindow":[0,1e-9]}}}'
+"$MCX" --bench cube60b -w DSP -E 1648335518 -F mc2 -s detfiltertest -q 1 $PARAM > /dev/null 2>&1
+temp=`"$MCX" --bench cube60b -w DSP -E 1648335518 --halfdet 1 --json "$filter" -S 0 $PARAM | sed 's/\x1b\[[0-9;]*m//g' | grep -o -E 'total: [0-9]+' | tail -1 | grep -o -E '[0-9]+'`
+haserror=`"$MCX" --bench cube60b -w DSP -E detfiltertest.mch -O J --json "$filter" -S 0 $PARAM | sed 's/\x1b\[[0-9;]*m//g' | grep -o -E 'simulated [0-9]+ photons' | grep -o -E '[0-9]+'`
+rm -f detfiltertest.*
+# the same photons, filtered on the GPU and by the host reference when loaded for replay, may only differ at the bounds
+if [ -z "$temp" ] || [ -z "$haserror" ] || [ "$haserror" -eq 0 ] || [ $(( (temp-haserror)*(temp-haserror)*10000 )) -gt $((haserror*haserror)) ]; then
+    echo "fail to filter detected photons on the GPU: $temp kept, $haserror by the host reference"; fail=$((fail+1)); else echo "ok"; fi
+
+echo "test grouped and sampled trajectories --trajsample 2,3 ... "
+temp=`"$MCX" --bench cube60 -D M -S 0 -d 0 $PARAM -n 1e2 --trajsample 2,3 | grep -o -E 'grouped [0-9]+ trajectory positions of [1-5][0-9] photons'`
+if [ -z "$temp" ]; then echo "fail to group the sampled trajectories"; fail=$((fail+1)); else echo "ok"; fi
+
+echo "test launch-configuration autotuner --autotune 1 ... "
+"$MCX" --bench cube60 --autotune 1 --tunefile mcxtune_test.json -S 0 $PARAM > /dev/null 2>&1
+temp=`"$MCX" --bench cube60 --autotune 1 --tunefile mcxtune_test.json -S 0 $PARAM 2>&1 | grep -o -E 'autotuning|absorbed:.*17\.[0-9]+%'`
+haserror=`grep -o BlockSize mcxtune_test.json 2> /dev/null`
+rm -f mcxtune_test.json
+if [ -z "$temp" ] || [ -z "$haserror" ] || [ -n "`echo "$temp" | grep autotuning`" ]; then echo "fail to run with the autotuned launch configuration"; fail=$((fail+1)); else echo "ok"; fi
+
+echo "test restarting from a preprocessed snapshot --dumpjson file.mcxs ... "
+"$MCX" --bench cube60b -n 1e4 --dumpjson mcxsnap.mcxs > /dev/null 2>&1
+temp=`"$MCX" -f mcxsnap.mcxs -s mcxsnap -S 0 $PARAM | sed 's/\x1b\[[0-9;]*m//g' | grep -o -E 'simulated\s+10000 photons'`
+rm -f mcxsnap*
+if [ -z "$temp" ]; then echo "fail to run from a preprocessed snapshot"; fail=$((fail+1)); else echo "ok"; fi
+
+echo "test non-uniform grid with unit voxel sizes against the uniform grid ... "
+ONES=`printf '1,%.0s' $(seq 59)`1
+temp=`"$MCX" --bench cube60 --json "{\"Domain\":{\"VoxelSize\":{\"Dx\":[$ONES],\"Dy\":[$ONES],\"Dz\":[$ONES]}}}" -S 0 $PARAM | grep -o -E 'absorbed:.*17\.[0-9]+%'`
+if [ -z "$temp" ]; then echo "fail to run with a non-uniform grid"; fail=$((fail+1)); else echo "ok"; fi
+
+echo "test exporting the voxel sizes of a non-uniform grid ... "
+temp=`"$MCX" --bench cube60 --json '{"Domain":{"Step":[1,1,2]}}' --dumpjson - | grep -o -E '"Dz":\s*\[2,'`
+if [ -z "$temp" ]; then echo "fail to export the voxel sizes of an anisotropic grid"; fail=$((fail+1)); else echo "ok"; fi
+
+echo "test coarse-to-fine simulation with a 2-level media pyramid ... "
+temp=`"$MCX" --bench cube60 --pyramid 2 -S 0 $PARAM | sed 's/\x1b\[[0-9;]*m//g'`
+temp=`echo "$temp" | grep -o -E 'tallying voxels|absorbed:.*17\.[0-9]+%' | wc -l`
+if [ "$temp" -ne "2" ]; then echo "fail to run a coarse-to-fine simulation"; fail=$((fail+1)); else echo "ok"; fi
+
+echo "test saving the output of a cropped zero-padded volume on the input grid ... "
+"$MCX" --bench cube60 --json '{"Shapes":[{"Grid":{"Tag":0,"Size":[60,60,60]}},{"Box":{"Tag":1,"O":[15,15,0],"Size":[30,30,30]}}]}' -d 0 -F mc2 -s testcompact $PARAM > /dev/null
+temp=`wc -c < testcompact.mc2 2> /dev/null`
+rm -f testcompact.mc2
+if [ "$temp" != "864000" ]; then echo "fail to save the output of a cropped volume"; fail=$((fail+1)); else echo "ok"; fi
+
+echo "test converting a label volume to the split-voxel format with --svmc ... "
+label=`"$MCX" --bench cube60 --shapes '{"Shapes":[{"Sphere":{"Tag":2,"O":[30,30,30],"R":10}}]}' -d 0 -S 0 $PARAM | sed 's/\x1b\[[0-9;]*m//g' | grep -o -E 'absorbed: *[0-9]+\.[0-9]+%' | grep -o -E '[0-9]+\.[0-9]+'`
+svmc=`"$MCX" --bench cube60 --shapes '{"Shapes":[{"Sphere":{"Tag":2,"O":[30,30,30],"R":10}}]}' --svmc 1 -d 0 -S 0 $PARAM | sed 's/\x1b\[[0-9;]*m//g' | grep -o -E 'absorbed: *[0-9]+\.[0-9]+%' | grep -o -E '[0-9]+\.[0-9]+'`
+temp=`echo "$label $svmc" | awk 'NF==2 && $1>0 && (($1-$2)^2)^0.5 < 1.0 {print "ok"}'`
+if [ -z "$temp" ]; then echo "the split-voxel sphere absorbs $svmc% instead of $label% of the labeled sphere"; fail=$((fail+1)); else echo "ok"; fi
+
+echo "test downsampling a label volume to the mixed-label format with --mixfactor ... "
+"$MCX" --bench cube60 --shapes '{"Shapes":[{"Sphere":{"Tag":2,"O":[30,30,30],"R":10}}]}' --mixfactor 2 -d 0 -F mc2 -s testmixlabel $PARAM > /dev/null
+temp=`wc -c < testmixlabel.mc2 2> /dev/null`
+rm -f testmixlabel.mc2
+if [ "$temp" != "108000" ]; then echo "fail to run a simulation on a downsampled mixed-label volume"; fail=$((fail+1)); else echo "ok"; fi
+
+echo "test computing the DCS g1 of the detectors with --dcsmodel ... "
+"$MCX" --bench cube60b --dcsmodel brownian -d 0 -S 0 -s testdcs $PARAM > /dev/null
+temp=`grep -c '"G1"' testdcs_g1.json 2> /dev/null`
+rm -f testdcs_g1.json testdcs.mch
+if [ "$temp" != "1" ]; then echo "fail to save the DCS g1 of the detectors"; fail=$((fail+1)); else echo "ok"; fi
+
+echo "test saving the forward frequency-domain fluence of two modulation frequencies ... "
+"$MCX" --bench cube60 -O r --rffreq 0,1e8 -d 0 -F mc2 -s testrf $PARAM > /dev/null
+temp=`wc -c < testrf.mc2 2> /dev/null`
+rm -f testrf.mc2
+if [ "$temp" != "3456000" ]; then echo "fail to save the forward frequency-domain fluence"; fail=$((fail+1)); else echo "ok"; fi
+
+echo "test the forward frequency-domain fluence against the Fourier transform of the time-resolved fluence ... "
+cat > testfd.json << EOF
+{
+    "Session": {"ID": "testfd", "Photons": 1e6, "RNGSeed": 1648335518},
+    "Domain": {"Dim": [20,20,20], "OriginType": 1,
+        "Media": [{"mua": 0, "mus": 0, "g": 1, "n": 1}, {"mua": 0.01, "mus": 10, "g": 0.9, "n": 1.37}]},
+    "Shapes": [{"Grid": {"Tag": 1, "Size": [20,20,20]}}],
+    "Forward": {"T0": 0, "T1": 5e-9, "Dt": 5e-11},
+    "Optode": {"Source": {"Type": "pencil", "Pos": [9.5, 9.5, 0], "Dir": [0, 0, 1]}}
+}
+EOF
+"$MCX" -f testfd.json -O F -d 0 -F mc2 -s testfdtd $PARAM > /dev/null
+"$MCX" -f testfd.json -O R --rffreq 0,2e8 -d 0 -F mc2 -s testfdrf $PARAM > /dev/null
+od -An -v -t f4 testfdtd.mc2 > testfdtd.txt 2> /dev/null
+od -An -v -t f4 testfdrf.mc2 > testfdrf.txt 2> /dev/null
+# the 100 gates of 50 ps are transformed at their centers; the 0 Hz frame must be the time-integrated fluence
+temp=`awk -v nvox=8000 -v ngate=100 -v dt=5e-11 -v freq=2e8 'NR==FNR{for(i=1;i<=NF;i++){g=int(n/nvox);v=n%nvox;n++;w=6.283185307179586*freq*(g+0.5)*dt;
+    re0[v]+=$i;re1[v]+=$i*cos(w);im1[v]+=$i*sin(w)};next}
+    {for(i=1;i<=NF;i++){f=int(m/nvox);v=m%nvox;m++;ref=(f==0)?re0[v]:((f==1)?re1[v]:((f==3)?im1[v]:0));d=$i-ref;err[f]+=d*d;tot[f]+=ref*ref}}
+    END{if(n==nvox*ngate && m==4*nvox && tot[0]>0 && tot[1]>0 && tot[3]>0 && sqrt(err[0]/tot[0])<1e-3 && sqrt(err[1]/tot[1])<2e-2 &&
+        sqrt(err[3]/tot[3])<2e-2 && sqrt(err[2]/tot[0])<1e-6)print "ok"}' testfdtd.txt testfdrf.txt`
+rm -f testfd.json testfdtd.mc2 testfdrf.mc2 testfdtd.txt testfdrf.txt
+if [ -z "$temp" ]; then echo "fail to reproduce the Fourier transform of the time-resolved fluence"; fail=$((fail+1)); else echo "ok"; fi
+
+echo "test the low-rank pattern basis --patterntol against the direct multi-pattern simulation ... "
+PATJSON='{"Optode":{"Source":{"Type":"pattern","Param1":[40,0,0,2],"Param2":[0,40,0,2],"SrcNum":3,"Pattern":{"Nx":2,"Ny":2,"Data":[1,0,1,0,1,1,0,1,1,1,0,1]}}}}'
+"$MCX" --bench cube60planar --json "$PATJSON" -U 0 -d 0 -F mc2 -s testpattern $PARAM > /dev/null
+patternerr=`"$MCX" --bench cube60planar --json "$PATJSON" --patterntol 1e-3 -U 0 -d 0 -F mc2 -s testpatternlr $PARAM | grep -o -E 'simulating 2 basis patterns for 3 patterns, relative error [-+.e0-9]+' | grep -o -E '[-+.e0-9]+$'`
+od -An -v -t f4 testpattern.mc2 > testpattern.txt 2> /dev/null
+od -An -v -t f4 testpatternlr.mc2 > testpatternlr.txt 2> /dev/null
+temp=`awk -v tol="$patternerr" 'NR==FNR{for(i=1;i<=NF;i++)ref[++n]=$i;next}{for(i=1;i<=NF;i++){m++;d=$i-ref[m];err+=d*d;tot+=ref[m]*ref[m]}}END{if(tol!="" && n>0 && m==n && tot>0 && sqrt(err/tot)<=tol+1e-4)print "ok"}' testpattern.txt testpatternlr.txt`
+rm -f testpattern.mc2 testpatternlr.mc2 testpattern.txt testpatternlr.txt
+if [ -z "$temp" ]; then echo "fail to reproduce the multi-pattern output with the low-rank basis"; fail=$((fail+1)); else echo "ok"; fi
+
 temp=`which valgrind 2> /dev/null`
 if [ ! -z "$temp" ]; then
     echo "test memory access errors using valgrind ... "
@@ -73,7 +73,7 @@ while (~feof(fid))
     srcnum = fread(fid, 1, 'uint');
     savedetflag = fread(fid, 1, 'uint');
     totalsource = fread(fid, 1, 'uint');
-    junk = fread(fid, 1, 'uint');
+    ishalf = fread(fid, 1, 'uint');
 
     detflag = dec2bin(bitand(savedetflag, (2^8 - 1))) - '0';
     if (strcmp(endian, 'ieee-le'))
@@ -83,8 +83,14 @@ while (~feof(fid))
     datalen = [1 hd(2) hd(2) hd(2) 3 3 1 4];
     datlen = detflag .* datalen(1:length(detflag));
 
-    dat = fread(fid, hd(7) * hd(4), format);
-    dat = reshape(dat, [hd(4), hd(7)])';
+    if (ishalf == 1)
+        dat = fread(fid, hd(7) * hd(4), 'uint32=>uint32');
+        dat = halfexpand(reshape(dat, [hd(4), hd(7)])', detflag, hd(2));
+        hd(4) = size(dat, 2);
+    else
+        dat = fread(fid, hd(7) * hd(4), format);
+        dat = reshape(dat, [hd(4), hd(7)])';
+    end
     if (savedetflag && length(detflag) > 2 && detflag(3) > 0)
         dat(:, sum(datlen(1:2)) + 1:sum(datlen(1:3))) = dat(:, sum(datlen(1:2)) + 1:sum(datlen(1:3))) * unitmm;
     elseif (savedetflag == 0)
@@ -124,3 +130,35 @@ if (nargout >= 2)
                           'lengthunit', header(8), 'seedbyte', seedbyte, 'normalizer', normalizer, ...
                           'respin', respin, 'srcnum', srcnum, 'savedetflag', savedetflag, 'totalsource', totalsource);
 end
+
+%--------------------------------------------------------------------------
+function dat = halfexpand(raw, detflag, medianum)
+% convert the half-precision ppath/mom pairs (saved with --halfdet 1) to double
+
+detflag(end + 1:4) = 0;
+halflen = ceil(medianum / 2);
+pos = detflag(1) + detflag(2) * medianum;
+val = double(reshape(typecast(raw(:), 'single'), size(raw)));
+dat = val(:, 1:pos);
+for i = 3:4
+    if (detflag(i))
+        pairs = double(raw(:, pos + 1:pos + halflen));
+        h = zeros(size(pairs, 1), 2 * halflen);
+        h(:, 1:2:end) = mod(pairs, 65536);
+        h(:, 2:2:end) = floor(pairs / 65536);
+        dat = [dat half2double(h(:, 1:medianum))];
+        pos = pos + halflen;
+    end
+end
+dat = [dat val(:, pos + 1:end)];
+
+%--------------------------------------------------------------------------
+function val = half2double(h)
+% decode the bits of IEEE 754 half-precision numbers
+
+sgn = 1 - 2 * (h >= 32768);
+ex = mod(floor(h / 1024), 32);
+mant = mod(h, 1024);
+val = sgn .* ((ex > 0) .* (1 + mant / 1024) .* 2.^(ex - 15) + (ex == 0) .* (mant / 1024) * 2^-14);
+val(ex == 31) = sgn(ex == 31) * Inf;
+val(ex == 31 & mant > 0) = NaN;